@@ -69,6 +69,9 @@ enum kernel_appout_type {
   KERNEL_APPOUT_LISTEN_CLOSE,
   KERNEL_APPOUT_ACCEPT_CONN,
   KERNEL_APPOUT_REQ_SCALE,
+  KERNEL_APPOUT_MR_REG,
+  KERNEL_APPOUT_MR_DEREG,
+  KERNEL_APPOUT_CONN_MR,
 };
 
 /** Open a new connection */
@@ -77,6 +80,8 @@ struct kernel_appout_conn_open {
   uint32_t remote_ip;
   uint32_t flags;
   uint16_t remote_port;
+  uint32_t mr_key;
+  uint64_t mr_len;
 } __attribute__((packed));
 
 #define KERNEL_APPOUT_CLOSE_RESET 0x1
@@ -120,6 +125,8 @@ struct kernel_appout_accept_conn {
   uint64_t listen_opaque;
   uint64_t conn_opaque;
   uint16_t local_port;
+  uint32_t mr_key;
+  uint64_t mr_len;
 } __attribute__((packed));
 
 /** Request scale to specified number of cores */
@@ -127,6 +134,29 @@ struct kernel_appout_req_scale {
   uint32_t num_cores;
 } __attribute__((packed));
 
+/** Register memory region for sharing between connections */
+struct kernel_appout_mr_reg {
+  uint64_t opaque;
+  uint64_t len;
+} __attribute__((packed));
+
+/** Deregister shared memory region */
+struct kernel_appout_mr_dereg {
+  uint64_t opaque;
+  uint32_t key;
+} __attribute__((packed));
+
+/** Replace memory region of connection */
+struct kernel_appout_conn_mr {
+  uint64_t opaque;
+  uint32_t remote_ip;
+  uint32_t local_ip;
+  uint16_t remote_port;
+  uint16_t local_port;
+  uint32_t mr_key;
+  uint64_t mr_len;
+} __attribute__((packed));
+
 /** Common struct for events on kernel -> app queue */
 struct kernel_appout {
   union {
@@ -140,6 +170,10 @@ struct kernel_appout {
 
     struct kernel_appout_req_scale    req_scale;
 
+    struct kernel_appout_mr_reg       mr_reg;
+    struct kernel_appout_mr_dereg     mr_dereg;
+    struct kernel_appout_conn_mr      conn_mr;
+
     uint8_t raw[63];
   } __attribute__((packed)) data;
   uint8_t type;
@@ -161,6 +195,9 @@ enum kernel_appin_type {
   KERNEL_APPIN_CONN_OPENED,
   KERNEL_APPIN_LISTEN_NEWCONN,
   KERNEL_APPIN_ACCEPTED_CONN,
+  KERNEL_APPIN_STATUS_MR_REG,
+  KERNEL_APPIN_STATUS_MR_DEREG,
+  KERNEL_APPIN_STATUS_CONN_MR,
 };
 
 /** Generic operation status */
@@ -178,7 +215,7 @@ struct kernel_appin_conn_opened {
   uint64_t wq_off;
   uint32_t rx_len;
   uint32_t tx_len;
-  uint32_t mr_len;
+  uint64_t mr_len;
   uint32_t wq_len;
   int32_t  status;
   uint32_t seq_rx;
@@ -187,6 +224,7 @@ struct kernel_appin_conn_opened {
   uint32_t local_ip;
   uint16_t local_port;
   uint16_t fn_core;
+  uint16_t rdma_credits;
 } __attribute__((packed));
 
 /** New connection on listener received */
@@ -205,7 +243,7 @@ struct kernel_appin_accept_conn {
   uint64_t wq_off;
   uint32_t rx_len;
   uint32_t tx_len;
-  uint32_t mr_len;
+  uint64_t mr_len;
   uint32_t wq_len;
   int32_t  status;
   uint32_t seq_rx;
@@ -215,6 +253,17 @@ struct kernel_appin_accept_conn {
   uint32_t remote_ip;
   uint16_t remote_port;
   uint16_t fn_core;
+  uint16_t rdma_credits;
+} __attribute__((packed));
+
+/** Shared memory region registered, or memory region of connection replaced
+ * (#KERNEL_APPIN_STATUS_CONN_MR) */
+struct kernel_appin_mr_reg {
+  uint64_t opaque;
+  uint64_t mr_off;
+  uint64_t mr_len;
+  uint32_t key;
+  int32_t  status;
 } __attribute__((packed));
 
 /** Common struct for events on app -> kernel queue */
@@ -224,6 +273,7 @@ struct kernel_appin {
     struct kernel_appin_conn_opened     conn_opened;
     struct kernel_appin_listen_newconn  listen_newconn;
     struct kernel_appin_accept_conn     accept_connection;
+    struct kernel_appin_mr_reg          mr_reg;
     uint8_t raw[127];
   } __attribute__((packed)) data;
   uint8_t type;
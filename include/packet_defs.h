@@ -170,6 +170,7 @@ struct tcp_hdr {
 #define TCP_OPT_NO_OP 1
 #define TCP_OPT_MSS 2
 #define TCP_OPT_TIMESTAMP 8
+#define TCP_OPT_EXP 253
 struct tcp_mss_opt {
   uint8_t kind;
   uint8_t length;
@@ -184,6 +185,19 @@ struct tcp_timestamp_opt {
   beui32_t ts_ecr;
 } __attribute__((packed));
 
+/** Experiment id of the RDMA option (RFC 6994) */
+#define TCP_OPT_RDMA_EXID 0x5244
+/** RDMA header version offered in SYN and chosen in SYN-ACK, along with
+ * the number of requests the sender accepts outstanding (0: unlimited) */
+struct tcp_rdma_opt {
+  uint8_t kind;
+  uint8_t length;
+  beui16_t exid;
+  uint8_t version;
+  uint8_t _pad;
+  beui16_t credits;
+} __attribute__((packed));
+
 
 /******************************************************************************/
 /* Object framing */
@@ -203,8 +217,23 @@ struct obj_hdr {
 
 #define RDMA_READ 0x01
 #define RDMA_WRITE 0x02
+#define RDMA_FETCH_ADD 0x04
+#define RDMA_CMP_SWAP 0x08
+#define RDMA_ATOMIC (RDMA_FETCH_ADD | RDMA_CMP_SWAP)
 #define RDMA_REQUEST 0x10
 #define RDMA_RESPONSE 0x20
+#define RDMA_SEND 0x40
+#define RDMA_IMM 0x80
+
+/** Header flags: payload is stored in the sender's transmit buffer (only
+ * meaningful to the sender, ignored on receive) */
+#define RDMA_FLAG_INLINE 0x0001
+/** Header flags: payload is gathered from the scatter/gather list of the
+ * sender's WQE, loffset is unused (only meaningful to the sender) */
+#define RDMA_FLAG_SGL 0x0002
+/** Header flags: request credits returned to the receiver, upper 12 bits */
+#define RDMA_FLAG_CREDITS_SHIFT 4
+#define RDMA_FLAG_CREDITS(n) ((uint16_t) ((n) << RDMA_FLAG_CREDITS_SHIFT))
 struct rdma_hdr {
   uint8_t type;
   uint8_t status;
@@ -216,6 +245,43 @@ struct rdma_hdr {
 } __attribute__((packed));
 STATIC_ASSERT(sizeof(struct rdma_hdr) == 20, rdma_hdr);
 
+/**
+ * Header versions, negotiated per connection with the RDMA TCP option.
+ * Version 1 (struct rdma_hdr) is used if the peer does not send the option.
+ */
+#define RDMA_HDR_V1 1
+#define RDMA_HDR_V2 2
+
+/** Version 2 header: 64-bit memory region offsets and immediate values */
+struct rdma_hdr_v2 {
+  uint8_t type;
+  uint8_t status;
+  beui16_t flags;
+  beui32_t id;
+  beui32_t length;
+  /** Immediate value of writes with RDMA_IMM, 0 otherwise */
+  beui32_t imm;
+  beui64_t offset;
+  beui64_t loffset;
+} __attribute__((packed));
+STATIC_ASSERT(sizeof(struct rdma_hdr_v2) == 32, rdma_hdr_v2);
+
+#define RDMA_HDR_MAXLEN sizeof(struct rdma_hdr_v2)
+
+/** Operands following an atomic request header */
+struct rdma_atomic_req {
+  /** Value to add, or value to compare with for compare and swap */
+  beui64_t compare_add;
+  /** Value to store if compare and swap matches */
+  beui64_t swap;
+} __attribute__((packed));
+
+/** Payload of an atomic response */
+struct rdma_atomic_resp {
+  /** Value of the remote word before the operation */
+  beui64_t old;
+} __attribute__((packed));
+
 /******************************************************************************/
 /* TCP packets */
 
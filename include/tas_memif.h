@@ -137,6 +137,7 @@ struct flextcp_pl_arx_rdmaconnupdate {
   uint64_t opaque;
   uint32_t wq_tail;
   uint32_t cq_head;
+  uint32_t rcv_tail;
 } __attribute__((packed));
 
 /** Application RX queue entry */
@@ -186,6 +187,37 @@ struct flextcp_pl_atx {
 
 STATIC_ASSERT(sizeof(struct flextcp_pl_atx) == 16, atx_size);
 
+/******************************************************************************/
+/* RDMA work queue doorbell */
+
+/**
+ * Doorbell in the cache line following a connection's work queue. The
+ * application publishes queue pointers here. With doorbell polling enabled
+ * (--fp-rdma-db-poll) the fast path polls them for active flows, and an ATX
+ * RDMA update is only needed to wake up an idle flow.
+ * The receive queue, of the same size as the work queue, follows the doorbell,
+ * followed by the inline payload slots of the work queue entries. All queue
+ * positions are free-running byte counters (see utils_ring.h).
+ */
+struct flextcp_pl_rdma_db {
+  /** Position to which next WQE will be added (written by application) */
+  volatile uint32_t wq_head;
+  /** Position of the oldest unread CQE (written by application) */
+  volatile uint32_t cq_tail;
+  /** Fast path polls the doorbell while set, only with doorbell polling
+   * enabled (written by fast path) */
+  volatile uint32_t fp_active;
+  /** Application waits for completions, kick its context on the next one
+   * (set by application, cleared by fast path) */
+  volatile uint32_t cq_armed;
+  /** Position to which next receive buffer will be posted (written by
+   * application) */
+  volatile uint32_t rcv_head;
+  uint8_t pad[44];
+} __attribute__((packed, aligned(64)));
+
+STATIC_ASSERT(sizeof(struct flextcp_pl_rdma_db) == 64, rdma_db_size);
+
 /******************************************************************************/
 /* Internal flexnic memory */
 
@@ -227,6 +259,8 @@ struct flextcp_pl_appctx {
   uint32_t tx_head;
   uint32_t last_ts;
   uint32_t rx_avail;
+  /** Kick the application on the next rx queue flush */
+  uint32_t kick_pending;
 } __attribute__((packed));
 
 /** Enable out of order receive processing members */
@@ -341,30 +375,63 @@ struct flextcp_pl_flowst {
   uint64_t rq_base;
   /** Base address of Memory Region */
   uint64_t mr_base;
-  /** Work/Completion queue size in bytes */
-  uint32_t wq_len;
   /** Memory region size in bytes */
-  uint32_t mr_len;
-  /** Offset to which new WQE will be added */
+  uint64_t mr_len;
+  /** Work/Completion queue size in bytes (power of two), queue positions
+   * below are free-running (see utils_ring.h) */
+  uint32_t wq_len;
+  /** Position to which new WQE will be added */
   uint32_t wq_head;
-  /** Offset of the next WQE to be processed */
+  /** Position of the next WQE to be processed */
   uint32_t wq_tail;
-  /** Offset of the oldest ack'd WQE unprocessed by application */
+  /** Position of the oldest WQE not completed yet */
   uint32_t cq_head;
-  /** Offset of the latest ack'd WQE unprocessed by application */
+  /** Position of the oldest completed WQE unread by application */
   uint32_t cq_tail;
-  /** Offset of the latest unack'd request */
+  /** Position of the latest unack'd request */
   uint32_t rq_head;
-  /** Offset of the oldest unack'd request */
+  /** Position of the oldest unack'd request */
   uint32_t rq_tail;
-// 192
-  /** Buffer for partially received request */
-  uint8_t pending_rq_buf[20];
+// 196
+  /** Buffer for partially received request (header and atomic operands) */
+  uint8_t pending_rq_buf[RDMA_HDR_MAXLEN + sizeof(struct rdma_atomic_req)];
   /** RQ parsing state */
   uint32_t pending_rq_state;
   /** Offset to next segment in partially transmitted RQ entry */
   uint32_t rqe_tx_seq;
-// 216
+  /** RDMA header version negotiated for this flow (see RDMA_HDR_V1) */
+  uint8_t rdma_hdr_ver;
+// 253
+  /** Sequence number of oldest tx frame not fully acknowledged */
+  uint32_t txf_ack_seq;
+  /** Length (header + payload) of that frame, 0 if not parsed yet */
+  uint32_t txf_ack_len;
+  /** Memory region offset of that frame's payload */
+  uint64_t txf_ack_off;
+  /** Sequence number of tx frame last used for building a segment */
+  uint32_t txf_seq;
+  /** Length (header + payload) of that frame, 0 if not parsed yet */
+  uint32_t txf_len;
+  /** Memory region offset of that frame's payload */
+  uint64_t txf_off;
+// 285
+  /** Position of the next posted receive buffer to be filled */
+  uint32_t rcv_tail;
+  /** Set after an unexpected response, outstanding WQEs failed */
+  uint8_t rdma_failed;
+  /** Requests the peer still accepts, returned with its responses */
+  uint16_t rdma_credits;
+  /** Credits granted at connect time, 0 if flow control is disabled */
+  uint16_t rdma_credits_max;
+  /** Flow id + 1 of the peer if both ends are flows of this instance, WQEs
+   * are then executed directly on the peer's memory region */
+  uint32_t rdma_peer;
+  /** WQE offset + 1 of a loopback copy running on a copy thread, later WQEs
+   * wait until it completes */
+  uint32_t rdma_copy_pending;
+  /** Set while the flow is on the doorbell poll list of a core */
+  uint8_t rdma_db_listed;
+// 303
 } __attribute__((packed, aligned(64)));
 
 #define FLEXNIC_PL_FLOWHTE_VALID  (1 << 31)
@@ -401,5 +468,6 @@ struct flextcp_pl_mem {
 
 
 void util_flexnic_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us);
+void util_flexnic_notify(struct flextcp_pl_appctx *ctx, uint32_t ts_us);
 
 #endif /* ndef FLEXTCP_PLIF_H_ */
@@ -31,6 +31,7 @@
 #define MIN(a,b) ((b) < (a) ? (b) : (a))
 #define MAX(a,b) ((b) > (a) ? (b) : (a))
 #define MEM_BARRIER() __asm__ volatile("" ::: "memory")
+#define MEM_FENCE() __sync_synchronize()
 #define STATIC_ASSERT(COND,MSG) typedef char static_assertion_##MSG[(COND)?1:-1]
 #define LIKELY(x) __builtin_expect((x),1)
 #define UNLIKELY(x) __builtin_expect((x),0)
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UTILS_RING_H_
+#define UTILS_RING_H_
+
+#include <stdint.h>
+
+/*
+ * Rings with free-running positions: producer (head) and consumer (tail)
+ * count bytes and are only wrapped by 32-bit overflow. The ring length must
+ * be a power of two, so positions map to offsets with a mask and stay
+ * consistent across the overflow. head == tail is an empty ring,
+ * head - tail == len a full one.
+ */
+
+/* Power of two ring length */
+static inline int ring_len_valid(uint64_t len)
+{
+  return len != 0 && len <= (1ULL << 31) && (len & (len - 1)) == 0;
+}
+
+/* Bytes between tail and head */
+static inline uint32_t ring_used(uint32_t head, uint32_t tail)
+{
+  return head - tail;
+}
+
+/* Offset of position pos in a ring of length len */
+static inline uint32_t ring_off(uint32_t len, uint32_t pos)
+{
+  return pos & (len - 1);
+}
+
+/* Position pos is in [tail, head] */
+static inline int ring_in(uint32_t tail, uint32_t head, uint32_t pos)
+{
+  return pos - tail <= head - tail;
+}
+
+#endif /* ndef UTILS_RING_H_ */
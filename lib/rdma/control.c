@@ -1,14 +1,25 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "tas_ll.h"
 #include "tas_rdma.h"
+#include "utils.h"
 
 #include "internal.h"
 
 struct rdma_socket* rdma_tas_fdmap[MAX_FD_NUM];
-struct flextcp_context* rdma_tas_appctx = NULL;
+static struct rdma_tas_mr* rdma_tas_mrs = NULL;
+
+/* Protects fd allocation, the memory region list and context creation. Data
+ * operations never take it. */
+static pthread_mutex_t rdma_tas_lock = PTHREAD_MUTEX_INITIALIZER;
+static int rdma_tas_fdfree[MAX_FD_NUM];     // Stack of unused fds
+static int rdma_tas_fdfree_num = 0;
+static __thread struct flextcp_context* rdma_tas_tctx = NULL;
+static pthread_key_t rdma_tas_tkey;         // Releases contexts on exit
+static pthread_once_t rdma_tas_tkey_once = PTHREAD_ONCE_INIT;
 
 /**
  * NOTE: As the TAS internal structures will change,
@@ -23,20 +34,168 @@ struct flextcp_context* rdma_tas_appctx = NULL;
 
 static int fd_tas_alloc(void)
 {
-    int i;
-    // Skip 0 to avoid possible confusion
-    for (i = 1; i < MAX_FD_NUM; i++)
-        if (rdma_tas_fdmap[i] == NULL)
-            break;
+    int fd = -1;
+    pthread_mutex_lock(&rdma_tas_lock);
+    if (rdma_tas_fdfree_num > 0)
+        fd = rdma_tas_fdfree[--rdma_tas_fdfree_num];
+    pthread_mutex_unlock(&rdma_tas_lock);
+    return fd;
+}
+
+static void fd_tas_free(int fd)
+{
+    pthread_mutex_lock(&rdma_tas_lock);
+    rdma_tas_fdfree[rdma_tas_fdfree_num++] = fd;
+    pthread_mutex_unlock(&rdma_tas_lock);
+}
+
+int rdma_tas_sock_add(struct rdma_socket* s)
+{
+    int fd = fd_tas_alloc();
+    if (fd == -1)
+        return -1;
+
+    s->fd = fd;
+    rdma_tas_fdmap[fd] = s;
+    return fd;
+}
+
+void rdma_tas_sock_del(int fd)
+{
+    rdma_tas_fdmap[fd] = NULL;
+    fd_tas_free(fd);
+}
+
+/* Free a thread context, unless sockets or asynchronous requests still
+ * use it */
+static int rdma_tas_ctx_release(struct rdma_tas_ctx* rctx)
+{
+    struct rdma_socket* s;
+    int fd;
 
-    if (i == MAX_FD_NUM)
+    if (rctx->ctrl_pending != 0 || rctx->done_head != NULL)
         return -1;
+    for (fd = 1; fd < MAX_FD_NUM; fd++)
+    {
+        s = rdma_tas_fdmap[fd];
+        if (s != NULL && s->ctx == &rctx->ctx)
+            return -1;
+    }
+
+    flextcp_context_destroy(&rctx->ctx);
+    free(rctx);
+    return 0;
+}
+
+/* Thread exit without rdma_tas_thread_fini(), contexts still in use stay
+ * allocated for their sockets */
+static void rdma_tas_thread_exit(void* rctx)
+{
+    rdma_tas_ctx_release(rctx);
+}
+
+static void rdma_tas_tkey_create(void)
+{
+    pthread_key_create(&rdma_tas_tkey, rdma_tas_thread_exit);
+}
+
+struct flextcp_context* rdma_tas_thread_ctx(void)
+{
+    if (rdma_tas_tctx != NULL)
+        return rdma_tas_tctx;
+
+    struct rdma_tas_ctx* rctx = calloc(1, sizeof(struct rdma_tas_ctx));
+    if (rctx == NULL)
+        return NULL;
+
+    // Context creation shares the slow path socket with other threads
+    pthread_mutex_lock(&rdma_tas_lock);
+    int ret = flextcp_context_create(&rctx->ctx);
+    pthread_mutex_unlock(&rdma_tas_lock);
+    if (ret != 0)
+    {
+        free(rctx);
+        return NULL;
+    }
+
+    pthread_once(&rdma_tas_tkey_once, rdma_tas_tkey_create);
+    pthread_setspecific(rdma_tas_tkey, rctx);
+    rdma_tas_tctx = &rctx->ctx;
+    return rdma_tas_tctx;
+}
+
+/* Asynchronous requests in flight are bounded so that the slow path always
+ * has room in the context queues for their completions. */
+static inline uint32_t rdma_ctrl_max(struct flextcp_context* ctx)
+{
+    return MIN(ctx->kin_len, ctx->kout_len) / 2;
+}
 
-    return i;
+/* Record the completion of an asynchronous connect/accept for
+ * rdma_tas_ctrl_poll(). Returns 1 if ev was such a completion. */
+static int rdma_ctrl_dispatch(struct flextcp_context* ctx,
+        struct flextcp_event* ev)
+{
+    struct rdma_tas_ctx* rctx = (struct rdma_tas_ctx*) ctx;
+    struct flextcp_connection* c;
+    struct rdma_socket* s;
+    int status;
+
+    if (ev->event_type == FLEXTCP_EV_CONN_OPEN)
+    {
+        c = ev->ev.conn_open.conn;
+        status = ev->ev.conn_open.status;
+    }
+    else if (ev->event_type == FLEXTCP_EV_LISTEN_ACCEPT)
+    {
+        c = ev->ev.listen_accept.conn;
+        status = ev->ev.listen_accept.status;
+    }
+    else
+        return 0;
+
+    s = (struct rdma_socket*) c;   // c is the first member
+    if (s->type != RDMA_PENDING_SOCKET)
+        return 0;
+
+    s->ctrl_status = status;
+    s->ctrl_next = NULL;
+    if (rctx->done_tail == NULL)
+        rctx->done_head = s;
+    else
+        rctx->done_tail->ctrl_next = s;
+    rctx->done_tail = s;
+    rctx->ctrl_pending--;
+    return 1;
+}
+
+/* Block until the slow path answers a synchronous request. Completions of
+ * asynchronous requests arriving in the meantime are kept for
+ * rdma_tas_ctrl_poll(). */
+static int rdma_ctrl_wait(struct flextcp_context* ctx,
+        struct flextcp_event* ev)
+{
+    int ret;
+    memset(ev, 0, sizeof(struct flextcp_event));
+    while (1)
+    {
+        // TODO: Only poll the kernel
+        ret = flextcp_context_poll(ctx, 1, ev);
+        if (ret < 0)
+            return -1;
+
+        if (ret == 1 && rdma_ctrl_dispatch(ctx, ev) == 0)
+            return 0;
+
+        if (ret == 0)
+            flextcp_block(ctx, CONTROL_TIMEOUT);
+    }
 }
 
 int rdma_tas_init(void)
 {
+    int i;
+
     // 1. Connect with TAS
     if (flextcp_init() != 0)
     {
@@ -44,22 +203,48 @@ int rdma_tas_init(void)
         return -1;
     }
 
-    // 2. Register app context with TAS
-    rdma_tas_appctx = calloc(1, sizeof(struct flextcp_context));
-    if (rdma_tas_appctx == NULL)
+    // 2. Initialize internal datastructures
+    memset(rdma_tas_fdmap, 0, sizeof(rdma_tas_fdmap));
+    // Skip 0 to avoid possible confusion, hand out small fds first
+    rdma_tas_fdfree_num = 0;
+    for (i = MAX_FD_NUM - 1; i > 0; i--)
+        rdma_tas_fdfree[rdma_tas_fdfree_num++] = i;
+
+    // 3. Register app context of the calling thread with TAS
+    if (rdma_tas_thread_ctx() == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    if (flextcp_context_create(rdma_tas_appctx) != 0)
+
+    return 0;
+}
+
+int rdma_tas_thread_init(void)
+{
+    if (rdma_tas_thread_ctx() == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 3. Initialize internal datastructures
-    memset(rdma_tas_fdmap, 0, sizeof(rdma_tas_fdmap));
+    return 0;
+}
+
+int rdma_tas_thread_fini(void)
+{
+    struct rdma_tas_ctx* rctx = (struct rdma_tas_ctx*) rdma_tas_tctx;
 
+    if (rctx == NULL)
+        return 0;
+    if (rdma_tas_ctx_release(rctx) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    pthread_setspecific(rdma_tas_tkey, NULL);
+    rdma_tas_tctx = NULL;
     return 0;
 }
 
@@ -73,6 +258,13 @@ int rdma_tas_listen(const struct sockaddr_in* localaddr, int backlog)
         return -1;
     }
 
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
     // 2. Allocate FD and Socket
     int fd = fd_tas_alloc();
     if (fd == -1)
@@ -83,6 +275,7 @@ int rdma_tas_listen(const struct sockaddr_in* localaddr, int backlog)
     struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
     if (s == NULL)
     {
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
@@ -94,33 +287,23 @@ int rdma_tas_listen(const struct sockaddr_in* localaddr, int backlog)
         backlog = LISTEN_BACKLOG_MAX;
 
     // 4. listen() IPC to TAS Slowpath
-    if (flextcp_listen_open(rdma_tas_appctx, &s->l,
+    if (flextcp_listen_open(ctx, &s->l,
             ntohs(localaddr->sin_port), backlog, 0) != 0)
     {
         free(s);
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 5. Block until TAS Slowpath processes the request
     struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
+    if (rdma_ctrl_wait(ctx, &ev) != 0)
     {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(rdma_tas_appctx, 1, &ev);
-        if (ret < 0)
-        {
-            free(s);
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
-        }
-
-        if (ret == 1)
-            break;
-
-        flextcp_block(rdma_tas_appctx, CONTROL_TIMEOUT);
+        free(s);
+        fd_tas_free(fd);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
     }
 
     // 6. Check listen() status
@@ -129,27 +312,56 @@ int rdma_tas_listen(const struct sockaddr_in* localaddr, int backlog)
         ev.ev.listen_open.status != 0)
     {
         free(s);
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 7. Store rdma_socket in rdma_tas_fdmap
     s->type = RDMA_LISTEN_SOCKET;
+    s->fd = fd;
+    s->ctx = ctx;
     rdma_tas_fdmap[fd] = s;
 
     return fd;
 }
 
+static struct rdma_socket* rdma_listener_lookup(int listenfd)
+{
+    if (listenfd < 1 || listenfd >= MAX_FD_NUM)
+        return NULL;
+
+    struct rdma_socket* ls = rdma_tas_fdmap[listenfd];
+    if (ls == NULL || ls->type != RDMA_LISTEN_SOCKET)
+        return NULL;
+
+    return ls;
+}
+
 int rdma_tas_accept(int listenfd, struct sockaddr_in* remoteaddr,
-		void **mr_base, uint32_t *mr_len)
+		void **mr_base, uint64_t *mr_len)
+{
+    return rdma_tas_accept_mr(listenfd, remoteaddr, 0, 0, mr_base, mr_len);
+}
+
+int rdma_tas_accept_mr(int listenfd, struct sockaddr_in* remoteaddr,
+        uint32_t rkey, uint64_t len, void **mr_base, uint64_t *mr_len)
 {
     // 1. Find listener rdma_socket
-    if (listenfd < 1 || listenfd >= MAX_FD_NUM)
+    // The connection is bound to the context of the accepting thread
+    struct rdma_socket* ls = rdma_listener_lookup(listenfd);
+    if (ls == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    if (ctx == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct rdma_socket* ls = rdma_tas_fdmap[listenfd];
 
     // 2. Allocate FD and Socket
     int fd = fd_tas_alloc();
@@ -161,37 +373,29 @@ int rdma_tas_accept(int listenfd, struct sockaddr_in* remoteaddr,
     struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
     if (s == NULL)
     {
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 3. accept() IPC to TAS Slowpath
-    if (flextcp_listen_accept(rdma_tas_appctx, &ls->l, &s->c) != 0)
+    if (flextcp_listen_accept_mr(ctx, &ls->l, &s->c, rkey,
+                len) != 0)
     {
         free(s);
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 4. Block until TAS Slowpath processes the request
     struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
+    if (rdma_ctrl_wait(ctx, &ev) != 0)
     {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(rdma_tas_appctx, 1, &ev);
-        if (ret < 0)
-        {
-            free(s);
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
-        }
-
-        if (ret == 1)
-            break;
-
-        flextcp_block(rdma_tas_appctx, CONTROL_TIMEOUT);
+        free(s);
+        fd_tas_free(fd);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
     }
 
     // 5. Check accept() status
@@ -200,12 +404,15 @@ int rdma_tas_accept(int listenfd, struct sockaddr_in* remoteaddr,
         ev.ev.listen_accept.status != 0)
     {
         free(s);
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 6. Store socket in rdma_tas_fdmap
     s->type = RDMA_CONN_SOCKET;
+    s->fd = fd;
+    s->ctx = ctx;
     rdma_tas_fdmap[fd] = s;
 
     // 7. Update return parameters
@@ -217,7 +424,13 @@ int rdma_tas_accept(int listenfd, struct sockaddr_in* remoteaddr,
 }
 
 int rdma_tas_connect(const struct sockaddr_in* remoteaddr, void **mr_base,
-		uint32_t *mr_len)
+		uint64_t *mr_len)
+{
+    return rdma_tas_connect_mr(remoteaddr, 0, 0, mr_base, mr_len);
+}
+
+int rdma_tas_connect_mr(const struct sockaddr_in* remoteaddr, uint32_t rkey,
+        uint64_t len, void **mr_base, uint64_t *mr_len)
 {
     // 1. Validate Remoteaddr
     if (remoteaddr == NULL || remoteaddr->sin_family != AF_INET)
@@ -226,6 +439,13 @@ int rdma_tas_connect(const struct sockaddr_in* remoteaddr, void **mr_base,
         return -1;
     }
 
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
     // 2. Allocate FD and Socket
     int fd = fd_tas_alloc();
     if (fd == -1)
@@ -236,38 +456,30 @@ int rdma_tas_connect(const struct sockaddr_in* remoteaddr, void **mr_base,
     struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
     if (s == NULL)
     {
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 3. connect() IPC to TAS Slowpath
-    if (flextcp_connection_open(rdma_tas_appctx, &s->c,
-        ntohl(remoteaddr->sin_addr.s_addr), ntohs(remoteaddr->sin_port)) != 0)
+    if (flextcp_connection_open_mr(ctx, &s->c,
+        ntohl(remoteaddr->sin_addr.s_addr), ntohs(remoteaddr->sin_port),
+        rkey, len) != 0)
     {
         free(s);
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 4. Block until TAS Slowpath processes the request
     struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
+    if (rdma_ctrl_wait(ctx, &ev) != 0)
     {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(rdma_tas_appctx, 1, &ev);
-        if (ret < 0)
-        {
-            free(s);
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
-        }
-
-        if (ret == 1)
-            break;
-
-        flextcp_block(rdma_tas_appctx, CONTROL_TIMEOUT);
+        free(s);
+        fd_tas_free(fd);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
     }
 
     // 5. Check accept() status
@@ -276,12 +488,15 @@ int rdma_tas_connect(const struct sockaddr_in* remoteaddr, void **mr_base,
         ev.ev.conn_open.status != 0)
     {
         free(s);
+        fd_tas_free(fd);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
     // 6. Store rdma_socket in rdma_tas_fdmap
     s->type = RDMA_CONN_SOCKET;
+    s->fd = fd;
+    s->ctx = ctx;
     rdma_tas_fdmap[fd] = s;
 
     // 7. Update return parameters
@@ -290,3 +505,373 @@ int rdma_tas_connect(const struct sockaddr_in* remoteaddr, void **mr_base,
 
     return fd;
 }
+
+int rdma_conn_close(int fd)
+{
+    // 1. Find the connection
+    struct rdma_socket* s = (fd < 1 || fd >= MAX_FD_NUM ? NULL :
+            rdma_tas_fdmap[fd]);
+    if (s == NULL || s->type != RDMA_CONN_SOCKET)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. close() IPC to TAS Slowpath, completions are no longer reported
+    rdma_conn_scq_detach(&s->c);
+    if (flextcp_connection_close(s->ctx, &s->c) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 3. Block until TAS Slowpath released the connection, the socket
+    //    stays allocated if it did not as it is still referenced there
+    struct flextcp_event ev;
+    do
+    {
+        if (rdma_ctrl_wait(s->ctx, &ev) != 0)
+        {
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+    } while (ev.event_type != FLEXTCP_EV_CONN_CLOSED ||
+            ev.ev.conn_closed.conn != &s->c);
+    if (ev.ev.conn_closed.status != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 4. Release the fd
+    rdma_tas_sock_del(fd);
+    free(s);
+    return 0;
+}
+
+int rdma_tas_close(int fd)
+{
+    if (stripe_lookup(fd) != NULL)
+        return stripe_close(fd);
+
+    return rdma_conn_close(fd);
+}
+
+/* Allocate an fd for an asynchronous connect/accept on the context of the
+ * calling thread. Returns NULL if too many requests are in flight. */
+static struct rdma_socket* rdma_pending_alloc(void* opaque)
+{
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    if (ctx == NULL ||
+            ((struct rdma_tas_ctx*) ctx)->ctrl_pending >= rdma_ctrl_max(ctx))
+        return NULL;
+
+    int fd = fd_tas_alloc();
+    if (fd == -1)
+        return NULL;
+    struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
+    if (s == NULL)
+    {
+        fd_tas_free(fd);
+        return NULL;
+    }
+
+    s->type = RDMA_PENDING_SOCKET;
+    s->fd = fd;
+    s->ctx = ctx;
+    s->opaque = opaque;
+    return s;
+}
+
+/* Request was sent to the slow path, publish the fd */
+static int rdma_pending_start(struct rdma_socket* s)
+{
+    ((struct rdma_tas_ctx*) s->ctx)->ctrl_pending++;
+    rdma_tas_fdmap[s->fd] = s;
+    return s->fd;
+}
+
+static void rdma_pending_free(struct rdma_socket* s)
+{
+    int fd = s->fd;
+    free(s);
+    fd_tas_free(fd);
+}
+
+int rdma_tas_connect_async(const struct sockaddr_in* remoteaddr,
+        uint32_t rkey, uint64_t len, void* opaque)
+{
+    // 1. Validate Remoteaddr
+    if (remoteaddr == NULL || remoteaddr->sin_family != AF_INET)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. Allocate FD and Socket
+    struct rdma_socket* s = rdma_pending_alloc(opaque);
+    if (s == NULL)
+        return RDMA_TAS_CTRL_BUSY;
+
+    // 3. connect() IPC to TAS Slowpath, completion is reported by
+    //    rdma_tas_ctrl_poll()
+    if (flextcp_connection_open_mr(s->ctx, &s->c,
+        ntohl(remoteaddr->sin_addr.s_addr), ntohs(remoteaddr->sin_port),
+        rkey, len) != 0)
+    {
+        rdma_pending_free(s);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    return rdma_pending_start(s);
+}
+
+int rdma_tas_accept_async(int listenfd, uint32_t rkey, uint64_t len,
+        void* opaque)
+{
+    // 1. Find listener rdma_socket
+    struct rdma_socket* ls = rdma_listener_lookup(listenfd);
+    if (ls == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. Allocate FD and Socket
+    struct rdma_socket* s = rdma_pending_alloc(opaque);
+    if (s == NULL)
+        return RDMA_TAS_CTRL_BUSY;
+
+    // 3. accept() IPC to TAS Slowpath, completes once a peer connects
+    if (flextcp_listen_accept_mr(s->ctx, &ls->l, &s->c, rkey, len) != 0)
+    {
+        rdma_pending_free(s);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    return rdma_pending_start(s);
+}
+
+int rdma_tas_ctrl_poll(struct rdma_ctrl_event* evs, uint32_t num)
+{
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    struct rdma_tas_ctx* rctx = (struct rdma_tas_ctx*) ctx;
+
+    // 1. Drain slow path events, no other events are expected here. A
+    //    pending notification is consumed first, so the fd does not stay
+    //    readable.
+    struct flextcp_event ev;
+    int i;
+    flextcp_block(ctx, 0);
+    for (i = 0; i < CTRL_POLL_BUDGET; i++)
+    {
+        if (flextcp_context_poll(ctx, 1, &ev) != 1)
+            break;
+        rdma_ctrl_dispatch(ctx, &ev);
+    }
+
+    // 2. Report completed requests
+    struct rdma_socket* s;
+    uint32_t n = 0;
+    while (n < num && (s = rctx->done_head) != NULL)
+    {
+        rctx->done_head = s->ctrl_next;
+        if (rctx->done_head == NULL)
+            rctx->done_tail = NULL;
+
+        evs[n].fd = s->fd;
+        evs[n].status = s->ctrl_status;
+        evs[n].opaque = s->opaque;
+        if (s->ctrl_status == 0)
+        {
+            s->type = RDMA_CONN_SOCKET;
+            evs[n].mr_base = s->c.mr;
+            evs[n].mr_len = s->c.mr_len;
+        }
+        else
+        {
+            // The fd is released with the failure report
+            rdma_tas_fdmap[s->fd] = NULL;
+            rdma_pending_free(s);
+            evs[n].mr_base = NULL;
+            evs[n].mr_len = 0;
+        }
+        n++;
+    }
+
+    return n;
+}
+
+int rdma_tas_ctrl_fd(void)
+{
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    return ctx->epfd;
+}
+
+/* Block until the slow path answers a memory region request */
+static int rdma_mr_wait(struct flextcp_context* ctx, struct flextcp_mr* m,
+        uint8_t type)
+{
+    struct flextcp_event ev;
+    if (rdma_ctrl_wait(ctx, &ev) != 0)
+        return -1;
+
+    if (ev.event_type != type || ev.ev.mr.mr != m || ev.ev.mr.status != 0)
+        return -1;
+
+    return 0;
+}
+
+int rdma_tas_reg_mr(uint64_t len, void **mr_base, uint32_t *rkey)
+{
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 1. Allocate region descriptor
+    struct rdma_tas_mr* mr = calloc(1, sizeof(struct rdma_tas_mr));
+    if (mr == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. Register with TAS Slowpath
+    if (flextcp_mr_register(ctx, &mr->m, len) != 0 ||
+            rdma_mr_wait(ctx, &mr->m, FLEXTCP_EV_MR_REG) != 0)
+    {
+        free(mr);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    pthread_mutex_lock(&rdma_tas_lock);
+    mr->next = rdma_tas_mrs;
+    rdma_tas_mrs = mr;
+    pthread_mutex_unlock(&rdma_tas_lock);
+
+    // 3. Update return parameters
+    *mr_base = mr->m.base;
+    *rkey = mr->m.key;
+    return 0;
+}
+
+int rdma_tas_dereg_mr(uint32_t rkey)
+{
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    if (ctx == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 1. Find and unlink region descriptor
+    struct rdma_tas_mr *mr, **pprev;
+    pthread_mutex_lock(&rdma_tas_lock);
+    for (pprev = &rdma_tas_mrs; (mr = *pprev) != NULL; pprev = &mr->next)
+        if (mr->m.key == rkey)
+            break;
+    if (mr != NULL)
+        *pprev = mr->next;
+    pthread_mutex_unlock(&rdma_tas_lock);
+
+    if (mr == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. Deregister with TAS Slowpath
+    if (flextcp_mr_deregister(ctx, &mr->m) != 0 ||
+            rdma_mr_wait(ctx, &mr->m, FLEXTCP_EV_MR_DEREG) != 0)
+    {
+        pthread_mutex_lock(&rdma_tas_lock);
+        mr->next = rdma_tas_mrs;
+        rdma_tas_mrs = mr;
+        pthread_mutex_unlock(&rdma_tas_lock);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    free(mr);
+    return 0;
+}
+
+uint32_t rdma_tas_mr_key(const void* addr, uint64_t len)
+{
+    uintptr_t a = (uintptr_t) addr, base;
+    struct rdma_tas_mr* mr;
+    uint32_t key = 0;
+
+    pthread_mutex_lock(&rdma_tas_lock);
+    for (mr = rdma_tas_mrs; mr != NULL; mr = mr->next)
+    {
+        base = (uintptr_t) mr->m.base;
+        if (a >= base && len <= mr->m.len && a - base <= mr->m.len - len)
+        {
+            key = mr->m.key;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rdma_tas_lock);
+    return key;
+}
+
+int rdma_tas_set_mr(int fd, uint32_t rkey, uint64_t len, void **mr_base,
+        uint64_t *mr_len)
+{
+    // 1. Find connection socket
+    if (fd < 1 || fd >= MAX_FD_NUM || rdma_tas_fdmap[fd] == NULL ||
+            rdma_tas_fdmap[fd]->type != RDMA_CONN_SOCKET)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    struct rdma_socket* s = rdma_tas_fdmap[fd];
+    struct flextcp_context* ctx = s->ctx;
+
+    // 2. IPC to TAS Slowpath
+    if (flextcp_connection_set_mr(ctx, &s->c, rkey, len) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 3. Block until TAS Slowpath processes the request
+    struct flextcp_event ev;
+    if (rdma_ctrl_wait(ctx, &ev) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 4. Check status
+    if (ev.event_type != FLEXTCP_EV_CONN_MR ||
+        ev.ev.conn_mr.conn != &s->c ||
+        ev.ev.conn_mr.status != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 5. Update return parameters
+    *mr_base = s->c.mr;
+    *mr_len = s->c.mr_len;
+    return 0;
+}
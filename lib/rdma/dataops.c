@@ -4,65 +4,174 @@
 
 #include "tas_ll.h"
 #include "tas_rdma.h"
+#include "tas_memif.h"
 #include "utils.h"
+#include "utils_ring.h"
+#include "utils_timeout.h"
 #include "internal.h"
 
-/* NOTE: Two data operations must not be called concurrently on the same
- * 'fd'
+/* NOTE: Data operations poll the context the connection is bound to and
+ * take no locks. Two data operations must not be called concurrently on
+ * connections of the same context, operations on connections of different
+ * threads' contexts never contend.
  */
 
-int rdma_tas_read(int fd, uint32_t len, uint32_t loffset, uint32_t roffset)
+static inline struct rdma_socket* rdma_sock_lookup(int fd)
 {
-    // 1. Find listener socket
+    // 1. Find connection socket
     if (fd < 1 || fd >= MAX_FD_NUM)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
+        return NULL;
+
     struct rdma_socket* s = rdma_tas_fdmap[fd];
-    if (s->type != RDMA_CONN_SOCKET)
+    if (s == NULL || s->type != RDMA_CONN_SOCKET)
+        return NULL;
+
+    return s;
+}
+
+static inline struct flextcp_context* rdma_conn_ctx(
+        struct flextcp_connection* c)
+{
+    return ((struct rdma_socket*) c)->ctx;     // c is the first member
+}
+
+static inline struct flextcp_connection* rdma_conn_lookup(int fd)
+{
+    struct rdma_socket* s = rdma_sock_lookup(fd);
+    return (s == NULL ? NULL : &s->c);
+}
+
+/* Work queue entry at position pos */
+static inline struct rdma_wqe* rdma_wq_entry(struct flextcp_connection* c,
+        uint32_t pos)
+{
+    return (struct rdma_wqe*)(c->wq_base + ring_off(c->wq_size, pos));
+}
+
+/* Inline payload slot of the work queue entry at offset wq_off */
+static inline uint8_t* rdma_inline_slot(struct flextcp_connection* c,
+        uint32_t wq_off)
+{
+    return c->wq_base + 2 * c->wq_size + sizeof(struct flextcp_pl_rdma_db) +
+        wq_off / sizeof(struct rdma_wqe) * RDMA_INLINE_MAX;
+}
+
+/* Requests posted and not completed yet */
+static inline uint32_t rdma_outstanding(struct flextcp_connection* c)
+{
+    return ring_used(c->wq_head, c->cq_head) / sizeof(struct rdma_wqe);
+}
+
+/* All RDMA_SGE_MAX entries of a list are in the memory region and add up to
+ * len */
+static inline int rdma_sgl_valid(struct flextcp_connection* c,
+        const struct rdma_sge* sgl, uint32_t len)
+{
+    uint64_t total = 0;
+    unsigned i;
+
+    for (i = 0; i < RDMA_SGE_MAX; i++)
     {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
+        if (sgl[i].len > c->mr_len || sgl[i].loff > c->mr_len - sgl[i].len)
+            return 0;
+        total += sgl[i].len;
     }
-    struct flextcp_connection* c = &s->c;
+    return total == len;
+}
 
+/* Add a work queue entry without notifying the fast path. If inl is set, len
+ * bytes of payload are copied from it to the inline slot of the entry. If sgl
+ * is set, its RDMA_SGE_MAX entries are the local side and loffset is unused.
+ * Returns the operation id, RDMA_TAS_NO_CREDITS if the remote peer does not
+ * accept more outstanding requests, or -1 if the entry is invalid or the
+ * queue is full.
+ */
+static inline int rdma_wqe_add(struct flextcp_connection* c, uint8_t type,
+        uint32_t len, uint64_t loffset, uint64_t roffset, uint32_t imm,
+        const void* inl, const struct rdma_sge* sgl)
+{
     // 2. Validate address in memory region
-    if (((uint64_t) loffset + len) > c->mr_len)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    if (inl != NULL && len > RDMA_INLINE_MAX)
+        return -1;
+    if (sgl != NULL && !rdma_sgl_valid(c, sgl, len))
+        return -1;
+    if (inl == NULL && sgl == NULL &&
+            (len > c->mr_len || loffset > c->mr_len - len))
         return -1;
-    }
 
     // 3. Acquire Work Queue Entry
-	  // NOTE: c->wq_len must be a multiple of sizeof(struct rdma_wqe)
-    if (c->wq_len + c->cq_len == c->wq_size){
-        // Queue full!
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    if (ring_used(c->wq_head, c->cq_tail) == c->wq_size)
         return -1;
-    }
-	uint32_t wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
-    struct rdma_wqe* wqe_pos = (struct rdma_wqe*)(c->wq_base + wq_head);
+    if (c->rdma_credits != 0 && rdma_outstanding(c) >= c->rdma_credits)
+        return RDMA_TAS_NO_CREDITS;
+
+    uint32_t wq_head = ring_off(c->wq_size, c->wq_head);
+    struct rdma_wqe* wqe_pos = rdma_wq_entry(c, c->wq_head);
 
     // 4. Fill entries of Work Queue
-    int32_t id;
-    id = wqe_pos->id = (c->wq_tail + c->wq_len) % c->wq_size;
-    wqe_pos->type = RDMA_OP_READ;
+    wqe_pos->id = wq_head;
+    wqe_pos->type = type;
     wqe_pos->status = RDMA_PENDING;
     wqe_pos->loff = loffset;
     wqe_pos->roff = roffset;
     wqe_pos->len = len;
+    wqe_pos->imm = imm;
+    wqe_pos->flags = 0;
+    if (inl != NULL)
+    {
+        memcpy(rdma_inline_slot(c, wq_head), inl, len);
+        wqe_pos->flags = RDMA_WQE_INLINE;
+    }
+    else if (sgl != NULL)
+    {
+        memcpy(rdma_inline_slot(c, wq_head), sgl, RDMA_INLINE_MAX);
+        wqe_pos->flags = RDMA_WQE_SGL;
+    }
 
-    // 5. Increment Queue length
-	uint32_t old_len = c->wq_len;
+    // 5. Advance Queue head
     MEM_BARRIER();
-	c->wq_len += sizeof(struct rdma_wqe);
+    c->wq_head += sizeof(struct rdma_wqe);
+
+    return wq_head;
+}
+
+int rdma_conn_wqe_add(struct flextcp_connection* c, uint8_t type,
+        uint32_t len, uint64_t loffset, uint64_t roffset, uint32_t imm,
+        const void* inl, const struct rdma_sge* sgl)
+{
+    return rdma_wqe_add(c, type, len, loffset, roffset, imm, inl, sgl);
+}
+
+static int rdma_tas_post(int fd, uint8_t type, uint32_t len,
+        uint64_t loffset, uint64_t roffset, uint32_t imm, const void* inl,
+        const struct rdma_sge* sgl)
+{
+    struct rdma_stripe* st = stripe_lookup(fd);
+    if (st != NULL)
+        return stripe_post(st, type, len, loffset, roffset, imm, inl, sgl);
+
+    struct flextcp_connection* c = rdma_conn_lookup(fd);
+    if (c == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    uint32_t old_head = c->wq_head;
+    int id = rdma_wqe_add(c, type, len, loffset, roffset, imm, inl, sgl);
+    if (id == RDMA_TAS_NO_CREDITS)
+        return id;
+    if (id < 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
 
     // TODO: Handle the case where bump queue is full
     // 6. Bump the fast path
-    if (rdma_conn_bump(rdma_tas_appctx, c) < 0) {
-        // Undo the length increment (effectively revert adding wqe)
-		c->wq_len = old_len;
+    if (rdma_conn_bump(rdma_conn_ctx(c), c) < 0) {
+        // Undo the head increment (effectively revert adding wqe)
+        c->wq_head = old_head;
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
@@ -70,83 +179,226 @@ int rdma_tas_read(int fd, uint32_t len, uint32_t loffset, uint32_t roffset)
     return id;
 }
 
-int rdma_tas_write(int fd, uint32_t len, uint32_t loffset, uint32_t roffset)
+int rdma_tas_read(int fd, uint32_t len, uint64_t loffset, uint64_t roffset)
 {
-    // 1. Find listener socket
-    if (fd < 1 || fd >= MAX_FD_NUM)
+    return rdma_tas_post(fd, RDMA_OP_READ, len, loffset, roffset, 0, NULL,
+            NULL);
+}
+
+int rdma_tas_write(int fd, uint32_t len, uint64_t loffset, uint64_t roffset)
+{
+    return rdma_tas_post(fd, RDMA_OP_WRITE, len, loffset, roffset, 0, NULL,
+            NULL);
+}
+
+/* Up to RDMA_SGE_MAX local buffers, the list is padded with empty entries */
+static int rdma_tas_post_sgl(int fd, uint8_t type, const struct rdma_sge* sgl,
+        uint32_t num, uint64_t roffset)
+{
+    struct rdma_sge list[RDMA_SGE_MAX];
+    uint64_t len = 0;
+    uint32_t i;
+
+    if (num > RDMA_SGE_MAX)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct rdma_socket* s = rdma_tas_fdmap[fd];
-    if (s->type != RDMA_CONN_SOCKET)
+
+    memset(list, 0, sizeof(list));
+    for (i = 0; i < num; i++)
+    {
+        list[i].loff = sgl[i].loff;
+        list[i].len = sgl[i].len;
+        len += sgl[i].len;
+    }
+    if (len > UINT32_MAX)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct flextcp_connection* c = &s->c;
 
-    // 2. Validate address in memory region
-    if (((uint64_t) loffset + len) > c->mr_len)
+    return rdma_tas_post(fd, type, len, 0, roffset, 0, NULL, list);
+}
+
+int rdma_tas_read_sgl(int fd, const struct rdma_sge* sgl, uint32_t num,
+        uint64_t roffset)
+{
+    return rdma_tas_post_sgl(fd, RDMA_OP_READ, sgl, num, roffset);
+}
+
+int rdma_tas_write_sgl(int fd, const struct rdma_sge* sgl, uint32_t num,
+        uint64_t roffset)
+{
+    return rdma_tas_post_sgl(fd, RDMA_OP_WRITE, sgl, num, roffset);
+}
+
+int rdma_tas_write_inline(int fd, const void* data, uint32_t len,
+        uint64_t roffset)
+{
+    return rdma_tas_post(fd, RDMA_OP_WRITE, len, 0, roffset, 0, data, NULL);
+}
+
+int rdma_tas_write_imm(int fd, uint32_t len, uint64_t loffset,
+        uint64_t roffset, uint32_t imm)
+{
+    return rdma_tas_post(fd, RDMA_OP_WRITE_IMM, len, loffset, roffset, imm,
+            NULL, NULL);
+}
+
+/* Operands are passed to the fast path through the local memory region */
+static int rdma_tas_atomic(int fd, uint8_t type, uint64_t loffset,
+        uint64_t roffset, uint64_t compare_add, uint64_t swap)
+{
+    struct flextcp_connection* c = rdma_conn_lookup(stripe_ctrl_fd(fd));
+    if (c == NULL || RDMA_ATOMIC_LEN > c->mr_len
+            || loffset > c->mr_len - RDMA_ATOMIC_LEN)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 3. Acquire Work Queue Entry
-    // NOTE: c->wq_len must be a multiple of sizeof(struct rdma_wqe)
-    if (c->wq_len + c->cq_len == c->wq_size){
-        // Queue full!
+    uint64_t ops[2] = { compare_add, swap };
+    memcpy(c->mr + loffset, ops, sizeof(ops));
+
+    return rdma_tas_post(fd, type, RDMA_ATOMIC_LEN, loffset, roffset, 0,
+            NULL, NULL);
+}
+
+int rdma_tas_fetch_add(int fd, uint64_t loffset, uint64_t roffset,
+        uint64_t add)
+{
+    return rdma_tas_atomic(fd, RDMA_OP_FETCH_ADD, loffset, roffset, add, 0);
+}
+
+int rdma_tas_cmp_swap(int fd, uint64_t loffset, uint64_t roffset,
+        uint64_t compare, uint64_t swap)
+{
+    return rdma_tas_atomic(fd, RDMA_OP_CMP_SWAP, loffset, roffset, compare,
+            swap);
+}
+
+int rdma_tas_send(int fd, uint32_t len, uint64_t loffset)
+{
+    return rdma_tas_post(fd, RDMA_OP_SEND, len, loffset, 0, 0, NULL, NULL);
+}
+
+/* Receive queue entry at position pos, the queue follows the doorbell */
+static inline struct rdma_wqe* rdma_rcv_entry(struct flextcp_connection* c,
+        uint32_t pos)
+{
+    return (struct rdma_wqe*)(c->wq_base + c->wq_size +
+            sizeof(struct flextcp_pl_rdma_db) + ring_off(c->wq_size, pos));
+}
+
+int rdma_tas_post_recv(int fd, uint32_t len, uint64_t loffset)
+{
+    struct flextcp_connection* c = rdma_conn_lookup(stripe_ctrl_fd(fd));
+    if (c == NULL || len > c->mr_len || loffset > c->mr_len - len)
+    {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-	uint32_t wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
-    struct rdma_wqe* wqe_pos = (struct rdma_wqe*)(c->wq_base + wq_head);
+    if (ring_used(c->rcv_head, c->rcv_cq_tail) == c->wq_size)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
 
-    // 4. Fill entries of Work Queue
-    int32_t id;
-    id = wqe_pos->id = (c->wq_tail + c->wq_len) % c->wq_size;
-    wqe_pos->type = RDMA_OP_WRITE;
-    wqe_pos->status = RDMA_PENDING;
-    wqe_pos->loff = loffset;
-    wqe_pos->roff = roffset;
-    wqe_pos->len = len;
+    uint32_t rcv_off = ring_off(c->wq_size, c->rcv_head);
+    struct rdma_wqe* wqe = rdma_rcv_entry(c, c->rcv_head);
+    wqe->id = rcv_off;
+    wqe->type = RDMA_OP_RECV;
+    wqe->status = RDMA_PENDING;
+    wqe->loff = loffset;
+    wqe->roff = 0;
+    wqe->len = len;
+    wqe->flags = RDMA_WQE_RECV;
+    c->rcv_head += sizeof(struct rdma_wqe);
 
-    // 5. Increment Queue length
-	uint32_t old_len = c->wq_len;
+    // The fast path picks up the buffer on the next incoming SEND
+    struct flextcp_pl_rdma_db* db =
+        (struct flextcp_pl_rdma_db*)(c->wq_base + c->wq_size);
     MEM_BARRIER();
-	c->wq_len += sizeof(struct rdma_wqe);
+    db->rcv_head = c->rcv_head;
 
-    // TODO: Handle the case where bump queue is full
-    // 6. Bump the fast path
-    if (rdma_conn_bump(rdma_tas_appctx, c) < 0) {
-        // Undo the length increment (effectively revert adding wqe)
-		c->wq_len = old_len;
+    return rcv_off;
+}
+
+int rdma_tas_recv_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num)
+{
+    struct flextcp_connection* c = rdma_conn_lookup(stripe_ctrl_fd(fd));
+    if (c == NULL)
+    {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
+    if (c->rcv_tail == c->rcv_cq_tail)
+        rdma_context_poll(rdma_conn_ctx(c), SCQ_POLL_BUDGET);
 
-    return id;
+    uint32_t i = 0;
+    while (c->rcv_tail != c->rcv_cq_tail && i < num)
+    {
+        memcpy(compl_evs + i, rdma_rcv_entry(c, c->rcv_cq_tail),
+                sizeof(struct rdma_wqe));
+
+        c->rcv_cq_tail += sizeof(struct rdma_wqe);
+        i++;
+    }
+    return i;
 }
 
-int rdma_tas_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num){
-    int ret;
-    if (fd < 1 || fd >= MAX_FD_NUM)
+int rdma_tas_post_burst(int fd, const struct rdma_wqe* ops, uint32_t num)
+{
+    struct flextcp_connection* c = rdma_conn_lookup(fd);
+    if (c == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct rdma_socket* s = rdma_tas_fdmap[fd];
-    if (s->type != RDMA_CONN_SOCKET)
+
+    uint32_t old_head = c->wq_head;
+    uint32_t i;
+    for (i = 0; i < num; i++)
+    {
+        if (ops[i].type != RDMA_OP_READ && ops[i].type != RDMA_OP_WRITE
+                && ops[i].type != RDMA_OP_SEND
+                && ops[i].type != RDMA_OP_WRITE_IMM)
+            break;
+        if (rdma_wqe_add(c, ops[i].type, ops[i].len, ops[i].loff,
+                    ops[i].roff, ops[i].imm, NULL, NULL) < 0)
+            break;
+    }
+
+    if (i == 0)
+        return 0;
+
+    // Single bump for the whole burst
+    if (rdma_conn_bump(rdma_conn_ctx(c), c) < 0) {
+        c->wq_head = old_head;
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    return i;
+}
+
+int rdma_tas_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num){
+    int ret;
+    struct rdma_stripe* st = stripe_lookup(fd);
+    if (st != NULL)
+        return stripe_cq_poll(st, compl_evs, num);
+
+    struct flextcp_connection* c = rdma_conn_lookup(fd);
+    if (c == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct flextcp_connection* c = &s->c;
-    if (c->cq_len < num * sizeof(struct rdma_wqe))
+    if (ring_used(c->cq_head, c->cq_tail) < num * sizeof(struct rdma_wqe))
     {
-        ret = rdma_fastpath_poll(rdma_tas_appctx, c, num * sizeof(struct rdma_wqe));
+        ret = rdma_fastpath_poll(rdma_conn_ctx(c), c, num * sizeof(struct rdma_wqe));
         if (ret < 0){
             fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
             return -1;
@@ -156,17 +408,303 @@ int rdma_tas_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num){
     int i = 0;
     struct rdma_wqe* wqe;
     struct rdma_wqe* ev;
-    while(c->cq_len > 0 && i < num){
-        wqe = (struct rdma_wqe*)(c->wq_base + c->cq_tail);
+    while(c->cq_head != c->cq_tail && i < num){
+        wqe = rdma_wq_entry(c, c->cq_tail);
         ev = compl_evs + i;
 
         // Copy the wqe data
         memcpy(ev, wqe, sizeof(struct rdma_wqe));
 
-        // Update queue pointers and length
-        c->cq_tail = (c->cq_tail + sizeof(struct rdma_wqe)) % c->wq_size;
-        c->cq_len -= sizeof(struct rdma_wqe);
+        // Update queue pointers
+        c->cq_tail += sizeof(struct rdma_wqe);
         i += 1;
     }
     return i;
 }
+
+int rdma_tas_cq_peek(int fd, struct rdma_wqe** compl_evs)
+{
+    int ret;
+    struct flextcp_connection* c = rdma_conn_lookup(fd);
+    if (c == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    if (c->cq_head == c->cq_tail)
+    {
+        ret = rdma_fastpath_poll(rdma_conn_ctx(c), c, sizeof(struct rdma_wqe));
+        if (ret < 0){
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+    }
+
+    // Only entries up to the end of the queue are contiguous
+    uint32_t cq_off = ring_off(c->wq_size, c->cq_tail);
+    uint32_t len = MIN(ring_used(c->cq_head, c->cq_tail), c->wq_size - cq_off);
+    *compl_evs = rdma_wq_entry(c, c->cq_tail);
+    return len / sizeof(struct rdma_wqe);
+}
+
+int rdma_tas_cq_advance(int fd, uint32_t num)
+{
+    struct flextcp_connection* c = rdma_conn_lookup(fd);
+    if (c == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    uint32_t len = num * sizeof(struct rdma_wqe);
+    if (len > ring_used(c->cq_head, c->cq_tail))
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    c->cq_tail += len;
+    return 0;
+}
+
+/* Request a wakeup on the next completion. Returns 1 if completions are
+ * already available and the caller must not sleep. */
+static int rdma_cq_arm(struct flextcp_connection* c)
+{
+    struct flextcp_pl_rdma_db* db =
+        (struct flextcp_pl_rdma_db*)(c->wq_base + c->wq_size);
+    struct rdma_wqe* wqe;
+
+    db->cq_armed = 1;
+    // Pairs with the fence in fast_rdma_cq_notify()
+    MEM_FENCE();
+
+    if (c->cq_head != c->cq_tail)
+        return 1;
+
+    // Oldest outstanding operation completed but not yet reported
+    if (c->wq_head != c->cq_head)
+    {
+        wqe = rdma_wq_entry(c, c->cq_head);
+        if (wqe->status != RDMA_PENDING && wqe->status != RDMA_TX_PENDING &&
+                wqe->status != RDMA_RESP_PENDING)
+            return 1;
+    }
+
+    return 0;
+}
+
+int rdma_conn_cq_arm(struct flextcp_connection* c)
+{
+    return rdma_cq_arm(c);
+}
+
+/* Socket of a connection or striped connection */
+static inline struct rdma_socket* rdma_cq_sock_lookup(int fd)
+{
+    struct rdma_stripe* st = stripe_lookup(fd);
+    return (st != NULL ? rdma_tas_fdmap[fd] : rdma_sock_lookup(fd));
+}
+
+static inline int rdma_sock_cq_arm(struct rdma_socket* s)
+{
+    if (s->type == RDMA_STRIPE_SOCKET)
+        return stripe_cq_arm(s->stripe);
+
+    return rdma_cq_arm(&s->c);
+}
+
+int rdma_tas_cq_arm(int fd)
+{
+    struct rdma_socket* s = rdma_cq_sock_lookup(fd);
+    if (s == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    return rdma_sock_cq_arm(s);
+}
+
+int rdma_tas_cq_fd(int fd)
+{
+    struct rdma_socket* s = rdma_cq_sock_lookup(fd);
+    if (s == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    return s->ctx->epfd;
+}
+
+int rdma_tas_cq_wait(int fd, struct rdma_wqe* compl_evs, uint32_t num,
+        int timeout_ms)
+{
+    struct rdma_socket* s = rdma_cq_sock_lookup(fd);
+    if (s == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    uint32_t start = util_timeout_time_us();
+    uint32_t i, elapsed_ms;
+    int ret;
+
+    // 1. Spin before sleeping, adapting to how fast completions arrive
+    if (s->cq_spin == 0)
+        s->cq_spin = CQ_SPIN_MIN;
+    for (i = 0; i < s->cq_spin; i++)
+    {
+        ret = rdma_tas_cq_poll(fd, compl_evs, num);
+        if (ret != 0)
+        {
+            if (i > s->cq_spin / 2)
+                s->cq_spin = MIN(s->cq_spin * 2, CQ_SPIN_MAX);
+            return ret;
+        }
+    }
+    s->cq_spin = MAX(s->cq_spin / 2, CQ_SPIN_MIN);
+
+    // 2. Sleep until the fast path reports completions
+    while (1)
+    {
+        elapsed_ms = (util_timeout_time_us() - start) / 1000;
+        if (timeout_ms >= 0 && elapsed_ms >= timeout_ms)
+        {
+            // Consume a pending notification without sleeping
+            flextcp_block(s->ctx, 0);
+            return rdma_tas_cq_poll(fd, compl_evs, num);
+        }
+
+        if (rdma_sock_cq_arm(s) == 0)
+            flextcp_block(s->ctx,
+                    timeout_ms < 0 ? -1 : timeout_ms - elapsed_ms);
+
+        ret = rdma_tas_cq_poll(fd, compl_evs, num);
+        if (ret != 0)
+            return ret;
+    }
+}
+
+struct rdma_tas_cq* rdma_tas_scq_create(void)
+{
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+    struct rdma_tas_cq* cq = calloc(1, sizeof(struct rdma_tas_cq));
+    if (ctx == NULL || cq == NULL)
+    {
+        free(cq);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+    cq->ctx = ctx;
+
+    return cq;
+}
+
+int rdma_tas_scq_attach(struct rdma_tas_cq* cq, int fd)
+{
+    // Polling the queue only makes progress on connections of its context
+    struct flextcp_connection* c = rdma_conn_lookup(fd);
+    if (cq == NULL || c == NULL || c->rdma_cq != NULL ||
+            rdma_conn_ctx(c) != cq->ctx)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    c->rdma_cq = &cq->ll;
+    cq->num_conns++;
+
+    // Completions that arrived before attaching
+    if (c->cq_head != c->cq_tail || c->rcv_tail != c->rcv_cq_tail)
+        rdma_cq_ready_push(c);
+
+    return 0;
+}
+
+void rdma_conn_scq_detach(struct flextcp_connection* c)
+{
+    // ll is the first member of the shared completion queue
+    struct rdma_tas_cq* cq = (struct rdma_tas_cq*) c->rdma_cq;
+    if (cq == NULL)
+        return;
+
+    rdma_cq_ready_remove(c);
+    c->rdma_cq = NULL;
+    cq->num_conns--;
+}
+
+int rdma_tas_scq_detach(struct rdma_tas_cq* cq, int fd)
+{
+    struct flextcp_connection* c = rdma_conn_lookup(fd);
+    if (cq == NULL || c == NULL || c->rdma_cq != &cq->ll)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // Unread completions stay on the connection for rdma_tas_cq_poll()
+    rdma_conn_scq_detach(c);
+    return 0;
+}
+
+int rdma_tas_scq_poll(struct rdma_tas_cq* cq, struct rdma_cq_event* evs,
+        uint32_t num)
+{
+    if (cq == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 1. Drain fast path updates for all connections of the context
+    rdma_context_poll(cq->ctx, SCQ_POLL_BUDGET);
+
+    // 2. Visit only connections with unread completions
+    uint32_t i = 0;
+    struct flextcp_connection* c;
+    struct rdma_socket* s;
+    struct rdma_wqe* wqe;
+    while (i < num && (c = rdma_cq_ready_pop(&cq->ll)) != NULL)
+    {
+        s = (struct rdma_socket*) c;   // c is the first member
+        while (c->cq_head != c->cq_tail && i < num)
+        {
+            wqe = rdma_wq_entry(c, c->cq_tail);
+            evs[i].fd = s->fd;
+            memcpy(&evs[i].wqe, wqe, sizeof(struct rdma_wqe));
+
+            c->cq_tail += sizeof(struct rdma_wqe);
+            i++;
+        }
+        while (c->rcv_tail != c->rcv_cq_tail && i < num)
+        {
+            wqe = rdma_rcv_entry(c, c->rcv_cq_tail);
+            evs[i].fd = s->fd;
+            memcpy(&evs[i].wqe, wqe, sizeof(struct rdma_wqe));
+
+            c->rcv_cq_tail += sizeof(struct rdma_wqe);
+            i++;
+        }
+
+        // Requeue at the end so other connections are served next
+        if (c->cq_head != c->cq_tail || c->rcv_tail != c->rcv_cq_tail)
+            rdma_cq_ready_push(c);
+    }
+
+    return i;
+}
+
+int rdma_tas_scq_destroy(struct rdma_tas_cq* cq)
+{
+    if (cq == NULL || cq->num_conns != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    free(cq);
+    return 0;
+}
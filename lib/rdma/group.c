@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tas_ll.h"
+#include "tas_rdma.h"
+#include "utils.h"
+#include "utils_ring.h"
+#include "internal.h"
+
+/* NOTE: A group write adds one WQE referencing the same memory region range
+ * to every member connection. The fast path reads WRITE payload from the
+ * memory region when it builds segments, so the payload is never copied per
+ * member. Every write holds a slot in the ops ring until all members
+ * completed it, slot indices are the operation ids of the group.
+ */
+
+struct group_op {
+    struct rdma_wqe wqe;    // Completion returned to the application
+    uint8_t pending;        // Members not completed yet
+    uint8_t acked;          // Members completed successfully
+    uint8_t failed;         // Members completed with an error
+};
+
+struct rdma_tas_group {
+    uint32_t num;
+    uint32_t quorum;
+    struct rdma_socket* socks[RDMA_GROUP_MAX];
+    uint32_t* slots[RDMA_GROUP_MAX];    // Ops slot of each member WQE
+    struct group_op* ops;
+    uint32_t ops_len;                   // Power of two
+    uint32_t ops_head;                  // Free-running slot counts
+    uint32_t ops_done;                  // Oldest write not reported yet
+    uint32_t ops_tail;                  // Oldest write not completed yet
+};
+
+struct rdma_tas_group* rdma_tas_group_create(const int* fds, uint32_t num,
+        uint32_t quorum)
+{
+    struct rdma_tas_group* g;
+    struct rdma_socket* s;
+    uint32_t i, entries = 0;
+
+    if (fds == NULL || num == 0 || num > RDMA_GROUP_MAX || quorum == 0 ||
+            quorum > num || (g = calloc(1, sizeof(*g))) == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+    // 1. Members share one context and one memory region
+    for (i = 0; i < num; i++)
+    {
+        s = (fds[i] < 1 || fds[i] >= MAX_FD_NUM ? NULL :
+                rdma_tas_fdmap[fds[i]]);
+        if (s == NULL || s->type != RDMA_CONN_SOCKET ||
+                (i > 0 && (s->ctx != g->socks[0]->ctx ||
+                           s->c.mr != g->socks[0]->c.mr)))
+            goto err;
+
+        g->socks[i] = s;
+        entries = MAX(entries, s->c.wq_size / sizeof(struct rdma_wqe));
+        g->slots[i] = calloc(s->c.wq_size / sizeof(struct rdma_wqe),
+                sizeof(uint32_t));
+        if (g->slots[i] == NULL)
+            goto err;
+    }
+
+    // 2. A write holds a WQE on every member until it completes
+    g->num = num;
+    g->quorum = quorum;
+    g->ops_len = 1;
+    while (g->ops_len < entries)
+        g->ops_len <<= 1;
+    g->ops = calloc(g->ops_len, sizeof(struct group_op));
+    if (g->ops == NULL)
+        goto err;
+
+    return g;
+
+err:
+    for (i = 0; i < num; i++)
+        free(g->slots[i]);
+    free(g);
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return NULL;
+}
+
+int rdma_tas_write_group(struct rdma_tas_group* g, uint32_t len,
+        uint64_t loffset, uint64_t roffset)
+{
+    uint32_t old_head[RDMA_GROUP_MAX];
+    struct flextcp_connection* c;
+    uint32_t i, slot;
+    int id;
+
+    // 1. Acquire a slot, released once all members completed the write
+    if (g == NULL || ring_used(g->ops_head, g->ops_tail) == g->ops_len)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    slot = ring_off(g->ops_len, g->ops_head);
+
+    // 2. Add the WQE to every member without notifying the fast path
+    for (i = 0; i < g->num; i++)
+    {
+        c = &g->socks[i]->c;
+        old_head[i] = c->wq_head;
+        id = rdma_conn_wqe_add(c, RDMA_OP_WRITE, len, loffset, roffset, 0,
+                NULL, NULL);
+        if (id < 0)
+        {
+            while (i-- > 0)
+                g->socks[i]->c.wq_head = old_head[i];
+            if (id == RDMA_TAS_NO_CREDITS)
+                return id;
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+        g->slots[i][id / sizeof(struct rdma_wqe)] = slot;
+    }
+
+    // 3. Bump the members. WQEs of a later failed bump stay queued and are
+    //    picked up with the next bump of their member.
+    if (rdma_conn_bump(g->socks[0]->ctx, &g->socks[0]->c) < 0)
+    {
+        for (i = 0; i < g->num; i++)
+            g->socks[i]->c.wq_head = old_head[i];
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    for (i = 1; i < g->num; i++)
+        rdma_conn_bump(g->socks[i]->ctx, &g->socks[i]->c);
+
+    struct group_op* op = &g->ops[slot];
+    op->pending = g->num;
+    op->acked = 0;
+    op->failed = 0;
+    op->wqe.id = slot;
+    op->wqe.type = RDMA_OP_WRITE;
+    op->wqe.status = RDMA_SUCCESS;
+    op->wqe.flags = 0;
+    op->wqe.loff = loffset;
+    op->wqe.roff = roffset;
+    op->wqe.len = len;
+    op->wqe.imm = 0;
+    g->ops_head++;
+
+    return slot;
+}
+
+/* The write reached its quorum or can no longer reach it */
+static inline int group_op_decided(struct rdma_tas_group* g,
+        struct group_op* op)
+{
+    return op->acked >= g->quorum || op->failed > g->num - g->quorum;
+}
+
+int rdma_tas_group_poll(struct rdma_tas_group* g, struct rdma_wqe* compl_evs,
+        uint32_t num)
+{
+    struct rdma_wqe evs[GROUP_POLL_BATCH];
+    struct group_op* op;
+    uint32_t i;
+    int k, n;
+
+    if (g == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 1. Account the member completions
+    for (i = 0; i < g->num; i++)
+    {
+        n = rdma_tas_cq_poll(g->socks[i]->fd, evs, GROUP_POLL_BATCH);
+        if (n < 0)
+        {
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+
+        for (k = 0; k < n; k++)
+        {
+            op = &g->ops[g->slots[i][evs[k].id / sizeof(struct rdma_wqe)]];
+            op->pending--;
+            if (evs[k].status == RDMA_SUCCESS)
+            {
+                op->acked++;
+            }
+            else
+            {
+                // The first failure is reported if the quorum is missed
+                if (op->failed == 0 && op->acked < g->quorum)
+                    op->wqe.status = evs[k].status;
+                op->failed++;
+            }
+        }
+    }
+
+    // 2. Report decided writes in posting order
+    i = 0;
+    while (g->ops_done != g->ops_head && i < num)
+    {
+        op = &g->ops[ring_off(g->ops_len, g->ops_done)];
+        if (!group_op_decided(g, op))
+            break;
+
+        if (op->acked >= g->quorum)
+            op->wqe.status = RDMA_SUCCESS;
+        memcpy(compl_evs + i, &op->wqe, sizeof(struct rdma_wqe));
+        g->ops_done++;
+        i++;
+    }
+
+    // 3. Free slots of writes all members completed
+    while (g->ops_tail != g->ops_done &&
+            g->ops[ring_off(g->ops_len, g->ops_tail)].pending == 0)
+        g->ops_tail++;
+
+    return i;
+}
+
+int rdma_tas_group_destroy(struct rdma_tas_group* g)
+{
+    uint32_t i;
+
+    if (g == NULL || g->ops_head != g->ops_tail)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    for (i = 0; i < g->num; i++)
+        free(g->slots[i]);
+    free(g->ops);
+    free(g);
+    return 0;
+}
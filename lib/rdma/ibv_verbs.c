@@ -0,0 +1,711 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "tas_ll.h"
+#include "tas_rdma.h"
+#include "utils_ring.h"
+#include "internal.h"
+#include "include/rdma_verbs.h"
+
+/**
+ * NOTE: libibverbs-style interface on top of the TAS work and completion
+ * queues.
+ * [1] Local addresses (sge.addr) must be in the memory region of the
+ *     connection, they are turned into offsets at post time.
+ * [2] Remote addresses are offsets into the remote peer's memory region, as
+ *     with IBV_ACCESS_ZERO_BASED registrations. rkeys are not checked.
+ * [3] All queue pairs and completion queues of a thread share one TAS
+ *     completion queue. ibv_poll_cq() sorts its completions into the
+ *     completion queues the queue pairs were created with, so they must be
+ *     polled on the thread that connected the queue pair.
+ * [4] ibv_destroy_cq() fails with EBUSY while queue pairs of any thread were
+ *     created with the CQ and not destroyed yet.
+ */
+
+#define VERBS_CQ_MIN    64      // Initial completions buffered per CQ
+
+/* Operation posted on a queue pair */
+struct verbs_wr {
+    uint64_t wr_id;
+    uint8_t signaled;
+};
+
+struct verbs_qp {
+    struct ibv_qp qp;           // Must be the first member
+    struct rdma_cm_id* id;
+    int fd;                     // Connection, 0 until connected
+    int sq_sig_all;
+    struct verbs_wr* send_wr;   // Indexed by work queue entry
+    struct verbs_wr* recv_wr;   // Indexed by receive queue entry
+    struct verbs_qp* next;      // Queue pairs of the thread
+};
+
+/* Completion queue with completions sorted out of the thread's TAS queue */
+struct verbs_cq {
+    struct ibv_cq cq;           // Must be the first member
+    struct ibv_wc* wc;
+    uint32_t wc_len;            // Power of two
+    uint32_t wc_head;
+    uint32_t wc_tail;
+    int qps;                    // Queue pairs of any thread reporting here
+};
+
+/* Completion channel with the CQ armed by ibv_req_notify_cq() */
+struct verbs_comp_channel {
+    struct ibv_comp_channel ch; // Must be the first member
+    struct ibv_cq* armed;
+};
+
+static __thread struct rdma_tas_cq* verbs_scq = NULL;
+static __thread struct verbs_qp* verbs_qps = NULL;
+
+static struct rdma_socket* verbs_qp_sock(struct verbs_qp* qp)
+{
+    if (qp->fd < 1 || qp->fd >= MAX_FD_NUM)
+        return NULL;
+
+    struct rdma_socket* s = rdma_tas_fdmap[qp->fd];
+    if (s == NULL || s->type != RDMA_CONN_SOCKET || s->qp != qp)
+        return NULL;
+
+    return s;
+}
+
+struct ibv_pd *ibv_alloc_pd(struct ibv_context *context)
+{
+    struct ibv_pd* pd = calloc(1, sizeof(struct ibv_pd));
+    if (pd == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+    pd->context = context;
+    return pd;
+}
+
+int ibv_dealloc_pd(struct ibv_pd *pd)
+{
+    free(pd);
+    return 0;
+}
+
+struct ibv_mr *ibv_reg_mr(struct ibv_pd *pd, void *addr, size_t length,
+        int access)
+{
+    if (addr == NULL)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct ibv_mr* mr = calloc(1, sizeof(struct ibv_mr));
+    if (mr == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+    // Memory is registered with TAS already, record the range and the key
+    // of the shared region it is part of (0 for a private region)
+    mr->context = (pd != NULL ? pd->context : NULL);
+    mr->pd = pd;
+    mr->addr = addr;
+    mr->length = length;
+    mr->lkey = mr->rkey = rdma_tas_mr_key(addr, length);
+    return mr;
+}
+
+int ibv_dereg_mr(struct ibv_mr *mr)
+{
+    free(mr);
+    return 0;
+}
+
+struct ibv_comp_channel *ibv_create_comp_channel(struct ibv_context *context)
+{
+    int fd = rdma_tas_ctrl_fd();
+    struct verbs_comp_channel* vch =
+        calloc(1, sizeof(struct verbs_comp_channel));
+    if (fd < 0 || vch == NULL)
+    {
+        free(vch);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+    // Readable on notifications for connections of the calling thread
+    vch->ch.context = context;
+    vch->ch.fd = fd;
+    return &vch->ch;
+}
+
+int ibv_destroy_comp_channel(struct ibv_comp_channel *channel)
+{
+    free(channel);
+    return 0;
+}
+
+struct ibv_cq *ibv_create_cq(struct ibv_context *context, int cqe,
+        void *cq_context, struct ibv_comp_channel *channel, int comp_vector)
+{
+    struct verbs_cq* vcq = calloc(1, sizeof(struct verbs_cq));
+    if (vcq == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+    vcq->wc_len = VERBS_CQ_MIN;
+    while (vcq->wc_len < (uint32_t) cqe && vcq->wc_len < (1U << 30))
+        vcq->wc_len *= 2;
+    vcq->wc = calloc(vcq->wc_len, sizeof(struct ibv_wc));
+    if (vcq->wc == NULL)
+    {
+        free(vcq);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+    vcq->cq.context = context;
+    vcq->cq.channel = channel;
+    vcq->cq.cq_context = cq_context;
+    vcq->cq.cqe = vcq->wc_len;
+    return &vcq->cq;
+}
+
+int ibv_destroy_cq(struct ibv_cq *cq)
+{
+    struct verbs_cq* vcq = (struct verbs_cq*) cq;
+
+    // Queue pairs are counted, so ones created on other threads hold the
+    // CQ as well
+    if (__sync_fetch_and_add(&vcq->qps, 0) != 0)
+        return EBUSY;
+
+    free(vcq->wc);
+    free(vcq);
+    return 0;
+}
+
+/* Count a queue pair reporting to a CQ, or drop it with n = -1 */
+static void verbs_cq_ref(struct ibv_cq* cq, int n)
+{
+    if (cq != NULL)
+        __sync_fetch_and_add(&((struct verbs_cq*) cq)->qps, n);
+}
+
+/* Buffer a completion, the buffer grows instead of overflowing */
+static int verbs_cq_push(struct verbs_cq* vcq, const struct ibv_wc* wc)
+{
+    uint32_t i, n;
+    struct ibv_wc* buf;
+
+    n = ring_used(vcq->wc_head, vcq->wc_tail);
+    if (n == vcq->wc_len)
+    {
+        buf = calloc(2 * vcq->wc_len, sizeof(struct ibv_wc));
+        if (buf == NULL)
+        {
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+        for (i = 0; i < n; i++)
+            buf[i] = vcq->wc[ring_off(vcq->wc_len, vcq->wc_tail + i)];
+
+        free(vcq->wc);
+        vcq->wc = buf;
+        vcq->wc_len *= 2;
+        vcq->wc_tail = 0;
+        vcq->wc_head = n;
+        vcq->cq.cqe = vcq->wc_len;
+    }
+
+    vcq->wc[ring_off(vcq->wc_len, vcq->wc_head)] = *wc;
+    vcq->wc_head++;
+    return 0;
+}
+
+static enum ibv_wc_status verbs_wc_status(uint8_t status)
+{
+    switch (status)
+    {
+        case RDMA_SUCCESS:
+            return IBV_WC_SUCCESS;
+        case RDMA_OUT_OF_BOUNDS:
+            return IBV_WC_REM_ACCESS_ERR;
+        case RDMA_UNALIGNED:
+            return IBV_WC_REM_INV_REQ_ERR;
+        case RDMA_NO_RECV:
+            return IBV_WC_RNR_RETRY_EXC_ERR;
+        case RDMA_UNSUPPORTED:
+            return IBV_WC_REM_OP_ERR;
+        case RDMA_CONN_FAILURE:
+            return IBV_WC_RETRY_EXC_ERR;
+        default:
+            return IBV_WC_GENERAL_ERR;
+    }
+}
+
+static enum ibv_wc_opcode verbs_wc_opcode(uint8_t type)
+{
+    switch (type)
+    {
+        case RDMA_OP_READ:
+            return IBV_WC_RDMA_READ;
+        case RDMA_OP_SEND:
+            return IBV_WC_SEND;
+        case RDMA_OP_CMP_SWAP:
+            return IBV_WC_COMP_SWAP;
+        case RDMA_OP_FETCH_ADD:
+            return IBV_WC_FETCH_ADD;
+        default:
+            return IBV_WC_RDMA_WRITE;
+    }
+}
+
+/* Sort a TAS completion into the completion queue of its queue pair */
+static int verbs_cq_route(const struct rdma_cq_event* ev)
+{
+    const struct rdma_wqe* wqe = &ev->wqe;
+    struct rdma_socket* s = rdma_tas_fdmap[ev->fd];
+    struct verbs_qp* qp = (s != NULL ? s->qp : NULL);
+    uint32_t idx = wqe->id / sizeof(struct rdma_wqe);
+    struct ibv_wc wc;
+    struct ibv_cq* cq;
+
+    // Queue pair destroyed while operations were in flight
+    if (qp == NULL)
+        return 0;
+
+    memset(&wc, 0, sizeof(wc));
+    wc.status = verbs_wc_status(wqe->status);
+    wc.vendor_err = wqe->status;
+    wc.byte_len = wqe->len;
+    wc.qp_num = qp->qp.qp_num;
+    if ((wqe->flags & RDMA_WQE_RECV) != 0)
+    {
+        wc.wr_id = qp->recv_wr[idx].wr_id;
+        wc.opcode = IBV_WC_RECV;
+        if (wqe->type == RDMA_OP_WRITE_IMM)
+        {
+            wc.opcode = IBV_WC_RECV_RDMA_WITH_IMM;
+            wc.wc_flags = IBV_WC_WITH_IMM;
+            wc.imm_data = htonl(wqe->imm);
+        }
+        cq = qp->qp.recv_cq;
+    }
+    else
+    {
+        // Unsignaled operations only report failures
+        if (!qp->send_wr[idx].signaled && wc.status == IBV_WC_SUCCESS)
+            return 0;
+        wc.wr_id = qp->send_wr[idx].wr_id;
+        wc.opcode = verbs_wc_opcode(wqe->type);
+        cq = qp->qp.send_cq;
+    }
+
+    if (cq == NULL)
+        return 0;
+    return verbs_cq_push((struct verbs_cq*) cq, &wc);
+}
+
+int ibv_poll_cq(struct ibv_cq *cq, int num_entries, struct ibv_wc *wc)
+{
+    struct verbs_cq* vcq = (struct verbs_cq*) cq;
+    struct rdma_cq_event evs[SCQ_POLL_BUDGET];
+    int i, n;
+
+    // 1. Sort completions of the thread's connections into their CQs
+    while (verbs_scq != NULL &&
+            ring_used(vcq->wc_head, vcq->wc_tail) < (uint32_t) num_entries)
+    {
+        n = rdma_tas_scq_poll(verbs_scq, evs, SCQ_POLL_BUDGET);
+        if (n < 0)
+            return -1;
+        for (i = 0; i < n; i++)
+        {
+            if (verbs_cq_route(&evs[i]) != 0)
+                return -1;
+        }
+        if (n < SCQ_POLL_BUDGET)
+            break;
+    }
+
+    // 2. Return completions of this CQ
+    for (i = 0; i < num_entries && vcq->wc_tail != vcq->wc_head; i++)
+    {
+        wc[i] = vcq->wc[ring_off(vcq->wc_len, vcq->wc_tail)];
+        vcq->wc_tail++;
+    }
+    return i;
+}
+
+int ibv_req_notify_cq(struct ibv_cq *cq, int solicited_only)
+{
+    struct verbs_comp_channel* vch = (struct verbs_comp_channel*) cq->channel;
+    struct verbs_qp* qp;
+
+    if (vch == NULL)
+        return EINVAL;
+
+    // Completions of every connection reporting to this CQ wake the channel
+    for (qp = verbs_qps; qp != NULL; qp = qp->next)
+    {
+        if ((qp->qp.send_cq == cq || qp->qp.recv_cq == cq) &&
+                verbs_qp_sock(qp) != NULL && rdma_tas_cq_arm(qp->fd) < 0)
+            return EINVAL;
+    }
+
+    vch->armed = cq;
+    return 0;
+}
+
+int ibv_get_cq_event(struct ibv_comp_channel *channel, struct ibv_cq **cq,
+        void **cq_context)
+{
+    struct verbs_comp_channel* vch = (struct verbs_comp_channel*) channel;
+    struct flextcp_context* ctx = rdma_tas_thread_ctx();
+
+    if (vch->armed == NULL || ctx == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Consumes the notification, the CQ is polled afterwards anyway
+    flextcp_block(ctx, -1);
+
+    *cq = vch->armed;
+    *cq_context = vch->armed->cq_context;
+    vch->armed = NULL;
+    return 0;
+}
+
+void ibv_ack_cq_events(struct ibv_cq *cq, unsigned int nevents)
+{
+    // Events are not reference counted
+}
+
+/* Add a work queue entry for a work request, returns 0 or an errno value */
+static int verbs_wr_add(struct verbs_qp* qp, struct flextcp_connection* c,
+        struct ibv_send_wr* wr)
+{
+    uint8_t type;
+    uint32_t imm = 0, len = 0;
+    uint64_t loff = 0, roff = wr->wr.rdma.remote_addr, total = 0;
+    uintptr_t addr;
+    struct rdma_sge list[RDMA_SGE_MAX];
+    const struct rdma_sge* sgl = NULL;
+    uint8_t buf[RDMA_INLINE_MAX];
+    const void* inl = NULL;
+    uint32_t off;
+    int i, id;
+
+    switch (wr->opcode)
+    {
+        case IBV_WR_RDMA_WRITE:
+            type = RDMA_OP_WRITE;
+            break;
+        case IBV_WR_RDMA_WRITE_WITH_IMM:
+            type = RDMA_OP_WRITE_IMM;
+            imm = ntohl(wr->imm_data);
+            break;
+        case IBV_WR_SEND:
+            type = RDMA_OP_SEND;
+            roff = 0;
+            break;
+        case IBV_WR_RDMA_READ:
+            type = RDMA_OP_READ;
+            break;
+        case IBV_WR_ATOMIC_CMP_AND_SWP:
+            type = RDMA_OP_CMP_SWAP;
+            roff = wr->wr.atomic.remote_addr;
+            break;
+        case IBV_WR_ATOMIC_FETCH_AND_ADD:
+            type = RDMA_OP_FETCH_ADD;
+            roff = wr->wr.atomic.remote_addr;
+            break;
+        default:
+            return EINVAL;
+    }
+
+    if (wr->num_sge < 0 || wr->num_sge > (int) RDMA_SGE_MAX)
+        return EINVAL;
+    for (i = 0; i < wr->num_sge; i++)
+        total += wr->sg_list[i].length;
+    if (total > UINT32_MAX)
+        return EINVAL;
+    len = total;
+
+    if ((wr->send_flags & IBV_SEND_INLINE) != 0 &&
+            type == RDMA_OP_WRITE && len <= RDMA_INLINE_MAX)
+    {
+        // Payload is copied to the work queue, any memory will do
+        for (i = 0, off = 0; i < wr->num_sge; i++)
+        {
+            memcpy(buf + off, (const void*)(uintptr_t) wr->sg_list[i].addr,
+                    wr->sg_list[i].length);
+            off += wr->sg_list[i].length;
+        }
+        inl = buf;
+    }
+    else
+    {
+        // Local buffers must be in the memory region of the connection
+        memset(list, 0, sizeof(list));
+        for (i = 0; i < wr->num_sge; i++)
+        {
+            addr = wr->sg_list[i].addr;
+            if (addr < (uintptr_t) c->mr ||
+                    wr->sg_list[i].length > c->mr_len ||
+                    addr - (uintptr_t) c->mr >
+                    c->mr_len - wr->sg_list[i].length)
+                return EINVAL;
+            list[i].loff = addr - (uintptr_t) c->mr;
+            list[i].len = wr->sg_list[i].length;
+        }
+        loff = list[0].loff;
+
+        // Several buffers are gathered or scattered by the fast path
+        if (wr->num_sge > 1)
+        {
+            if (type == RDMA_OP_CMP_SWAP || type == RDMA_OP_FETCH_ADD)
+                return EINVAL;
+            sgl = list;
+            loff = 0;
+        }
+    }
+
+    if (type == RDMA_OP_CMP_SWAP || type == RDMA_OP_FETCH_ADD)
+    {
+        // Operands are passed through the local buffer, so unlike with
+        // verbs its SGE has to hold RDMA_ATOMIC_LEN bytes, not only the
+        // 8 bytes of the old value
+        uint64_t ops[2] = { wr->wr.atomic.compare_add, wr->wr.atomic.swap };
+        if (len < RDMA_ATOMIC_LEN || RDMA_ATOMIC_LEN > c->mr_len ||
+                loff > c->mr_len - RDMA_ATOMIC_LEN)
+            return EINVAL;
+        memcpy(c->mr + loff, ops, sizeof(ops));
+        len = RDMA_ATOMIC_LEN;
+    }
+
+    // Entry was validated, so only a full queue or lack of credits remain
+    id = rdma_conn_wqe_add(c, type, len, loff, roff, imm, inl, sgl);
+    if (id < 0)
+        return ENOMEM;
+
+    qp->send_wr[id / sizeof(struct rdma_wqe)].wr_id = wr->wr_id;
+    qp->send_wr[id / sizeof(struct rdma_wqe)].signaled = qp->sq_sig_all ||
+        (wr->send_flags & IBV_SEND_SIGNALED) != 0;
+    return 0;
+}
+
+int ibv_post_send(struct ibv_qp *ibqp, struct ibv_send_wr *wr,
+        struct ibv_send_wr **bad_wr)
+{
+    struct verbs_qp* qp = (struct verbs_qp*) ibqp;
+    struct rdma_socket* s = verbs_qp_sock(qp);
+    struct ibv_send_wr* first = wr;
+    int ret = 0;
+
+    if (s == NULL)
+    {
+        *bad_wr = wr;
+        return EINVAL;
+    }
+
+    // 1. Add all entries of the chain
+    uint32_t old_head = s->c.wq_head;
+    for (; wr != NULL; wr = wr->next)
+    {
+        ret = verbs_wr_add(qp, &s->c, wr);
+        if (ret != 0)
+        {
+            *bad_wr = wr;
+            break;
+        }
+    }
+    if (s->c.wq_head == old_head)
+        return ret;
+
+    // 2. Notify the fast path once
+    if (rdma_conn_bump(s->ctx, &s->c) < 0)
+    {
+        s->c.wq_head = old_head;
+        *bad_wr = first;
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return ENOMEM;
+    }
+
+    return ret;
+}
+
+int ibv_post_recv(struct ibv_qp *ibqp, struct ibv_recv_wr *wr,
+        struct ibv_recv_wr **bad_wr)
+{
+    struct verbs_qp* qp = (struct verbs_qp*) ibqp;
+    struct rdma_socket* s = verbs_qp_sock(qp);
+    uintptr_t addr;
+    uint32_t len;
+    int id;
+
+    for (; wr != NULL; wr = wr->next)
+    {
+        if (s == NULL || wr->num_sge != 1)
+        {
+            *bad_wr = wr;
+            return EINVAL;
+        }
+
+        addr = wr->sg_list[0].addr;
+        len = wr->sg_list[0].length;
+        if (addr < (uintptr_t) s->c.mr || len > s->c.mr_len ||
+                addr - (uintptr_t) s->c.mr > s->c.mr_len - len)
+        {
+            *bad_wr = wr;
+            return EINVAL;
+        }
+
+        id = rdma_tas_post_recv(qp->fd, len, addr - (uintptr_t) s->c.mr);
+        if (id < 0)
+        {
+            *bad_wr = wr;
+            return ENOMEM;
+        }
+        qp->recv_wr[id / sizeof(struct rdma_wqe)].wr_id = wr->wr_id;
+    }
+
+    return 0;
+}
+
+int verbs_qp_connect(struct rdma_cm_id* id)
+{
+    struct verbs_qp* qp = (struct verbs_qp*) id->qp;
+    int fd = id->send_cq_channel->fd;
+    struct rdma_socket* s;
+    uint32_t n;
+
+    if (qp == NULL || qp->fd == fd)
+        return 0;
+    if (qp->fd != 0 || fd < 1 || fd >= MAX_FD_NUM ||
+            (s = rdma_tas_fdmap[fd]) == NULL ||
+            s->type != RDMA_CONN_SOCKET || s->qp != NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 1. Work request ids of every queue entry
+    n = s->c.wq_size / sizeof(struct rdma_wqe);
+    qp->send_wr = calloc(n, sizeof(struct verbs_wr));
+    qp->recv_wr = calloc(n, sizeof(struct verbs_wr));
+    if (qp->send_wr == NULL || qp->recv_wr == NULL)
+        goto err;
+
+    // 2. Report completions to the thread's queue
+    if (verbs_scq == NULL && (verbs_scq = rdma_tas_scq_create()) == NULL)
+        goto err;
+    if (rdma_tas_scq_attach(verbs_scq, fd) != 0)
+        goto err;
+
+    qp->fd = fd;
+    qp->qp.qp_num = fd;
+    qp->qp.state = IBV_QPS_RTS;
+    s->qp = qp;
+    return 0;
+
+err:
+    free(qp->send_wr);
+    free(qp->recv_wr);
+    qp->send_wr = qp->recv_wr = NULL;
+    fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    return -1;
+}
+
+int rdma_create_qp(struct rdma_cm_id *id, struct ibv_pd *pd,
+        struct ibv_qp_init_attr *qp_init_attr)
+{
+    if (id->qp != NULL)
+        return rdma_seterrno(EINVAL);
+
+    struct verbs_qp* qp = calloc(1, sizeof(struct verbs_qp));
+    if (qp == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    qp->id = id;
+    qp->sq_sig_all = qp_init_attr->sq_sig_all;
+    qp->qp.context = id->verbs;
+    qp->qp.qp_context = qp_init_attr->qp_context;
+    qp->qp.pd = (pd != NULL ? pd : id->pd);
+    qp->qp.send_cq = qp_init_attr->send_cq;
+    qp->qp.recv_cq = qp_init_attr->recv_cq;
+    qp->qp.qp_type = qp_init_attr->qp_type;
+    qp->qp.state = IBV_QPS_INIT;
+    verbs_cq_ref(qp->qp.send_cq, 1);
+    verbs_cq_ref(qp->qp.recv_cq, 1);
+
+    // Limits of the TAS queues
+    qp_init_attr->cap.max_send_sge = RDMA_SGE_MAX;
+    qp_init_attr->cap.max_recv_sge = 1;
+    qp_init_attr->cap.max_inline_data = RDMA_INLINE_MAX;
+
+    id->qp = &qp->qp;
+    id->send_cq = qp->qp.send_cq;
+    id->recv_cq = qp->qp.recv_cq;
+    qp->next = verbs_qps;
+    verbs_qps = qp;
+
+    // Already connected
+    if (id->send_cq_channel->fd > 0 && verbs_qp_connect(id) != 0)
+    {
+        rdma_destroy_qp(id);
+        return -1;
+    }
+    return 0;
+}
+
+void rdma_destroy_qp(struct rdma_cm_id *id)
+{
+    struct verbs_qp *qp = (struct verbs_qp*) id->qp, **pprev;
+    struct rdma_socket* s;
+
+    if (qp == NULL)
+        return;
+
+    // Completions still in flight are dropped
+    if ((s = verbs_qp_sock(qp)) != NULL)
+    {
+        rdma_conn_scq_detach(&s->c);
+        s->qp = NULL;
+    }
+
+    for (pprev = &verbs_qps; *pprev != NULL; pprev = &(*pprev)->next)
+    {
+        if (*pprev == qp)
+        {
+            *pprev = qp->next;
+            break;
+        }
+    }
+
+    // The last queue pair releases the thread's queue, so that the thread
+    // context can be released as well
+    if (verbs_qps == NULL && verbs_scq != NULL &&
+            rdma_tas_scq_destroy(verbs_scq) == 0)
+        verbs_scq = NULL;
+
+    verbs_cq_ref(qp->qp.send_cq, -1);
+    verbs_cq_ref(qp->qp.recv_cq, -1);
+    id->qp = NULL;
+    id->send_cq = NULL;
+    id->recv_cq = NULL;
+    free(qp->send_wr);
+    free(qp->recv_wr);
+    free(qp);
+}
@@ -2030,6 +2030,48 @@ struct ibv_values_ex {
 	struct timespec raw_clock;
 };
 
+/*
+ * Verbs implemented on top of TAS, see lib/rdma/ibv_verbs.c. Memory must
+ * be part of a TAS memory region: the region of the connection or a shared
+ * region from rdma_tas_reg_mr(). Remote addresses are offsets into the
+ * memory region of the remote peer (IBV_ACCESS_ZERO_BASED semantics).
+ */
+struct ibv_pd *ibv_alloc_pd(struct ibv_context *context);
+int ibv_dealloc_pd(struct ibv_pd *pd);
+
+struct ibv_mr *ibv_reg_mr(struct ibv_pd *pd, void *addr, size_t length,
+			  int access);
+int ibv_dereg_mr(struct ibv_mr *mr);
+
+struct ibv_comp_channel *ibv_create_comp_channel(struct ibv_context *context);
+int ibv_destroy_comp_channel(struct ibv_comp_channel *channel);
+
+struct ibv_cq *ibv_create_cq(struct ibv_context *context, int cqe,
+			     void *cq_context,
+			     struct ibv_comp_channel *channel,
+			     int comp_vector);
+int ibv_destroy_cq(struct ibv_cq *cq);
+
+/*
+ * Completions of all QPs of the calling thread are collected by the CQ that
+ * is polled and sorted into the send and receive CQs of their QP.
+ */
+int ibv_poll_cq(struct ibv_cq *cq, int num_entries, struct ibv_wc *wc);
+int ibv_req_notify_cq(struct ibv_cq *cq, int solicited_only);
+int ibv_get_cq_event(struct ibv_comp_channel *channel,
+		     struct ibv_cq **cq, void **cq_context);
+void ibv_ack_cq_events(struct ibv_cq *cq, unsigned int nevents);
+
+/*
+ * Atomic operations pass their operands to TAS through the local buffer, so
+ * its SGE must hold RDMA_ATOMIC_LEN (16) bytes, the old value is returned in
+ * the first 8. Shorter SGEs are rejected with EINVAL.
+ */
+int ibv_post_send(struct ibv_qp *qp, struct ibv_send_wr *wr,
+		  struct ibv_send_wr **bad_wr);
+int ibv_post_recv(struct ibv_qp *qp, struct ibv_recv_wr *wr,
+		  struct ibv_recv_wr **bad_wr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -256,6 +256,38 @@ struct rdma_event_channel *rdma_create_event_channel(void);
  */
 void rdma_destroy_event_channel(struct rdma_event_channel *channel);
 
+/**
+ * rdma_get_cm_event - Retrieves the next pending communication event.
+ * @channel: Event channel to check for events.
+ * @event: Allocated information about the next communication event.
+ * Description:
+ *   Retrieves a communication event.  If no events are pending, by default,
+ *   the call will block until an event is received.
+ * Notes:
+ *   All events that are reported must be acknowledged by calling
+ *   rdma_ack_cm_event.  Connects and accepts of ids on a channel are
+ *   asynchronous, their completion is reported as
+ *   RDMA_CM_EVENT_ESTABLISHED, RDMA_CM_EVENT_CONNECT_ERROR or
+ *   RDMA_CM_EVENT_CONNECT_REQUEST.  The channel fd becomes readable when
+ *   the thread that created the channel may have events.
+ * See also:
+ *   rdma_ack_cm_event, rdma_create_event_channel, rdma_event_str
+ */
+int rdma_get_cm_event(struct rdma_event_channel *channel,
+		      struct rdma_cm_event **event);
+
+/**
+ * rdma_ack_cm_event - Free a communication event.
+ * @event: Event to be released.
+ * Description:
+ *   All events which are allocated by rdma_get_cm_event must be released,
+ *   there should be a one-to-one correspondence between successful gets
+ *   and acks.
+ * See also:
+ *   rdma_get_cm_event, rdma_destroy_id
+ */
+int rdma_ack_cm_event(struct rdma_cm_event *event);
+
 /**
  * rdma_create_id - Allocate a communication identifier.
  * @channel: The communication channel that events associated with the
@@ -714,37 +746,15 @@ rdma_post_recvv(struct rdma_cm_id *id, void *context, struct ibv_sge *sgl,
 
 /*
  * Simple send, receive, and RDMA calls.
+ *
+ * addr must be in the memory region of the connection (id->mr), remote_addr
+ * is an offset into the memory region of the remote peer. Without a QP the
+ * operation is posted directly and its op_id is stored in id->op_id.
  */
-/*
-static inline int
-rdma_post_recv(struct rdma_cm_id *id, void *context, void *addr,
-	       size_t length, struct ibv_mr *mr)
-{
-	struct ibv_sge sge;
-
-	assert((addr >= mr->addr) &&
-		(((uint8_t *) addr + length) <= ((uint8_t *) mr->addr + mr->length)));
-	sge.addr = (uint64_t) (uintptr_t) addr;
-	sge.length = (uint32_t) length;
-	sge.lkey = mr->lkey;
-
-	return rdma_post_recvv(id, context, &sge, 1);
-}
-
-static inline int
-rdma_post_send(struct rdma_cm_id *id, void *context, void *addr,
-	       size_t length, struct ibv_mr *mr, int flags)
-{
-	struct ibv_sge sge;
-
-	sge.addr = (uint64_t) (uintptr_t) addr;
-	sge.length = (uint32_t) length;
-	sge.lkey = mr ? mr->lkey : 0;
-
-	return rdma_post_sendv(id, context, &sge, 1, flags);
-}
-*/
-
+int rdma_post_recv(struct rdma_cm_id *id, void *context, void *addr,
+	       size_t length, struct ibv_mr *mr);
+int rdma_post_send(struct rdma_cm_id *id, void *context, void *addr,
+	       size_t length, struct ibv_mr *mr, int flags);
 int rdma_post_read(struct rdma_cm_id *id, void *context, void *addr,
 	       size_t length, struct ibv_mr *mr, int flags,
 	       uint64_t remote_addr, uint32_t rkey);
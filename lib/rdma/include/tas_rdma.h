@@ -12,9 +12,70 @@
  */
 enum rdma_op_type_e {
     RDMA_OP_READ,
-    RDMA_OP_WRITE
+    RDMA_OP_WRITE,
+    RDMA_OP_FETCH_ADD,
+    RDMA_OP_CMP_SWAP,
+    RDMA_OP_SEND,
+    RDMA_OP_RECV,
+    RDMA_OP_WRITE_IMM
 };
 
+/**
+ * Bytes of the local memory region used by an atomic operation: operands
+ * (add or compare value, then swap value) before, and the old value of the
+ * remote word in the first 8 bytes after completion.
+ */
+#define RDMA_ATOMIC_LEN 16
+
+/**
+ * Maximum payload of an inline operation. Each work queue entry has a slot of
+ * this size for inline payload, following the receive queue.
+ */
+#define RDMA_INLINE_MAX 64
+
+/** WQE flags: payload is in the inline slot of the entry, loff is unused */
+#define RDMA_WQE_INLINE 0x1
+
+/**
+ * WQE flags: receive completion, set on entries posted with
+ * rdma_tas_post_recv(). Tells a receive-side RDMA_OP_WRITE_IMM completion
+ * apart from the completion of a posted write with immediate.
+ */
+#define RDMA_WQE_RECV   0x2
+
+/**
+ * Local buffer of a scatter/gather list. A list of up to RDMA_SGE_MAX
+ * entries is stored in the inline slot of its work queue entry.
+ */
+struct rdma_sge {
+    uint64_t loff;  /**> Offset into local memory region */
+    uint32_t len;
+    uint32_t reserved;
+} __attribute__((packed));
+
+#define RDMA_SGE_MAX    (RDMA_INLINE_MAX / sizeof(struct rdma_sge))
+
+/**
+ * WQE flags: local side of a READ, WRITE, WRITE_IMM or SEND is the
+ * scatter/gather list in the inline slot of the entry, loff is unused.
+ * Unused list entries have len 0, len is the sum of all entries.
+ */
+#define RDMA_WQE_SGL    0x4
+
+/**
+ * Returned instead of an op_id when posting an operation while the remote
+ * peer does not accept more outstanding requests. The number of requests a
+ * peer accepts (its credits) is negotiated at connect time. Retry after
+ * polling completions, the connection is not affected.
+ */
+#define RDMA_TAS_NO_CREDITS (-2)
+
+/**
+ * Returned by asynchronous connect/accept calls while too many requests of
+ * the calling thread are in flight. Retry after rdma_tas_ctrl_poll().
+ */
+#define RDMA_TAS_CTRL_BUSY (-3)
+
 /**
  * Status of RDMA operation.
  * 
@@ -26,7 +87,10 @@ enum rdma_op_status_e {
     RDMA_TX_PENDING,
     RDMA_RESP_PENDING,
     RDMA_CONN_FAILURE,
-    RDMA_OUT_OF_BOUNDS
+    RDMA_OUT_OF_BOUNDS,
+    RDMA_UNALIGNED,
+    RDMA_NO_RECV,       /**> No receive buffer posted by the remote peer */
+    RDMA_UNSUPPORTED    /**> Operation not supported on this connection */
 };
 
 /**
@@ -37,23 +101,81 @@ struct rdma_wqe {
     uint8_t type;
     uint8_t status;
     uint16_t flags;
-    uint32_t loff;  /**> Local offset */
-    uint32_t roff;  /**> Remote offset */
     uint32_t len;
+    uint32_t imm;   /**> Immediate value of RDMA_OP_WRITE_IMM */
+    uint64_t loff;  /**> Local offset */
+    uint64_t roff;  /**> Remote offset */
 } __attribute__((packed));
 
+/**
+ * Completion event returned by a shared completion queue
+ */
+struct rdma_cq_event {
+    int fd;             /**> Connection the operation was posted on */
+    struct rdma_wqe wqe;    /**> Completed operation, wqe.id is the op_id */
+};
+
+/**
+ * Completion of an asynchronous connect or accept
+ */
+struct rdma_ctrl_event {
+    int fd;             /**> Returned by rdma_tas_connect/accept_async() */
+    int status;         /**> 0 if connected, the fd is released otherwise */
+    void* opaque;       /**> Passed to rdma_tas_connect/accept_async() */
+    void* mr_base;      /**> Memory region of the connection */
+    uint64_t mr_len;
+};
+
+/**
+ * Completion queue shared by several connections (opaque)
+ */
+struct rdma_tas_cq;
+
 /**
  * Initialize application library to communicate with TAS.
  * [1] Setup IPC mechanisms with TAS
  * [2] Reset the state
+ * [3] Create the TAS context of the calling thread
  * 
- * Application must ensure that this is first called before
+ * Application must ensure that this is first called once before
  * using any RDMA APIs
+ *
+ * Every thread gets its own TAS context. Connections are bound to the
+ * context of the thread that opened or accepted them, and data operations
+ * take no locks: a connection must only be used by one thread at a time,
+ * connections of different threads never contend. File descriptors are
+ * opaque handles of the library, not kernel file descriptors: they index a
+ * table shared by all threads of the process, so they are unique across
+ * threads, reused after rdma_tas_close(), and at most 65535 are open at a
+ * time.
  * 
  * @return SUCCESS/FAILURE
  */
 int rdma_tas_init(void);
 
+/**
+ * Create the TAS context of the calling thread. Optional, the context is
+ * otherwise created by the first connection or memory region request of
+ * the thread.
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_thread_init(void);
+
+/**
+ * Release the TAS context of the calling thread. Fails while connections,
+ * listeners or asynchronous requests of the thread are open. Shared
+ * completion queues of the thread must be destroyed before. The next
+ * request of the thread creates a new context.
+ *
+ * Contexts of exiting threads are released the same way, but stay
+ * allocated if still in use. TAS keeps the queues of a released context,
+ * so the number of contexts created by a process remains bounded.
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_thread_fini(void);
+
 /**
  * Listen to RDMA connections on a TCP port.
  * 
@@ -78,7 +200,7 @@ int rdma_tas_listen(const struct sockaddr_in* localaddr, int backlog);
  * 
  * @return File Descriptor on SUCCESS. -1 on FAILURE.
  */
-int rdma_tas_accept(int listenfd, struct sockaddr_in* remoteaddr, void **mr_base, uint32_t *mr_len);
+int rdma_tas_accept(int listenfd, struct sockaddr_in* remoteaddr, void **mr_base, uint64_t *mr_len);
 
 /**
  * Connect to a remote RDMA-capable server.
@@ -90,7 +212,215 @@ int rdma_tas_accept(int listenfd, struct sockaddr_in* remoteaddr, void **mr_base
  * 
  * @return File Descriptor on SUCCESS. -1 on FAILURE.
  */
-int rdma_tas_connect(const struct sockaddr_in* remoteaddr, void **mr_base, uint32_t *mr_len);
+int rdma_tas_connect(const struct sockaddr_in* remoteaddr, void **mr_base, uint64_t *mr_len);
+
+/**
+ * Start connecting to a remote RDMA-capable server without waiting for the
+ * connection to be established, see rdma_tas_connect_mr() for the
+ * parameters. Many connections can be opened in parallel this way.
+ *
+ * The fd can not be used for data operations before its completion is
+ * returned by rdma_tas_ctrl_poll() on the same thread.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param opaque        Returned with the completion
+ *
+ * @return File Descriptor on SUCCESS. RDMA_TAS_CTRL_BUSY or -1 on FAILURE.
+ */
+int rdma_tas_connect_async(const struct sockaddr_in* remoteaddr,
+        uint32_t rkey, uint64_t len, void* opaque);
+
+/**
+ * Start accepting an RDMA connection on a listen socket without waiting for
+ * a remote peer, see rdma_tas_accept_mr() for the parameters. Accepts can be
+ * posted ahead of incoming connections, they complete in the order peers
+ * connect.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param opaque        Returned with the completion
+ *
+ * @return File Descriptor on SUCCESS. RDMA_TAS_CTRL_BUSY or -1 on FAILURE.
+ */
+int rdma_tas_accept_async(int listenfd, uint32_t rkey, uint64_t len,
+        void* opaque);
+
+/**
+ * Fetch completions of asynchronous connects and accepts of the calling
+ * thread.
+ *
+ * NOTE: *Non-blocking*
+ *
+ * @param evs   Completion events
+ * @param num   Maximum number of events to read
+ * @return -1 on FAILURE, number of completion events on SUCCESS
+ */
+int rdma_tas_ctrl_poll(struct rdma_ctrl_event* evs, uint32_t num);
+
+/**
+ * File descriptor that becomes readable when the calling thread has
+ * completions for rdma_tas_ctrl_poll(), for use with poll()/epoll(). It is
+ * the same fd as rdma_tas_cq_fd() of connections of the thread.
+ *
+ * @return -1 on FAILURE, pollable file descriptor on SUCCESS
+ */
+int rdma_tas_ctrl_fd(void);
+
+/**
+ * Register a memory region that is shared by connections of this
+ * application. Memory use of the region is independent of the number of
+ * connections attached to it.
+ *
+ * NOTE: *Blocking*
+ *
+ * @param len       Size of the memory region
+ * @param mr_base   Set to the start of the memory region
+ * @param rkey      Set to the key used to attach connections to the region
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_reg_mr(uint64_t len, void **mr_base, uint32_t *rkey);
+
+/**
+ * Deregister a shared memory region. Connections already attached keep
+ * using the region until they are closed.
+ *
+ * @param rkey  Key returned by rdma_tas_reg_mr()
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_dereg_mr(uint32_t rkey);
+
+/**
+ * Accept a pending RDMA connection with a shared memory region or a private
+ * memory region of the requested size.
+ *
+ * @param listenfd      File descriptor returned on rdma_listen()
+ * @param remoteaddr    IPv4 address and TCP port number of remote peer
+ * @param rkey          Key returned by rdma_tas_reg_mr(), 0 for a private
+ *                      memory region
+ * @param len           Size of the private memory region, 0 for the TAS
+ *                      default (--rdma-mr-len)
+ *
+ * @return File Descriptor on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_accept_mr(int listenfd, struct sockaddr_in* remoteaddr,
+        uint32_t rkey, uint64_t len, void **mr_base, uint64_t *mr_len);
+
+/**
+ * Connect to a remote RDMA-capable server with a shared memory region or a
+ * private memory region of the requested size.
+ *
+ * @param remoteaddr    IPv4 address and TCP port number of remote server
+ * @param rkey          Key returned by rdma_tas_reg_mr(), 0 for a private
+ *                      memory region
+ * @param len           Size of the private memory region, 0 for the TAS
+ *                      default (--rdma-mr-len)
+ *
+ * @return File Descriptor on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_connect_mr(const struct sockaddr_in* remoteaddr, uint32_t rkey,
+        uint64_t len, void **mr_base, uint64_t *mr_len);
+
+/** Maximum number of sub-flows of a striped connection */
+#define RDMA_STRIPE_MAX 8
+
+/**
+ * Connect to a remote RDMA-capable server with a striped connection backed
+ * by num connections (sub-flows) to the same listener, which the server
+ * accepts with rdma_tas_accept_stripe(). Each sub-flow first sends a
+ * zero-length write with immediate (the hello) consuming one receive buffer
+ * of the server.
+ *
+ * READ and WRITE operations of at least 16 KiB use the sub-flows after the
+ * first one and are split over them in parts of at least 16 KiB. All other
+ * operations and posted receive buffers use the first sub-flow, so small
+ * operations do not wait behind bulk transfers. Operations on different
+ * sub-flows may execute in any order, except that a SEND or WRITE_IMM, and
+ * everything posted after it, is held until all earlier bulk operations
+ * completed, so the peer never sees it before their data. Held operations
+ * are submitted by rdma_tas_cq_poll() and rdma_tas_cq_wait(), which return
+ * completions in posting order. rdma_tas_post_burst(), rdma_tas_cq_peek(),
+ * rdma_tas_cq_advance(), rdma_tas_set_mr(), shared completion queues and
+ * connection groups work on single connections only and reject the fd.
+ * Close the striped connection with rdma_tas_close().
+ *
+ * NOTE: *Blocking*
+ *
+ * @param remoteaddr    IPv4 address and TCP port number of remote server
+ * @param rkey          Key returned by rdma_tas_reg_mr(), all sub-flows use
+ *                      this memory region
+ * @param num           Number of sub-flows, at most RDMA_STRIPE_MAX
+ * @param mr_base       Set to the start of the memory region
+ * @param mr_len        Set to the size of the memory region
+ *
+ * @return File Descriptor on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_connect_stripe(const struct sockaddr_in* remoteaddr,
+        uint32_t rkey, uint32_t num, void **mr_base, uint64_t *mr_len);
+
+/**
+ * Accept a striped connection opened with rdma_tas_connect_stripe().
+ *
+ * Every sub-flow starts with a hello naming its striped connection and its
+ * index, so several clients may connect at the same time. Sub-flows of
+ * other striped connections accepted in the meantime are kept for later
+ * calls on the listener, and accepted connections without a valid hello
+ * within a second are closed. The listener should only be used for striped
+ * connections with the same number of sub-flows.
+ *
+ * NOTE: *Blocking*
+ *
+ * @param listenfd      File descriptor returned on rdma_listen()
+ * @param remoteaddr    IPv4 address and TCP port number of remote peer
+ * @param rkey          Key returned by rdma_tas_reg_mr(), all sub-flows use
+ *                      this memory region
+ * @param num           Number of sub-flows the client opens
+ * @param mr_base       Set to the start of the memory region
+ * @param mr_len        Set to the size of the memory region
+ *
+ * @return File Descriptor on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_accept_stripe(int listenfd, struct sockaddr_in* remoteaddr,
+        uint32_t rkey, uint32_t num, void **mr_base, uint64_t *mr_len);
+
+/**
+ * Close a connection, or all sub-flows of a striped connection, and release
+ * the fd. Operations still outstanding are dropped without completion. A
+ * connection is detached from its shared completion queue, and must not be
+ * a member of a connection group.
+ *
+ * NOTE: *Blocking*
+ *
+ * @param fd        File Descriptor obtained on successful accept()/connect()
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_close(int fd);
+
+/**
+ * Replace the memory region of a connection, e.g. to grow it or to switch
+ * to a region registered after connecting.
+ *
+ * A new private region keeps the contents of a private region up to the
+ * smaller size. The previous region must not be used after this returns.
+ * Fails while operations are outstanding, including unacknowledged payload
+ * and operations of the peer in progress, and if the connection was active
+ * while the contents were copied. Not supported on striped connections.
+ *
+ * NOTE: *Blocking*
+ *
+ * @param fd        File Descriptor obtained on successful accept()/connect()
+ * @param rkey      Key returned by rdma_tas_reg_mr(), 0 for a private
+ *                  memory region
+ * @param len       Size of the private memory region, 0 for the TAS default
+ * @param mr_base   Set to the start of the new memory region
+ * @param mr_len    Set to the size of the new memory region
+ *
+ * @return 0 on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_set_mr(int fd, uint32_t rkey, uint64_t len, void **mr_base,
+        uint64_t *mr_len);
 
 /**
  * One-sided communication primitive to read data
@@ -111,7 +441,7 @@ int rdma_tas_connect(const struct sockaddr_in* remoteaddr, void **mr_base, uint3
  *         READ/WRITE calls on the same connection. It may be used to
  *         query the SUCCESS or FAILURE of an operation using completion queue.
  */
-int rdma_tas_read(int fd, uint32_t len, uint32_t loffset, uint32_t roffset);
+int rdma_tas_read(int fd, uint32_t len, uint64_t loffset, uint64_t roffset);
 
 /**
  * One-sided communication primitive to write data
@@ -132,7 +462,187 @@ int rdma_tas_read(int fd, uint32_t len, uint32_t loffset, uint32_t roffset);
  *         READ/WRITE calls on the same connection. It may be used to
  *         query the SUCCESS or FAILURE of an operation using completion queue.
  */
-int rdma_tas_write(int fd, uint32_t len, uint32_t loffset, uint32_t roffset);
+int rdma_tas_write(int fd, uint32_t len, uint64_t loffset, uint64_t roffset);
+
+/**
+ * Read from remote peer's memory like rdma_tas_read(), and scatter the data
+ * into up to RDMA_SGE_MAX local buffers in list order.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param sgl   Local buffers, each in the local memory region
+ * @param num   Number of entries in *sgl*, at most RDMA_SGE_MAX
+ * @param roffset Offset into remote memory region from where the data is read
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_read_sgl(int fd, const struct rdma_sge* sgl, uint32_t num,
+        uint64_t roffset);
+
+/**
+ * Write to remote peer's memory like rdma_tas_write(), with the data
+ * gathered from up to RDMA_SGE_MAX local buffers in list order. The remote
+ * side is one contiguous range and the write is one operation with a single
+ * completion.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param sgl   Local buffers, each in the local memory region
+ * @param num   Number of entries in *sgl*, at most RDMA_SGE_MAX
+ * @param roffset Offset into remote memory region to where the data is written
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_write_sgl(int fd, const struct rdma_sge* sgl, uint32_t num,
+        uint64_t roffset);
+
+/**
+ * Write up to RDMA_INLINE_MAX bytes to remote peer's memory without staging
+ * them in the local memory region. The data is copied to the work queue, so
+ * the buffer can be reused when this returns.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param data  Data to write
+ * @param len   Number of bytes to write, at most RDMA_INLINE_MAX
+ * @param roffset Offset into remote memory region to where the data is written
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_write_inline(int fd, const void* data, uint32_t len,
+        uint64_t roffset);
+
+/**
+ * Write data to remote peer's memory like rdma_tas_write(), and notify the
+ * remote peer once all data is placed. The notification consumes the next
+ * receive buffer posted by the remote peer with rdma_tas_post_recv(), and is
+ * reported as a receive completion with type RDMA_OP_WRITE_IMM, len set to
+ * the number of bytes written and imm set to the immediate value.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param len   Number of bytes to write
+ * @param loffset Offset into local memory region where the data is copied
+ * @param roffset Offset into remote memory region to where the data is written
+ * @param imm   Immediate value passed to the remote peer
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ *         The completion has status RDMA_NO_RECV if the remote peer had no
+ *         receive buffer posted (no data is written), and RDMA_UNSUPPORTED
+ *         if the remote peer does not support version 2 headers.
+ */
+int rdma_tas_write_imm(int fd, uint32_t len, uint64_t loffset,
+        uint64_t roffset, uint32_t imm);
+
+/**
+ * One-sided atomic add on an 8-byte aligned word in the remote peer's
+ * memory, executed by the remote fast path.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param loffset Offset of RDMA_ATOMIC_LEN bytes in local memory, the old
+ *                remote value is stored in the first 8 bytes on completion
+ * @param roffset Offset of the word in the remote memory region
+ * @param add   Value to add
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ *         The completion has status RDMA_UNALIGNED if roffset is not 8-byte
+ *         aligned.
+ */
+int rdma_tas_fetch_add(int fd, uint64_t loffset, uint64_t roffset,
+        uint64_t add);
+
+/**
+ * One-sided atomic compare and swap on an 8-byte aligned word in the remote
+ * peer's memory, executed by the remote fast path. The word is set to swap
+ * if it equals compare.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param loffset Offset of RDMA_ATOMIC_LEN bytes in local memory, the old
+ *                remote value is stored in the first 8 bytes on completion
+ * @param roffset Offset of the word in the remote memory region
+ * @param compare Expected value of the word
+ * @param swap  New value of the word
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ */
+int rdma_tas_cmp_swap(int fd, uint64_t loffset, uint64_t roffset,
+        uint64_t compare, uint64_t swap);
+
+/**
+ * Two-sided communication primitive to send a message to the next receive
+ * buffer posted by the remote peer with rdma_tas_post_recv().
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param len   Number of bytes to send
+ * @param loffset Offset into local memory region of the message
+ *
+ * @return Operation identifier (op_id) on SUCCESS. -1 on FAILURE.
+ *         The completion has status RDMA_NO_RECV if the remote peer had no
+ *         receive buffer posted, and RDMA_OUT_OF_BOUNDS if the message does
+ *         not fit into it.
+ */
+int rdma_tas_send(int fd, uint32_t len, uint64_t loffset);
+
+/**
+ * Post a buffer for a message sent by the remote peer with rdma_tas_send().
+ * Buffers are filled in the order they are posted.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param len   Size of the buffer
+ * @param loffset Offset of the buffer in the local memory region
+ *
+ * @return Receive identifier on SUCCESS. -1 on FAILURE, e.g. if the receive
+ *         queue is full.
+ */
+int rdma_tas_post_recv(int fd, uint32_t len, uint64_t loffset);
+
+/**
+ * Fetch receive completions. The completion has type RDMA_OP_RECV (or
+ * RDMA_OP_WRITE_IMM, see rdma_tas_write_imm()), id set to the receive
+ * identifier and len set to the length of the message.
+ *
+ * NOTE: *Non-blocking*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param compl_evs Reference to RDMA event descriptors.
+ * @param num   Maximum number of events to read
+ * @return -1 on FAILURE, number of receive completions on SUCCESS
+ */
+int rdma_tas_recv_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num);
+
+/**
+ * Post a batch of operations with a single fast path notification.
+ *
+ * Only type, loff, roff, len and imm of each entry in *ops* are used, types
+ * other than READ, WRITE, WRITE_IMM and SEND are invalid. Atomics are
+ * invalid as well, post them with rdma_tas_fetch_add() and
+ * rdma_tas_cmp_swap(), which place their operands in the local buffer.
+ * Posting stops at the first invalid entry, when the work queue is full or
+ * when the remote peer's credits are used up (see RDMA_TAS_NO_CREDITS), so
+ * a return value below *num* leaves the remaining entries unposted. Not
+ * supported on striped connections.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param ops   Operations to post
+ * @param num   Number of entries in *ops*
+ * @return Number of operations posted on SUCCESS. -1 on FAILURE.
+ *         Posted operations get consecutive op_ids in work queue order.
+ */
+int rdma_tas_post_burst(int fd, const struct rdma_wqe* ops, uint32_t num);
 
 /**
  * Fetch completion event with the status of a completed operation.
@@ -147,4 +657,191 @@ int rdma_tas_write(int fd, uint32_t len, uint32_t loffset, uint32_t roffset);
  */
 int rdma_tas_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num);
 
+/**
+ * Wait for completion events.
+ *
+ * Polls the completion queue for a while and then sleeps on the context
+ * event fd until the fast path reports a completion.
+ *
+ * NOTE: *Blocking*
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param compl_evs Reference to RDMA event descriptors.
+ * @param num   Maximum number of events to read
+ * @param timeout_ms Maximum time to wait, -1 to wait indefinitely
+ * @return -1 on FAILURE, number of completion events on SUCCESS (0 on
+ *          timeout). Completion events are copied to *compl_evs*.
+ */
+int rdma_tas_cq_wait(int fd, struct rdma_wqe* compl_evs, uint32_t num,
+        int timeout_ms);
+
+/**
+ * Request a notification on the fd returned by rdma_tas_cq_fd() for the next
+ * completion on this connection.
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @return -1 on FAILURE, 1 if completions are already available (the
+ *          notification may not fire), 0 if armed.
+ */
+int rdma_tas_cq_arm(int fd);
+
+/**
+ * File descriptor that becomes readable on notifications, for use with
+ * poll()/epoll(). The fd is shared by all connections of the context the
+ * connection is bound to. After it becomes
+ * readable, call rdma_tas_cq_wait() with a timeout of 0 to consume the
+ * notification.
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @return -1 on FAILURE, pollable file descriptor on SUCCESS
+ */
+int rdma_tas_cq_fd(int fd);
+
+/**
+ * Access completion events in place without copying them.
+ *
+ * The returned entries stay valid until released with rdma_tas_cq_advance().
+ * Not supported on striped connections, their completions are assembled
+ * from the sub-flows by rdma_tas_cq_poll().
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param compl_evs Set to the first unread completion event.
+ * @return -1 on FAILURE, number of contiguous completion events on SUCCESS
+ */
+int rdma_tas_cq_peek(int fd, struct rdma_wqe** compl_evs);
+
+/**
+ * Release completion events returned by rdma_tas_cq_peek().
+ *
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @param num   Number of completion events to release
+ * @return 0 on SUCCESS, -1 on FAILURE
+ */
+int rdma_tas_cq_advance(int fd, uint32_t num);
+
+/** Maximum number of members of a connection group */
+#define RDMA_GROUP_MAX  8
+
+/**
+ * Group of connections that receive the same writes, e.g. the replicas of
+ * a replication layer.
+ */
+struct rdma_tas_group;
+
+/**
+ * Create a connection group for rdma_tas_write_group().
+ *
+ * All members must use the same shared memory region and belong to the
+ * context of the same thread. Completions of the members are consumed by
+ * rdma_tas_group_poll(), so members should only be used for group writes.
+ *
+ * @param fds       File Descriptors obtained on successful accept()/connect()
+ * @param num       Number of members, at most RDMA_GROUP_MAX
+ * @param quorum    Members that must complete a write successfully before
+ *                  its completion is reported, num to wait for all
+ * @return Connection group on SUCCESS. NULL on FAILURE.
+ */
+struct rdma_tas_group* rdma_tas_group_create(const int* fds, uint32_t num,
+        uint32_t quorum);
+
+/**
+ * Write the same range of the local memory region to the same offset in the
+ * memory region of every member of a group.
+ *
+ * The payload is read from the memory region by the fast path for every
+ * member, it is not copied per member.
+ *
+ * NOTE: *Asynchronous*
+ *
+ * @param g     Connection group from rdma_tas_group_create()
+ * @param len   Number of bytes to write
+ * @param loffset Offset into local memory region from where the data is read
+ * @param roffset Offset into remote memory regions where the data is written
+ *
+ * @return Operation identifier of the group on SUCCESS, RDMA_TAS_NO_CREDITS
+ *         if a member does not accept more outstanding requests, -1 on
+ *         FAILURE.
+ */
+int rdma_tas_write_group(struct rdma_tas_group* g, uint32_t len,
+        uint64_t loffset, uint64_t roffset);
+
+/**
+ * Fetch completions of group writes in posting order. A write completes
+ * successfully once quorum members completed it successfully, and with the
+ * status of the first failure once the quorum can no longer be reached.
+ *
+ * NOTE: *Non-blocking*
+ *
+ * @param g     Connection group from rdma_tas_group_create()
+ * @param compl_evs Completion events, id is the group operation identifier
+ * @param num   Maximum number of events to read
+ * @return -1 on FAILURE, number of completion events on SUCCESS
+ */
+int rdma_tas_group_poll(struct rdma_tas_group* g, struct rdma_wqe* compl_evs,
+        uint32_t num);
+
+/**
+ * Destroy a connection group once all members completed all its writes.
+ * The members stay open.
+ *
+ * @param g     Connection group from rdma_tas_group_create()
+ * @return 0 on SUCCESS, -1 on FAILURE
+ */
+int rdma_tas_group_destroy(struct rdma_tas_group* g);
+
+/**
+ * Create a completion queue that can be shared by many connections. The
+ * queue belongs to the context of the calling thread.
+ *
+ * @return Completion queue on SUCCESS. NULL on FAILURE.
+ */
+struct rdma_tas_cq* rdma_tas_scq_create(void);
+
+/**
+ * Report completions of a connection on a shared completion queue.
+ *
+ * Completions of the connection are then returned by rdma_tas_scq_poll().
+ * A connection can be attached to only one shared completion queue, of the
+ * same context. Not supported on striped connections.
+ *
+ * @param cq    Completion queue from rdma_tas_scq_create()
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @return 0 on SUCCESS, -1 on FAILURE
+ */
+int rdma_tas_scq_attach(struct rdma_tas_cq* cq, int fd);
+
+/**
+ * Stop reporting completions of a connection on a shared completion queue.
+ * Completions not returned by rdma_tas_scq_poll() yet are then returned by
+ * rdma_tas_cq_poll() on the connection. Closing a connection detaches it.
+ *
+ * @param cq    Completion queue the connection is attached to
+ * @param fd    File Descriptor obtained on successful accept()/connect()
+ * @return 0 on SUCCESS, -1 on FAILURE
+ */
+int rdma_tas_scq_detach(struct rdma_tas_cq* cq, int fd);
+
+/**
+ * Fetch completion events of all connections attached to a shared
+ * completion queue, including receive completions (type RDMA_OP_RECV).
+ *
+ * NOTE: *Non-blocking*
+ *
+ * @param cq    Completion queue from rdma_tas_scq_create()
+ * @param evs   Completion events with the fd of their connection
+ * @param num   Maximum number of events to read
+ * @return -1 on FAILURE, number of completion events on SUCCESS
+ */
+int rdma_tas_scq_poll(struct rdma_tas_cq* cq, struct rdma_cq_event* evs,
+        uint32_t num);
+
+/**
+ * Destroy a shared completion queue without attached connections, see
+ * rdma_tas_scq_detach().
+ *
+ * @param cq    Completion queue from rdma_tas_scq_create()
+ * @return 0 on SUCCESS, -1 on FAILURE
+ */
+int rdma_tas_scq_destroy(struct rdma_tas_cq* cq);
+
 #endif /* FLEXTCP_RDMA_H_ */
@@ -2,12 +2,15 @@
 #define INTERNAL_H_
 
 #include "tas_ll.h"
+#include "tas_rdma.h"
 
 /* File descriptor related definitions */
 enum {
     RDMA_UNDEF_SOCKET,
     RDMA_LISTEN_SOCKET,
-    RDMA_CONN_SOCKET
+    RDMA_CONN_SOCKET,
+    RDMA_PENDING_SOCKET,    // Asynchronous connect/accept in flight
+    RDMA_STRIPE_SOCKET      // Striped over several connections
 };
 
 struct rdma_socket{
@@ -16,19 +19,115 @@ struct rdma_socket{
         struct flextcp_listener l;
     };
     uint8_t type;
+    int fd;
+    uint32_t cq_spin;   // Polls before rdma_tas_cq_wait() sleeps
+    struct flextcp_context* ctx;    // Context of the thread that opened it
+    void* opaque;           // Returned with the connect/accept completion
+    int ctrl_status;        // Status of the asynchronous connect/accept
+    struct rdma_socket* ctrl_next;  // Completions not yet reported
+    void* qp;               // Verbs queue pair, see ibv_verbs.c
+    struct rdma_stripe* stripe;     // Sub-flows, see multipath.c
+};
+
+/* TAS context of a thread, ctx must be the first member */
+struct rdma_tas_ctx {
+    struct flextcp_context ctx;
+    struct rdma_socket* done_head;  // Completed asynchronous connect/accept
+    struct rdma_socket* done_tail;
+    uint32_t ctrl_pending;          // Asynchronous connect/accept in flight
+};
+
+/* Memory region shared by connections */
+struct rdma_tas_mr {
+    struct flextcp_mr m;
+    struct rdma_tas_mr* next;
+};
+
+/* Shared completion queue */
+struct rdma_tas_cq {
+    struct flextcp_rdma_cq ll;
+    uint32_t num_conns;
+    struct flextcp_context* ctx;    // Context of all attached connections
 };
 
 #define MAX_FD_NUM  (1 << 16)   // TODO: Should be configurable
-extern struct rdma_socket* fdmap[MAX_FD_NUM];
 extern struct rdma_socket* rdma_tas_fdmap[MAX_FD_NUM];
 
-/* TAS Application Context */
-extern struct flextcp_context* appctx;
-extern struct flextcp_context* rdma_tas_appctx;
+/* Allocate an fd for a socket and publish it, -1 if none is left */
+int rdma_tas_sock_add(struct rdma_socket* s);
+
+/* Unpublish the socket of fd and release the fd */
+void rdma_tas_sock_del(int fd);
+
+/* Close a connection and release its fd, blocks until TAS released it */
+int rdma_conn_close(int fd);
+
+/* Context of the calling thread, created on first use */
+struct flextcp_context* rdma_tas_thread_ctx(void);
+
+/* Key of the shared memory region containing [addr, addr + len), 0 if it
+ * is in none */
+uint32_t rdma_tas_mr_key(const void* addr, uint64_t len);
+
+/* Add a work queue entry without notifying the fast path, see dataops.c */
+int rdma_conn_wqe_add(struct flextcp_connection* c, uint8_t type,
+        uint32_t len, uint64_t loffset, uint64_t roffset, uint32_t imm,
+        const void* inl, const struct rdma_sge* sgl);
+
+/* Request a wakeup on the next completion of a connection, 1 if
+ * completions are already available, see dataops.c */
+int rdma_conn_cq_arm(struct flextcp_connection* c);
+
+/* Detach a connection from its shared completion queue, if any, see
+ * dataops.c */
+void rdma_conn_scq_detach(struct flextcp_connection* c);
+
+/* Bind the queue pair of an id to its connection once the fd is known,
+ * see ibv_verbs.c */
+struct rdma_cm_id;
+int verbs_qp_connect(struct rdma_cm_id* id);
+
+/* Striped connection of fd, NULL if fd is none, see multipath.c */
+struct rdma_stripe* stripe_lookup(int fd);
+
+/* Sub-flow carrying all but bulk operations of a striped connection, fd
+ * itself if it is not striped */
+int stripe_ctrl_fd(int fd);
+
+/* Post an operation on a striped connection and bump its sub-flows */
+int stripe_post(struct rdma_stripe* st, uint8_t type, uint32_t len,
+        uint64_t loffset, uint64_t roffset, uint32_t imm, const void* inl,
+        const struct rdma_sge* sgl);
+
+/* Completions of a striped connection in posting order */
+int stripe_cq_poll(struct rdma_stripe* st, struct rdma_wqe* compl_evs,
+        uint32_t num);
+
+/* Request a wakeup on the next sub-flow completion, 1 if completions are
+ * already available */
+int stripe_cq_arm(struct rdma_stripe* st);
+
+/* Close the sub-flows of a striped connection and release its fd */
+int stripe_close(int fd);
 
 #define LISTEN_BACKLOG_MIN  8
 #define LISTEN_BACKLOG_MAX  1024
 
 #define CONTROL_TIMEOUT     10  // Block for 10ms
 
+#define CQ_SPIN_MIN         64
+#define CQ_SPIN_MAX         (64 * 1024)
+
+#define SCQ_POLL_BUDGET     64  // Fast path updates handled per scq poll
+#define CTRL_POLL_BUDGET    64  // Slow path events handled per ctrl poll
+#define ACCEPT_PREPOST      16  // Accepts posted by an rdma_listen() with
+                                // an event channel
+
+#define STRIPE_BULK_MIN     (16 * 1024)     // Smallest part of a split op
+#define STRIPE_POLL_BATCH   32  // Sub-flow completions fetched per poll
+#define STRIPE_HELLO_TRIES  100 // Hellos sent while the server has no
+                                // receive buffer posted
+#define STRIPE_HELLO_TIMEOUT 1000   // Wait for a hello for 1s
+#define GROUP_POLL_BATCH    32  // Member completions fetched per poll
+
 #endif /* INTERNAL_H_ */
@@ -0,0 +1,625 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "tas_ll.h"
+#include "tas_rdma.h"
+#include "utils.h"
+#include "utils_ring.h"
+#include "utils_timeout.h"
+#include "internal.h"
+
+/* NOTE: A striped connection is one logical connection backed by several
+ * connections (sub-flows) of the same context. Every operation takes a slot
+ * in the ops ring until all its parts completed and its completion was
+ * returned, so completions are reported in posting order. Slot indices are
+ * the operation ids of the striped connection.
+ *
+ * Bulk parts on other sub-flows may still be in flight when a later SEND or
+ * WRITE_IMM on the first sub-flow reaches the peer, which would then see
+ * the notification before the data. These operations and all operations
+ * posted after them are held in the ops ring until the earlier bulk parts
+ * completed, and are added to their sub-flows by stripe_cq_poll().
+ *
+ * Every sub-flow starts with a hello from the client, a zero-length
+ * WRITE_IMM whose immediate value carries the local port of the client's
+ * first sub-flow, the number of sub-flows and the index of the sub-flow.
+ * The port is unique for the client address while the striped connection
+ * is open, so the server groups sub-flows by remote address and port, and
+ * sub-flows of clients connecting concurrently do not mix.
+ */
+
+struct stripe_op {
+    struct rdma_wqe wqe;    // Completion returned to the application
+    uint32_t parts;         // Parts not completed yet
+    uint8_t bulk;           // Parts are on the bulk sub-flows
+    uint8_t data[RDMA_INLINE_MAX];  // Inline payload or SGL of a held op
+};
+
+/* Sub-flows accepted on a listener for a striped connection that is not
+ * complete yet */
+struct stripe_pending {
+    int listenfd;
+    uint32_t remote_ip;
+    uint16_t port;                      // Client port of the first sub-flow
+    uint32_t count;                     // Sub-flows accepted so far
+    int fds[RDMA_STRIPE_MAX];           // Indexed by sub-flow, 0 if missing
+    struct stripe_pending* next;
+};
+
+struct rdma_stripe {
+    uint32_t num;                       // Number of sub-flows
+    int fds[RDMA_STRIPE_MAX];           // Sub-flow connections
+    uint32_t* slots[RDMA_STRIPE_MAX];   // Ops slot of each sub-flow WQE
+    struct stripe_op* ops;
+    uint32_t ops_len;                   // Power of two
+    uint32_t ops_head;                  // Free-running slot counts
+    uint32_t ops_tail;
+    uint32_t ops_posted;                // Ops before are on sub-flows
+    uint32_t bulk_pending;              // Bulk ops not completed yet
+    uint32_t next;                      // Next bulk sub-flow
+};
+
+/* Incomplete striped connections of all listeners */
+static pthread_mutex_t stripe_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stripe_pending* stripe_pendings = NULL;
+
+static inline struct flextcp_connection* stripe_conn(struct rdma_stripe* st,
+        uint32_t i)
+{
+    return &rdma_tas_fdmap[st->fds[i]]->c;
+}
+
+static inline struct flextcp_context* stripe_ctx(struct rdma_stripe* st,
+        uint32_t i)
+{
+    return rdma_tas_fdmap[st->fds[i]]->ctx;
+}
+
+struct rdma_stripe* stripe_lookup(int fd)
+{
+    if (fd < 1 || fd >= MAX_FD_NUM)
+        return NULL;
+
+    struct rdma_socket* s = rdma_tas_fdmap[fd];
+    if (s == NULL || s->type != RDMA_STRIPE_SOCKET)
+        return NULL;
+
+    return s->stripe;
+}
+
+int stripe_ctrl_fd(int fd)
+{
+    struct rdma_stripe* st = stripe_lookup(fd);
+    return (st == NULL ? fd : st->fds[0]);
+}
+
+/* Parts of a bulk READ/WRITE, 0 if the operation uses the first sub-flow */
+static inline uint32_t stripe_parts(struct rdma_stripe* st, uint8_t type,
+        uint32_t len, const void* inl, const struct rdma_sge* sgl)
+{
+    if (st->num == 1 || (type != RDMA_OP_READ && type != RDMA_OP_WRITE) ||
+            inl != NULL || sgl != NULL || len < STRIPE_BULK_MIN)
+        return 0;
+
+    return MIN(st->num - 1, len / STRIPE_BULK_MIN);
+}
+
+/* SEND and WRITE_IMM tell the peer that earlier operations completed */
+static inline int stripe_fence(uint8_t type)
+{
+    return type == RDMA_OP_SEND || type == RDMA_OP_WRITE_IMM;
+}
+
+/* Add the parts of the operation in slot to their sub-flows and bump them.
+ * Returns 0, RDMA_TAS_NO_CREDITS or -1, nothing is added on failure. */
+static int stripe_submit(struct rdma_stripe* st, uint32_t slot,
+        const void* inl, const struct rdma_sge* sgl)
+{
+    struct stripe_op* op = &st->ops[slot];
+    struct flextcp_connection* c[RDMA_STRIPE_MAX];
+    uint32_t old_head[RDMA_STRIPE_MAX];
+    uint32_t flow[RDMA_STRIPE_MAX];
+    uint32_t i, n, parts, off, part_len, len = op->wqe.len;
+    int id;
+
+    // 1. Add the parts to their sub-flows without notifying the fast path
+    parts = stripe_parts(st, op->wqe.type, len, inl, sgl);
+    n = MAX(parts, 1);
+    off = 0;
+    for (i = 0; i < n; i++)
+    {
+        flow[i] = (parts == 0 ? 0 : 1 + (st->next + i) % (st->num - 1));
+        part_len = (parts == 0 ? len : len / n + (i < len % n ? 1 : 0));
+        c[i] = stripe_conn(st, flow[i]);
+        old_head[i] = c[i]->wq_head;
+
+        id = rdma_conn_wqe_add(c[i], op->wqe.type, part_len,
+                op->wqe.loff + off, op->wqe.roff + off, op->wqe.imm, inl,
+                sgl);
+        if (id < 0)
+        {
+            while (i-- > 0)
+                c[i]->wq_head = old_head[i];
+            return (id == RDMA_TAS_NO_CREDITS ? id : -1);
+        }
+
+        st->slots[flow[i]][id / sizeof(struct rdma_wqe)] = slot;
+        off += part_len;
+    }
+
+    // 2. Bump the sub-flows. Parts of a later failed bump stay queued and
+    //    are picked up with the next bump of their sub-flow.
+    if (rdma_conn_bump(stripe_ctx(st, flow[0]), c[0]) < 0)
+    {
+        for (i = 0; i < n; i++)
+            c[i]->wq_head = old_head[i];
+        return -1;
+    }
+    for (i = 1; i < n; i++)
+        rdma_conn_bump(stripe_ctx(st, flow[i]), c[i]);
+
+    if (parts != 0)
+    {
+        st->next = (st->next + n) % (st->num - 1);
+        st->bulk_pending++;
+    }
+    op->bulk = (parts != 0);
+    op->parts = n;
+    return 0;
+}
+
+/* Submit held operations once no earlier bulk part is in flight for them */
+static void stripe_release(struct rdma_stripe* st)
+{
+    struct stripe_op* op;
+    uint32_t slot;
+    int ret;
+
+    while (st->ops_posted != st->ops_head)
+    {
+        slot = ring_off(st->ops_len, st->ops_posted);
+        op = &st->ops[slot];
+        if (stripe_fence(op->wqe.type) && st->bulk_pending != 0)
+            break;
+
+        ret = stripe_submit(st, slot,
+                ((op->wqe.flags & RDMA_WQE_INLINE) != 0 ? op->data : NULL),
+                ((op->wqe.flags & RDMA_WQE_SGL) != 0 ?
+                    (const struct rdma_sge*) op->data : NULL));
+        // Validated when posted, so the peer is out of credits or the
+        // sub-flow queue is full: retry with the next poll
+        if (ret != 0)
+            break;
+
+        op->wqe.flags = 0;
+        st->ops_posted++;
+    }
+}
+
+/* Local side of an operation is in the memory region, see rdma_wqe_add() */
+static int stripe_valid(struct flextcp_connection* c, uint32_t len,
+        uint64_t loffset, const void* inl, const struct rdma_sge* sgl)
+{
+    uint64_t total = 0;
+    uint32_t i;
+
+    if (inl != NULL)
+        return len <= RDMA_INLINE_MAX;
+    if (sgl == NULL)
+        return len <= c->mr_len && loffset <= c->mr_len - len;
+
+    for (i = 0; i < RDMA_SGE_MAX; i++)
+    {
+        if (sgl[i].len > c->mr_len || sgl[i].loff > c->mr_len - sgl[i].len)
+            return 0;
+        total += sgl[i].len;
+    }
+    return total == len;
+}
+
+int stripe_post(struct rdma_stripe* st, uint8_t type, uint32_t len,
+        uint64_t loffset, uint64_t roffset, uint32_t imm, const void* inl,
+        const struct rdma_sge* sgl)
+{
+    struct stripe_op* op;
+    uint32_t slot;
+    int ret;
+
+    // 1. Acquire a slot, released once the completion is returned
+    if (ring_used(st->ops_head, st->ops_tail) == st->ops_len)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    slot = ring_off(st->ops_len, st->ops_head);
+
+    op = &st->ops[slot];
+    op->wqe.id = slot;
+    op->wqe.type = type;
+    op->wqe.status = RDMA_SUCCESS;
+    op->wqe.flags = 0;
+    op->wqe.loff = loffset;
+    op->wqe.roff = roffset;
+    op->wqe.len = len;
+    op->wqe.imm = imm;
+
+    // 2. Post right away unless earlier operations are held or this one
+    //    has to wait for bulk parts in flight
+    if (st->ops_posted == st->ops_head &&
+            !(stripe_fence(type) && st->bulk_pending != 0))
+    {
+        ret = stripe_submit(st, slot, inl, sgl);
+        if (ret == RDMA_TAS_NO_CREDITS)
+            return ret;
+        if (ret != 0)
+        {
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+        st->ops_posted++;
+        st->ops_head++;
+        return slot;
+    }
+
+    // 3. Otherwise hold the operation, validated now as it is submitted
+    //    later. All sub-flows share the memory region.
+    if (!stripe_valid(stripe_conn(st, 0), len, loffset, inl, sgl))
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    if (inl != NULL)
+    {
+        memcpy(op->data, inl, len);
+        op->wqe.flags = RDMA_WQE_INLINE;
+    }
+    else if (sgl != NULL)
+    {
+        memcpy(op->data, sgl, RDMA_INLINE_MAX);
+        op->wqe.flags = RDMA_WQE_SGL;
+    }
+    op->bulk = 0;
+    op->parts = 0;
+    st->ops_head++;
+    return slot;
+}
+
+int stripe_cq_poll(struct rdma_stripe* st, struct rdma_wqe* compl_evs,
+        uint32_t num)
+{
+    struct rdma_wqe evs[STRIPE_POLL_BATCH];
+    struct stripe_op* op;
+    uint32_t i;
+    int k, n;
+
+    // 1. Complete the parts reported by the sub-flows
+    for (i = 0; i < st->num; i++)
+    {
+        n = rdma_tas_cq_poll(st->fds[i], evs, STRIPE_POLL_BATCH);
+        if (n < 0)
+        {
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+
+        for (k = 0; k < n; k++)
+        {
+            op = &st->ops[st->slots[i][evs[k].id / sizeof(struct rdma_wqe)]];
+            // The first failed part fails the operation
+            if (op->wqe.status == RDMA_SUCCESS)
+                op->wqe.status = evs[k].status;
+            if (--op->parts == 0 && op->bulk)
+                st->bulk_pending--;
+        }
+    }
+
+    // 2. Submit held operations the completed bulk parts were blocking
+    stripe_release(st);
+
+    // 3. Return completed operations in posting order, held ones are not
+    //    complete
+    i = 0;
+    while (st->ops_tail != st->ops_head && i < num)
+    {
+        op = &st->ops[ring_off(st->ops_len, st->ops_tail)];
+        if (op->parts != 0 || st->ops_tail == st->ops_posted)
+            break;
+
+        memcpy(compl_evs + i, &op->wqe, sizeof(struct rdma_wqe));
+        st->ops_tail++;
+        i++;
+    }
+    return i;
+}
+
+int stripe_cq_arm(struct rdma_stripe* st)
+{
+    struct stripe_op* op = &st->ops[ring_off(st->ops_len, st->ops_tail)];
+    uint32_t i;
+    int ret = 0;
+
+    // Completed operations not returned yet
+    if (st->ops_tail != st->ops_posted && op->parts == 0)
+        return 1;
+
+    for (i = 0; i < st->num; i++)
+        if (rdma_conn_cq_arm(stripe_conn(st, i)) != 0)
+            ret = 1;
+    return ret;
+}
+
+/* Close the sub-flows of a striped connection, returns -1 if one failed */
+static int stripe_close_fds(const int* fds, uint32_t num)
+{
+    uint32_t i;
+    int ret = 0;
+
+    for (i = 0; i < num; i++)
+        if (rdma_conn_close(fds[i]) != 0)
+            ret = -1;
+    return ret;
+}
+
+static void stripe_free(struct rdma_stripe* st)
+{
+    uint32_t i;
+
+    for (i = 0; i < st->num; i++)
+        free(st->slots[i]);
+    free(st->ops);
+    free(st);
+}
+
+int stripe_close(int fd)
+{
+    struct rdma_stripe* st = stripe_lookup(fd);
+    struct rdma_socket* s;
+
+    if (st == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // Outstanding operations are dropped with their sub-flows
+    s = rdma_tas_fdmap[fd];
+    rdma_tas_sock_del(fd);
+    free(s);
+    if (stripe_close_fds(st->fds, st->num) != 0)
+    {
+        stripe_free(st);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    stripe_free(st);
+    return 0;
+}
+
+/* Group the connected sub-flows into a striped connection */
+static int stripe_create(const int* fds, uint32_t num)
+{
+    struct rdma_stripe* st = calloc(1, sizeof(struct rdma_stripe));
+    struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
+    uint32_t i, entries = 0;
+    int fd;
+
+    if (st == NULL || s == NULL)
+        goto err;
+
+    st->num = num;
+    for (i = 0; i < num; i++)
+    {
+        st->fds[i] = fds[i];
+        entries += stripe_conn(st, i)->wq_size / sizeof(struct rdma_wqe);
+        st->slots[i] = calloc(stripe_conn(st, i)->wq_size /
+                sizeof(struct rdma_wqe), sizeof(uint32_t));
+        if (st->slots[i] == NULL)
+            goto err;
+    }
+
+    // Every operation holds at least one sub-flow WQE until it completes
+    st->ops_len = 1;
+    while (st->ops_len < entries)
+        st->ops_len <<= 1;
+    st->ops = calloc(st->ops_len, sizeof(struct stripe_op));
+    if (st->ops == NULL)
+        goto err;
+
+    s->type = RDMA_STRIPE_SOCKET;
+    s->ctx = stripe_ctx(st, 0);
+    s->stripe = st;
+    if ((fd = rdma_tas_sock_add(s)) == -1)
+        goto err;
+
+    return fd;
+
+err:
+    if (st != NULL)
+        stripe_free(st);
+    free(s);
+    return -1;
+}
+
+static inline uint32_t stripe_hello(uint16_t port, uint32_t num, uint32_t idx)
+{
+    return ((uint32_t) port << 16) | (num << 8) | idx;
+}
+
+/* Send the hello of sub-flow idx. The server posts the receive buffer for
+ * it after accepting, so the hello is repeated while it finds none. */
+static int stripe_hello_send(int fd, uint16_t port, uint32_t num,
+        uint32_t idx)
+{
+    struct rdma_wqe ev;
+    uint32_t i;
+
+    for (i = 0; i < STRIPE_HELLO_TRIES; i++)
+    {
+        if (rdma_tas_write_imm(fd, 0, 0, 0, stripe_hello(port, num, idx)) < 0
+                || rdma_tas_cq_wait(fd, &ev, 1, STRIPE_HELLO_TIMEOUT) != 1)
+            return -1;
+
+        if (ev.status == RDMA_SUCCESS)
+            return 0;
+        if (ev.status != RDMA_NO_RECV)
+            return -1;
+        flextcp_block(rdma_tas_fdmap[fd]->ctx, CONTROL_TIMEOUT);
+    }
+    return -1;
+}
+
+/* Wait for the hello of an accepted sub-flow */
+static int stripe_hello_recv(int fd, uint32_t* hello)
+{
+    uint32_t start = util_timeout_time_us();
+    struct rdma_wqe ev;
+    int n;
+
+    if (rdma_tas_post_recv(fd, 0, 0) < 0)
+        return -1;
+
+    while ((n = rdma_tas_recv_poll(fd, &ev, 1)) == 0)
+    {
+        if ((util_timeout_time_us() - start) / 1000 >= STRIPE_HELLO_TIMEOUT)
+            return -1;
+        flextcp_block(rdma_tas_fdmap[fd]->ctx, CONTROL_TIMEOUT);
+    }
+    if (n < 0 || ev.type != RDMA_OP_WRITE_IMM || ev.len != 0)
+        return -1;
+
+    *hello = ev.imm;
+    return 0;
+}
+
+/* Add sub-flow fd with its hello to the striped connection it belongs to.
+ * Returns the connection once all num sub-flows are there, NULL otherwise.
+ * Sub-flows with an invalid hello are closed. */
+static struct stripe_pending* stripe_pending_add(int listenfd, int fd,
+        uint32_t hello, uint32_t num)
+{
+    uint32_t remote_ip = rdma_tas_fdmap[fd]->c.remote_ip;
+    uint16_t port = hello >> 16;
+    uint32_t idx = hello & 0xff;
+    struct stripe_pending *p, **pprev;
+
+    if (((hello >> 8) & 0xff) != num || idx >= num)
+    {
+        rdma_conn_close(fd);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&stripe_lock);
+    for (pprev = &stripe_pendings; (p = *pprev) != NULL; pprev = &p->next)
+        if (p->listenfd == listenfd && p->remote_ip == remote_ip &&
+                p->port == port)
+            break;
+
+    if (p == NULL && (p = calloc(1, sizeof(struct stripe_pending))) != NULL)
+    {
+        p->listenfd = listenfd;
+        p->remote_ip = remote_ip;
+        p->port = port;
+        p->next = stripe_pendings;
+        stripe_pendings = p;
+        pprev = &stripe_pendings;
+    }
+    if (p == NULL || p->fds[idx] != 0)
+    {
+        pthread_mutex_unlock(&stripe_lock);
+        rdma_conn_close(fd);
+        return NULL;
+    }
+
+    p->fds[idx] = fd;
+    if (++p->count == num)
+        *pprev = p->next;
+    else
+        p = NULL;
+    pthread_mutex_unlock(&stripe_lock);
+    return p;
+}
+
+int rdma_tas_connect_stripe(const struct sockaddr_in* remoteaddr,
+        uint32_t rkey, uint32_t num, void **mr_base, uint64_t *mr_len)
+{
+    int fds[RDMA_STRIPE_MAX];
+    uint32_t i;
+    int fd;
+
+    // 1. All sub-flows address the same shared memory region
+    if (num == 0 || num > RDMA_STRIPE_MAX || rkey == 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 2. Open the sub-flows one after the other, each starts with a hello
+    //    naming the striped connection by the port of the first one
+    for (i = 0; i < num; i++)
+    {
+        fds[i] = rdma_tas_connect_mr(remoteaddr, rkey, 0, mr_base, mr_len);
+        if (fds[i] == -1 || stripe_hello_send(fds[i],
+                    rdma_tas_fdmap[fds[0]]->c.local_port, num, i) != 0)
+        {
+            stripe_close_fds(fds, (fds[i] == -1 ? i : i + 1));
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+    }
+
+    if ((fd = stripe_create(fds, num)) == -1)
+    {
+        stripe_close_fds(fds, num);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    return fd;
+}
+
+int rdma_tas_accept_stripe(int listenfd, struct sockaddr_in* remoteaddr,
+        uint32_t rkey, uint32_t num, void **mr_base, uint64_t *mr_len)
+{
+    struct stripe_pending* p = NULL;
+    uint32_t hello;
+    int fd;
+
+    if (num == 0 || num > RDMA_STRIPE_MAX || rkey == 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    // 1. Accept sub-flows until one striped connection is complete, those
+    //    of other clients are kept for later calls
+    while (p == NULL)
+    {
+        fd = rdma_tas_accept_mr(listenfd, remoteaddr, rkey, 0, mr_base,
+                mr_len);
+        if (fd == -1)
+        {
+            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+            return -1;
+        }
+
+        // Peers that are not striped connections send no hello
+        if (stripe_hello_recv(fd, &hello) != 0)
+        {
+            rdma_conn_close(fd);
+            continue;
+        }
+        p = stripe_pending_add(listenfd, fd, hello, num);
+    }
+
+    // 2. Sub-flows are in the order of their index
+    if ((fd = stripe_create(p->fds, num)) == -1)
+    {
+        stripe_close_fds(p->fds, num);
+        free(p);
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+    free(p);
+    return fd;
+}
@@ -1,64 +1,239 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "tas_ll.h"
 #include "utils.h"
+#include "utils_ring.h"
 #include "internal.h"
 #include "include/rdma_verbs.h"
 
-struct rdma_socket* fdmap[MAX_FD_NUM];
-struct flextcp_context* appctx = NULL;
+/* Identifier with the state of asynchronous connection establishment */
+struct verbs_id {
+    struct rdma_cm_id id;   // Must be the first member
+    int listening;          // Accepts are posted, see rdma_listen()
+    uint32_t accepts_missing;   // Not posted again for lack of fds
+};
+
+/* Event channel with events not yet returned by rdma_get_cm_event() */
+struct verbs_channel {
+    struct rdma_event_channel ch;   // Must be the first member
+    struct verbs_event* head;
+    struct verbs_event* tail;
+};
+
+struct verbs_event {
+    struct rdma_cm_event ev;        // Must be the first member
+    struct verbs_event* next;
+};
+
+static pthread_once_t verbs_once = PTHREAD_ONCE_INIT;
+static int verbs_init_ret = -1;
+
+static void verbs_init_once(void)
+{
+    verbs_init_ret = rdma_tas_init();
+}
 
-static int init = 0;
-struct rdma_event_channel *rdma_create_event_channel(void)
+static int verbs_init(void)
 {
-    struct rdma_event_channel *ec;
-    ec = malloc(sizeof(struct rdma_event_channel));
-    ec->fd = -1; // We don't use event channel, just set it to -1
-    return ec;
+    pthread_once(&verbs_once, verbs_init_once);
+    return verbs_init_ret;
 }
-void rdma_destroy_event_channel(struct rdma_event_channel *channel)
+
+static int verbs_event_push(struct rdma_event_channel *channel,
+        struct rdma_cm_id *id, struct rdma_cm_id *listen_id,
+        enum rdma_cm_event_type type, int status)
 {
-    if (channel)
-        free(channel);
+    struct verbs_channel *vc = (struct verbs_channel *) channel;
+    struct verbs_event *ve = calloc(1, sizeof(struct verbs_event));
+    if (ve == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
+    }
+
+    ve->ev.id = id;
+    ve->ev.listen_id = listen_id;
+    ve->ev.event = type;
+    ve->ev.status = status;
+    if (vc->tail == NULL)
+        vc->head = ve;
+    else
+        vc->tail->next = ve;
+    vc->tail = ve;
+    return 0;
 }
 
-int rdma_create_id(struct rdma_event_channel *channel,
-                   struct rdma_cm_id **id, void *context,
-                   enum rdma_port_space ps)
+static int verbs_ctrl_poll(void);
+
+/* Post an accept on a listener. If too many requests are in flight and wait
+ * is set, completions are collected until one finishes. Otherwise, i.e. when
+ * posting again from verbs_ctrl_poll(), being busy fails the accept just as
+ * running out of fds does. */
+static int verbs_post_accept(struct rdma_cm_id *listen, int wait)
 {
-    if(!init){
-        // 1. Connect with TAS
-        if (flextcp_init() != 0)
+    int fd, ret;
+    while ((fd = rdma_tas_accept_async(listen->recv_cq_channel->fd, 0,
+                    listen->mr->length, listen)) == RDMA_TAS_CTRL_BUSY)
+    {
+        if (!wait || (ret = verbs_ctrl_poll()) < 0)
         {
             fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
             return -1;
         }
+        if (ret == 0)
+            flextcp_block(rdma_tas_thread_ctx(), CONTROL_TIMEOUT);
+    }
+    return (fd < 0 ? -1 : 0);
+}
+
+/* Post the accepts of a listener that could not be posted again after their
+ * requests completed, as far as fds are free by now */
+static void verbs_repost_accepts(struct rdma_cm_id *listen)
+{
+    struct verbs_id *vid = (struct verbs_id *) listen;
+    while (vid->accepts_missing > 0 && verbs_post_accept(listen, 0) == 0)
+        vid->accepts_missing--;
+}
+
+/* Turn completed connects and accepts into events on their channels */
+static int verbs_ctrl_poll(void)
+{
+    struct rdma_ctrl_event evs[CTRL_POLL_BUDGET];
+    struct rdma_cm_id *id, *listen;
+    int i, n;
 
-        // 2. Register app context with TAS
-        appctx = calloc(1, sizeof(struct flextcp_context));
-        if (appctx == NULL)
+    n = rdma_tas_ctrl_poll(evs, CTRL_POLL_BUDGET);
+    for (i = 0; i < n; i++)
+    {
+        id = evs[i].opaque;
+        if (((struct verbs_id *) id)->listening)
         {
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
+            // A peer connected, report it on a new id. Without a free fd
+            // the listener is short of an accept until one is released.
+            listen = id;
+            ((struct verbs_id *) listen)->accepts_missing++;
+            verbs_repost_accepts(listen);
+            if (evs[i].status != 0 ||
+                    rdma_create_id(listen->channel, &id, NULL,
+                        listen->ps) != 0)
+            {
+                fprintf(stderr, "[ERROR] %s():%u failed\n", __func__,
+                        __LINE__);
+                continue;
+            }
+            id->send_cq_channel->fd = evs[i].fd;
+            id->mr->addr = evs[i].mr_base;
+            id->mr->length = evs[i].mr_len;
+            if (verbs_event_push(listen->channel, id, listen,
+                        RDMA_CM_EVENT_CONNECT_REQUEST, 0) != 0)
+                return -1;
         }
-        if (flextcp_context_create(appctx) != 0)
+        else if (evs[i].status == 0)
+        {
+            id->send_cq_channel->fd = evs[i].fd;
+            id->mr->addr = evs[i].mr_base;
+            id->mr->length = evs[i].mr_len;
+            if (verbs_qp_connect(id) != 0 || verbs_event_push(id->channel, id, NULL,
+                        RDMA_CM_EVENT_ESTABLISHED, 0) != 0)
+                return -1;
+        }
+        else if (verbs_event_push(id->channel, id, NULL,
+                    RDMA_CM_EVENT_CONNECT_ERROR, evs[i].status) != 0)
+            return -1;
+    }
+    return n;
+}
+
+struct rdma_event_channel *rdma_create_event_channel(void)
+{
+    if (verbs_init() != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+    struct verbs_channel *vc = calloc(1, sizeof(struct verbs_channel));
+    if (vc == NULL)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return NULL;
+    }
+
+    // Readable when connects or accepts of the calling thread complete
+    vc->ch.fd = rdma_tas_ctrl_fd();
+    return &vc->ch;
+}
+
+void rdma_destroy_event_channel(struct rdma_event_channel *channel)
+{
+    struct verbs_channel *vc = (struct verbs_channel *) channel;
+    struct verbs_event *ve;
+
+    if (vc == NULL)
+        return;
+
+    while ((ve = vc->head) != NULL)
+    {
+        vc->head = ve->next;
+        free(ve);
+    }
+    free(vc);
+}
+
+int rdma_get_cm_event(struct rdma_event_channel *channel,
+        struct rdma_cm_event **event)
+{
+    struct verbs_channel *vc = (struct verbs_channel *) channel;
+    struct verbs_event *ve;
+
+    int ret;
+    while (vc->head == NULL)
+    {
+        ret = verbs_ctrl_poll();
+        if (ret < 0)
         {
             fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
             return -1;
         }
+        if (ret == 0)
+            flextcp_block(rdma_tas_thread_ctx(), CONTROL_TIMEOUT);
+    }
+
+    ve = vc->head;
+    vc->head = ve->next;
+    if (vc->head == NULL)
+        vc->tail = NULL;
+
+    *event = &ve->ev;
+    return 0;
+}
+
+int rdma_ack_cm_event(struct rdma_cm_event *event)
+{
+    free(event);
+    return 0;
+}
 
-        // 3. Initialize internal datastructures
-        memset(fdmap, 0, sizeof(fdmap));
-        init = 1;
+int rdma_create_id(struct rdma_event_channel *channel,
+                   struct rdma_cm_id **id, void *context,
+                   enum rdma_port_space ps)
+{
+    if (verbs_init() != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return -1;
     }
-    struct rdma_cm_id *id_priv = calloc(1, sizeof(struct rdma_cm_id));
-    if (id_priv == NULL)
+
+    struct verbs_id *vid = calloc(1, sizeof(struct verbs_id));
+    if (vid == NULL)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
+    struct rdma_cm_id *id_priv = &vid->id;
     id_priv->channel = channel;
     id_priv->context = context;
     id_priv->ps = ps;
@@ -76,27 +251,16 @@ int rdma_create_id(struct rdma_event_channel *channel,
 }
 int rdma_destroy_id(struct rdma_cm_id *id)
 {
-    rdma_destroy_event_channel(id->channel);
-
-    // It might need destrution fuction
-    if (id->verbs)
-        free(id->verbs);
-    if (id->qp)
-        free(id->qp);
-    if (id->recv_cq)
-        free(id->recv_cq);
+    // The event channel may be shared with other ids, protection domain
+    // and completion queues belong to the application
+    rdma_destroy_qp(id);
     if (id->recv_cq_channel)
         free(id->recv_cq_channel);
-    if (id->send_cq)
-        free(id->send_cq);
     if (id->send_cq_channel)
         free(id->send_cq_channel);
-    if (id->srq)
-        free(id->srq);
-    if (id->pd)
-        free(id->pd);
     if (id->mr)
         free(id->mr);
+    free(id);
     return 0;
 }
 
@@ -119,463 +283,317 @@ int rdma_resolve_addr(struct rdma_cm_id *id, struct sockaddr *src_addr,
 }
 
 int rdma_connect(struct rdma_cm_id *id, struct rdma_conn_param *conn_param){
-    return rdma_establish(id);
-}
-
-static int fd_alloc(void)
-{
-    int i;
-    // Skip 0 to avoid possible confusion
-    for (i = 1; i < MAX_FD_NUM; i++)
-        if (fdmap[i] == NULL)
-            break;
-
-    if (i == MAX_FD_NUM)
-        return -1;
-
-    return i;
-}
-
-int rdma_establish(struct rdma_cm_id *id){
 
-    // Call rdma_connect
     struct sockaddr_in *remoteaddr =  &id->route.addr.dst_sin;
-    
-    //int fd = rdma_tas_connect(remoteaddr,&id->mr->addr,(uint32_t*)&id->mr->length);
-    // add mr to rdma_cm_id, because rdma_tas_connect does the work of mem reg??
-    if (remoteaddr == NULL || remoteaddr->sin_family != AF_INET)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-
-    // 2. Allocate FD and Socket
-    int fd = fd_alloc();
-    if (fd == -1)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-    struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
-    if (s == NULL)
+    if (remoteaddr->sin_family != AF_INET)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 3. connect() IPC to TAS Slowpath
-    if (flextcp_connection_open(appctx, &s->c,
-        ntohl(remoteaddr->sin_addr.s_addr), ntohs(remoteaddr->sin_port)) != 0)
+    // 1. Without an event channel, block until connected. A preset mr
+    //    length is the requested size of the memory region.
+    if (id->channel == NULL)
     {
-        free(s);
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-
-    // 4. Block until TAS Slowpath processes the request
-    struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
-    {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(appctx, 1, &ev);
-        if (ret < 0)
+        int fd = rdma_tas_connect_mr(remoteaddr, 0, id->mr->length,
+                &id->mr->addr, &id->mr->length);
+        if (fd < 0)
         {
-            free(s);
             fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
             return -1;
         }
-
-        if (ret == 1)
-            break;
-
-        flextcp_block(appctx, CONTROL_TIMEOUT);
+        id->send_cq_channel->fd = fd;
+        return verbs_qp_connect(id);
     }
 
-    // 5. Check accept() status
-    if (ev.event_type != FLEXTCP_EV_CONN_OPEN ||
-        ev.ev.conn_open.conn != &s->c ||
-        ev.ev.conn_open.status != 0)
+    // 2. Otherwise RDMA_CM_EVENT_ESTABLISHED is reported on the channel,
+    //    completions are collected while too many connects are in flight
+    int fd;
+    while ((fd = rdma_tas_connect_async(remoteaddr, 0, id->mr->length,
+                    id)) == RDMA_TAS_CTRL_BUSY)
+    {
+        if (verbs_ctrl_poll() < 0)
+            return -1;
+    }
+    if (fd < 0)
     {
-        free(s);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 6. Store rdma_socket in fdmap
-    s->type = RDMA_CONN_SOCKET;
-    fdmap[fd] = s;
+    return 0;
+}
 
-    // 7. Update return parameters
-    id->mr->addr = s->c.mr;
-    id->mr->length = s->c.mr_len;
+int rdma_establish(struct rdma_cm_id *id){
+
+    // TAS completes the connection before reporting it, nothing left to do
+    if (id->send_cq_channel->fd < 1)
+        return rdma_seterrno(EINVAL);
 
-    // after we got fd from connect/accept, store it to id->send_cq_channel->fd
-    if(fd < 0){
-        return -1;
-    }
-    id->send_cq_channel->fd = fd;
     return 0;
-    
 }
 
 int rdma_listen(struct rdma_cm_id *id, int backlog){
 
     // Call rdma_listen here
     struct sockaddr_in *localaddr = &id->route.addr.src_sin;
-    //int lfd = rdma_tas_listen(localaddr, backlog);
-    //rdma_tas_listen(const struct sockaddr_in* localaddr, int backlog)
-    if (localaddr == NULL || localaddr->sin_family != AF_INET)
+    int fd = rdma_tas_listen(localaddr, backlog);
+    if (fd < 0)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 2. Allocate FD and Socket
-    int fd = fd_alloc();
-    if (fd == -1)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-    struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
-    if (s == NULL)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-
-    // 3. Set backlog to a valid range
-    if (backlog < LISTEN_BACKLOG_MIN)
-        backlog = LISTEN_BACKLOG_MIN;
-    if (backlog > LISTEN_BACKLOG_MAX)
-        backlog = LISTEN_BACKLOG_MAX;
-
-    // 4. listen() IPC to TAS Slowpath
-    if (flextcp_listen_open(appctx, &s->l,
-            ntohs(localaddr->sin_port), backlog, 0) != 0)
-    {
-        free(s);
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
+    // after we got fd from listen, store it to id->recv_cq_channel->fd
+    id->recv_cq_channel->fd = fd;
 
-    // 5. Block until TAS Slowpath processes the request
-    struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
+    // With an event channel, connecting peers are reported as
+    // RDMA_CM_EVENT_CONNECT_REQUEST on accepts posted ahead of time
+    if (id->channel != NULL)
     {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(appctx, 1, &ev);
-        if (ret < 0)
+        ((struct verbs_id *) id)->listening = 1;
+        for (int i = 0; i < ACCEPT_PREPOST; i++)
         {
-            free(s);
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
+            if (verbs_post_accept(id, 1) != 0)
+            {
+                fprintf(stderr, "[ERROR] %s():%u failed\n", __func__,
+                        __LINE__);
+                return -1;
+            }
         }
+    }
 
-        if (ret == 1)
-            break;
+    return 0;
+}
 
-        flextcp_block(appctx, CONTROL_TIMEOUT);
-    }
+int rdma_accept(struct rdma_cm_id *id, struct rdma_conn_param *conn_param){
 
-    // 6. Check listen() status
-    if (ev.event_type != FLEXTCP_EV_LISTEN_OPEN ||
-        ev.ev.listen_open.listener != &s->l ||
-        ev.ev.listen_open.status != 0)
+    // The connection is already established in TAS
+    if (id->send_cq_channel->fd < 1)
     {
-        free(s);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 7. Store rdma_socket in fdmap
-    s->type = RDMA_LISTEN_SOCKET;
-    fdmap[fd] = s;
-
-    // after we got fd from listen, store it to id->recv_cq_channel->fd
-     if(fd){
-        id->recv_cq_channel->fd = fd;
-        return 0;
-    }
-    else return -1;
-
+    if (id->channel != NULL)
+        return verbs_event_push(id->channel, id, NULL,
+                RDMA_CM_EVENT_ESTABLISHED, 0);
+    return 0;
 }
 
-int rdma_accept(struct rdma_cm_id *id, struct rdma_conn_param *conn_param){
+/* Take the next connect request of a listener from its channel */
+static struct rdma_cm_id *verbs_request_pop(struct rdma_cm_id *listen)
+{
+    struct verbs_channel *vc = (struct verbs_channel *) listen->channel;
+    struct verbs_event *ve, *prev = NULL;
+    struct rdma_cm_id *id;
 
-    // Do nothing here
-    return 0;
+    for (ve = vc->head; ve != NULL; prev = ve, ve = ve->next)
+        if (ve->ev.event == RDMA_CM_EVENT_CONNECT_REQUEST &&
+                ve->ev.listen_id == listen)
+            break;
+
+    if (ve == NULL)
+        return NULL;
+
+    if (prev == NULL)
+        vc->head = ve->next;
+    else
+        prev->next = ve->next;
+    if (vc->tail == ve)
+        vc->tail = prev;
+    id = ve->ev.id;
+    free(ve);
+    return id;
 }
 
 int rdma_get_request (struct rdma_cm_id *listen, struct rdma_cm_id **id){
-    // Call rdma_accept here
-    if (*id == NULL){
-        struct rdma_event_channel * ec = rdma_create_event_channel();
-        rdma_create_id(ec, id, NULL, listen->ps);
-    }
-    //int fd =  rdma_tas_accept(listen->recv_cq_channel->fd, &(*id)->route.addr.dst_sin , &(*id)->mr->addr, (uint32_t *)&(*id)->mr->length);
-    //rdma_tas_accept(int listenfd, struct sockaddr_in* remoteaddr,
-	//	void **mr_base, uint32_t *mr_len)
-    if (listen->recv_cq_channel->fd < 1 || listen->recv_cq_channel->fd >= MAX_FD_NUM)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-    struct rdma_socket* ls = fdmap[listen->recv_cq_channel->fd];
 
-    // 2. Allocate FD and Socket
-    int fd = fd_alloc();
-    if (fd == -1)
+    // 1. Listener with an event channel: wait for a connect request
+    if (((struct verbs_id *) listen)->listening)
     {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
+        struct rdma_cm_id *req;
+        int ret;
+        verbs_repost_accepts(listen);
+        while ((req = verbs_request_pop(listen)) == NULL)
+        {
+            ret = verbs_ctrl_poll();
+            if (ret < 0)
+            {
+                fprintf(stderr, "[ERROR] %s():%u failed\n", __func__,
+                        __LINE__);
+                return -1;
+            }
+            if (ret == 0)
+                flextcp_block(rdma_tas_thread_ctx(), CONTROL_TIMEOUT);
+        }
+        if (*id != NULL)
+            rdma_destroy_id(*id);
+        *id = req;
+        return 0;
     }
-    struct rdma_socket* s = calloc(1, sizeof(struct rdma_socket));
-    if (s == NULL)
+
+    // 2. Otherwise accept synchronously, with the memory region size
+    //    preset on the new id or inherited from the listener
+    if (*id == NULL && rdma_create_id(NULL, id, NULL, listen->ps) != 0)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 3. accept() IPC to TAS Slowpath
-    if (flextcp_listen_accept(appctx, &ls->l, &s->c) != 0)
+    uint64_t mr_len = (*id)->mr->length;
+    if (mr_len == 0)
+        mr_len = listen->mr->length;
+    int fd = rdma_tas_accept_mr(listen->recv_cq_channel->fd,
+            &(*id)->route.addr.dst_sin, 0, mr_len, &(*id)->mr->addr,
+            &(*id)->mr->length);
+    if (fd < 0)
     {
-        free(s);
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
 
-    // 4. Block until TAS Slowpath processes the request
-    struct flextcp_event ev;
-    int ret;
-    memset(&ev, 0, sizeof(struct flextcp_event));
-    while (1)
-    {
-	// TODO: Only poll the kernel
-        ret = flextcp_context_poll(appctx, 1, &ev);
-        if (ret < 0)
-        {
-            free(s);
-            fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-            return -1;
-        }
-
-        if (ret == 1)
-            break;
-
-        flextcp_block(appctx, CONTROL_TIMEOUT);
-    }
+    // after we got fd from connect/accept, store it to id->send_cq_channel->fd
+    (*id)->send_cq_channel->fd = fd;
+    return verbs_qp_connect(*id);
+}
 
-    // 5. Check accept() status
-    if (ev.event_type != FLEXTCP_EV_LISTEN_ACCEPT ||
-        ev.ev.listen_accept.conn != &s->c ||
-        ev.ev.listen_accept.status != 0)
-    {
-        free(s);
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
+/* Connection socket of an id */
+static struct rdma_socket* verbs_sock_lookup(struct rdma_cm_id *id)
+{
+    int fd = id->send_cq_channel->fd;
+    if (fd < 1 || fd >= MAX_FD_NUM)
+        return NULL;
 
-    // 6. Store socket in fdmap
-    s->type = RDMA_CONN_SOCKET;
-    fdmap[fd] = s;
+    struct rdma_socket* s = rdma_tas_fdmap[fd];
+    if (s == NULL || s->type != RDMA_CONN_SOCKET)
+        return NULL;
 
-    // 7. Update return parameters
-    (*id)->mr->addr = s->c.mr;
-    (*id)->mr->length = s->c.mr_len;
-    // after we got fd from connect/accept, store it to id->send_cq_channel->fd
-    if(fd){
-        (*id)->send_cq_channel->fd = fd;
-        return 0;
-    }
-    else return -1;    
+    return s;
 }
 
-int rdma_post_write(struct rdma_cm_id *id, void *context, void *addr,
-		size_t length, struct ibv_mr *mr, int flags,
-		uint64_t remote_addr, uint32_t rkey)
+/* Post a single-buffer operation on the queue pair of an id */
+static int verbs_post_one(struct rdma_cm_id *id, void *context, void *addr,
+        size_t length, struct ibv_mr *mr, int flags,
+        enum ibv_wr_opcode opcode, uint64_t remote_addr, uint32_t rkey)
 {
-    /* ignore flags, rkey
-       ignore mr because mr is now put into id
-       from doc: addr - The local address of the source of the write request. But let it hold loffset here
-       from doc: remote_addr - The address of the remote registered memory to write into.
-       But remote mem is always registered to the config value, so let remote_addr here hold roffset
-    */
-
-    if(length > id->mr->length){
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;        
-    }
+    struct ibv_send_wr wr, *bad;
+    struct ibv_sge sge;
+
+    sge.addr = (uint64_t) (uintptr_t) addr;
+    sge.length = (uint32_t) length;
+    sge.lkey = mr ? mr->lkey : 0;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = (uintptr_t) context;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.opcode = opcode;
+    wr.send_flags = flags;
+    wr.wr.rdma.remote_addr = remote_addr;
+    wr.wr.rdma.rkey = rkey;
+
+    return rdma_seterrno(ibv_post_send(id->qp, &wr, &bad));
+}
 
-    //int ret = rdma_write(id->send_cq_channel->fd, length, *addr, remote_addr);
-    uint32_t loffset = *(char *)addr;
-    // 1. Find listener socket
-    if (id->send_cq_channel->fd < 1 || id->send_cq_channel->fd >= MAX_FD_NUM)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-    struct rdma_socket* s = fdmap[id->send_cq_channel->fd];
-    if (s->type != RDMA_CONN_SOCKET)
+/* Without a queue pair, post directly and keep the op_id in the id */
+static int verbs_post_direct(struct rdma_cm_id *id, void *addr,
+        size_t length, uint8_t type, uint64_t remote_addr)
+{
+    struct rdma_socket* s = verbs_sock_lookup(id);
+    if (s == NULL || (uintptr_t) addr < (uintptr_t) s->c.mr ||
+            length > UINT32_MAX)
     {
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
         return -1;
     }
-    struct flextcp_connection* c = &s->c;
 
-    // 2. Validate address in memory region
-    if (((uint64_t) loffset + length) > c->mr_len)
+    uint64_t loffset = (uintptr_t) addr - (uintptr_t) s->c.mr;
+    int op_id;
+    switch (type)
     {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-
-    // 3. Acquire Work Queue Entry
-    // NOTE: c->wq_len must be a multiple of sizeof(struct rdma_wqe)
-    if (c->wq_len + c->cq_len == c->wq_size){
-        // Queue full!
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
+        case RDMA_OP_READ:
+            op_id = rdma_tas_read(s->fd, length, loffset, remote_addr);
+            break;
+        case RDMA_OP_WRITE:
+            op_id = rdma_tas_write(s->fd, length, loffset, remote_addr);
+            break;
+        default:
+            op_id = rdma_tas_send(s->fd, length, loffset);
+            break;
     }
-
-	uint32_t wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
-    struct rdma_wqe* wqe_pos = (struct rdma_wqe*)(c->wq_base + wq_head);
-
-    // 4. Fill entries of Work Queue
-    int32_t wid;
-    wid = wqe_pos->id = (c->wq_tail + c->wq_len) % c->wq_size;
-    wqe_pos->type = RDMA_OP_WRITE;
-    wqe_pos->status = RDMA_PENDING;
-    wqe_pos->loff = loffset;
-    wqe_pos->roff = remote_addr;
-    wqe_pos->len = length;
-
-    // 5. Increment Queue length
-	uint32_t old_len = c->wq_len;
-    MEM_BARRIER();
-	c->wq_len += sizeof(struct rdma_wqe);
-
-    // TODO: Handle the case where bump queue is full
-    // 6. Bump the fast path
-    if (rdma_conn_bump(appctx, c) < 0) {
-        // Undo the length increment (effectively revert adding wqe)
-		c->wq_len = old_len;
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+    if (op_id < 0)
         return -1;
-    }
 
-    id->op_id = wid;
+    id->op_id = op_id;
     return 0;
+}
+
+int rdma_post_write(struct rdma_cm_id *id, void *context, void *addr,
+		size_t length, struct ibv_mr *mr, int flags,
+		uint64_t remote_addr, uint32_t rkey)
+{
+    if (id->qp == NULL)
+        return verbs_post_direct(id, addr, length, RDMA_OP_WRITE,
+                remote_addr);
 
+    return verbs_post_one(id, context, addr, length, mr, flags,
+            IBV_WR_RDMA_WRITE, remote_addr, rkey);
 }
+
 int rdma_post_read(struct rdma_cm_id *id, void *context, void *addr,
 	       size_t length, struct ibv_mr *mr, int flags,
 	       uint64_t remote_addr, uint32_t rkey)
 {
-    // similarly with write
-    // fd we use id->send_cq_channel->fd
-
-    //int ret = rdma_read(id->send_cq_channel->fd, length, *addr, remote_addr);
-    uint32_t loffset = *(char *)addr;
-    // 1. Find listener socket
-    if (id->send_cq_channel->fd < 1 || id->send_cq_channel->fd >= MAX_FD_NUM)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-    struct rdma_socket* s = fdmap[id->send_cq_channel->fd];
-    if (s->type != RDMA_CONN_SOCKET)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-    struct flextcp_connection* c = &s->c;
+    if (id->qp == NULL)
+        return verbs_post_direct(id, addr, length, RDMA_OP_READ,
+                remote_addr);
 
-    // 2. Validate address in memory region
-    if (((uint64_t) loffset + length) > c->mr_len)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
+    return verbs_post_one(id, context, addr, length, mr, flags,
+            IBV_WR_RDMA_READ, remote_addr, rkey);
+}
 
-    // 3. Acquire Work Queue Entry
-	  // NOTE: c->wq_len must be a multiple of sizeof(struct rdma_wqe)
-    if (c->wq_len + c->cq_len == c->wq_size){
-        // Queue full!
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-	uint32_t wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
-    struct rdma_wqe* wqe_pos = (struct rdma_wqe*)(c->wq_base + wq_head);
-
-    // 4. Fill entries of Work Queue
-    int32_t wid;
-    wid = wqe_pos->id = (c->wq_tail + c->wq_len) % c->wq_size;
-    wqe_pos->type = RDMA_OP_READ;
-    wqe_pos->status = RDMA_PENDING;
-    wqe_pos->loff = loffset;
-    wqe_pos->roff = remote_addr;
-    wqe_pos->len = length;
-
-    // 5. Increment Queue length
-	uint32_t old_len = c->wq_len;
-    MEM_BARRIER();
-	c->wq_len += sizeof(struct rdma_wqe);
-
-    // TODO: Handle the case where bump queue is full
-    // 6. Bump the fast path
-    if (rdma_conn_bump(appctx, c) < 0) {
-        // Undo the length increment (effectively revert adding wqe)
-		c->wq_len = old_len;
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
+int rdma_post_send(struct rdma_cm_id *id, void *context, void *addr,
+	       size_t length, struct ibv_mr *mr, int flags)
+{
+    if (id->qp == NULL)
+        return verbs_post_direct(id, addr, length, RDMA_OP_SEND, 0);
 
-    id->op_id = wid;
-    return 0;
+    return verbs_post_one(id, context, addr, length, mr, flags,
+            IBV_WR_SEND, 0, 0);
 }
 
-int rdma_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num){
-    int ret;
-    if (fd < 1 || fd >= MAX_FD_NUM)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-    struct rdma_socket* s = fdmap[fd];
-    if (s->type != RDMA_CONN_SOCKET)
-    {
-        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
-        return -1;
-    }
-    struct flextcp_connection* c = &s->c;
-    if (c->cq_len < num * sizeof(struct rdma_wqe))
+int rdma_post_recv(struct rdma_cm_id *id, void *context, void *addr,
+	       size_t length, struct ibv_mr *mr)
+{
+    if (id->qp == NULL)
     {
-        ret = rdma_fastpath_poll(appctx, c, num * sizeof(struct rdma_wqe));
-        if (ret < 0){
+        struct rdma_socket* s = verbs_sock_lookup(id);
+        if (s == NULL || (uintptr_t) addr < (uintptr_t) s->c.mr ||
+                length > UINT32_MAX)
+        {
             fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
             return -1;
         }
+        return (rdma_tas_post_recv(s->fd, length,
+                    (uintptr_t) addr - (uintptr_t) s->c.mr) < 0 ? -1 : 0);
     }
 
-    int i = 0;
-    struct rdma_wqe* wqe;
-    struct rdma_wqe* ev;
-    while(c->cq_len > 0 && i < num){
-        wqe = (struct rdma_wqe*)(c->wq_base + c->cq_tail);
-        ev = compl_evs + i;
+    struct ibv_recv_wr wr, *bad;
+    struct ibv_sge sge;
 
-        // Copy the wqe data
-        memcpy(ev, wqe, sizeof(struct rdma_wqe));
+    sge.addr = (uint64_t) (uintptr_t) addr;
+    sge.length = (uint32_t) length;
+    sge.lkey = mr ? mr->lkey : 0;
 
-        // Update queue pointers and length
-        c->cq_tail = (c->cq_tail + sizeof(struct rdma_wqe)) % c->wq_size;
-        c->cq_len -= sizeof(struct rdma_wqe);
-        i += 1;
-    }
-    return i;
+    wr.wr_id = (uintptr_t) context;
+    wr.next = NULL;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+
+    return rdma_seterrno(ibv_post_recv(id->qp, &wr, &bad));
+}
+
+int rdma_cq_poll(int fd, struct rdma_wqe* compl_evs, uint32_t num){
+    return rdma_tas_cq_poll(fd, compl_evs, num);
 }
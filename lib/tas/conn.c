@@ -88,6 +88,13 @@ int flextcp_listen_open(struct flextcp_context *ctx,
 
 int flextcp_listen_accept(struct flextcp_context *ctx,
     struct flextcp_listener *lst, struct flextcp_connection *conn)
+{
+  return flextcp_listen_accept_mr(ctx, lst, conn, 0, 0);
+}
+
+int flextcp_listen_accept_mr(struct flextcp_context *ctx,
+    struct flextcp_listener *lst, struct flextcp_connection *conn,
+    uint32_t mr_key, uint64_t mr_len)
 {
   uint32_t pos = ctx->kin_head;
   struct kernel_appout *kin = ctx->kin_base;
@@ -107,6 +114,8 @@ int flextcp_listen_accept(struct flextcp_context *ctx,
   kin->data.accept_conn.listen_opaque = OPAQUE(lst);
   kin->data.accept_conn.conn_opaque = OPAQUE(conn);
   kin->data.accept_conn.local_port = lst->local_port;
+  kin->data.accept_conn.mr_key = mr_key;
+  kin->data.accept_conn.mr_len = mr_len;
   MEM_BARRIER();
   kin->type = KERNEL_APPOUT_ACCEPT_CONN;
   flextcp_kernel_kick();
@@ -122,6 +131,13 @@ int flextcp_listen_accept(struct flextcp_context *ctx,
 
 int flextcp_connection_open(struct flextcp_context *ctx,
     struct flextcp_connection *conn, uint32_t dst_ip, uint16_t dst_port)
+{
+  return flextcp_connection_open_mr(ctx, conn, dst_ip, dst_port, 0, 0);
+}
+
+int flextcp_connection_open_mr(struct flextcp_context *ctx,
+    struct flextcp_connection *conn, uint32_t dst_ip, uint16_t dst_port,
+    uint32_t mr_key, uint64_t mr_len)
 {
   uint32_t pos = ctx->kin_head, f = 0;
   struct kernel_appout *kin = ctx->kin_base;
@@ -143,6 +159,8 @@ int flextcp_connection_open(struct flextcp_context *ctx,
   kin->data.conn_open.remote_ip = dst_ip;
   kin->data.conn_open.remote_port = dst_port;
   kin->data.conn_open.flags = f;
+  kin->data.conn_open.mr_key = mr_key;
+  kin->data.conn_open.mr_len = mr_len;
   MEM_BARRIER();
   kin->type = KERNEL_APPOUT_CONN_OPEN;
   flextcp_kernel_kick();
@@ -424,6 +442,104 @@ int flextcp_connection_move(struct flextcp_context *ctx,
   return 0;
 }
 
+int flextcp_connection_set_mr(struct flextcp_context *ctx,
+    struct flextcp_connection *conn, uint32_t mr_key, uint64_t mr_len)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "flextcp_connection_set_mr: no queue space\n");
+    return -1;
+  }
+
+  kin->data.conn_mr.local_ip = conn->local_ip;
+  kin->data.conn_mr.remote_ip = conn->remote_ip;
+  kin->data.conn_mr.local_port = conn->local_port;
+  kin->data.conn_mr.remote_port = conn->remote_port;
+  kin->data.conn_mr.mr_key = mr_key;
+  kin->data.conn_mr.mr_len = mr_len;
+  kin->data.conn_mr.opaque = OPAQUE(conn);
+  MEM_BARRIER();
+  kin->type = KERNEL_APPOUT_CONN_MR;
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
+
+int flextcp_mr_register(struct flextcp_context *ctx, struct flextcp_mr *mr,
+    uint64_t len)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "flextcp_mr_register: no queue space\n");
+    return -1;
+  }
+
+  memset(mr, 0, sizeof(*mr));
+  mr->status = MR_REG_REQUESTED;
+
+  kin->data.mr_reg.opaque = OPAQUE(mr);
+  kin->data.mr_reg.len = len;
+  MEM_BARRIER();
+  kin->type = KERNEL_APPOUT_MR_REG;
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
+
+int flextcp_mr_deregister(struct flextcp_context *ctx, struct flextcp_mr *mr)
+{
+  uint32_t pos = ctx->kin_head;
+  struct kernel_appout *kin = ctx->kin_base;
+
+  kin += pos;
+
+  if (mr->status != MR_REGISTERED) {
+    fprintf(stderr, "flextcp_mr_deregister: region not registered\n");
+    return -1;
+  }
+
+  if (kin->type != KERNEL_APPOUT_INVALID) {
+    fprintf(stderr, "flextcp_mr_deregister: no queue space\n");
+    return -1;
+  }
+
+  mr->status = MR_DEREG_REQUESTED;
+
+  kin->data.mr_dereg.opaque = OPAQUE(mr);
+  kin->data.mr_dereg.key = mr->key;
+  MEM_BARRIER();
+  kin->type = KERNEL_APPOUT_MR_DEREG;
+  flextcp_kernel_kick();
+
+  pos = pos + 1;
+  if (pos >= ctx->kin_len) {
+    pos = 0;
+  }
+  ctx->kin_head = pos;
+
+  return 0;
+}
+
 static void connection_init(struct flextcp_connection *conn)
 {
   memset(conn, 0, sizeof(*conn));
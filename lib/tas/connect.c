@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/vfs.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
@@ -136,9 +137,15 @@ static void *map_region_huge(const char *name, size_t len)
   int fd;
   void *m;
   char path[128];
+  struct statfs sfs;
 
   snprintf(path, sizeof(path), "%s/%s", FLEXNIC_HUGE_PREFIX, name);
 
+  /* mapping must cover whole huge pages, which may be 1GB */
+  if (statfs(FLEXNIC_HUGE_PREFIX, &sfs) == 0 && sfs.f_bsize > 0) {
+    len = (len + sfs.f_bsize - 1) / sfs.f_bsize * sfs.f_bsize;
+  }
+
   if ((fd = open(path, O_RDWR)) == -1) {
     perror("map_region: shm_open memory failed");
     return NULL;
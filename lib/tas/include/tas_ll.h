@@ -71,6 +71,11 @@ struct flextcp_context {
   struct flextcp_connection *bump_pending_first;
   struct flextcp_connection *bump_pending_last;
 
+  /* TCP events dequeued while polling for RDMA updates */
+  struct flextcp_event *ev_backlog;
+  uint16_t ev_backlog_head;
+  uint16_t ev_backlog_num;
+
   /* other */
   uint16_t db_id;
   uint16_t ctx_id;
@@ -81,6 +86,22 @@ struct flextcp_context {
   int epfd, evfd;
 };
 
+/** RDMA memory region shared by connections of the application. (opaque) */
+struct flextcp_mr {
+  uint8_t *base;
+  uint64_t len;
+  /** Key to attach connections to the region */
+  uint32_t key;
+  uint8_t status;
+};
+
+/** Completion queue shared by several RDMA connections. (opaque)
+ * Connections with unread completions are queued here while polling. */
+struct flextcp_rdma_cq {
+  struct flextcp_connection *ready_first;
+  struct flextcp_connection *ready_last;
+};
+
 /** TCP listening "socket". (opaque) */
 struct flextcp_listener {
   struct flextcp_connection *conns;
@@ -113,17 +134,26 @@ struct flextcp_connection {
   /** pending tx bump to fast path */
   uint32_t txb_bump;
 
-  /* work queue / completion queue */
+  /* work queue / completion queue, free-running positions (utils_ring.h) */
   uint8_t *wq_base;
   uint32_t wq_size;
-  uint32_t wq_len; /*> Number of pending work queue entries */
-  uint32_t wq_tail; /*> Offset to first unprocessed wq entry */
-  uint32_t cq_len; /*> Number of unread cq entries */
-  uint32_t cq_tail; /*> Offset to first unread cq entry */
+  uint32_t wq_head; /*> Position of the next wq entry to be added */
+  uint32_t wq_tail; /*> Position of first unprocessed wq entry */
+  uint32_t cq_head; /*> Position of first wq entry not completed yet */
+  uint32_t cq_tail; /*> Position of first unread cq entry */
+  struct flextcp_rdma_cq *rdma_cq; /*> Shared completion queue or NULL */
+  struct flextcp_connection *rdma_cq_next;
+  uint8_t rdma_cq_ready;
+  uint16_t rdma_credits; /*> Requests the peer accepts outstanding, 0: any */
+
+  /* receive queue, follows the work queue doorbell */
+  uint32_t rcv_head; /*> Position of the next receive buffer to be posted */
+  uint32_t rcv_tail; /*> Position of first unfilled receive buffer */
+  uint32_t rcv_cq_tail; /*> Position of first unread receive completion */
 
   /* Memory region */
   uint8_t *mr;
-  uint32_t mr_len;
+  uint64_t mr_len;
 
   uint32_t local_ip;
   uint32_t remote_ip;
@@ -170,6 +200,13 @@ enum flextcp_event_type {
   FLEXTCP_EV_CONN_TXCLOSED,
   /** Connection moved to new context */
   FLEXTCP_EV_CONN_MOVED,
+
+  /** flextcp_mr_register() result */
+  FLEXTCP_EV_MR_REG,
+  /** flextcp_mr_deregister() result */
+  FLEXTCP_EV_MR_DEREG,
+  /** flextcp_connection_set_mr() result */
+  FLEXTCP_EV_CONN_MR,
 };
 
 /** Events that can occur on flextcp contexts. */
@@ -226,6 +263,16 @@ struct flextcp_event {
       int16_t status;
       struct flextcp_connection *conn;
     } conn_closed;
+    /** For #FLEXTCP_EV_MR_REG and #FLEXTCP_EV_MR_DEREG */
+    struct {
+      int16_t status;
+      struct flextcp_mr *mr;
+    } mr;
+    /** For #FLEXTCP_EV_CONN_MR */
+    struct {
+      int16_t status;
+      struct flextcp_connection *conn;
+    } conn_mr;
   } ev;
 };
 
@@ -242,6 +289,12 @@ int flextcp_init(void);
  */
 int flextcp_context_create(struct flextcp_context *ctx);
 
+/**
+ * Release the local resources of a flextcp context without connections. The
+ * context queues stay allocated in TAS.
+ */
+void flextcp_context_destroy(struct flextcp_context *ctx);
+
 /**
  * Poll events from a flextcp socket.
  */
@@ -256,7 +309,32 @@ int rdma_fastpath_poll(struct flextcp_context *ctx,
     struct flextcp_connection *conn, int num);
 
 /**
- * Bump fast path for a new RDMA wq entry
+ * Poll up to 'num' entries from all fastpath rx queues of the context,
+ * queueing connections with new completions on their shared completion
+ * queue. Returns the number of entries processed.
+ */
+int rdma_context_poll(struct flextcp_context *ctx, int num);
+
+/**
+ * Dequeue the next connection with unread completions from a shared
+ * completion queue, NULL if there is none.
+ */
+struct flextcp_connection *rdma_cq_ready_pop(struct flextcp_rdma_cq *cq);
+
+/**
+ * Queue a connection with unread completions on its shared completion queue.
+ */
+void rdma_cq_ready_push(struct flextcp_connection *c);
+
+/**
+ * Remove a connection from the ready list of its shared completion queue,
+ * e.g. before detaching it.
+ */
+void rdma_cq_ready_remove(struct flextcp_connection *c);
+
+/**
+ * Bump fast path for a new RDMA wq entry. On failure the doorbell keeps the
+ * previous work queue head, callers restore c->wq_head.
  */
 int rdma_conn_bump(struct flextcp_context *ctx,
     struct flextcp_connection *c);
@@ -320,4 +398,35 @@ int flextcp_connection_tx_possible(struct flextcp_context *ctx,
 int flextcp_connection_move(struct flextcp_context *ctx,
         struct flextcp_connection *conn);
 
+/*****************************************************************************/
+/* RDMA memory regions */
+
+/** Register a memory region that connections can share (asynchronous). */
+int flextcp_mr_register(struct flextcp_context *ctx, struct flextcp_mr *mr,
+    uint64_t len);
+
+/** Deregister a shared memory region (asynchronous). The memory stays valid
+ * until all attached connections are closed. */
+int flextcp_mr_deregister(struct flextcp_context *ctx, struct flextcp_mr *mr);
+
+/** Open a connection using the shared memory region with key `mr_key', or if
+ * it is 0 a private region of `mr_len' bytes (0 for the default size)
+ * (asynchronous). */
+int flextcp_connection_open_mr(struct flextcp_context *ctx,
+    struct flextcp_connection *conn, uint32_t dst_ip, uint16_t dst_port,
+    uint32_t mr_key, uint64_t mr_len);
+
+/** Accept a connection using the shared memory region with key `mr_key', or
+ * if it is 0 a private region of `mr_len' bytes (0 for the default size)
+ * (asynchronous). */
+int flextcp_listen_accept_mr(struct flextcp_context *ctx,
+    struct flextcp_listener *lst, struct flextcp_connection *conn,
+    uint32_t mr_key, uint64_t mr_len);
+
+/** Replace the memory region of an open connection with the shared region
+ * `mr_key', or if it is 0 with a private region of `mr_len' bytes that keeps
+ * the contents of a private region (asynchronous). */
+int flextcp_connection_set_mr(struct flextcp_context *ctx,
+    struct flextcp_connection *conn, uint32_t mr_key, uint64_t mr_len);
+
 #endif /* ndef TAS_LL_H_ */
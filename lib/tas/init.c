@@ -36,6 +36,7 @@
 #include <kernel_appif.h>
 #include <tas_ll.h>
 #include <tas_memif.h>
+#include <utils_ring.h>
 #include <utils_timeout.h>
 #include "internal.h"
 
@@ -53,6 +54,12 @@ static inline void event_kappin_st_listen_open(
     struct kernel_appin_status *inev, struct flextcp_event *outev);
 static inline void event_kappin_st_conn_closed(
     struct kernel_appin_status *inev, struct flextcp_event *outev);
+static inline void event_kappin_st_mr_reg(
+    struct kernel_appin_mr_reg *inev, struct flextcp_event *outev);
+static inline void event_kappin_st_mr_dereg(
+    struct kernel_appin_status *inev, struct flextcp_event *outev);
+static inline void event_kappin_st_conn_mr(
+    struct kernel_appin_mr_reg *inev, struct flextcp_event *outev);
 
 static inline int event_arx_connupdate(struct flextcp_context *ctx,
     struct flextcp_pl_arx_connupdate *inev,
@@ -127,6 +134,13 @@ int flextcp_context_create(struct flextcp_context *ctx)
     return -1;
   }
 
+  ctx->ev_backlog = calloc(FLEXTCP_EV_BACKLOG, sizeof(*ctx->ev_backlog));
+  if (ctx->ev_backlog == NULL) {
+    fprintf(stderr, "flextcp_context_create: allocating event backlog "
+        "failed\n");
+    return -1;
+  }
+
   ctx->evfd = eventfd(0, 0);
   assert(ctx->evfd != -1);
 
@@ -144,6 +158,15 @@ int flextcp_context_create(struct flextcp_context *ctx)
   return flextcp_kernel_newctx(ctx);
 }
 
+void flextcp_context_destroy(struct flextcp_context *ctx)
+{
+  /* queues were allocated by the kernel and stay with it */
+  close(ctx->epfd);
+  close(ctx->evfd);
+  free(ctx->ev_backlog);
+  ctx->ev_backlog = NULL;
+}
+
 #include <pthread.h>
 
 int debug_flextcp_on = 0;
@@ -184,6 +207,12 @@ static int kernel_poll(struct flextcp_context *ctx, int num,
       event_kappin_st_conn_move(&kout->data.status, &events[i]);
     } else if (type == KERNEL_APPIN_STATUS_CONN_CLOSE) {
       event_kappin_st_conn_closed(&kout->data.status, &events[i]);
+    } else if (type == KERNEL_APPIN_STATUS_MR_REG) {
+      event_kappin_st_mr_reg(&kout->data.mr_reg, &events[i]);
+    } else if (type == KERNEL_APPIN_STATUS_MR_DEREG) {
+      event_kappin_st_mr_dereg(&kout->data.status, &events[i]);
+    } else if (type == KERNEL_APPIN_STATUS_CONN_MR) {
+      event_kappin_st_conn_mr(&kout->data.mr_reg, &events[i]);
     } else {
       fprintf(stderr, "flextcp_context_poll: unexpected kout type=%u pos=%u len=%u\n",
           type, pos, ctx->kout_len);
@@ -210,50 +239,164 @@ static int kernel_poll(struct flextcp_context *ctx, int num,
   return (j == -1 ? -1 : 0);
 }
 
-int rdma_fastpath_poll(struct flextcp_context *ctx,
-        struct flextcp_connection *conn, int num){
-    int i;
-    struct flextcp_pl_arx *arx_q, *arx;
-    uint32_t head;
-    struct flextcp_connection *rx_conn;
-
-    arx_q = (struct flextcp_pl_arx *) ctx->queues[conn->fn_core].rxq_base;
-    head = ctx->queues[conn->fn_core].rxq_head;
-    for (i = 0; i < num;) {
-        arx = &arx_q[head / sizeof(*arx)];
-        if (arx->type == FLEXTCP_PL_ARX_INVALID) {
-            break;
-        } else if (arx->type == FLEXTCP_PL_ARX_RDMAUPDATE) {
-            rx_conn = OPAQUE_PTR(arx->msg.rdmaupdate.opaque);
-            if (arx->msg.rdmaupdate.cq_head > rx_conn->cq_tail){
-                rx_conn->cq_len = arx->msg.rdmaupdate.cq_head - rx_conn->cq_tail;
-            }else{
-                rx_conn->cq_len = arx->msg.rdmaupdate.cq_head + rx_conn->wq_size - rx_conn->cq_tail;
-            }
-            if (arx->msg.rdmaupdate.wq_tail > rx_conn->wq_tail){
-                rx_conn->wq_len -= (arx->msg.rdmaupdate.wq_tail - rx_conn->wq_tail);
-            }else if (arx->msg.rdmaupdate.wq_tail < rx_conn->wq_tail){
-                rx_conn->wq_len -= (arx->msg.rdmaupdate.wq_tail + rx_conn->wq_size - rx_conn->wq_tail);
-            }else if (rx_conn->wq_len == rx_conn->wq_size){
-                rx_conn->wq_len = 0;
-            }
-            rx_conn->wq_tail = arx->msg.rdmaupdate.wq_tail;
-            i = conn->cq_len;
-        } else {
-            fprintf(stderr, "flextcp_context_poll: kout type=%u head=%x\n", arx->type, head);
-        }
+void rdma_cq_ready_push(struct flextcp_connection *c)
+{
+  struct flextcp_rdma_cq *cq = c->rdma_cq;
 
-        MEM_BARRIER();
+  if (cq == NULL || c->rdma_cq_ready)
+    return;
 
-        arx->type = 0;
-        /* next entry */
-        head += sizeof(*arx);
-        if (head >= ctx->rxq_len) {
-            head -= ctx->rxq_len;
-        }
-    }
-    ctx->queues[conn->fn_core].rxq_head = head;
+  c->rdma_cq_ready = 1;
+  c->rdma_cq_next = NULL;
+  if (cq->ready_last == NULL) {
+    cq->ready_first = c;
+  } else {
+    cq->ready_last->rdma_cq_next = c;
+  }
+  cq->ready_last = c;
+}
+
+struct flextcp_connection *rdma_cq_ready_pop(struct flextcp_rdma_cq *cq)
+{
+  struct flextcp_connection *c = cq->ready_first;
+
+  if (c == NULL)
+    return NULL;
+
+  cq->ready_first = c->rdma_cq_next;
+  if (cq->ready_first == NULL)
+    cq->ready_last = NULL;
+  c->rdma_cq_next = NULL;
+  c->rdma_cq_ready = 0;
+  return c;
+}
+
+void rdma_cq_ready_remove(struct flextcp_connection *c)
+{
+  struct flextcp_rdma_cq *cq = c->rdma_cq;
+  struct flextcp_connection *p;
+
+  if (cq == NULL || !c->rdma_cq_ready)
+    return;
+
+  if (cq->ready_first == c) {
+    cq->ready_first = c->rdma_cq_next;
+    p = NULL;
+  } else {
+    for (p = cq->ready_first; p->rdma_cq_next != c; p = p->rdma_cq_next);
+    p->rdma_cq_next = c->rdma_cq_next;
+  }
+  if (cq->ready_last == c)
+    cq->ready_last = p;
+
+  c->rdma_cq_next = NULL;
+  c->rdma_cq_ready = 0;
+}
+
+static inline void event_arx_rdmaupdate(struct flextcp_context *ctx,
+    struct flextcp_pl_arx_rdmaconnupdate *inev)
+{
+  struct flextcp_connection *conn;
+
+  /* positions only move forward, never past what was posted */
+  conn = OPAQUE_PTR(inev->opaque);
+  if (ring_in(conn->wq_tail, conn->wq_head, inev->wq_tail))
+    conn->wq_tail = inev->wq_tail;
+  if (ring_in(conn->cq_head, conn->wq_tail, inev->cq_head))
+    conn->cq_head = inev->cq_head;
+  if (ring_in(conn->rcv_tail, conn->rcv_head, inev->rcv_tail))
+    conn->rcv_tail = inev->rcv_tail;
+
+  if (conn->cq_head != conn->cq_tail || conn->rcv_tail != conn->rcv_cq_tail)
+    rdma_cq_ready_push(conn);
+}
+
+/* Handle a TCP update seen while polling for RDMA updates. Events are kept
+ * in the context backlog and returned by the next flextcp_context_poll().
+ * Returns -1 if the backlog is full and the entry must stay in the queue. */
+static inline int event_arx_backlog(struct flextcp_context *ctx,
+    struct flextcp_pl_arx *arx, uint16_t q)
+{
+  uint16_t pos, avail;
+  struct flextcp_event evs[4];
+  int i, n;
+
+  if (arx->type != FLEXTCP_PL_ARX_CONNUPDATE) {
+    fprintf(stderr, "rdma_fastpath_poll: unexpected type=%u\n", arx->type);
     return 0;
+  }
+
+  avail = FLEXTCP_EV_BACKLOG - ctx->ev_backlog_num;
+  n = event_arx_connupdate(ctx, &arx->msg.connupdate, evs,
+      (avail < 4 ? avail : 4), q);
+  if (n == -1)
+    return -1;
+
+  for (i = 0; i < n; i++) {
+    pos = (ctx->ev_backlog_head + ctx->ev_backlog_num) % FLEXTCP_EV_BACKLOG;
+    ctx->ev_backlog[pos] = evs[i];
+    ctx->ev_backlog_num++;
+  }
+  return 0;
+}
+
+/* Process RDMA updates from one queue, stopping after 'max' entries or once
+ * 'conn' (if set) has at least 'want' bytes of completions. */
+static int rdma_queue_poll(struct flextcp_context *ctx, uint16_t q,
+    struct flextcp_connection *conn, uint32_t want, int max)
+{
+  int i;
+  struct flextcp_pl_arx *arx_q, *arx;
+  uint32_t head;
+
+  arx_q = (struct flextcp_pl_arx *) ctx->queues[q].rxq_base;
+  head = ctx->queues[q].rxq_head;
+  for (i = 0; i < max; i++) {
+    if (conn != NULL && ring_used(conn->cq_head, conn->cq_tail) >= want)
+      break;
+
+    arx = &arx_q[head / sizeof(*arx)];
+    if (arx->type == FLEXTCP_PL_ARX_INVALID) {
+      break;
+    } else if (arx->type == FLEXTCP_PL_ARX_RDMAUPDATE) {
+      event_arx_rdmaupdate(ctx, &arx->msg.rdmaupdate);
+    } else if (event_arx_backlog(ctx, arx, q) == -1) {
+      break;
+    }
+
+    MEM_BARRIER();
+
+    arx->type = 0;
+    /* next entry */
+    head += sizeof(*arx);
+    if (head >= ctx->rxq_len) {
+      head -= ctx->rxq_len;
+    }
+  }
+  ctx->queues[q].rxq_head = head;
+  return i;
+}
+
+int rdma_fastpath_poll(struct flextcp_context *ctx,
+        struct flextcp_connection *conn, int num)
+{
+  rdma_queue_poll(ctx, conn->fn_core, conn, num,
+      ctx->rxq_len / sizeof(struct flextcp_pl_arx));
+  return 0;
+}
+
+int rdma_context_poll(struct flextcp_context *ctx, int num)
+{
+  int i = 0;
+  uint16_t k, q;
+
+  q = ctx->next_queue;
+  for (k = 0; k < ctx->num_queues && i < num; k++) {
+    i += rdma_queue_poll(ctx, q, NULL, 0, num - i);
+    q = (q + 1 < ctx->num_queues ? q + 1 : 0);
+  }
+  ctx->next_queue = q;
+  return i;
 }
 
 static int fastpath_poll(struct flextcp_context *ctx, int num,
@@ -277,6 +420,8 @@ static int fastpath_poll(struct flextcp_context *ctx, int num,
         break;
       } else if (arx->type == FLEXTCP_PL_ARX_CONNUPDATE) {
         j = event_arx_connupdate(ctx, &arx->msg.connupdate, events + i, num - i, ctx->next_queue);
+      } else if (arx->type == FLEXTCP_PL_ARX_RDMAUPDATE) {
+        event_arx_rdmaupdate(ctx, &arx->msg.rdmaupdate);
       } else {
         fprintf(stderr, "flextcp_context_poll: kout type=%u head=%x\n", arx->type, head);
       }
@@ -453,7 +598,8 @@ static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
 
       /* prefetch connection state for all entries */
       for (k = 0, q = ctx->next_queue; k < ctx->num_queues && i + l < num; k++) {
-        if (types[k] == FLEXTCP_PL_ARX_CONNUPDATE) {
+        if (types[k] == FLEXTCP_PL_ARX_CONNUPDATE ||
+            types[k] == FLEXTCP_PL_ARX_RDMAUPDATE) {
           arx = (struct flextcp_pl_arx *) (ctx->queues[q].rxq_base +
               qheads[q]);
           util_prefetch0(OPAQUE_PTR(arx->msg.connupdate.opaque) + 64);
@@ -487,6 +633,9 @@ static int fastpath_poll_vec(struct flextcp_context *ctx, int num,
       if (t == FLEXTCP_PL_ARX_CONNUPDATE) {
         j = event_arx_connupdate(ctx, &arx->msg.connupdate, events + i,
             num - i, q);
+      } else if (t == FLEXTCP_PL_ARX_RDMAUPDATE) {
+        j = 0;
+        event_arx_rdmaupdate(ctx, &arx->msg.rdmaupdate);
       } else {
         j = 0;
         fprintf(stderr, "flextcp_context_poll: kout type=%u head=%x\n",
@@ -542,11 +691,19 @@ int flextcp_context_poll(struct flextcp_context *ctx, int num,
     q = (q + 1 < ctx->num_queues ? q + 1 : 0);
   }
 
+  /* events left behind by RDMA polling come first */
+  while (i < num && ctx->ev_backlog_num > 0) {
+    events[i++] = ctx->ev_backlog[ctx->ev_backlog_head];
+    ctx->ev_backlog_head = (ctx->ev_backlog_head + 1) % FLEXTCP_EV_BACKLOG;
+    ctx->ev_backlog_num--;
+  }
+
   /* poll kernel */
-  if (kernel_poll(ctx, num, events, &i) == -1) {
+  if (kernel_poll(ctx, num - i, events + i, &j) == -1) {
     /* not enough event space, abort */
-    return i;
+    return i + j;
   }
+  i += j;
 
   /* poll NIC queues */
   fastpath_poll_vec(ctx, num - i, events + i, &j);
@@ -628,6 +785,7 @@ static inline int event_kappin_conn_opened(
   conn->seq_tx = inev->seq_tx;
   conn->flow_id = inev->flow_id;
   conn->fn_core = inev->fn_core;
+  conn->rdma_credits = inev->rdma_credits;
 
   conn->rxb_base = (uint8_t *) flexnic_mem + inev->rx_off;
   conn->rxb_len = inev->rx_len;
@@ -709,6 +867,7 @@ static inline int event_kappin_accept_conn(
   conn->seq_tx = inev->seq_tx;
   conn->flow_id = inev->flow_id;
   conn->fn_core = inev->fn_core;
+  conn->rdma_credits = inev->rdma_credits;
 
   conn->rxb_base = (uint8_t *) flexnic_mem + inev->rx_off;
   conn->rxb_len = inev->rx_len;
@@ -783,6 +942,59 @@ static inline void event_kappin_st_conn_closed(
   conn->status = CONN_CLOSED;
 }
 
+static inline void event_kappin_st_mr_reg(
+    struct kernel_appin_mr_reg *inev, struct flextcp_event *outev)
+{
+  struct flextcp_mr *mr;
+
+  mr = OPAQUE_PTR(inev->opaque);
+
+  outev->event_type = FLEXTCP_EV_MR_REG;
+  outev->ev.mr.status = inev->status;
+  outev->ev.mr.mr = mr;
+
+  if (inev->status != 0) {
+    mr->status = MR_UNREGISTERED;
+    return;
+  }
+
+  mr->base = (uint8_t *) flexnic_mem + inev->mr_off;
+  mr->len = inev->mr_len;
+  mr->key = inev->key;
+  mr->status = MR_REGISTERED;
+}
+
+static inline void event_kappin_st_mr_dereg(
+    struct kernel_appin_status *inev, struct flextcp_event *outev)
+{
+  struct flextcp_mr *mr;
+
+  mr = OPAQUE_PTR(inev->opaque);
+
+  outev->event_type = FLEXTCP_EV_MR_DEREG;
+  outev->ev.mr.status = inev->status;
+  outev->ev.mr.mr = mr;
+
+  mr->status = (inev->status == 0 ? MR_UNREGISTERED : MR_REGISTERED);
+}
+
+static inline void event_kappin_st_conn_mr(
+    struct kernel_appin_mr_reg *inev, struct flextcp_event *outev)
+{
+  struct flextcp_connection *conn;
+
+  conn = OPAQUE_PTR(inev->opaque);
+
+  outev->event_type = FLEXTCP_EV_CONN_MR;
+  outev->ev.conn_mr.status = inev->status;
+  outev->ev.conn_mr.conn = conn;
+
+  if (inev->status == 0) {
+    conn->mr = (uint8_t *) flexnic_mem + inev->mr_off;
+    conn->mr_len = inev->mr_len;
+  }
+}
+
 static inline int event_arx_connupdate(struct flextcp_context *ctx,
     struct flextcp_pl_arx_connupdate *inev, struct flextcp_event *outevs,
     int outn, uint16_t fn_core)
@@ -972,14 +1184,30 @@ static void txq_probe(struct flextcp_context *ctx, unsigned n)
 int rdma_conn_bump(struct flextcp_context *ctx,
 		struct flextcp_connection *c){
 	struct flextcp_pl_atx *atx;
+    struct flextcp_pl_rdma_db *db;
+    uint32_t old_head;
     assert(c->status == CONN_OPEN);
+
+    // Publish queue pointers in the doorbell after the work queue
+    db = (struct flextcp_pl_rdma_db *) (c->wq_base + c->wq_size);
+    old_head = db->wq_head;
+    db->wq_head = c->wq_head;
+    db->cq_tail = c->cq_tail;
+    // Pairs with the fence in fast_rdma_db_idle()
+    MEM_FENCE();
+    if (db->fp_active)
+        return 0;
+
+    // Flow is idle: wake up the fast path
     // TODO: Only call txq_probe when we run out of space
     txq_probe(ctx, ctx->txq_len);
     if (flextcp_context_tx_alloc(ctx, &atx, c->fn_core) != 0) {
+        // Callers take the new entries back, so must the doorbell
+        db->wq_head = old_head;
         fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
 		    return -1;
     }
-    atx->msg.rdmaupdate.wq_head = (c->wq_tail + c->wq_len) % c->wq_size;
+    atx->msg.rdmaupdate.wq_head = c->wq_head;
     atx->msg.rdmaupdate.cq_tail = c->cq_tail;
     atx->msg.rdmaupdate.flow_id = c->flow_id;
     MEM_BARRIER();
@@ -37,6 +37,9 @@
 #define CONN_FLAG_TXEOS_ACK 4
 #define CONN_FLAG_RXEOS 8
 
+/** TCP events buffered by RDMA polling until the next context poll */
+#define FLEXTCP_EV_BACKLOG 64
+
 enum conn_state {
   CONN_CLOSED,
   CONN_OPEN_REQUESTED,
@@ -45,6 +48,13 @@ enum conn_state {
   CONN_CLOSE_REQUESTED,
 };
 
+enum mr_state {
+  MR_UNREGISTERED,
+  MR_REG_REQUESTED,
+  MR_REGISTERED,
+  MR_DEREG_REQUESTED,
+};
+
 extern void *flexnic_mem;
 extern int flexnic_evfd[FLEXTCP_MAX_FTCPCORES];
 
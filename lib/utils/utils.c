@@ -95,3 +95,12 @@ void util_flexnic_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us)
 
   ctx->last_ts = ts_us;
 }
+
+void util_flexnic_notify(struct flextcp_pl_appctx *ctx, uint32_t ts_us)
+{
+  uint64_t val = 1;
+  int r = write(ctx->evfd, &val, sizeof(uint64_t));
+  assert(r == sizeof(uint64_t));
+
+  ctx->last_ts = ts_us;
+}
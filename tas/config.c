@@ -30,7 +30,10 @@
 #include <unistd.h>
 
 #include <utils.h>
+#include <utils_ring.h>
 
+#include <packet_defs.h>
+#include <tas_rdma.h>
 #include <config.h>
 
 enum cfg_params {
@@ -48,6 +51,7 @@ enum cfg_params {
   CP_TCP_HANDSHAKE_RETRIES,
   CP_RDMA_MR_LEN,
   CP_RDMA_WQ_LEN,
+  CP_RDMA_HDR_VERSION,
   CP_CC,
   CP_CC_CONTROL_GRANULARITY,
   CP_CC_CONTROL_INTERVAL,
@@ -74,6 +78,9 @@ enum cfg_params {
   CP_FP_NO_XSUMOFFLOAD,
   CP_FP_NO_AUTOSCALE,
   CP_FP_NO_HUGEPAGES,
+  CP_FP_RDMA_DB_POLL,
+  CP_FP_COPY_THREADS,
+  CP_FP_COPY_MIN,
   CP_KNI_NAME,
   CP_READY_FD,
   CP_DPDK_EXTRA,
@@ -123,6 +130,9 @@ static struct option opts[] = {
     { .name = "rmda-wq-len",
       .has_arg = required_argument,
       .val = CP_RDMA_WQ_LEN },
+    { .name = "rdma-hdr-version",
+      .has_arg = required_argument,
+      .val = CP_RDMA_HDR_VERSION },
     { .name = "cc",
       .has_arg = required_argument,
       .val = CP_CC },
@@ -201,6 +211,15 @@ static struct option opts[] = {
     { .name = "fp-no-hugepages",
       .has_arg = no_argument,
       .val = CP_FP_NO_HUGEPAGES },
+    { .name = "fp-rdma-db-poll",
+      .has_arg = no_argument,
+      .val = CP_FP_RDMA_DB_POLL },
+    { .name = "fp-copy-threads",
+      .has_arg = required_argument,
+      .val = CP_FP_COPY_THREADS },
+    { .name = "fp-copy-min",
+      .has_arg = required_argument,
+      .val = CP_FP_COPY_MIN },
     { .name = "kni-name",
       .has_arg = required_argument,
       .val = CP_KNI_NAME },
@@ -317,11 +336,25 @@ int config_parse(struct configuration *c, int argc, char *argv[])
           fprintf(stderr, "rdma mr len parsing failed\n");
           goto failed;
         }
+        break;
       case CP_RDMA_WQ_LEN:
-        if (parse_int64(optarg, &c->rdma_wq_len) != 0) {
-          fprintf(stderr, "rdma wq len parsing failed\n");
+        if (parse_int64(optarg, &c->rdma_wq_len) != 0 ||
+            !ring_len_valid(c->rdma_wq_len) ||
+            c->rdma_wq_len < 4 * sizeof(struct rdma_wqe))
+        {
+          fprintf(stderr, "rdma wq len parsing failed (power of two of at "
+              "least 4 entries)\n");
           goto failed;
         }
+        break;
+      case CP_RDMA_HDR_VERSION:
+        if (parse_int32(optarg, &c->rdma_hdr_ver) != 0 ||
+            c->rdma_hdr_ver < RDMA_HDR_V1 || c->rdma_hdr_ver > RDMA_HDR_V2)
+        {
+          fprintf(stderr, "rdma header version parsing failed\n");
+          goto failed;
+        }
+        break;
       case CP_CC:
         if (!strcmp(optarg, "dctcp-win")) {
           c->cc_algorithm = CONFIG_CC_DCTCP_WIN;
@@ -478,6 +511,21 @@ int config_parse(struct configuration *c, int argc, char *argv[])
       case CP_FP_NO_HUGEPAGES:
         c->fp_hugepages = 0;
         break;
+      case CP_FP_RDMA_DB_POLL:
+        c->fp_rdma_db_poll = 1;
+        break;
+      case CP_FP_COPY_THREADS:
+        if (parse_int32(optarg, &c->fp_copy_threads) != 0) {
+          fprintf(stderr, "fp copy threads parsing failed\n");
+          goto failed;
+        }
+        break;
+      case CP_FP_COPY_MIN:
+        if (parse_int32(optarg, &c->fp_copy_min) != 0) {
+          fprintf(stderr, "fp copy min parsing failed\n");
+          goto failed;
+        }
+        break;
 
       case CP_KNI_NAME:
         if (!(c->kni_name = strdup(optarg))) {
@@ -544,7 +592,8 @@ static int config_defaults(struct configuration *c, char *progname)
   c->tcp_handshake_to = 10000;
   c->tcp_handshake_retries = 10;
   c->rdma_mr_len = 64 * 1024;
-  c->rdma_wq_len = 20 * 512;
+  c->rdma_wq_len = sizeof(struct rdma_wqe) * 512;
+  c->rdma_hdr_ver = RDMA_HDR_V2;
   c->cc_algorithm = CONFIG_CC_DCTCP_RATE;
   c->cc_control_granularity = 50;
   c->cc_control_interval = 2;
@@ -569,6 +618,9 @@ static int config_defaults(struct configuration *c, char *progname)
   c->fp_xsumoffload = 1;
   c->fp_autoscale = 1;
   c->fp_hugepages = 1;
+  c->fp_rdma_db_poll = 0;
+  c->fp_copy_threads = 0;
+  c->fp_copy_min = 64 * 1024;
   c->kni_name = NULL;
   c->ready_fd = -1;
   c->quiet = 0;
@@ -610,6 +662,8 @@ static void print_usage(struct configuration *c, char *progname)
           "[default: %"PRIu32"]\n"
       "  --tcp-handshake-retries=RETRIES  Handshake retries "
           "[default: %"PRIu32"]\n"
+      "  --rdma-hdr-version=VER      Highest RDMA header version offered "
+          "[default: %"PRIu32"]\n"
       "\n"
       "Congestion control parameters:\n"
       "  --cc=ALGORITHM              Congestion-control algorithm "
@@ -667,6 +721,12 @@ static void print_usage(struct configuration *c, char *progname)
           "[default: enabled]\n"
       "  --fp-no-hugepages           Disable hugepages for SHM "
           "[default: enabled]\n"
+      "  --fp-rdma-db-poll           Poll RDMA doorbells of active flows "
+          "[default: disabled]\n"
+      "  --fp-copy-threads=THREADS   Threads for bulk loopback RDMA copies "
+          "[default: disabled]\n"
+      "  --fp-copy-min=BYTES         Min. length of offloaded copies "
+          "[default: %"PRIu32"]\n"
       "  --dpdk-extra=ARG            Add extra DPDK argument\n"
       "\n"
       "Host kernel interface:\n"
@@ -682,7 +742,7 @@ static void print_usage(struct configuration *c, char *progname)
       progname,
       c->nic_rx_len, c->nic_tx_len, c->app_kin_len, c->app_kout_len,
       c->tcp_rtt_init, c->tcp_link_bw, c->tcp_rxbuf_len, c->tcp_txbuf_len,
-      c->tcp_handshake_to, c->tcp_handshake_retries,
+      c->tcp_handshake_to, c->tcp_handshake_retries, c->rdma_hdr_ver,
       c->cc_control_granularity, c->cc_control_interval, c->cc_rexmit_ints,
       (double) c->cc_dctcp_weight / UINT32_MAX, c->cc_dctcp_min,
       c->cc_const_rate, c->cc_timely_tlow, c->cc_timely_thigh,
@@ -690,7 +750,7 @@ static void print_usage(struct configuration *c, char *progname)
       (double) c->cc_timely_alpha / UINT32_MAX,
       (double) c->cc_timely_beta / UINT32_MAX, c->cc_timely_min_rtt,
       c->cc_timely_min_rate, c->arp_to, c->arp_to_max,
-      c->fp_cores_max);
+      c->fp_cores_max, c->fp_copy_min);
 }
 
 static inline int parse_int64(const char *s, uint64_t *pi)
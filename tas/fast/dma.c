@@ -0,0 +1,117 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <rte_config.h>
+#include <rte_memcpy.h>
+
+#include "dma.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* NOTE: Streaming copies align the destination with a regular copy of the
+ * head, move whole cache lines with non-temporal stores while prefetching
+ * the source ahead, and finish the tail with a regular copy. The fence makes
+ * the streamed data visible before any later store, e.g. a completion.
+ * Callers only stream copies of at least DMA_STREAM_MIN bytes.
+ */
+
+void (*dma_copy_stream)(void *dst, const void *src, size_t len) = NULL;
+
+#if defined(__x86_64__)
+
+/* Bytes the source is prefetched ahead of the copy */
+#define DMA_PREFETCH_DIST 512
+
+static void dma_stream_sse2(void *dst, const void *src, size_t len)
+{
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  size_t head = (-(uintptr_t) d) & 15;
+  __m128i v0, v1, v2, v3;
+
+  rte_memcpy(d, s, head);
+  d += head;
+  s += head;
+  len -= head;
+
+  for (; len >= 64; d += 64, s += 64, len -= 64) {
+    _mm_prefetch((const char *) s + DMA_PREFETCH_DIST, _MM_HINT_NTA);
+    v0 = _mm_loadu_si128((const __m128i *) s);
+    v1 = _mm_loadu_si128((const __m128i *) (s + 16));
+    v2 = _mm_loadu_si128((const __m128i *) (s + 32));
+    v3 = _mm_loadu_si128((const __m128i *) (s + 48));
+    _mm_stream_si128((__m128i *) d, v0);
+    _mm_stream_si128((__m128i *) (d + 16), v1);
+    _mm_stream_si128((__m128i *) (d + 32), v2);
+    _mm_stream_si128((__m128i *) (d + 48), v3);
+  }
+  _mm_sfence();
+
+  rte_memcpy(d, s, len);
+}
+
+static void __attribute__((target("avx2"))) dma_stream_avx2(void *dst,
+    const void *src, size_t len)
+{
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  size_t head = (-(uintptr_t) d) & 31;
+  __m256i v0, v1;
+
+  rte_memcpy(d, s, head);
+  d += head;
+  s += head;
+  len -= head;
+
+  for (; len >= 64; d += 64, s += 64, len -= 64) {
+    _mm_prefetch((const char *) s + DMA_PREFETCH_DIST, _MM_HINT_NTA);
+    v0 = _mm256_loadu_si256((const __m256i *) s);
+    v1 = _mm256_loadu_si256((const __m256i *) (s + 32));
+    _mm256_stream_si256((__m256i *) d, v0);
+    _mm256_stream_si256((__m256i *) (d + 32), v1);
+  }
+  _mm_sfence();
+
+  rte_memcpy(d, s, len);
+}
+
+static void __attribute__((target("avx512f"))) dma_stream_avx512(void *dst,
+    const void *src, size_t len)
+{
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  size_t head = (-(uintptr_t) d) & 63;
+  __m512i v0;
+
+  rte_memcpy(d, s, head);
+  d += head;
+  s += head;
+  len -= head;
+
+  for (; len >= 64; d += 64, s += 64, len -= 64) {
+    _mm_prefetch((const char *) s + DMA_PREFETCH_DIST, _MM_HINT_NTA);
+    v0 = _mm512_loadu_si512((const void *) s);
+    _mm512_stream_si512((void *) d, v0);
+  }
+  _mm_sfence();
+
+  rte_memcpy(d, s, len);
+}
+
+#endif
+
+void dma_init(void)
+{
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    dma_copy_stream = dma_stream_avx512;
+  else if (__builtin_cpu_supports("avx2"))
+    dma_copy_stream = dma_stream_avx2;
+  else
+    dma_copy_stream = dma_stream_sse2;
+#endif
+}
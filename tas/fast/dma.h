@@ -32,15 +32,36 @@
 #include <rte_memcpy.h>
 #include <tas.h>
 
+/** Copies from this length on bypass the cache if the CPU supports it */
+#define DMA_STREAM_MIN (4 * 1024)
+
 #ifdef DATAPLANE_STATS
 void dma_dump_stats(void);
 #endif
 
+/** Copy with non-temporal stores, NULL if not supported by the CPU */
+extern void (*dma_copy_stream)(void *dst, const void *src, size_t len);
+
+/** Select the copy routines for this CPU */
+void dma_init(void);
+
+/**
+ * Copy payload. The fast path does not read large payload again, so it is
+ * streamed past the cache instead of evicting flow state.
+ */
+static inline void dma_copy(void *dst, const void *src, size_t len)
+{
+  if (len >= DMA_STREAM_MIN && dma_copy_stream != NULL)
+    dma_copy_stream(dst, src, len);
+  else
+    rte_memcpy(dst, src, len);
+}
+
 static inline void dma_read(uintptr_t addr, size_t len, void *buf)
 {
   assert(addr + len >= addr && addr + len <= FLEXNIC_DMA_MEM_SIZE);
 
-  rte_memcpy(buf, (uint8_t *) tas_shm + addr, len);
+  dma_copy(buf, (uint8_t *) tas_shm + addr, len);
 
 #ifdef FLEXNIC_TRACE_DMA
   struct flexnic_trace_entry_dma evt = {
@@ -56,7 +77,7 @@ static inline void dma_write(uintptr_t addr, size_t len, const void *buf)
 {
   assert(addr + len >= addr && addr + len <= FLEXNIC_DMA_MEM_SIZE);
 
-  rte_memcpy((uint8_t *) tas_shm + addr, buf, len);
+  dma_copy((uint8_t *) tas_shm + addr, buf, len);
 
 #ifdef FLEXNIC_TRACE_DMA
   struct flexnic_trace_entry_dma evt = {
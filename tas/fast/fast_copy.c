@@ -0,0 +1,222 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <rte_config.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_ring.h>
+
+#include <tas_memif.h>
+#include <utils.h>
+
+#include "internal.h"
+#include "fastemu.h"
+#include "tas.h"
+
+/* NOTE: Copy threads move the payload of bulk loopback RDMA operations so
+ * the fast path core does not stall its other flows on a large copy. Every
+ * core owns COPY_PENDING_MAX requests, they travel to a copy thread through
+ * its submission ring and come back through the core's completion ring. A
+ * flow is always submitted to the same copy thread. A copy thread that found
+ * no work for COPY_SPIN_MAX polls sleeps on its eventfd until a core submits
+ * the next copy.
+ */
+
+/* Empty polls before a copy thread goes to sleep */
+#define COPY_SPIN_MAX 4096
+
+struct copy_thread {
+  struct rte_ring *ring;
+  int evfd;
+  volatile uint8_t sleeping;
+};
+
+static struct copy_thread *copy_threads;
+
+/* Sleep until a core submits a copy, the ring is checked again after
+ * announcing it so no submission is missed */
+static void copy_thread_sleep(struct copy_thread *ct)
+{
+  uint64_t val;
+  int ret;
+
+  ct->sleeping = 1;
+  /* Pairs with the fence in fast_copy_submit() */
+  MEM_FENCE();
+  if (rte_ring_empty(ct->ring)) {
+    ret = read(ct->evfd, &val, sizeof(val));
+    assert(ret == sizeof(val));
+  }
+  ct->sleeping = 0;
+}
+
+static void *copy_thread(void *arg)
+{
+  struct copy_thread *ct = arg;
+  struct fast_copy_req *reqs[BATCH_SIZE];
+  struct dataplane_context *ctx;
+  uint64_t val = 1;
+  unsigned i, n, idle = 0;
+  int ret;
+
+  while (!exited) {
+    n = rte_ring_dequeue_burst(ct->ring, (void **) reqs, BATCH_SIZE, NULL);
+    if (n == 0) {
+      if (++idle < COPY_SPIN_MAX) {
+        rte_pause();
+      } else {
+        copy_thread_sleep(ct);
+        idle = 0;
+      }
+      continue;
+    }
+    idle = 0;
+
+    for (i = 0; i < n; i++) {
+      dma_copy(reqs[i]->dst, reqs[i]->src, reqs[i]->len);
+
+      /* the completion ring holds all requests of its core */
+      ctx = ctxs[reqs[i]->ctx_id];
+      ret = rte_ring_enqueue(ctx->copy_done_ring, reqs[i]);
+      assert(ret == 0);
+
+      /* wake up the core if it waits for interrupts */
+      if (config.fp_interrupts) {
+        ret = write(ctx->evfd, &val, sizeof(val));
+        assert(ret == sizeof(val));
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int fast_copy_init(void)
+{
+  char name[32];
+  pthread_t pt;
+  uint32_t i, len;
+
+  if (config.fp_copy_threads == 0)
+    return 0;
+
+  if ((copy_threads = calloc(config.fp_copy_threads, sizeof(*copy_threads)))
+      == NULL)
+  {
+    fprintf(stderr, "fast_copy_init: calloc failed\n");
+    return -1;
+  }
+
+  /* a submission ring can take all requests of all cores */
+  for (len = 1; len <= fp_cores_max * COPY_PENDING_MAX; len <<= 1);
+
+  for (i = 0; i < config.fp_copy_threads; i++) {
+    sprintf(name, "copy_ring_%u", i);
+    if ((copy_threads[i].ring = rte_ring_create(name, len, rte_socket_id(),
+            RING_F_SC_DEQ)) == NULL)
+    {
+      fprintf(stderr, "fast_copy_init: rte_ring_create failed\n");
+      return -1;
+    }
+
+    if ((copy_threads[i].evfd = eventfd(0, 0)) == -1) {
+      fprintf(stderr, "fast_copy_init: eventfd failed\n");
+      return -1;
+    }
+
+    if (pthread_create(&pt, NULL, copy_thread, &copy_threads[i]) != 0) {
+      fprintf(stderr, "fast_copy_init: pthread_create failed\n");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int fast_copy_context_init(struct dataplane_context *ctx)
+{
+  char name[32];
+  uint16_t i;
+
+  ctx->copy_done_ring = NULL;
+  ctx->copy_free_num = 0;
+  if (config.fp_copy_threads == 0)
+    return 0;
+
+  sprintf(name, "copy_done_ring_%u", ctx->id);
+  if ((ctx->copy_done_ring = rte_ring_create(name, 2 * COPY_PENDING_MAX,
+          rte_socket_id(), RING_F_SC_DEQ)) == NULL)
+  {
+    fprintf(stderr, "fast_copy_context_init: rte_ring_create failed\n");
+    return -1;
+  }
+
+  for (i = 0; i < COPY_PENDING_MAX; i++) {
+    ctx->copy_reqs[i].ctx_id = ctx->id;
+    ctx->copy_free[i] = &ctx->copy_reqs[i];
+  }
+  ctx->copy_free_num = COPY_PENDING_MAX;
+
+  return 0;
+}
+
+/**
+ * Hand a copy to the copy thread of the flow. Returns -1 if no request is
+ * available, the copy then has to be executed inline.
+ */
+int fast_copy_submit(struct dataplane_context *ctx, void *dst,
+    const void *src, uint32_t len, uint32_t flow_id, uint32_t id)
+{
+  struct copy_thread *ct = &copy_threads[flow_id % config.fp_copy_threads];
+  struct fast_copy_req *req;
+  uint64_t val = 1;
+  int ret;
+
+  if (ctx->copy_free_num == 0)
+    return -1;
+
+  req = ctx->copy_free[ctx->copy_free_num - 1];
+  req->dst = dst;
+  req->src = src;
+  req->len = len;
+  req->flow_id = flow_id;
+  req->id = id;
+  if (rte_ring_enqueue(ct->ring, req) != 0)
+    return -1;
+  ctx->copy_free_num--;
+
+  /* Pairs with the fence in copy_thread_sleep() */
+  MEM_FENCE();
+  if (ct->sleeping) {
+    ret = write(ct->evfd, &val, sizeof(val));
+    assert(ret == sizeof(val));
+  }
+  return 0;
+}
+
+/**
+ * Complete copies finished by the copy threads. Every completion adds up to
+ * two entries to the arx cache, one for the flow and one for its peer.
+ */
+unsigned fast_copy_poll(struct dataplane_context *ctx)
+{
+  struct fast_copy_req *reqs[BATCH_SIZE / 2];
+  unsigned i, n;
+
+  if (ctx->copy_free_num == COPY_PENDING_MAX || ctx->copy_done_ring == NULL)
+    return 0;
+
+  n = rte_ring_dequeue_burst(ctx->copy_done_ring, (void **) reqs,
+      BATCH_SIZE / 2, NULL);
+  for (i = 0; i < n; i++) {
+    fast_rdma_copy_done(ctx, reqs[i]->flow_id, reqs[i]->id);
+    ctx->copy_free[ctx->copy_free_num++] = reqs[i];
+  }
+
+  return n;
+}
@@ -275,7 +275,7 @@ int fast_flows_packet(struct dataplane_context *ctx,
   uint32_t payload_bytes, payload_off, seq, ack, old_avail, new_avail,
            orig_payload;
   uint8_t *payload;
-  uint32_t rx_bump = 0, tx_bump = 0, rx_pos, rtt;
+  uint32_t rx_bump = 0, rx_placed = 0, tx_bump = 0, rx_pos, rtt;
   int no_permanent_sp = 0;
   uint16_t tcp_extra_hlen, trim_start, trim_end;
   uint16_t flow_id = fs - fp_state->flowst;
@@ -500,9 +500,19 @@ int fast_flows_packet(struct dataplane_context *ctx,
 
   /* if there is payload, dma it to the receive buffer */
   if (payload_bytes > 0) {
-    flow_rx_write(fs, fs->rx_next_pos, payload_bytes, payload);
+    if (fs->wq_len == 0) {
+      flow_rx_write(fs, fs->rx_next_pos, payload_bytes, payload);
+      rx_bump = payload_bytes;
+    } else {
+      /* rdma flows place in-order payload directly into the memory region,
+       * the receive buffer position is skipped */
+      rx_placed = payload_bytes;
+      rx_pos += payload_bytes;
+      if (rx_pos >= fs->rx_len) {
+        rx_pos -= fs->rx_len;
+      }
+    }
 
-    rx_bump = payload_bytes;
     fs->rx_avail -= payload_bytes;
     fs->rx_next_pos += payload_bytes;
     if (fs->rx_next_pos >= fs->rx_len) {
@@ -510,6 +520,10 @@ int fast_flows_packet(struct dataplane_context *ctx,
     }
     assert(fs->rx_next_pos < fs->rx_len);
     fs->rx_next_seq += payload_bytes;
+
+    if (rx_placed != 0) {
+      fast_rdmarq_place(ctx, fs, payload, rx_placed);
+    }
 #ifndef SKIP_ACK
     trigger_ack = 1;
 #endif
@@ -570,7 +584,7 @@ int fast_flows_packet(struct dataplane_context *ctx,
 unlock:
   /* if we bumped at least one, then we need to add a notification to the
    * queue */
-  if (LIKELY(rx_bump != 0 || tx_bump != 0 || fin_bump)) {
+  if (LIKELY(rx_bump != 0 || rx_placed != 0 || tx_bump != 0 || fin_bump)) {
 #if PL_DEBUG_ARX
     fprintf(stderr, "dma_krx_pkt_fastpath: updating application state\n");
 #endif
@@ -942,9 +956,15 @@ static void flow_tx_segment(struct dataplane_context *ctx,
   opt_ts->ts_val = t_beui32(ts_my);
   opt_ts->ts_ecr = t_beui32(ts_echo);
 
-  /* add payload if requested */
+  /* add payload if requested, rdma flows only keep headers in the tx buffer
+   * and the payload is read directly from the memory region */
   if (payload > 0) {
-    flow_tx_read(fs, payload_pos, payload, (uint8_t *) p + hdrs_len);
+    if (fs->wq_len != 0) {
+      fast_rdma_txbuf_read(fs, seq, payload_pos, payload,
+          (uint8_t *) p + hdrs_len);
+    } else {
+      flow_tx_read(fs, payload_pos, payload, (uint8_t *) p + hdrs_len);
+    }
   }
 
   /* checksums */
@@ -2,35 +2,398 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "fastpath.h"
 #include "packet_defs.h"
 #include "internal.h"
+#include "fastemu.h"
 #include "tas_memif.h"
 #include "tas.h"
 #include "tas_rdma.h"
 #include "tcp_common.h"
+#include "utils_ring.h"
 
 #define RDMA_RQ_PENDING_PARSE 0x0
-#define RDMA_RQ_PENDING_DATA  0x14
+#define RDMA_RQ_PENDING_DATA  0xffffffff
+
+/* Memory region offset of tx frames stored completely in the tx buffer */
+#define RDMA_TXF_INLINE UINT64_MAX
+/* Tx frames gathered from the list of the WQE with the id in the low bits */
+#define RDMA_TXF_SGL (1ULL << 63)
+
+/** RDMA header fields in host byte order, independent of header version */
+struct fast_rdma_hdr {
+  uint8_t type;
+  uint8_t status;
+  uint16_t flags;
+  uint32_t id;
+  uint32_t length;
+  uint32_t imm;
+  uint64_t offset;
+  uint64_t loffset;
+};
 
 static inline void fast_rdma_txbuf_copy(struct flextcp_pl_flowst* fl,
       uint32_t len, void* src);
+static inline void fast_rdma_txbuf_reserve(struct flextcp_pl_flowst* fl,
+      uint32_t len);
+static inline void fast_rdma_txf_sync(struct flextcp_pl_flowst* fl);
 static inline void fast_rdma_rxbuf_copy(struct flextcp_pl_flowst* fl,
       uint32_t rx_head, uint32_t len, void* dst);
+static inline void fast_rdma_rx_copy(struct flextcp_pl_flowst* fl,
+      const uint8_t* src, uint32_t rx_head, uint32_t len, void* dst);
 static inline void fast_rdmacq_bump(struct flextcp_pl_flowst* fl,
       uint32_t id, uint8_t status);
 static inline void arx_rdma_cache_add(struct dataplane_context* ctx,
-      uint16_t ctx_id, uint64_t opaque, uint32_t wq_tail, uint32_t cq_head);
+      uint16_t ctx_id, uint64_t opaque, uint32_t wq_tail, uint32_t cq_head,
+      uint32_t rcv_tail);
+static inline void fast_rdma_cq_notify(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fs);
 void fast_rdma_poll(struct dataplane_context* ctx,
       struct flextcp_pl_flowst* fl);
+static inline struct flextcp_pl_flowst* fast_rdma_lock(
+      struct flextcp_pl_flowst* fs);
+static void fast_rdma_poll_flow(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fl, struct flextcp_pl_flowst* peer);
 
-int fast_rdmawq_bump(struct dataplane_context *ctx, uint32_t flow_id,
-    uint32_t new_wq_head, uint32_t new_cq_tail)
+static inline uint32_t fast_rdma_hdr_len(const struct flextcp_pl_flowst* fs)
 {
-  struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
+  return (fs->rdma_hdr_ver == RDMA_HDR_V2 ? sizeof(struct rdma_hdr_v2)
+      : sizeof(struct rdma_hdr));
+}
+
+static inline void fast_rdma_hdr_decode(const struct flextcp_pl_flowst* fs,
+      const void* buf, struct fast_rdma_hdr* h)
+{
+  if (fs->rdma_hdr_ver == RDMA_HDR_V2)
+  {
+    const struct rdma_hdr_v2* hdr = buf;
+    h->type = hdr->type;
+    h->status = hdr->status;
+    h->flags = f_beui16(hdr->flags);
+    h->id = f_beui32(hdr->id);
+    h->length = f_beui32(hdr->length);
+    h->imm = f_beui32(hdr->imm);
+    h->offset = f_beui64(hdr->offset);
+    h->loffset = f_beui64(hdr->loffset);
+  }
+  else
+  {
+    const struct rdma_hdr* hdr = buf;
+    h->type = hdr->type;
+    h->status = hdr->status;
+    h->flags = f_beui16(hdr->flags);
+    h->id = f_beui32(hdr->id);
+    h->length = f_beui32(hdr->length);
+    h->offset = f_beui32(hdr->offset);
+    h->loffset = f_beui32(hdr->loffset);
+    h->imm = 0;
+  }
+}
+
+/* Returns the header length */
+static inline uint32_t fast_rdma_hdr_encode(const struct flextcp_pl_flowst* fs,
+      const struct fast_rdma_hdr* h, void* buf)
+{
+  if (fs->rdma_hdr_ver == RDMA_HDR_V2)
+  {
+    struct rdma_hdr_v2* hdr = buf;
+    hdr->type = h->type;
+    hdr->status = h->status;
+    hdr->flags = t_beui16(h->flags);
+    hdr->id = t_beui32(h->id);
+    hdr->length = t_beui32(h->length);
+    hdr->imm = t_beui32(h->imm);
+    hdr->offset = t_beui64(h->offset);
+    hdr->loffset = t_beui64(h->loffset);
+    return sizeof(*hdr);
+  }
+  else
+  {
+    struct rdma_hdr* hdr = buf;
+    hdr->type = h->type;
+    hdr->status = h->status;
+    hdr->flags = t_beui16(h->flags);
+    hdr->id = t_beui32(h->id);
+    hdr->length = t_beui32(h->length);
+    hdr->offset = t_beui32(h->offset);
+    hdr->loffset = t_beui32(h->loffset);
+    return sizeof(*hdr);
+  }
+}
+
+/* Wire type bit for a WQE operation */
+static inline uint8_t fast_rdma_op_type(uint8_t op)
+{
+  switch (op)
+  {
+    case RDMA_OP_READ:
+      return RDMA_READ;
+    case RDMA_OP_FETCH_ADD:
+      return RDMA_FETCH_ADD;
+    case RDMA_OP_CMP_SWAP:
+      return RDMA_CMP_SWAP;
+    case RDMA_OP_SEND:
+      return RDMA_SEND;
+    case RDMA_OP_WRITE_IMM:
+      return RDMA_WRITE | RDMA_IMM;
+    default:
+      return RDMA_WRITE;
+  }
+}
+
+/* Length of atomic operands or result following a header of this type */
+static inline uint32_t fast_rdma_atomic_len(uint8_t type)
+{
+  if ((type & RDMA_ATOMIC) == 0)
+    return 0;
+
+  return ((type & RDMA_REQUEST) == RDMA_REQUEST ?
+      sizeof(struct rdma_atomic_req) : sizeof(struct rdma_atomic_resp));
+}
+
+/* Bytes to collect in pending_rq_buf before a received frame is parsed */
+static inline uint32_t fast_rdma_rq_hdr_len(const struct flextcp_pl_flowst* fs)
+{
+  uint32_t len = fast_rdma_hdr_len(fs);
+
+  /* type is the first byte of every header version */
+  if (fs->pending_rq_state > 0)
+    len += fast_rdma_atomic_len(fs->pending_rq_buf[0]);
+  return len;
+}
+
+/* Check that [off, off + len) lies within the memory region */
+static inline int fast_rdma_mr_check(const struct flextcp_pl_flowst* fs,
+      uint64_t off, uint32_t len)
+{
+  return len <= fs->mr_len && off <= fs->mr_len - len;
+}
+
+/**
+ * Execute an atomic request on an 8-byte aligned word of the memory region.
+ * The word is also accessed by the application, hence the atomic builtins.
+ */
+static inline uint8_t fast_rdma_atomic_exec(struct flextcp_pl_flowst* fs,
+      uint8_t type, uint64_t off, const struct rdma_atomic_req* req,
+      uint64_t* old)
+{
+  uint64_t* word;
+  uint64_t expected;
+
+  *old = 0;
+  if (!fast_rdma_mr_check(fs, off, sizeof(uint64_t)))
+    return RDMA_OUT_OF_BOUNDS;
+  if (((fs->mr_base + off) & (sizeof(uint64_t) - 1)) != 0)
+    return RDMA_UNALIGNED;
+
+  word = dma_pointer(fs->mr_base + off, sizeof(uint64_t));
+  if ((type & RDMA_FETCH_ADD) == RDMA_FETCH_ADD)
+  {
+    *old = __atomic_fetch_add(word, f_beui64(req->compare_add),
+        __ATOMIC_SEQ_CST);
+  }
+  else
+  {
+    /* expected is replaced with the current value if the compare fails */
+    expected = f_beui64(req->compare_add);
+    __atomic_compare_exchange_n(word, &expected, f_beui64(req->swap), 0,
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    *old = expected;
+  }
+
+  return RDMA_SUCCESS;
+}
+
+static inline struct flextcp_pl_rdma_db* fast_rdma_db(
+      struct flextcp_pl_flowst* fs)
+{
+  return dma_pointer(fs->wq_base + fs->wq_len,
+      sizeof(struct flextcp_pl_rdma_db));
+}
+
+/* Work queue entry at position pos */
+static inline struct rdma_wqe* fast_rdma_wq_entry(
+      struct flextcp_pl_flowst* fs, uint32_t pos)
+{
+  return dma_pointer(fs->wq_base + ring_off(fs->wq_len, pos),
+      sizeof(struct rdma_wqe));
+}
+
+/* Response queue entry at position pos */
+static inline struct rdma_wqe* fast_rdma_rq_entry(
+      struct flextcp_pl_flowst* fs, uint32_t pos)
+{
+  return dma_pointer(fs->rq_base + ring_off(fs->wq_len, pos),
+      sizeof(struct rdma_wqe));
+}
+
+/* Receive queue entry at position pos, the queue follows the doorbell */
+static inline struct rdma_wqe* fast_rdma_rcv_entry(
+      struct flextcp_pl_flowst* fs, uint32_t pos)
+{
+  return dma_pointer(fs->wq_base + fs->wq_len +
+      sizeof(struct flextcp_pl_rdma_db) + ring_off(fs->wq_len, pos),
+      sizeof(struct rdma_wqe));
+}
+
+/* Inline payload slot of the work queue entry at position pos */
+static inline void* fast_rdma_inline_data(struct flextcp_pl_flowst* fs,
+      uint32_t pos)
+{
+  return dma_pointer(fs->wq_base + 2 * fs->wq_len +
+      sizeof(struct flextcp_pl_rdma_db) +
+      ring_off(fs->wq_len, pos) / sizeof(struct rdma_wqe) * RDMA_INLINE_MAX,
+      RDMA_INLINE_MAX);
+}
+
+/* Scatter/gather list of the work queue entry at position pos */
+static inline const struct rdma_sge* fast_rdma_sgl(
+      struct flextcp_pl_flowst* fs, uint32_t pos)
+{
+  return fast_rdma_inline_data(fs, pos);
+}
+
+/* Check that all list entries are in the memory region and add up to len */
+static inline int fast_rdma_sgl_check(struct flextcp_pl_flowst* fs,
+      uint32_t pos, uint32_t len)
+{
+  const struct rdma_sge* sgl = fast_rdma_sgl(fs, pos);
+  uint64_t total = 0;
+  unsigned i;
+
+  for (i = 0; i < RDMA_SGE_MAX; i++)
+  {
+    if (!fast_rdma_mr_check(fs, sgl[i].loff, sgl[i].len))
+      return 0;
+    total += sgl[i].len;
+  }
+  return total == len;
+}
+
+/**
+ * Map byte off of the payload of a list to the memory region. Returns the
+ * number of contiguous bytes at *mr_off, 0 if off is past the list.
+ */
+static inline uint32_t fast_rdma_sgl_map(struct flextcp_pl_flowst* fs,
+      uint32_t pos, uint32_t off, uint64_t* mr_off)
+{
+  const struct rdma_sge* sgl = fast_rdma_sgl(fs, pos);
+  unsigned i;
+
+  for (i = 0; i < RDMA_SGE_MAX; i++)
+  {
+    if (off < sgl[i].len)
+    {
+      *mr_off = sgl[i].loff + off;
+      return sgl[i].len - off;
+    }
+    off -= sgl[i].len;
+  }
+  return 0;
+}
+
+/* Outstanding READ with id that scatters its response into a list */
+static inline int fast_rdma_sgl_read(struct flextcp_pl_flowst* fs,
+      uint32_t id)
+{
+  struct rdma_wqe* wqe;
+
+  if (id >= fs->wq_len || id % sizeof(struct rdma_wqe) != 0)
+    return 0;
+
+  wqe = fast_rdma_wq_entry(fs, id);
+  return wqe->id == id && wqe->type == RDMA_OP_READ
+      && wqe->status == RDMA_RESP_PENDING
+      && (wqe->flags & RDMA_WQE_SGL) != 0;
+}
+
+/* Next posted receive buffer, NULL if none is posted */
+static inline struct rdma_wqe* fast_rdma_recv_next(
+      struct flextcp_pl_flowst* fs)
+{
+  struct flextcp_pl_rdma_db* db = fast_rdma_db(fs);
+  uint32_t rcv_head = db->rcv_head;
+
+  if (rcv_head == fs->rcv_tail
+      || ring_used(rcv_head, fs->rcv_tail) > fs->wq_len)
+    return NULL;
+
+  return fast_rdma_rcv_entry(fs, fs->rcv_tail);
+}
+
+/**
+ * Place an incoming SEND of len bytes in the next posted receive buffer. The
+ * buffer is only consumed once all data is received (fast_rdma_recv_done()).
+ */
+static inline void fast_rdma_recv_start(struct flextcp_pl_flowst* fs,
+      struct rdma_wqe* wqe, uint32_t len)
+{
+  struct rdma_wqe* recv = fast_rdma_recv_next(fs);
+
+  wqe->type = RDMA_OP_SEND;
+  if (recv == NULL)
+  {
+    wqe->status = RDMA_NO_RECV;
+    return;
+  }
+
+  recv->type = RDMA_OP_RECV;
+  wqe->loff = recv->loff;
+  if (len > recv->len || !fast_rdma_mr_check(fs, recv->loff, len))
+  {
+    wqe->status = RDMA_OUT_OF_BOUNDS;
+    recv->len = 0;
+  }
+  else
+  {
+    wqe->status = RDMA_PENDING;
+    recv->len = len;
+  }
+}
+
+/**
+ * Take the next posted receive buffer for the completion of an incoming write
+ * with immediate. Payload is placed at the offset given by the writer.
+ */
+static inline void fast_rdma_recv_imm(struct flextcp_pl_flowst* fs,
+      struct rdma_wqe* wqe, uint32_t len, uint32_t imm)
+{
+  struct rdma_wqe* recv = fast_rdma_recv_next(fs);
+
+  wqe->type = RDMA_OP_WRITE_IMM;
+  if (recv == NULL)
+  {
+    wqe->status = RDMA_NO_RECV;
+    return;
+  }
+
+  recv->type = RDMA_OP_WRITE_IMM;
+  recv->imm = imm;
+  recv->len = len;
+}
+
+/* Complete the receive buffer used by the last SEND or write with immediate */
+static inline void fast_rdma_recv_done(struct flextcp_pl_flowst* fs,
+      uint8_t status)
+{
+  struct rdma_wqe* recv = fast_rdma_rcv_entry(fs, fs->rcv_tail);
+
+  recv->status = status;
+  fs->rcv_tail += sizeof(struct rdma_wqe);
+}
+
+/* Pick up queue pointers published by the application in the doorbell.
+ * Returns -1 if they are invalid and were ignored. */
+static inline int fast_rdma_db_poll(struct flextcp_pl_flowst* fs,
+      struct flextcp_pl_rdma_db* db)
+{
+  uint32_t new_wq_head = db->wq_head;
+  uint32_t new_cq_tail = db->cq_tail;
 
-  fs_lock(fs);
+  if (new_wq_head == fs->wq_head && new_cq_tail == fs->cq_tail)
+    return 0;
 
 /**
  * Work queue regions
@@ -44,84 +407,249 @@ int fast_rdmawq_bump(struct dataplane_context *ctx, uint32_t flow_id,
  *  D: wq_head            ^: In-progress WQEs - req. not yet sent by fp
  *
  *  NOTE: head is always non-inclusive - i.e. [tail, head)
+ *
+ *  Positions are free-running, so A <= B <= C <= D holds in ring distance
+ *  from A and D - A <= wq_len.
  */
 
-  uint32_t wq_len, wq_head, wq_tail;
-  uint32_t cq_head, cq_tail;
-  wq_len = fs->wq_len;
-  wq_head = fs->wq_head;
-  wq_tail = fs->wq_tail;
-  cq_head = fs->cq_head;
-  cq_tail = fs->cq_tail;
-
-  /**
-   *  TODO: Validate wq bump
-   *
-   *  NOTE: Is this too expensive ?!
-   *  Should we trust the application input blindly ?
-   */
-  uint8_t invalid = ((new_wq_head >= wq_len)
-        || (wq_tail < new_wq_head && new_wq_head < wq_head)
-        || (new_wq_head < wq_head && wq_head < wq_tail)
-        || (wq_head < wq_tail && wq_tail <= new_wq_head)
-        || (new_cq_tail >= wq_len)
-        || (new_cq_tail < cq_tail && cq_tail < cq_head)
-        || (cq_tail < cq_head && cq_head < new_cq_tail)
-        || (cq_head < new_cq_tail && new_cq_tail < cq_tail)
-        || (wq_tail < new_wq_head && wq_tail < cq_head && cq_head < new_wq_head)
-        || (wq_tail < new_wq_head && wq_tail < new_cq_tail && new_cq_tail < new_wq_head)
-        || (new_wq_head < wq_tail && cq_head > wq_tail)
-        || (cq_head < new_wq_head && new_wq_head < wq_tail)
-        || (new_wq_head < wq_tail && new_cq_tail > wq_tail)
-        || (new_cq_tail < new_wq_head && new_wq_head < wq_tail));
-
-  if (UNLIKELY(invalid))
-  {
-    goto RDMA_BUMP_ERROR;
+  /* The application only moves cq_tail over completed WQEs, and new WQEs
+   * must fit between wq_tail and the new cq_tail */
+  if (UNLIKELY(!ring_in(fs->cq_tail, fs->cq_head, new_cq_tail)
+        || !ring_in(fs->wq_tail, new_cq_tail + fs->wq_len, new_wq_head)
+        || ((new_wq_head | new_cq_tail) % sizeof(struct rdma_wqe)) != 0))
+  {
+    fprintf(stderr, "Invalid bump flowid=%u len=%u wq_head=%u wq_tail=%u \
+            cq_head=%u cq_tail=%u new_wq_head=%u new_cq_tail=%u\n",
+            (uint32_t) (fs - fp_state->flowst), fs->wq_len, fs->wq_head,
+            fs->wq_tail, fs->cq_head, fs->cq_tail, new_wq_head, new_cq_tail);
+    return -1;
   }
 
   /* Update the queue */
   fs->wq_head = new_wq_head;
   fs->cq_tail = new_cq_tail;
+  return 0;
+}
+
+/**
+ * Put a flow on the doorbell poll list of this core. Returns 0 if doorbell
+ * polling is disabled or the list is full, the application then bumps the
+ * flow for every post.
+ */
+static inline int fast_rdma_db_list(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fs)
+{
+  if (fs->rdma_db_listed)
+    return 1;
+  if (!config.fp_rdma_db_poll || ctx->rdma_db_num == RDMA_DB_POLL_MAX)
+    return 0;
+
+  ctx->rdma_db_flows[ctx->rdma_db_num++] = fs - fp_state->flowst;
+  fs->rdma_db_listed = 1;
+  return 1;
+}
 
-  /* No pending workqueue requests previously !*/
-  if (wq_head == wq_tail)
+/**
+ * Decide whether the fast path polls the doorbell of this flow. A flow is
+ * polled from dataplane_loop() while it has WQEs, tx data or a loopback copy
+ * pending. Returns 1 if the application published new entries while the flow
+ * went idle.
+ */
+static inline int fast_rdma_db_idle(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fs, struct flextcp_pl_rdma_db* db)
+{
+  if (fs->wq_head != fs->wq_tail || fs->tx_avail != 0 || fs->tx_sent != 0
+      || fs->rdma_copy_pending != 0)
   {
-    uint32_t old_avail, new_avail;
-    // copy packets into txbuf
-    old_avail = tcp_txavail(fs, NULL);
-    fast_rdma_poll(ctx, fs);
-    new_avail = tcp_txavail(fs, NULL);
+    if (!db->fp_active && fast_rdma_db_list(ctx, fs))
+      db->fp_active = 1;
+    return 0;
+  }
 
-    if (old_avail < new_avail) {
-      if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail -
-            old_avail, TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK
-            | QMAN_ADD_AVAIL) != 0)
-      {
-        fprintf(stderr, "fast_rdmawq_bump: qman_set failed, UNEXPECTED\n");
-        abort();
-      }
+  if (db->fp_active)
+  {
+    db->fp_active = 0;
+    /* Pairs with the fence in rdma_conn_bump() */
+    MEM_FENCE();
+  }
+
+  return db->wq_head != fs->wq_head;
+}
+
+/**
+ * Poll a locked flow and schedule the payload it queued for transmission.
+ */
+static void fast_rdma_wakeup(struct dataplane_context *ctx, uint32_t flow_id,
+    struct flextcp_pl_flowst *fs, struct flextcp_pl_flowst *peer)
+{
+  uint32_t old_avail, new_avail;
+
+  old_avail = tcp_txavail(fs, NULL);
+  fast_rdma_poll_flow(ctx, fs, peer);
+  new_avail = tcp_txavail(fs, NULL);
+
+  if (old_avail < new_avail) {
+    if (qman_set(&ctx->qman, flow_id, fs->tx_rate, new_avail -
+          old_avail, TCP_MSS, QMAN_SET_RATE | QMAN_SET_MAXCHUNK
+          | QMAN_ADD_AVAIL) != 0)
+    {
+      fprintf(stderr, "fast_rdma_wakeup: qman_set failed, UNEXPECTED\n");
+      abort();
     }
   }
+}
+
+int fast_rdmawq_bump(struct dataplane_context *ctx, uint32_t flow_id,
+    uint32_t new_wq_head, uint32_t new_cq_tail)
+{
+  struct flextcp_pl_flowst *fs = &fp_state->flowst[flow_id];
+  struct flextcp_pl_flowst *peer;
+
+  peer = fast_rdma_lock(fs);
+
+  /* The bump only wakes up the flow, queue pointers are taken from the
+   * doorbell which is at least as recent as the bump. */
+  fast_rdma_wakeup(ctx, flow_id, fs, peer);
+
+  if (peer != NULL)
+    fs_unlock(peer);
   fs_unlock(fs);
   return -1;  /* Return value compatible with fast_flows_bump() */
+}
 
-RDMA_BUMP_ERROR:
-  fs_unlock(fs);
-  fprintf(stderr, "Invalid bump flowid=%u len=%u wq_head=%u wq_tail=%u \
-          cq_head=%u cq_tail=%u new_wq_head=%u new_cq_tail=%u\n",
-          flow_id, wq_len, wq_head, wq_tail, cq_head, cq_tail,
-          new_wq_head, new_cq_tail);
-  return -1;
+/**
+ * Poll the doorbells of the flows on this core's list, new WQEs are picked up
+ * without a bump from the application. Flows that went idle leave the list.
+ * At most max flows are bumped, returns their number.
+ */
+unsigned fast_rdma_db_poll_active(struct dataplane_context* ctx,
+    unsigned max)
+{
+  struct flextcp_pl_flowst* fs;
+  struct flextcp_pl_rdma_db* db;
+  uint32_t flow_id;
+  uint16_t visited = 0, i;
+  unsigned n = 0;
+
+  while (visited < ctx->rdma_db_num && n < max)
+  {
+    i = ctx->rdma_db_pos;
+    if (i >= ctx->rdma_db_num)
+      i = 0;
+    flow_id = ctx->rdma_db_flows[i];
+    fs = &fp_state->flowst[flow_id];
+    db = fast_rdma_db(fs);
+
+    /* Entries of idle or reset flows are dropped under the flow lock, where
+     * the flow is also added again */
+    if (!fs->rdma_db_listed || !db->fp_active)
+    {
+      fs_lock(fs);
+      if (!fs->rdma_db_listed || !db->fp_active)
+      {
+        fs->rdma_db_listed = 0;
+        ctx->rdma_db_flows[i] = ctx->rdma_db_flows[--ctx->rdma_db_num];
+        ctx->rdma_db_pos = i;
+        fs_unlock(fs);
+        visited++;
+        continue;
+      }
+      fs_unlock(fs);
+    }
+
+    if (db->wq_head != fs->wq_head)
+    {
+      fast_rdmawq_bump(ctx, flow_id, db->wq_head, db->cq_tail);
+      n++;
+    }
+    ctx->rdma_db_pos = i + 1;
+    visited++;
+  }
+
+  return n;
 }
 
-int fast_rdmarq_bump(struct dataplane_context* ctx,
-    struct flextcp_pl_flowst* fs, uint32_t prev_rx_head, uint32_t rx_bump)
+/* Return credits granted by the peer in a header */
+static inline void fast_rdma_credits_add(struct flextcp_pl_flowst* fs,
+      uint16_t flags)
 {
-  uint32_t rq_head, rq_len, rx_head, rx_len, new_rx_head;
+  uint32_t credits;
+
+  if (fs->rdma_credits_max == 0)
+    return;
+
+  credits = fs->rdma_credits + (flags >> RDMA_FLAG_CREDITS_SHIFT);
+  fs->rdma_credits = MIN(credits, fs->rdma_credits_max);
+}
+
+/**
+ * Queue the request at rq_head for a response. A peer that ignores its
+ * credits and overruns the RQ fails the flow instead of overwriting
+ * responses that were not sent yet. Returns the new rq_head.
+ */
+static inline uint32_t fast_rdma_rq_push(struct flextcp_pl_flowst* fs,
+      uint32_t rq_head)
+{
+  uint32_t next = rq_head + sizeof(struct rdma_wqe);
+
+  /* The entry at rq_head is written while its request is parsed */
+  if (UNLIKELY(ring_used(next, fs->rq_tail) >= fs->wq_len))
+  {
+    if (!fs->rdma_failed)
+      fprintf(stderr, "%s(): flow %u RQ overrun\n", __func__,
+          (uint32_t) (fs - fp_state->flowst));
+    fs->rdma_failed = 1;
+    return rq_head;
+  }
+
+  return next;
+}
+
+/**
+ * Place len bytes of a READ response into the list of the requesting WQE,
+ * wqe->loff is the position in the payload. The list is in application
+ * memory, entries that became invalid fail the READ.
+ */
+static inline void fast_rdma_rx_scatter(struct flextcp_pl_flowst* fs,
+    struct rdma_wqe* wqe, const uint8_t* src, uint32_t rx_head, uint32_t len)
+{
+  uint32_t part, off = wqe->loff;
+  uint64_t mr_off;
+
+  while (len > 0)
+  {
+    part = MIN(len, fast_rdma_sgl_map(fs, wqe->roff, off, &mr_off));
+    if (UNLIKELY(part == 0 || !fast_rdma_mr_check(fs, mr_off, part)))
+    {
+      wqe->status = RDMA_OUT_OF_BOUNDS;
+      fs->rx_avail += len;
+      return;
+    }
+
+    fast_rdma_rx_copy(fs, src, rx_head, part,
+        dma_pointer(fs->mr_base + mr_off, part));
+
+    rx_head += part;
+    if (rx_head >= fs->rx_len)
+      rx_head -= fs->rx_len;
+    if (src != NULL)
+      src += part;
+    off += part;
+    len -= part;
+  }
+}
+
+/**
+ * Parse the received rdma stream and place payload in the memory region.
+ * Bytes are taken from src if set, otherwise from the receive buffer at
+ * prev_rx_head. Returns 1 if completions were added to the CQ.
+ */
+static int fast_rdma_rx_consume(struct flextcp_pl_flowst* fs,
+    const uint8_t* src, uint32_t prev_rx_head, uint32_t rx_bump)
+{
+  uint32_t rq_head, rx_head, rx_len, new_rx_head;
   uint8_t cq_bump = 0;
   rq_head = fs->rq_head;
-  rq_len = fs->wq_len;
   rx_head = prev_rx_head;
   rx_len = fs->rx_len;
 
@@ -129,20 +657,27 @@ int fast_rdmarq_bump(struct dataplane_context* ctx,
   if (new_rx_head >= rx_len)
     new_rx_head -= rx_len;
 
+  /* Frames without payload complete as soon as the header is parsed */
   uint32_t wqe_pending_rx, rx_bump_len;
-  while (rx_head != new_rx_head && rx_bump > 0)
+  while ((rx_head != new_rx_head && rx_bump > 0)
+      || (fs->pending_rq_state == RDMA_RQ_PENDING_DATA &&
+        fast_rdma_rq_entry(fs, rq_head)->len == 0))
   {
     if (fs->pending_rq_state == RDMA_RQ_PENDING_DATA)
     {
-      struct rdma_wqe* wqe = dma_pointer(fs->rq_base + rq_head,
-                                            sizeof(struct rdma_wqe));
+      struct rdma_wqe* wqe = fast_rdma_rq_entry(fs, rq_head);
       wqe_pending_rx = wqe->len;
       rx_bump_len = MIN(wqe_pending_rx, rx_bump);
 
-      void* mr_ptr = dma_pointer(fs->mr_base + wqe->loff, rx_bump_len);
-
-      if (wqe->status == RDMA_PENDING)
-        fast_rdma_rxbuf_copy(fs, rx_head, rx_bump_len, mr_ptr);
+      if (wqe->status == RDMA_PENDING && (wqe->flags & RDMA_WQE_SGL) != 0)
+      {
+        fast_rdma_rx_scatter(fs, wqe, src, rx_head, rx_bump_len);
+      }
+      else if (wqe->status == RDMA_PENDING)
+      {
+        void* mr_ptr = dma_pointer(fs->mr_base + wqe->loff, rx_bump_len);
+        fast_rdma_rx_copy(fs, src, rx_head, rx_bump_len, mr_ptr);
+      }
       else
       {
         /* Ignore this data */
@@ -152,6 +687,8 @@ int fast_rdmarq_bump(struct dataplane_context* ctx,
       rx_head += rx_bump_len;
       if (rx_head >= rx_len)
         rx_head -= rx_len;
+      if (src != NULL)
+        src += rx_bump_len;
       rx_bump -= rx_bump_len;
       wqe_pending_rx -= rx_bump_len;
       wqe->len -= rx_bump_len;
@@ -168,52 +705,113 @@ int fast_rdmarq_bump(struct dataplane_context* ctx,
           fast_rdmacq_bump(fs, wqe->id, wqe->status);
           cq_bump = 1;
         }
-        if(wqe->type == (RDMA_OP_WRITE)){
-        rq_head += sizeof(struct rdma_wqe);
-        if (rq_head >= rq_len)
-          rq_head -= rq_len;
+        if((wqe->type == (RDMA_OP_SEND) || wqe->type == (RDMA_OP_WRITE_IMM))
+            && wqe->status != RDMA_NO_RECV){
+          fast_rdma_recv_done(fs, wqe->status);
+          cq_bump = 1;
+        }
+        if(wqe->type == (RDMA_OP_WRITE) || wqe->type == (RDMA_OP_SEND)
+            || wqe->type == (RDMA_OP_WRITE_IMM)){
+          rq_head = fast_rdma_rq_push(fs, rq_head);
         }
       }
     }
     else
     {
-      wqe_pending_rx = 20 - fs->pending_rq_state;
+      wqe_pending_rx = fast_rdma_rq_hdr_len(fs) - fs->pending_rq_state;
       rx_bump_len = MIN(wqe_pending_rx, rx_bump);
-      fast_rdma_rxbuf_copy(fs, rx_head, rx_bump_len, fs->pending_rq_buf + fs->pending_rq_state);
+      fast_rdma_rx_copy(fs, src, rx_head, rx_bump_len, fs->pending_rq_buf + fs->pending_rq_state);
 
       rx_head += rx_bump_len;
       if (rx_head >= rx_len)
         rx_head -= rx_len;
+      if (src != NULL)
+        src += rx_bump_len;
       rx_bump -= rx_bump_len;
-      wqe_pending_rx -= rx_bump_len;
       fs->pending_rq_state += rx_bump_len;
 
-      if (wqe_pending_rx == 0)
+      /* Header complete, atomic operands may still follow */
+      if (fs->pending_rq_state == fast_rdma_rq_hdr_len(fs))
       {
-        struct rdma_hdr* hdr = (struct rdma_hdr*) fs->pending_rq_buf;
-        
-        struct rdma_wqe* wqe = dma_pointer(fs->rq_base + rq_head, sizeof(struct rdma_wqe));
-        wqe->id = f_beui32(hdr->id);
-        wqe->len = f_beui32(hdr->length);
-        wqe->loff = f_beui32(hdr->offset);
-        if (wqe->loff + wqe->len > fs->mr_len)
+        struct fast_rdma_hdr hdr;
+        fast_rdma_hdr_decode(fs, fs->pending_rq_buf, &hdr);
+        fast_rdma_credits_add(fs, hdr.flags);
+
+        /* Payload follows unless the type below says otherwise */
+        fs->pending_rq_state = RDMA_RQ_PENDING_DATA;
+
+        struct rdma_wqe* wqe = fast_rdma_rq_entry(fs, rq_head);
+        wqe->id = hdr.id;
+        wqe->len = hdr.length;
+        wqe->flags = 0;
+        wqe->loff = hdr.offset;
+        if (!fast_rdma_mr_check(fs, wqe->loff, wqe->len))
             wqe->status = RDMA_OUT_OF_BOUNDS;
         else
            wqe->status = RDMA_PENDING;
-        wqe->roff = f_beui32(hdr->loffset);
+        wqe->roff = hdr.loffset;
 
-        uint8_t type = hdr->type;
-        if ((type & RDMA_RESPONSE) == RDMA_RESPONSE)
+        uint8_t type = hdr.type;
+        if ((type & RDMA_ATOMIC) != 0)
+        {
+          /* Operands or result were collected with the header */
+          fs->pending_rq_state = RDMA_RQ_PENDING_PARSE;
+          const uint8_t* payload = fs->pending_rq_buf + fast_rdma_hdr_len(fs);
+
+          if ((type & RDMA_REQUEST) == RDMA_REQUEST)
+          {
+            /* The old value is kept in loff until the response is sent */
+            wqe->type = ((type & RDMA_FETCH_ADD) == RDMA_FETCH_ADD ?
+                RDMA_OP_FETCH_ADD : RDMA_OP_CMP_SWAP);
+            wqe->len = sizeof(struct rdma_atomic_resp);
+            wqe->status = fast_rdma_atomic_exec(fs, type, hdr.offset,
+                (const struct rdma_atomic_req*) payload, &wqe->loff);
+
+            rq_head = fast_rdma_rq_push(fs, rq_head);
+          }
+          else
+          {
+            uint8_t status = hdr.status;
+            uint64_t old;
+
+            if (status == RDMA_SUCCESS)
+            {
+              if (fast_rdma_mr_check(fs, hdr.offset, sizeof(old)))
+              {
+                old = f_beui64(((const struct rdma_atomic_resp*) payload)->old);
+                dma_write(fs->mr_base + hdr.offset, sizeof(old), &old);
+              }
+              else
+              {
+                status = RDMA_OUT_OF_BOUNDS;
+              }
+            }
+            fast_rdmacq_bump(fs, hdr.id, status);
+            cq_bump = 1;
+          }
+        }
+        else if ((type & RDMA_RESPONSE) == RDMA_RESPONSE)
         {
           if ((type & RDMA_READ) == RDMA_READ)
           {
             wqe->type = (RDMA_OP_READ);
+
+            /* Scatter into the list of the READ, roff keeps its id and loff
+             * the position in the payload */
+            if (fast_rdma_sgl_read(fs, hdr.id))
+            {
+              wqe->flags = RDMA_WQE_SGL;
+              wqe->roff = hdr.id;
+              wqe->loff = 0;
+              wqe->status = (fast_rdma_sgl_check(fs, hdr.id, wqe->len) ?
+                  RDMA_PENDING : RDMA_OUT_OF_BOUNDS);
+            }
           }
-          else if ((type & RDMA_WRITE) == RDMA_WRITE)
+          else if ((type & (RDMA_WRITE | RDMA_SEND)) != 0)
           {
             /* No more data to be received */
             fs->pending_rq_state = RDMA_RQ_PENDING_PARSE;
-            fast_rdmacq_bump(fs, f_beui32(hdr->id), hdr->status);
+            fast_rdmacq_bump(fs, hdr.id, hdr.status);
             cq_bump = 1;
           }
           else
@@ -228,15 +826,21 @@ int fast_rdmarq_bump(struct dataplane_context* ctx,
           {
             wqe->type = (RDMA_OP_READ);
             fs->pending_rq_state = RDMA_RQ_PENDING_PARSE; /* No more data to be received */
-            
-            rq_head += sizeof(struct rdma_wqe);
-            if (rq_head >= rq_len)
-               rq_head -= rq_len;
+
+            rq_head = fast_rdma_rq_push(fs, rq_head);
+          }
+          else if ((type & (RDMA_WRITE | RDMA_IMM)) == (RDMA_WRITE | RDMA_IMM))
+          {
+            fast_rdma_recv_imm(fs, wqe, hdr.length, hdr.imm);
           }
           else if ((type & RDMA_WRITE) == RDMA_WRITE)
           { 
             wqe->type = (RDMA_OP_WRITE);
           }
+          else if ((type & RDMA_SEND) == RDMA_SEND)
+          {
+            fast_rdma_recv_start(fs, wqe, hdr.length);
+          }
           else
           {
             fprintf(stderr, "%s():%d Invalid request type\n", __func__, __LINE__);
@@ -253,59 +857,141 @@ int fast_rdmarq_bump(struct dataplane_context* ctx,
   }
 
   fs->rq_head = rq_head;
-  if (cq_bump)
-    arx_rdma_cache_add(ctx, fs->db_id, fs->opaque, fs->wq_tail, fs->cq_head);
+  return cq_bump;
+}
+
+int fast_rdmarq_bump(struct dataplane_context* ctx,
+    struct flextcp_pl_flowst* fs, uint32_t prev_rx_head, uint32_t rx_bump)
+{
+  if (fast_rdma_rx_consume(fs, NULL, prev_rx_head, rx_bump))
+    fast_rdma_cq_notify(ctx, fs);
+
+  return 0;
+}
+
+int fast_rdmarq_place(struct dataplane_context* ctx,
+    struct flextcp_pl_flowst* fs, const void* payload, uint32_t len)
+{
+  if (fast_rdma_rx_consume(fs, payload, 0, len))
+    fast_rdma_cq_notify(ctx, fs);
 
   return 0;
 }
 
 static inline void arx_rdma_cache_add(struct dataplane_context* ctx,
-      uint16_t ctx_id, uint64_t opaque, uint32_t wq_tail, uint32_t cq_head)
+      uint16_t ctx_id, uint64_t opaque, uint32_t wq_tail, uint32_t cq_head,
+      uint32_t rcv_tail)
 {
-  uint16_t id = ctx->arx_num++;
+  uint16_t id = ctx->arx_num;
+
+  /* Merge with the previous update of the same flow */
+  if (id > 0 && ctx->arx_ctx[id - 1] == ctx_id
+      && ctx->arx_cache[id - 1].type == FLEXTCP_PL_ARX_RDMAUPDATE
+      && ctx->arx_cache[id - 1].msg.rdmaupdate.opaque == opaque)
+    id--;
+  else
+    ctx->arx_num++;
 
   ctx->arx_ctx[id] = ctx_id;
   ctx->arx_cache[id].type = FLEXTCP_PL_ARX_RDMAUPDATE;
   ctx->arx_cache[id].msg.rdmaupdate.opaque = opaque;
   ctx->arx_cache[id].msg.rdmaupdate.wq_tail = wq_tail;
   ctx->arx_cache[id].msg.rdmaupdate.cq_head = cq_head;
+  ctx->arx_cache[id].msg.rdmaupdate.rcv_tail = rcv_tail;
 }
 
-static inline void fast_rdmacq_bump(struct flextcp_pl_flowst* fl,
-      uint32_t id, uint8_t status)
+/* Report new completions to the application */
+static inline void fast_rdma_cq_notify(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fs)
+{
+  struct flextcp_pl_rdma_db* db = fast_rdma_db(fs);
+
+  arx_rdma_cache_add(ctx, fs->db_id, fs->opaque, fs->wq_tail, fs->cq_head,
+      fs->rcv_tail);
+
+  /* Pairs with the fence in rdma_cq_arm(): completions written above are
+   * visible to the application or we see it armed */
+  MEM_FENCE();
+  if (db->cq_armed)
+  {
+    db->cq_armed = 0;
+    fp_state->appctx[ctx->id][fs->db_id].kick_pending = 1;
+  }
+}
+
+/* Advance cq_head over contiguous completed WQEs */
+static inline void fast_rdma_cq_advance(struct flextcp_pl_flowst* fl)
 {
   uint32_t cq_head = fl->cq_head;
   uint32_t wq_tail = fl->wq_tail;
-  uint32_t wq_len = fl->wq_len;
+  struct rdma_wqe* wqe;
 
   while (cq_head != wq_tail)
   {
-    struct rdma_wqe* wqe = dma_pointer(fl->wq_base + cq_head,
-                                        sizeof(struct rdma_wqe));
-    if (wqe->status == RDMA_RESP_PENDING)
-    {
-      if (wqe->id != id)
-      {
-        fprintf(stderr, "%s():%d Invalid response received=%u expected=%u\n",
-            __func__, __LINE__, wqe->id, id);
-        abort();
-      }
-
-      wqe->status = status;
-      cq_head += sizeof(struct rdma_wqe);
-      if (cq_head >= wq_len)
-        cq_head -= wq_len;
+    wqe = fast_rdma_wq_entry(fl, cq_head);
+    if (wqe->status == RDMA_RESP_PENDING || wqe->status == RDMA_TX_PENDING)
       break;
-    }
 
     cq_head += sizeof(struct rdma_wqe);
-    if (cq_head >= wq_len)
-      cq_head -= wq_len;
   }
 
   fl->cq_head = cq_head;
 }
 
+/* Fail all outstanding WQEs of a flow after a response that does not match
+ * any of them, the peer's state can no longer be trusted */
+static inline void fast_rdma_fail(struct flextcp_pl_flowst* fl, uint32_t id)
+{
+  uint32_t pos = fl->cq_head;
+  struct rdma_wqe* wqe;
+
+  if (fl->rdma_failed)
+    return;
+
+  fprintf(stderr, "%s(): flow %u unexpected response id=%u\n", __func__,
+      (uint32_t) (fl - fp_state->flowst), id);
+  fl->rdma_failed = 1;
+
+  while (pos != fl->wq_tail)
+  {
+    wqe = fast_rdma_wq_entry(fl, pos);
+    if (wqe->status == RDMA_RESP_PENDING)
+      wqe->status = RDMA_CONN_FAILURE;
+
+    pos += sizeof(struct rdma_wqe);
+  }
+
+  fast_rdma_cq_advance(fl);
+}
+
+/**
+ * Complete the WQE of a response. The id of an operation is the offset of
+ * its WQE, so responses are matched in constant time and may arrive out of
+ * order.
+ */
+static inline void fast_rdmacq_bump(struct flextcp_pl_flowst* fl,
+      uint32_t id, uint8_t status)
+{
+  struct rdma_wqe* wqe;
+
+  if (UNLIKELY(id >= fl->wq_len || id % sizeof(struct rdma_wqe) != 0))
+  {
+    fast_rdma_fail(fl, id);
+    return;
+  }
+
+  wqe = dma_pointer(fl->wq_base + id, sizeof(struct rdma_wqe));
+  if (UNLIKELY(wqe->status != RDMA_RESP_PENDING || wqe->id != id))
+  {
+    fast_rdma_fail(fl, id);
+    return;
+  }
+
+  wqe->status = status;
+  if (id == ring_off(fl->wq_len, fl->cq_head))
+    fast_rdma_cq_advance(fl);
+}
+
 static inline void fast_rdma_rxbuf_copy(struct flextcp_pl_flowst* fl,
       uint32_t rx_head, uint32_t len, void* dst)
 {
@@ -336,6 +1022,21 @@ static inline void fast_rdma_rxbuf_copy(struct flextcp_pl_flowst* fl,
   fl->rx_avail += len;
 }
 
+/* Copy received bytes from the packet if available, else the rx buffer */
+static inline void fast_rdma_rx_copy(struct flextcp_pl_flowst* fl,
+      const uint8_t* src, uint32_t rx_head, uint32_t len, void* dst)
+{
+  if (src != NULL)
+  {
+    rte_memcpy(dst, src, len);
+    fl->rx_avail += len;
+  }
+  else
+  {
+    fast_rdma_rxbuf_copy(fl, rx_head, len, dst);
+  }
+}
+
 static inline void fast_rdma_txbuf_copy(struct flextcp_pl_flowst* fl,
       uint32_t len, void* src)
 {
@@ -371,14 +1072,222 @@ static inline void fast_rdma_txbuf_copy(struct flextcp_pl_flowst* fl,
   fl->tx_avail += len;
 }
 
-/* Transmit atmost one WQE */
-static inline int fast_rdmawqe_tx(struct flextcp_pl_flowst* fl,
+/**
+ * Reserve sequence space in the transmit buffer for payload that stays in the
+ * memory region. The payload is read from the memory region when the segment
+ * is built (see fast_rdma_txbuf_read()), so nothing is written here.
+ */
+static inline void fast_rdma_txbuf_reserve(struct flextcp_pl_flowst* fl,
+      uint32_t len)
+{
+  uint32_t txbuf_head = fl->txb_head + len;
+
+  if (txbuf_head >= fl->tx_len)
+    txbuf_head -= fl->tx_len;
+
+  fl->txb_head = txbuf_head;
+  fl->tx_avail += len;
+}
+
+/* Map tx sequence number to position in the circular transmit buffer */
+static inline uint32_t fast_rdma_txseq_pos(struct flextcp_pl_flowst* fl,
+      uint32_t seq)
+{
+  int64_t pos = (int64_t) fl->tx_next_pos + (int32_t) (seq - fl->tx_next_seq);
+
+  if (pos < 0)
+    pos += fl->tx_len;
+  else if (pos >= fl->tx_len)
+    pos -= fl->tx_len;
+
+  return pos;
+}
+
+static inline void fast_rdma_txbuf_read_raw(struct flextcp_pl_flowst* fl,
+      uint32_t pos, uint32_t len, void* dst)
+{
+  uint32_t part;
+
+  if (LIKELY(pos + len <= fl->tx_len))
+  {
+    dma_read(fl->tx_base + pos, len, dst);
+  }
+  else
+  {
+    part = fl->tx_len - pos;
+    dma_read(fl->tx_base + pos, part, dst);
+    dma_read(fl->tx_base, len - part, (uint8_t*) dst + part);
+  }
+}
+
+/* Parse the rdma_hdr of the tx frame starting at sequence number seq */
+static inline void fast_rdma_txf_load(struct flextcp_pl_flowst* fl,
+      uint32_t seq, uint32_t* len, uint64_t* off)
+{
+  uint8_t buf[RDMA_HDR_MAXLEN];
+  struct fast_rdma_hdr hdr;
+  uint32_t hdr_len = fast_rdma_hdr_len(fl);
+  uint8_t type;
+
+  fast_rdma_txbuf_read_raw(fl, fast_rdma_txseq_pos(fl, seq), hdr_len, buf);
+  fast_rdma_hdr_decode(fl, buf, &hdr);
+
+  /* Write and send requests and read responses carry payload from the memory
+   * region, atomic operands and results are stored in the transmit buffer */
+  type = hdr.type & (RDMA_REQUEST | RDMA_RESPONSE | RDMA_READ | RDMA_WRITE
+      | RDMA_SEND);
+  *len = hdr_len;
+  *off = hdr.loffset;
+  if ((hdr.type & RDMA_ATOMIC) != 0 || (hdr.flags & RDMA_FLAG_INLINE) != 0)
+  {
+    *len += hdr.length;
+    *off = RDMA_TXF_INLINE;
+  }
+  else if (type == (RDMA_REQUEST | RDMA_WRITE) || type == (RDMA_REQUEST | RDMA_SEND)
+      || type == (RDMA_RESPONSE | RDMA_READ))
+  {
+    *len += hdr.length;
+    if ((hdr.flags & RDMA_FLAG_SGL) != 0)
+      *off = RDMA_TXF_SGL | hdr.id;
+  }
+}
+
+/**
+ * Advance the acknowledged frame cursor past fully acknowledged frames. Must
+ * run before new headers are written to the transmit buffer, since these may
+ * overwrite acknowledged headers.
+ */
+static inline void fast_rdma_txf_sync(struct flextcp_pl_flowst* fl)
+{
+  uint32_t tail_seq = fl->tx_next_seq - fl->tx_sent;
+  uint32_t head_seq = fl->tx_next_seq + fl->tx_avail;
+
+  while (fl->txf_ack_seq != head_seq)
+  {
+    if (fl->txf_ack_len == 0)
+      fast_rdma_txf_load(fl, fl->txf_ack_seq, &fl->txf_ack_len,
+          &fl->txf_ack_off);
+
+    if (tail_seq - fl->txf_ack_seq < fl->txf_ack_len)
+      break;
+
+    fl->txf_ack_seq += fl->txf_ack_len;
+    fl->txf_ack_len = 0;
+  }
+}
+
+/* Point the segment frame cursor to the frame containing seq */
+static inline void fast_rdma_txf_locate(struct flextcp_pl_flowst* fl,
+      uint32_t seq)
+{
+  /* Restart from the oldest unacknowledged frame, e.g. after retransmit */
+  if (fl->txf_len == 0 || (int32_t) (seq - fl->txf_seq) < 0
+      || (int32_t) (fl->txf_seq - fl->txf_ack_seq) < 0)
+  {
+    fl->txf_seq = fl->txf_ack_seq;
+    fl->txf_len = fl->txf_ack_len;
+    fl->txf_off = fl->txf_ack_off;
+    if (fl->txf_len == 0)
+      fast_rdma_txf_load(fl, fl->txf_seq, &fl->txf_len, &fl->txf_off);
+  }
+
+  while (seq - fl->txf_seq >= fl->txf_len)
+  {
+    fl->txf_seq += fl->txf_len;
+    fast_rdma_txf_load(fl, fl->txf_seq, &fl->txf_len, &fl->txf_off);
+  }
+}
+
+void fast_rdma_txbuf_read(struct flextcp_pl_flowst* fl, uint32_t seq,
+      uint32_t pos, uint16_t len, void* dst)
+{
+  uint32_t hdr_len = fast_rdma_hdr_len(fl);
+  uint32_t off, part, seg;
+  uint64_t mr_off;
+  uint8_t* buf = dst;
+
+  while (len > 0)
+  {
+    fast_rdma_txf_locate(fl, seq);
+    off = seq - fl->txf_seq;
+
+    if (fl->txf_off == RDMA_TXF_INLINE)
+    {
+      part = MIN(len, fl->txf_len - off);
+      fast_rdma_txbuf_read_raw(fl, pos, part, buf);
+    }
+    else if (off < hdr_len)
+    {
+      /* Headers are the only bytes stored in the transmit buffer */
+      part = MIN(len, hdr_len - off);
+      fast_rdma_txbuf_read_raw(fl, pos, part, buf);
+    }
+    else
+    {
+      /* Payload is read straight from the memory region */
+      part = MIN(len, fl->txf_len - off);
+      if ((fl->txf_off & RDMA_TXF_SGL) != 0)
+      {
+        /* Gathered from the list, at most up to the end of an entry */
+        seg = fast_rdma_sgl_map(fl, fl->txf_off & ~RDMA_TXF_SGL,
+            off - hdr_len, &mr_off);
+        if (LIKELY(seg != 0))
+          part = MIN(part, seg);
+        else
+          mr_off = UINT64_MAX;  /* List changed since, sent as zeroes */
+      }
+      else
+      {
+        mr_off = fl->txf_off + off - hdr_len;
+      }
+      if (LIKELY(fast_rdma_mr_check(fl, mr_off, part)))
+        dma_read(fl->mr_base + mr_off, part, buf);
+      else
+        memset(buf, 0, part);
+    }
+
+    seq += part;
+    pos += part;
+    if (pos >= fl->tx_len)
+      pos -= fl->tx_len;
+    buf += part;
+    len -= part;
+  }
+}
+
+/* Copy atomic operands (request) or the old value (response) to the tx
+ * buffer, the header has to be there already */
+static inline void fast_rdma_atomic_tx(struct flextcp_pl_flowst* fl,
     struct rdma_wqe* wqe, int is_request)
 {
-  uint32_t tx_seq, tx_len;
+  struct rdma_atomic_req req;
+  struct rdma_atomic_resp resp;
+  uint64_t ops[2];
+
+  if (is_request)
+  {
+    dma_read(fl->mr_base + wqe->loff, sizeof(ops), ops);
+    req.compare_add = t_beui64(ops[0]);
+    req.swap = t_beui64(ops[1]);
+    fast_rdma_txbuf_copy(fl, sizeof(req), &req);
+    wqe->status = RDMA_RESP_PENDING;
+  }
+  else
+  {
+    resp.old = t_beui64(wqe->loff);
+    fast_rdma_txbuf_copy(fl, sizeof(resp), &resp);
+  }
+}
+
+/* Transmit atmost one WQE, inl points to the inline payload if any */
+static inline int fast_rdmawqe_tx(struct flextcp_pl_flowst* fl,
+    struct rdma_wqe* wqe, int is_request, void* inl)
+{
+  uint32_t tx_seq, tx_len, hdr_len;
   uint32_t free_txbuf_len, wqe_tx_pending_len;
-  struct rdma_hdr hdr;
-  void* mr_buf;
+  struct fast_rdma_hdr hdr;
+  uint8_t hdr_buf[RDMA_HDR_MAXLEN];
+  uint32_t atomic_len;
 
   if(is_request){
      tx_seq = fl->wqe_tx_seq;
@@ -396,20 +1305,43 @@ static inline int fast_rdmawqe_tx(struct flextcp_pl_flowst* fl,
   else
   {
     hdr.type = (is_request ? RDMA_REQUEST : RDMA_RESPONSE)
-                 | (wqe->type == RDMA_OP_READ ? RDMA_READ : RDMA_WRITE);
+                 | fast_rdma_op_type(wqe->type);
     hdr.status = (is_request ? 0 : wqe->status);
-    hdr.length = t_beui32(wqe->len);
-    hdr.offset = t_beui32(wqe->roff);
-    hdr.id = t_beui32(wqe->id);
-    hdr.flags = t_beui16(0);
-    hdr.loffset = t_beui32(wqe->loff);
-
-    fast_rdma_txbuf_copy(fl, sizeof(struct rdma_hdr), &hdr);
-
-    free_txbuf_len -= sizeof(struct rdma_hdr);
+    atomic_len = fast_rdma_atomic_len(hdr.type);
+    hdr.length = (atomic_len != 0 ? atomic_len : wqe->len);
+    hdr.offset = wqe->roff;
+    hdr.id = wqe->id;
+    hdr.flags = (inl != NULL ? RDMA_FLAG_INLINE : 0);
+    if (is_request && inl == NULL && atomic_len == 0
+        && (wqe->flags & RDMA_WQE_SGL) != 0)
+      hdr.flags = RDMA_FLAG_SGL;
+    /* The RQ entry of a response is free for a new request once sent */
+    if (!is_request)
+      hdr.flags |= RDMA_FLAG_CREDITS(1);
+    hdr.imm = wqe->imm;
+    hdr.loffset = wqe->loff;
+
+    hdr_len = fast_rdma_hdr_encode(fl, &hdr, hdr_buf);
+    fast_rdma_txbuf_copy(fl, hdr_len, hdr_buf);
+
+    free_txbuf_len -= hdr_len;
     tx_seq = 0;
     wqe_tx_pending_len = wqe->len;
 
+    if (atomic_len != 0)
+    {
+      fast_rdma_atomic_tx(fl, wqe, is_request);
+      return 0;
+    }
+
+    /* Small payload goes straight from the work queue to the tx buffer */
+    if (inl != NULL)
+    {
+      fast_rdma_txbuf_copy(fl, wqe->len, inl);
+      wqe->status = RDMA_RESP_PENDING;
+      return 0;
+    }
+
     if (is_request)
     {
       if (wqe->type == RDMA_OP_READ)
@@ -436,8 +1368,7 @@ static inline int fast_rdmawqe_tx(struct flextcp_pl_flowst* fl,
   }
 
   tx_len = MIN(wqe_tx_pending_len, free_txbuf_len);
-  mr_buf = dma_pointer(fl->mr_base + wqe->loff + tx_seq, wqe_tx_pending_len);
-  fast_rdma_txbuf_copy(fl, tx_len, mr_buf);
+  fast_rdma_txbuf_reserve(fl, tx_len);
   tx_seq += tx_len;
 
   free_txbuf_len -= tx_len;
@@ -454,19 +1385,56 @@ static inline int fast_rdmawqe_tx(struct flextcp_pl_flowst* fl,
   return wqe_tx_pending_len;
 }
 
-void fast_rdma_poll(struct dataplane_context* ctx,
-      struct flextcp_pl_flowst* fl)
+/**
+ * Check the local side of the new WQE at position pos. The inline payload, if
+ * any, is returned in inl. Returns 0 if the WQE is out of bounds.
+ */
+static inline int fast_rdma_wqe_check(struct flextcp_pl_flowst* fl,
+    uint32_t pos, struct rdma_wqe* wqe, void** inl)
+{
+  uint8_t type = fast_rdma_op_type(wqe->type);
+  uint32_t len;
+
+  *inl = NULL;
+  len = ((type & RDMA_ATOMIC) != 0 ? RDMA_ATOMIC_LEN : wqe->len);
+  if ((wqe->flags & RDMA_WQE_INLINE) != 0
+      && (type & (RDMA_WRITE | RDMA_SEND)) != 0)
+  {
+    if (wqe->len > RDMA_INLINE_MAX)
+      return 0;
+    *inl = fast_rdma_inline_data(fl, pos);
+    len = 0;
+  }
+  else if ((wqe->flags & RDMA_WQE_SGL) != 0
+      && (type & (RDMA_READ | RDMA_WRITE | RDMA_SEND)) != 0)
+  {
+    /* Local side is the list, loff is unused */
+    if (!fast_rdma_sgl_check(fl, pos, wqe->len))
+      return 0;
+    len = 0;
+  }
+
+  return fast_rdma_mr_check(fl, wqe->loff, len);
+}
+
+static void fast_rdma_poll_queues(struct flextcp_pl_flowst* fl)
 {
   uint32_t wq_head, wq_tail, rq_head, rq_tail, tx_seq;
   uint32_t free_txbuf_len, ret, is_rqe;
+  uint8_t type, wq_blocked;
   struct rdma_wqe* wqe;
+  void* inl;
 
+  /* WQEs behind a loopback copy wait for the copy thread */
+  wq_blocked = (fl->rdma_copy_pending != 0);
   wq_head = fl->wq_head;
   wq_tail = fl->wq_tail;
   rq_head = fl->rq_head;
   rq_tail = fl->rq_tail;
   free_txbuf_len = fl->tx_len - fl->tx_avail - fl->tx_sent;
 
+  fast_rdma_txf_sync(fl);
+
   if (fl->wqe_tx_seq > 0)
   {
     is_rqe = 0;
@@ -485,10 +1453,10 @@ void fast_rdma_poll(struct dataplane_context* ctx,
 
   while (free_txbuf_len > 0)
   {
-    if (rq_head == rq_tail && wq_head == wq_tail)
+    if (rq_head == rq_tail && (wq_head == wq_tail || wq_blocked))
       break;
 
-    if (!is_rqe && wq_head == wq_tail)
+    if (!is_rqe && (wq_head == wq_tail || wq_blocked))
     {
       is_rqe = 1;
       continue;
@@ -500,30 +1468,61 @@ void fast_rdma_poll(struct dataplane_context* ctx,
       continue;
     }
 
+    inl = NULL;
     if (!is_rqe)
     {
-      wqe = dma_pointer(fl->wq_base + wq_tail, sizeof(struct rdma_wqe));
+      wqe = fast_rdma_wq_entry(fl, wq_tail);
 
-      /* New WQE to be processed */
-      if (UNLIKELY(wqe->loff + wqe->len > fl->mr_len))
+      /* New WQE to be processed, version 1 headers carry 32-bit offsets */
+      if (UNLIKELY(!fast_rdma_wqe_check(fl, wq_tail, wqe, &inl)
+            || (fl->rdma_hdr_ver != RDMA_HDR_V2
+              && ((wqe->loff | wqe->roff) >> 32) != 0)))
       {
         wqe->status = RDMA_OUT_OF_BOUNDS;
         goto NEXT_WQE;
       }
+
+      /* Immediate values need version 2 headers */
+      if (UNLIKELY(wqe->type == RDMA_OP_WRITE_IMM
+            && fl->rdma_hdr_ver != RDMA_HDR_V2))
+      {
+        wqe->status = RDMA_UNSUPPORTED;
+        goto NEXT_WQE;
+      }
+
+      if (UNLIKELY(fl->rdma_failed && tx_seq == 0))
+      {
+        wqe->status = RDMA_CONN_FAILURE;
+        goto NEXT_WQE;
+      }
     }
     else
     {
-      wqe = dma_pointer(fl->rq_base + rq_tail, sizeof(struct rdma_wqe));
+      wqe = fast_rdma_rq_entry(fl, rq_tail);
     }
 
-    /* New request/response */
+    /* New request/response, atomic operands are sent with the header */
     if (tx_seq == 0)
     {
-      if (free_txbuf_len < sizeof(struct rdma_hdr))
+      type = (is_rqe ? RDMA_RESPONSE : RDMA_REQUEST)
+          | fast_rdma_op_type(wqe->type);
+      if (free_txbuf_len < fast_rdma_hdr_len(fl) + fast_rdma_atomic_len(type)
+          + (inl != NULL ? wqe->len : 0))
         break;
+
+      /* Every request takes a slot in the peer's RQ until it responds */
+      if (!is_rqe && fl->rdma_credits_max != 0)
+      {
+        if (fl->rdma_credits == 0)
+        {
+          wq_blocked = 1;
+          continue;
+        }
+        fl->rdma_credits--;
+      }
     }
 
-    ret = fast_rdmawqe_tx(fl, wqe, !is_rqe);
+    ret = fast_rdmawqe_tx(fl, wqe, !is_rqe, inl);
     if (ret > 0)
     {
       tx_seq = wqe->len - ret;
@@ -534,14 +1533,10 @@ NEXT_WQE:
     if (is_rqe)
     {
       rq_tail += sizeof(struct rdma_wqe);
-      if (rq_tail >= fl->wq_len)
-        rq_tail -= fl->wq_len;
     }
     else
     {
       wq_tail += sizeof(struct rdma_wqe);
-      if (wq_tail >= fl->wq_len)
-        wq_tail -= fl->wq_len;
     }
     tx_seq = 0;
     is_rqe = (is_rqe ? 0 : 1);
@@ -550,8 +1545,293 @@ NEXT_WQE:
 
   fl->wq_tail = wq_tail;
   fl->rq_tail = rq_tail;
+  fast_rdma_cq_advance(fl);
   if (is_rqe)
     fl->rqe_tx_seq = tx_seq;
   else
     fl->wqe_tx_seq = tx_seq;
 }
+
+/**
+ * Copy the payload of a loopback WQE between its local side and the peer's
+ * memory region at remote. The list of a WQE is in application memory, so
+ * every entry is checked again as it is used.
+ */
+static inline uint8_t fast_rdma_lb_copy(struct flextcp_pl_flowst* fl,
+    uint32_t pos, const struct rdma_wqe* wqe, const void* inl,
+    uint64_t remote, int to_remote)
+{
+  uint32_t off, part;
+  uint64_t mr_off;
+
+  if (inl != NULL)
+  {
+    dma_write(remote, wqe->len, inl);
+    return RDMA_SUCCESS;
+  }
+
+  if ((wqe->flags & RDMA_WQE_SGL) == 0)
+  {
+    if (to_remote)
+      dma_write(remote, wqe->len, dma_pointer(fl->mr_base + wqe->loff,
+            wqe->len));
+    else
+      dma_read(remote, wqe->len, dma_pointer(fl->mr_base + wqe->loff,
+            wqe->len));
+    return RDMA_SUCCESS;
+  }
+
+  for (off = 0; off < wqe->len; off += part)
+  {
+    part = MIN(wqe->len - off, fast_rdma_sgl_map(fl, pos, off, &mr_off));
+    if (UNLIKELY(part == 0 || !fast_rdma_mr_check(fl, mr_off, part)))
+      return RDMA_OUT_OF_BOUNDS;
+
+    if (to_remote)
+      dma_write(remote + off, part, dma_pointer(fl->mr_base + mr_off, part));
+    else
+      dma_read(remote + off, part, dma_pointer(fl->mr_base + mr_off, part));
+  }
+  return RDMA_SUCCESS;
+}
+
+/**
+ * Execute a WQE on the loopback peer, which takes the place of the remote
+ * end in fast_rdma_rx_consume(). Returns the completion status.
+ */
+static inline uint8_t fast_rdma_lb_exec(struct flextcp_pl_flowst* fl,
+    struct flextcp_pl_flowst* peer, uint32_t pos, struct rdma_wqe* wqe,
+    const void* inl)
+{
+  struct rdma_wqe rq;
+  struct rdma_atomic_req req;
+  uint64_t ops[2], old;
+  uint8_t status;
+
+  switch (wqe->type)
+  {
+    case RDMA_OP_FETCH_ADD:
+    case RDMA_OP_CMP_SWAP:
+      dma_read(fl->mr_base + wqe->loff, sizeof(ops), ops);
+      req.compare_add = t_beui64(ops[0]);
+      req.swap = t_beui64(ops[1]);
+      status = fast_rdma_atomic_exec(peer, fast_rdma_op_type(wqe->type),
+          wqe->roff, &req, &old);
+      if (status == RDMA_SUCCESS)
+        dma_write(fl->mr_base + wqe->loff, sizeof(old), &old);
+      return status;
+
+    case RDMA_OP_READ:
+      if (!fast_rdma_mr_check(peer, wqe->roff, wqe->len))
+        return RDMA_OUT_OF_BOUNDS;
+      return fast_rdma_lb_copy(fl, pos, wqe, NULL, peer->mr_base + wqe->roff,
+          0);
+
+    case RDMA_OP_SEND:
+      fast_rdma_recv_start(peer, &rq, wqe->len);
+      if (rq.status == RDMA_NO_RECV)
+        return RDMA_NO_RECV;
+      if (rq.status == RDMA_PENDING)
+        rq.status = fast_rdma_lb_copy(fl, pos, wqe, inl,
+            peer->mr_base + rq.loff, 1);
+      fast_rdma_recv_done(peer, rq.status);
+      return rq.status;
+
+    case RDMA_OP_WRITE_IMM:
+      rq.status = (fast_rdma_mr_check(peer, wqe->roff, wqe->len) ?
+          RDMA_PENDING : RDMA_OUT_OF_BOUNDS);
+      fast_rdma_recv_imm(peer, &rq, wqe->len, wqe->imm);
+      if (rq.status == RDMA_NO_RECV)
+        return RDMA_NO_RECV;
+      if (rq.status == RDMA_PENDING)
+        rq.status = fast_rdma_lb_copy(fl, pos, wqe, inl,
+            peer->mr_base + wqe->roff, 1);
+      fast_rdma_recv_done(peer, rq.status);
+      return rq.status;
+
+    default:
+      if (!fast_rdma_mr_check(peer, wqe->roff, wqe->len))
+        return RDMA_OUT_OF_BOUNDS;
+      return fast_rdma_lb_copy(fl, pos, wqe, inl, peer->mr_base + wqe->roff,
+          1);
+  }
+}
+
+/**
+ * Hand the copy of a bulk loopback READ/WRITE to a copy thread. The WQE
+ * completes in fast_rdma_copy_done(). Returns 0 if the WQE has to be executed
+ * inline.
+ */
+static inline int fast_rdma_lb_offload(struct dataplane_context* ctx,
+    struct flextcp_pl_flowst* fl, struct flextcp_pl_flowst* peer,
+    uint32_t pos, struct rdma_wqe* wqe, const void* inl)
+{
+  uint32_t id = ring_off(fl->wq_len, pos);
+  void *local, *remote;
+  int ret;
+
+  if (config.fp_copy_threads == 0 || wqe->len < config.fp_copy_min
+      || inl != NULL || (wqe->flags & RDMA_WQE_SGL) != 0
+      || (wqe->type != RDMA_OP_READ && wqe->type != RDMA_OP_WRITE)
+      || !fast_rdma_mr_check(peer, wqe->roff, wqe->len))
+    return 0;
+
+  local = dma_pointer(fl->mr_base + wqe->loff, wqe->len);
+  remote = dma_pointer(peer->mr_base + wqe->roff, wqe->len);
+  if (wqe->type == RDMA_OP_WRITE)
+    ret = fast_copy_submit(ctx, remote, local, wqe->len, fl - fp_state->flowst,
+        id);
+  else
+    ret = fast_copy_submit(ctx, local, remote, wqe->len, fl - fp_state->flowst,
+        id);
+  if (ret != 0)
+    return 0;
+
+  wqe->status = RDMA_RESP_PENDING;
+  fl->rdma_copy_pending = id + 1;
+  return 1;
+}
+
+/**
+ * Execute all new WQEs of a flow whose peer is a flow of this instance
+ * directly on the peer, nothing is sent over TCP. Both flows are locked.
+ * Execution stops behind a WQE handed to a copy thread.
+ */
+static void fast_rdma_loopback(struct dataplane_context* ctx,
+    struct flextcp_pl_flowst* fl, struct flextcp_pl_flowst* peer)
+{
+  uint32_t wq_tail = fl->wq_tail;
+  uint32_t rcv_tail = peer->rcv_tail;
+  struct rdma_wqe* wqe;
+  void* inl;
+
+  while (wq_tail != fl->wq_head && fl->rdma_copy_pending == 0)
+  {
+    wqe = fast_rdma_wq_entry(fl, wq_tail);
+    if (UNLIKELY(!fast_rdma_wqe_check(fl, wq_tail, wqe, &inl)))
+      wqe->status = RDMA_OUT_OF_BOUNDS;
+    else if (UNLIKELY(fl->rdma_failed))
+      wqe->status = RDMA_CONN_FAILURE;
+    else if (!fast_rdma_lb_offload(ctx, fl, peer, wq_tail, wqe, inl))
+      wqe->status = fast_rdma_lb_exec(fl, peer, wq_tail, wqe, inl);
+
+    wq_tail += sizeof(struct rdma_wqe);
+  }
+
+  fl->wq_tail = wq_tail;
+  fast_rdma_cq_advance(fl);
+
+  /* Receive buffers of the peer were filled */
+  if (peer->rcv_tail != rcv_tail)
+    fast_rdma_cq_notify(ctx, peer);
+}
+
+/**
+ * Lock a flow and its loopback peer in flow id order. Returns the peer, NULL
+ * if the flow has none and only the flow is locked.
+ */
+static inline struct flextcp_pl_flowst* fast_rdma_lock(
+    struct flextcp_pl_flowst* fs)
+{
+  struct flextcp_pl_flowst* peer;
+  uint32_t peer_id;
+
+  for (;;)
+  {
+    peer_id = fs->rdma_peer;
+    if (peer_id == 0)
+    {
+      fs_lock(fs);
+      if (fs->rdma_peer == 0)
+        return NULL;
+      fs_unlock(fs);
+      continue;
+    }
+
+    peer = &fp_state->flowst[peer_id - 1];
+    if (peer < fs)
+    {
+      fs_lock(peer);
+      fs_lock(fs);
+    }
+    else
+    {
+      fs_lock(fs);
+      fs_lock(peer);
+    }
+
+    /* The slow path pairs and unpairs flows with only one of them locked */
+    if (fs->rdma_peer == peer_id)
+      return peer;
+    fs_unlock(peer);
+    fs_unlock(fs);
+  }
+}
+
+static void fast_rdma_poll_flow(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fl, struct flextcp_pl_flowst* peer)
+{
+  struct flextcp_pl_rdma_db* db = fast_rdma_db(fl);
+  uint32_t cq_head = fl->cq_head;
+  int db_valid;
+
+  /* An invalid doorbell is not polled again until the next wakeup */
+  do
+  {
+    db_valid = (fast_rdma_db_poll(fl, db) == 0);
+    /* A WQE partially sent before the flows were paired finishes over TCP */
+    if (peer != NULL && fl->wqe_tx_seq == 0)
+      fast_rdma_loopback(ctx, fl, peer);
+    fast_rdma_poll_queues(fl);
+  } while (fast_rdma_db_idle(ctx, fl, db) && db_valid);
+
+  /* WQEs failed without being sent */
+  if (fl->cq_head != cq_head)
+    fast_rdma_cq_notify(ctx, fl);
+}
+
+/**
+ * Complete a loopback WQE whose payload a copy thread moved and execute the
+ * WQEs of the flow queued behind it. WQEs posted to an active flow while the
+ * copy was running were not announced with a bump, so the doorbell is polled
+ * as well.
+ */
+void fast_rdma_copy_done(struct dataplane_context* ctx, uint32_t flow_id,
+      uint32_t id)
+{
+  struct flextcp_pl_flowst* fl = &fp_state->flowst[flow_id];
+  struct flextcp_pl_flowst* peer;
+  uint32_t cq_head;
+
+  peer = fast_rdma_lock(fl);
+
+  if (fl->rdma_copy_pending == id + 1)
+  {
+    fl->rdma_copy_pending = 0;
+    fast_rdma_wq_entry(fl, id)->status = RDMA_SUCCESS;
+    fast_rdma_wakeup(ctx, flow_id, fl, peer);
+
+    /* Without a peer the loopback did not complete the copied WQE */
+    cq_head = fl->cq_head;
+    fast_rdma_cq_advance(fl);
+    if (fl->cq_head != cq_head)
+      fast_rdma_cq_notify(ctx, fl);
+  }
+
+  if (peer != NULL)
+    fs_unlock(peer);
+  fs_unlock(fl);
+}
+
+void fast_rdma_poll(struct dataplane_context* ctx,
+      struct flextcp_pl_flowst* fl)
+{
+  /* WQEs of a loopback flow are only executed with the peer locked. New
+   * ones arrive with a bump, or while the flow is active through the
+   * doorbell polled by fast_rdma_db_poll_active() or when a copy of the flow
+   * completes. */
+  if (fl->rdma_peer != 0 && fl->wqe_tx_seq == 0 && fl->rqe_tx_seq == 0)
+    return;
+
+  fast_rdma_poll_flow(ctx, fl, NULL);
+}
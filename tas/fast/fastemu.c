@@ -59,6 +59,8 @@ static unsigned poll_queues(struct dataplane_context *ctx, uint32_t ts)  __attri
 static unsigned poll_kernel(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
 static unsigned poll_qman(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
 static unsigned poll_qman_fwd(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
+static unsigned poll_copies(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
+static unsigned poll_rdma_db(struct dataplane_context *ctx, uint32_t ts) __attribute__((noinline));
 static void poll_scale(struct dataplane_context *ctx);
 
 static inline uint8_t bufcache_prealloc(struct dataplane_context *ctx, uint16_t num,
@@ -93,6 +95,15 @@ int dataplane_init(void)
     return -1;
   }
 
+  /* select copy routines */
+  dma_init();
+
+  /* start copy threads */
+  if (fast_copy_init() != 0) {
+    fprintf(stderr, "dataplane_init: starting copy threads failed\n");
+    return -1;
+  }
+
   return 0;
 }
 
@@ -121,6 +132,12 @@ int dataplane_context_init(struct dataplane_context *ctx)
     return -1;
   }
 
+  /* initialize copy offload completions */
+  if (fast_copy_context_init(ctx) != 0) {
+    fprintf(stderr, "initializing copy completions failed\n");
+    return -1;
+  }
+
   ctx->poll_next_ctx = ctx->id;
 
   ctx->evfd = eventfd(0, 0);
@@ -161,12 +178,14 @@ void dataplane_loop(struct dataplane_context *ctx)
     tx_flush(ctx);
 
     n += poll_qman_fwd(ctx, ts);
+    n += poll_copies(ctx, ts);
 
     STATS_TSADD(ctx, cyc_rx, rx - start);
     n += poll_qman(ctx, ts);
     STATS_TS(qm);
     STATS_TSADD(ctx, cyc_qm, qm - rx);
     n += poll_queues(ctx, ts);
+    n += poll_rdma_db(ctx, ts);
     STATS_TS(qs);
     STATS_TSADD(ctx, cyc_qs, qs - qm);
     n += poll_kernel(ctx, ts);
@@ -182,8 +201,10 @@ void dataplane_loop(struct dataplane_context *ctx)
 
       if(startwait == 0) {
 	startwait = ts;
-      } else if (config.fp_interrupts && ts - startwait >= POLL_CYCLE) {
-	// Idle -- wait for interrupt or data from apps/kernel
+      } else if (config.fp_interrupts && ts - startwait >= POLL_CYCLE &&
+          ctx->rdma_db_num == 0) {
+	// Idle -- wait for interrupt or data from apps/kernel. Not while
+	// doorbells are polled, posts to these flows do not wake us up.
 	int r = network_rx_interrupt_ctl(&ctx->net, 1);
 
 	// Only if device running
@@ -474,6 +495,30 @@ static unsigned poll_qman_fwd(struct dataplane_context *ctx, uint32_t ts)
   return ret;
 }
 
+static unsigned poll_rdma_db(struct dataplane_context *ctx, uint32_t ts)
+{
+  unsigned n;
+
+  /* a bump adds up to two arx entries, for the flow and a loopback peer */
+  n = fast_rdma_db_poll_active(ctx, BATCH_SIZE / 2);
+  if (n > 0)
+    arx_cache_flush(ctx, ts);
+
+  return n;
+}
+
+static unsigned poll_copies(struct dataplane_context *ctx, uint32_t ts)
+{
+  unsigned n;
+
+  /* completed copies resume their flows and report completions */
+  n = fast_copy_poll(ctx);
+  if (n > 0)
+    arx_cache_flush(ctx, ts);
+
+  return n;
+}
+
 static inline uint8_t bufcache_prealloc(struct dataplane_context *ctx, uint16_t num,
     struct network_buf_handle ***handles)
 {
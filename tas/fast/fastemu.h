@@ -80,8 +80,23 @@ int fast_rdmawq_bump(struct dataplane_context *ctx, uint32_t flow_id,
     uint32_t new_wq_head, uint32_t new_cq_tail);
 int fast_rdmarq_bump(struct dataplane_context* ctx,
     struct flextcp_pl_flowst* fs, uint32_t prev_rx_head, uint32_t rx_bump);
+int fast_rdmarq_place(struct dataplane_context* ctx,
+    struct flextcp_pl_flowst* fs, const void* payload, uint32_t len);
 void fast_rdma_poll(struct dataplane_context* ctx,
       struct flextcp_pl_flowst* fl);
+void fast_rdma_txbuf_read(struct flextcp_pl_flowst* fl, uint32_t seq,
+      uint32_t pos, uint16_t len, void* dst);
+unsigned fast_rdma_db_poll_active(struct dataplane_context* ctx,
+      unsigned max);
+void fast_rdma_copy_done(struct dataplane_context* ctx, uint32_t flow_id,
+      uint32_t id);
+
+/* fast_copy.c */
+int fast_copy_init(void);
+int fast_copy_context_init(struct dataplane_context *ctx);
+int fast_copy_submit(struct dataplane_context *ctx, void *dst,
+    const void *src, uint32_t len, uint32_t flow_id, uint32_t id);
+unsigned fast_copy_poll(struct dataplane_context *ctx);
 
 /*****************************************************************************/
 /* Helpers */
@@ -126,6 +141,12 @@ static inline void arx_cache_add(struct dataplane_context *ctx, uint16_t ctx_id,
 
 static inline void actx_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us)
 {
+  if(UNLIKELY(ctx->kick_pending)) {
+    ctx->kick_pending = 0;
+    util_flexnic_notify(ctx, ts_us);
+    return;
+  }
+
   if(UNLIKELY(ts_us - ctx->last_ts > POLL_CYCLE)) {
     util_flexnic_kick(ctx, ts_us);
     return;
@@ -57,6 +57,8 @@ struct configuration {
   uint64_t rdma_mr_len;
   /** RDMA work/completion queue size. */
   uint64_t rdma_wq_len;
+  /** Highest RDMA header version offered to peers. */
+  uint32_t rdma_hdr_ver;
   /** Initial tcp rtt for cc rate [us]*/
   uint32_t tcp_rtt_init;
   /** Link bandwidth for converting window to rate [gbps] */
@@ -123,6 +125,14 @@ struct configuration {
   uint32_t fp_autoscale;
   /** FP: use huge pages for internal and buffer memory */
   uint32_t fp_hugepages;
+  /** FP: poll the RDMA doorbells of flows with outstanding WQEs instead of
+   * waiting for a bump on every post. Saves the bumps of pipelined posts but
+   * keeps the core busy while such flows exist. */
+  uint32_t fp_rdma_db_poll;
+  /** FP: threads copying bulk loopback RDMA payload, 0 to copy inline */
+  uint32_t fp_copy_threads;
+  /** FP: minimal length of copies handed to the copy threads */
+  uint32_t fp_copy_min;
   /** SP: kni interface name */
   char *kni_name;
   /** Ready signal fd */
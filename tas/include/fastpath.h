@@ -36,6 +36,8 @@
 #define BATCH_SIZE 16
 #define BUFCACHE_SIZE 128
 #define TXBUF_SIZE (2 * BATCH_SIZE)
+#define COPY_PENDING_MAX 64
+#define RDMA_DB_POLL_MAX 1024
 
 
 struct network_thread {
@@ -62,6 +64,16 @@ struct qman_thread {
   bool nolimit_first;
 };
 
+/** Payload copy handed to a copy thread */
+struct fast_copy_req {
+  void *dst;
+  const void *src;
+  uint32_t len;
+  uint32_t flow_id;
+  /** WQE offset completed by the copy */
+  uint32_t id;
+  uint16_t ctx_id;
+};
 
 struct dataplane_context {
   struct network_thread net;
@@ -92,6 +104,19 @@ struct dataplane_context {
   uint16_t bufcache_num;
   uint16_t bufcache_head;
 
+  /********************************************************/
+  /* flows whose RDMA doorbell is polled */
+  uint32_t rdma_db_flows[RDMA_DB_POLL_MAX];
+  uint16_t rdma_db_num;
+  uint16_t rdma_db_pos;
+
+  /********************************************************/
+  /* copies offloaded to copy threads */
+  struct rte_ring *copy_done_ring;
+  struct fast_copy_req copy_reqs[COPY_PENDING_MAX];
+  struct fast_copy_req *copy_free[COPY_PENDING_MAX];
+  uint16_t copy_free_num;
+
   uint64_t loadmon_cyc_busy;
 
   uint64_t kernel_drop;
@@ -55,7 +55,10 @@ void network_cleanup(void);
 void *util_create_shmsiszed(const char *name, size_t size, void *addr);
 
 /* should become config options */
+#ifndef FLEXNIC_RDMA_MEM_SIZE
+/* Raise (e.g. -DFLEXNIC_RDMA_MEM_SIZE=...) for regions beyond 1GB */
 #define FLEXNIC_RDMA_MEM_SIZE (1024 * 1024 * 1024ull)
+#endif
 #define FLEXNIC_DMA_MEM_SIZE ((1024 * 1024 * 1024) + FLEXNIC_RDMA_MEM_SIZE)
 #define FLEXNIC_INTERNAL_MEM_SIZE (1024 * 1024 * 48)
 #define FLEXNIC_NUM_QMQUEUES (128 * 1024)
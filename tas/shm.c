@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/vfs.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
@@ -53,6 +54,8 @@ static void *util_create_shmsiszed_huge(const char *name, size_t size,
 /* destroy shared huge page memory region */
 static void destroy_shm_huge(const char *name, size_t size, void *addr)
     __attribute__((used));
+/* round size up to the page size of the huge page mount */
+static size_t huge_size(size_t size);
 
 /* Allocate DMA memory before DPDK grabs all huge pages */
 int shm_preinit(void)
@@ -194,6 +197,7 @@ static void *util_create_shmsiszed_huge(const char *name, size_t size,
   char path[128];
 
   snprintf(path, sizeof(path), "%s/%s", FLEXNIC_HUGE_PREFIX, name);
+  size = huge_size(size);
 
   if ((fd = open(path, O_CREAT | O_RDWR, 0666)) == -1) {
     perror("util_create_shmsiszed: open failed");
@@ -230,8 +234,19 @@ static void destroy_shm_huge(const char *name, size_t size, void *addr)
 
   snprintf(path, sizeof(path), "%s/%s", FLEXNIC_HUGE_PREFIX, name);
 
-  if (munmap(addr, size) != 0) {
+  if (munmap(addr, huge_size(size)) != 0) {
     fprintf(stderr, "Warning: munmap failed (%s)\n", strerror(errno));
   }
   unlink(path);
 }
+
+static size_t huge_size(size_t size)
+{
+  struct statfs sfs;
+
+  /* f_bsize is the huge page size, e.g. 2MB or 1GB (mount -o pagesize=1G) */
+  if (statfs(FLEXNIC_HUGE_PREFIX, &sfs) != 0 || sfs.f_bsize <= 0) {
+    return size;
+  }
+  return (size + sfs.f_bsize - 1) / sfs.f_bsize * sfs.f_bsize;
+}
@@ -409,6 +409,7 @@ static void uxsocket_accept(void)
   app->closed = false;
   app->conns = NULL;
   app->listeners = NULL;
+  app->mrs = NULL;
   app->id = app_id_next++;
   nbqueue_enq(&ux_to_poll, &app->nqe);
 }
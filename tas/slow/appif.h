@@ -76,6 +76,7 @@ struct application {
 
   struct connection *conns;
   struct listener   *listeners;
+  struct rdma_mr    *mrs;
 
   struct nicif_completion comp;
 
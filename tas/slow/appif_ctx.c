@@ -47,6 +47,12 @@ static int kin_accept_conn(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
 static int kin_req_scale(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_mr_reg(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_mr_dereg(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
+static int kin_conn_mr(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout);
 
 static void appif_ctx_kick(struct app_context *ctx)
 {
@@ -97,6 +103,7 @@ void appif_conn_opened(struct connection *c, int status)
     kout->data.conn_opened.local_port = c->local_port;
     kout->data.conn_opened.flow_id = c->flow_id;
     kout->data.conn_opened.fn_core = c->fn_core;
+    kout->data.conn_opened.rdma_credits = c->rdma_credits;
   } else {
     tcp_destroy(c);
   }
@@ -219,6 +226,7 @@ void appif_accept_conn(struct connection *c, int status)
     kout->data.accept_connection.remote_port = c->remote_port;
     kout->data.accept_connection.flow_id = c->flow_id;
     kout->data.accept_connection.fn_core = c->fn_core;
+    kout->data.accept_connection.rdma_credits = c->rdma_credits;
 
     c->app_next = app->conns;
     app->conns = c;
@@ -293,6 +301,21 @@ unsigned appif_ctx_poll(struct application *app, struct app_context *ctx)
       kout_inc += kin_req_scale(app, ctx, kin, kout);
       break;
 
+    case KERNEL_APPOUT_MR_REG:
+      /* memory region registration */
+      kout_inc += kin_mr_reg(app, ctx, kin, kout);
+      break;
+
+    case KERNEL_APPOUT_MR_DEREG:
+      /* memory region deregistration */
+      kout_inc += kin_mr_dereg(app, ctx, kin, kout);
+      break;
+
+    case KERNEL_APPOUT_CONN_MR:
+      /* connection memory region change */
+      kout_inc += kin_conn_mr(app, ctx, kin, kout);
+      break;
+
     case KERNEL_APPOUT_LISTEN_CLOSE:
     default:
       fprintf(stderr, "kin_poll: unsupported request type %u\n", kin->type);
@@ -325,9 +348,18 @@ static int kin_conn_open(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
 {
   struct connection *conn;
+  struct rdma_mr *mr = NULL;
+
+  if (kin->data.conn_open.mr_key != 0 &&
+      (mr = mr_attach(app, kin->data.conn_open.mr_key)) == NULL)
+  {
+    fprintf(stderr, "kin_conn_open: memory region not found\n");
+    goto error;
+  }
 
   if (tcp_open(ctx, kin->data.conn_open.opaque, kin->data.conn_open.remote_ip,
-      kin->data.conn_open.remote_port, ctx->doorbell->id, &conn) != 0)
+      kin->data.conn_open.remote_port, ctx->doorbell->id, mr,
+      kin->data.conn_open.mr_len, &conn) != 0)
   {
     fprintf(stderr, "kin_conn_open: tcp_open failed\n");
     goto error;
@@ -478,6 +510,7 @@ static int kin_accept_conn(struct application *app, struct app_context *ctx,
     volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
 {
   struct listener *listen;
+  struct rdma_mr *mr = NULL;
 
   /* look for listen struct */
   for (listen = app->listeners; listen != NULL; listen = listen->app_next) {
@@ -488,8 +521,15 @@ static int kin_accept_conn(struct application *app, struct app_context *ctx,
     }
   }
 
+  if (kin->data.accept_conn.mr_key != 0 &&
+      (mr = mr_attach(app, kin->data.accept_conn.mr_key)) == NULL)
+  {
+    fprintf(stderr, "kin_accept_conn: memory region not found\n");
+    goto error;
+  }
+
   if (tcp_accept(ctx, kin->data.accept_conn.conn_opaque, listen,
-        ctx->doorbell->id) != 0)
+        ctx->doorbell->id, mr, kin->data.accept_conn.mr_len) != 0)
   {
     fprintf(stderr, "kin_accept_conn\n");
     goto error;
@@ -517,3 +557,102 @@ static int kin_req_scale(struct application *app, struct app_context *ctx,
 
   return 0;
 }
+
+static int kin_mr_reg(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  struct rdma_mr *mr;
+
+  if (mr_register(app, kin->data.mr_reg.len, &mr) != 0) {
+    fprintf(stderr, "kin_mr_reg: mr_register failed\n");
+    goto error;
+  }
+
+  kout->data.mr_reg.opaque = kin->data.mr_reg.opaque;
+  kout->data.mr_reg.mr_off = mr->buf - (uint8_t *) tas_shm;
+  kout->data.mr_reg.mr_len = mr->len;
+  kout->data.mr_reg.key = mr->key;
+  kout->data.mr_reg.status = 0;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_MR_REG;
+  appif_ctx_kick(ctx);
+  return 1;
+
+error:
+  kout->data.mr_reg.opaque = kin->data.mr_reg.opaque;
+  kout->data.mr_reg.status = -1;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_MR_REG;
+  appif_ctx_kick(ctx);
+  return 1;
+}
+
+static int kin_mr_dereg(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  int status = 0;
+
+  if (mr_deregister(app, kin->data.mr_dereg.key) != 0) {
+    fprintf(stderr, "kin_mr_dereg: mr_deregister failed\n");
+    status = -1;
+  }
+
+  kout->data.status.opaque = kin->data.mr_dereg.opaque;
+  kout->data.status.status = status;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_MR_DEREG;
+  appif_ctx_kick(ctx);
+  return 1;
+}
+
+static int kin_conn_mr(struct application *app, struct app_context *ctx,
+    volatile struct kernel_appout *kin, volatile struct kernel_appin *kout)
+{
+  struct connection *conn;
+  struct rdma_mr *mr = NULL;
+
+  for (conn = app->conns; conn != NULL; conn = conn->app_next) {
+    if (conn->local_ip == kin->data.conn_mr.local_ip &&
+        conn->remote_ip == kin->data.conn_mr.remote_ip &&
+        conn->local_port == kin->data.conn_mr.local_port &&
+        conn->remote_port == kin->data.conn_mr.remote_port &&
+        conn->opaque == kin->data.conn_mr.opaque)
+    {
+      break;
+    }
+  }
+  if (conn == NULL) {
+    fprintf(stderr, "kin_conn_mr: connection not found\n");
+    goto error;
+  }
+
+  if (kin->data.conn_mr.mr_key != 0 &&
+      (mr = mr_attach(app, kin->data.conn_mr.mr_key)) == NULL)
+  {
+    fprintf(stderr, "kin_conn_mr: memory region not found\n");
+    goto error;
+  }
+
+  if (tcp_setmr(conn, mr, kin->data.conn_mr.mr_len) != 0) {
+    fprintf(stderr, "kin_conn_mr: tcp_setmr failed\n");
+    goto error;
+  }
+
+  kout->data.mr_reg.opaque = kin->data.conn_mr.opaque;
+  kout->data.mr_reg.mr_off = conn->mr_buf - (uint8_t *) tas_shm;
+  kout->data.mr_reg.mr_len = conn->mr_len;
+  kout->data.mr_reg.key = kin->data.conn_mr.mr_key;
+  kout->data.mr_reg.status = 0;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_CONN_MR;
+  appif_ctx_kick(ctx);
+  return 1;
+
+error:
+  kout->data.mr_reg.opaque = kin->data.conn_mr.opaque;
+  kout->data.mr_reg.status = -1;
+  MEM_BARRIER();
+  kout->type = KERNEL_APPIN_STATUS_CONN_MR;
+  appif_ctx_kick(ctx);
+  return 1;
+}
@@ -35,6 +35,7 @@
 
 #include <tas_memif.h>
 
+struct application;
 struct config_route;
 struct connection;
 struct kernel_statistics;
@@ -111,6 +112,8 @@ int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
 enum nicif_connection_flags {
   /** Enable ECN for connection. */
   NICIF_CONN_ECN        = (1 <<  2),
+  /** Use version 2 RDMA headers (64-bit offsets). */
+  NICIF_CONN_RDMA_HDR_V2 = (1 <<  3),
 };
 
 /**
@@ -134,6 +137,7 @@ enum nicif_connection_flags {
  * @param local_seq   Next sequence number for transmission
  * @param app_opaque  Opaque value to pass in notificaitions
  * @param flags       See #nicif_connection_flags.
+ * @param rdma_credits Outstanding requests accepted by the peer (0: no limit)
  * @param rate        Congestion rate to set [Kbps]
  * @param fn_core     FlexNIC emulator core for the connection
  * @param flow_group  Flow group
@@ -144,14 +148,14 @@ enum nicif_connection_flags {
 int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
     uint16_t port_local, uint32_t ip_remote, uint16_t port_remote,
     uint64_t rx_base, uint32_t rx_len, uint64_t tx_base, uint32_t tx_len,
-    uint64_t wq_base, uint32_t wq_len, uint64_t mr_base, uint32_t mr_len,
+    uint64_t wq_base, uint32_t wq_len, uint64_t mr_base, uint64_t mr_len,
     uint64_t rq_base, uint32_t remote_seq, uint32_t local_seq, 
-    uint64_t app_opaque,
-    uint32_t flags, uint32_t rate, uint32_t fn_core, uint16_t flow_group,
-    uint32_t *pf_id);
+    uint64_t app_opaque, uint32_t flags, uint16_t rdma_credits,
+    uint32_t rate, uint32_t fn_core, uint16_t flow_group, uint32_t *pf_id);
 
 /**
  * Disable connection fast path (mark as sp'd and remove from hash table).
+ * Unpairs a loopback peer and waits for loopback copies of both flows.
  *
  * @param f_id      Flow state ID
  * @param tx_seq    Pointer to return last transmit sequence number
@@ -171,6 +175,19 @@ int nicif_connection_disable(uint32_t f_id, uint32_t *tx_seq, uint32_t *rx_seq,
  */
 void nicif_connection_free(uint32_t f_id);
 
+/**
+ * Pair two flows of this instance that are the two ends of one connection.
+ * WQEs of either flow are then executed directly on the other flow's memory
+ * region instead of being sent over TCP. The pairing is removed when one of
+ * the flows is disabled.
+ *
+ * @param f_a First flow state ID
+ * @param f_b Second flow state ID
+ *
+ * @return 0 on success, <0 else
+ */
+int nicif_connection_rdma_peer(uint32_t f_a, uint32_t f_b);
+
 /**
  * Move flow to new db.
  *
@@ -221,6 +238,22 @@ int nicif_connection_stats(uint32_t f_id,
  */
 int nicif_connection_setrate(uint32_t f_id, uint32_t rate);
 
+/**
+ * Switch flow to a new memory region.
+ *
+ * @param f_id      ID of flow
+ * @param mr_base   Offset of new region in DMA memory
+ * @param mr_len    Size of new region
+ * @param copy_len  Number of bytes to copy over from the current region
+ *
+ * Fails if operations of the flow are outstanding or it was active while the
+ * contents were copied, the old region is then still in use.
+ *
+ * @return 0 on success, <0 else
+ */
+int nicif_connection_setmr(uint32_t f_id, uint64_t mr_base, uint64_t mr_len,
+    uint64_t copy_len);
+
 /**
  * Mark flow for retransmit after timeout.
  *
@@ -296,6 +329,76 @@ void packetmem_free(struct packetmem_handle *handle);
 
 /** @} */
 
+/*****************************************************************************/
+/**
+ * @addtogroup kernel-mr
+ * @brief RDMA Memory Regions.
+ * @ingroup kernel
+ *
+ * Memory regions registered once per application and shared by any number of
+ * its connections (similar to a protection domain). Connections attach to a
+ * region by its key when they are opened or accepted.
+ * @{ */
+
+/** Shared RDMA memory region */
+struct rdma_mr {
+  /** Memory manager handle for the region. */
+  struct packetmem_handle *handle;
+  /** Region pointer. */
+  uint8_t *buf;
+  /** Region size. */
+  uint64_t len;
+  /** Key used by connections to attach to the region. */
+  uint32_t key;
+  /** Number of connections attached. */
+  uint32_t refcnt;
+  /** Region was deregistered and is freed with the last connection. */
+  int dead;
+  /** Link list pointer for application memory regions. */
+  struct rdma_mr *next;
+};
+
+/**
+ * Register a shared memory region.
+ *
+ * @param app   Application
+ * @param len   Size of the region
+ * @param mr    Pointer to location for storing pointer of created region
+ *
+ * @return 0 on success, <0 else
+ */
+int mr_register(struct application *app, uint64_t len, struct rdma_mr **mr);
+
+/**
+ * Deregister a shared memory region. The region is freed once no connection
+ * is attached anymore.
+ *
+ * @param app   Application
+ * @param key   Key of the region
+ *
+ * @return 0 on success, <0 else
+ */
+int mr_deregister(struct application *app, uint32_t key);
+
+/**
+ * Look up a registered memory region and attach a connection to it.
+ *
+ * @param app   Application
+ * @param key   Key of the region
+ *
+ * @return Region or NULL if not found.
+ */
+struct rdma_mr *mr_attach(struct application *app, uint32_t key);
+
+/**
+ * Detach a connection from a memory region.
+ *
+ * @param mr    Region returned by mr_attach()
+ */
+void mr_detach(struct rdma_mr *mr);
+
+/** @} */
+
 /*****************************************************************************/
 /**
  * @addtogroup kernel-appif
@@ -443,8 +546,10 @@ struct connection {
     struct packetmem_handle *rx_handle;
     /** Memory manager handle for transmit buffer. */
     struct packetmem_handle *tx_handle;
-    /** Memory manager handle for memory region. */
+    /** Memory manager handle for private memory region. */
     struct packetmem_handle *mr_handle;
+    /** Shared memory region, NULL if the region is private. */
+    struct rdma_mr *mr;
     /** Memory manager handle for work queue. */
     struct packetmem_handle *wq_handle;
     /** Memory mamanger handle for request queue. */
@@ -464,9 +569,11 @@ struct connection {
     /** Transmit buffer size. */
     uint32_t tx_len;
     /** Memory region size. */
-    uint32_t mr_len;
+    uint64_t mr_len;
     /** Work Queue size. */
     uint32_t wq_len;
+    /** Requests the peer accepts outstanding (0: unlimited). */
+    uint16_t rdma_credits;
   /**@}*/
 
   /**
@@ -627,13 +734,17 @@ void tcp_poll(void);
  * @param remote_ip   Remote IP address
  * @param remote_port Remote port number
  * @param db_id       Doorbell ID to use for connection
+ * @param mr          Shared memory region from mr_attach(), NULL to allocate
+ *                    a private region
+ * @param mr_len      Size of private region, 0 for the configured default
  * @param conn        Pointer to location for storing pointer of created conn
  *                    struct.
  *
  * @return 0 on success, <0 else
  */
 int tcp_open(struct app_context *ctx, uint64_t opaque, uint32_t remote_ip,
-    uint16_t remote_port, uint32_t db_id, struct connection **conn);
+    uint16_t remote_port, uint32_t db_id, struct rdma_mr *mr, uint64_t mr_len,
+    struct connection **conn);
 
 /**
  * Open a listener.
@@ -659,11 +770,28 @@ int tcp_listen(struct app_context *ctx, uint64_t opaque, uint16_t local_port,
  * @param opaque  Opaque value passed from application
  * @param listen  Listener
  * @param db_id   Doorbell ID
+ * @param mr      Shared memory region from mr_attach(), NULL to allocate a
+ *                private region
+ * @param mr_len  Size of private region, 0 for the configured default
  *
  * @return 0 on success, <0 else
  */
 int tcp_accept(struct app_context *ctx, uint64_t opaque,
-        struct listener *listen, uint32_t db_id);
+        struct listener *listen, uint32_t db_id, struct rdma_mr *mr,
+        uint64_t mr_len);
+
+/**
+ * Replace the memory region of an open connection. Contents of a private
+ * region are copied to a new private region, up to the smaller size.
+ *
+ * @param conn    Connection
+ * @param mr      Shared memory region from mr_attach(), NULL to allocate a
+ *                private region
+ * @param mr_len  Size of private region, 0 for the configured default
+ *
+ * @return 0 on success, <0 else
+ */
+int tcp_setmr(struct connection *conn, struct rdma_mr *mr, uint64_t mr_len);
 
 /**
  * RX processing for a TCP packet.
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2019 University of Washington, Max Planck Institute for
+ * Software Systems, and The University of Texas at Austin
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * @brief Shared RDMA memory regions.
+ * @file mr.c
+ * @addtogroup kernel-mr
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <tas.h>
+#include "internal.h"
+#include "appif.h"
+
+static void mr_free(struct rdma_mr *mr);
+
+/* 0 is reserved for connections with a private region */
+static uint32_t key_next = 1;
+
+int mr_register(struct application *app, uint64_t len, struct rdma_mr **pmr)
+{
+  struct rdma_mr *mr;
+  uintptr_t off;
+
+  if (len == 0) {
+    fprintf(stderr, "mr_register: invalid length\n");
+    return -1;
+  }
+
+  if ((mr = malloc(sizeof(*mr))) == NULL) {
+    fprintf(stderr, "mr_register: malloc failed\n");
+    return -1;
+  }
+
+  if (packetmem_alloc(len, &off, &mr->handle) != 0) {
+    fprintf(stderr, "mr_register: packetmem_alloc failed\n");
+    free(mr);
+    return -1;
+  }
+
+  mr->buf = (uint8_t *) tas_shm + off;
+  mr->len = len;
+  mr->key = key_next++;
+  if (key_next == 0) {
+    key_next = 1;
+  }
+  mr->refcnt = 0;
+  mr->dead = 0;
+
+  mr->next = app->mrs;
+  app->mrs = mr;
+
+  *pmr = mr;
+  return 0;
+}
+
+int mr_deregister(struct application *app, uint32_t key)
+{
+  struct rdma_mr *mr, **pprev;
+
+  for (pprev = &app->mrs; (mr = *pprev) != NULL; pprev = &mr->next) {
+    if (mr->key == key) {
+      break;
+    }
+  }
+  if (mr == NULL) {
+    fprintf(stderr, "mr_deregister: region not found\n");
+    return -1;
+  }
+
+  /* no new connections can attach from here on */
+  *pprev = mr->next;
+  mr->dead = 1;
+  if (mr->refcnt == 0) {
+    mr_free(mr);
+  }
+  return 0;
+}
+
+struct rdma_mr *mr_attach(struct application *app, uint32_t key)
+{
+  struct rdma_mr *mr;
+
+  for (mr = app->mrs; mr != NULL; mr = mr->next) {
+    if (mr->key == key) {
+      mr->refcnt++;
+      return mr;
+    }
+  }
+  return NULL;
+}
+
+void mr_detach(struct rdma_mr *mr)
+{
+  if (mr == NULL) {
+    return;
+  }
+
+  assert(mr->refcnt > 0);
+  mr->refcnt--;
+  if (mr->refcnt == 0 && mr->dead) {
+    mr_free(mr);
+  }
+}
+
+static void mr_free(struct rdma_mr *mr)
+{
+  packetmem_free(mr->handle);
+  free(mr);
+}
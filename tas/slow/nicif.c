@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sched.h>
 
 #include <tas.h>
 #include <tas_memif.h>
@@ -175,11 +176,10 @@ int nicif_appctx_add(uint16_t appid, uint32_t db, uint64_t *rxq_base,
 int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
     uint16_t port_local, uint32_t ip_remote, uint16_t port_remote,
     uint64_t rx_base, uint32_t rx_len, uint64_t tx_base, uint32_t tx_len,
-    uint64_t wq_base, uint32_t wq_len, uint64_t mr_base, uint32_t mr_len,
+    uint64_t wq_base, uint32_t wq_len, uint64_t mr_base, uint64_t mr_len,
     uint64_t rq_base, uint32_t remote_seq, uint32_t local_seq, 
-    uint64_t app_opaque,
-    uint32_t flags, uint32_t rate, uint32_t fn_core, uint16_t flow_group,
-    uint32_t *pf_id)
+    uint64_t app_opaque, uint32_t flags, uint16_t rdma_credits,
+    uint32_t rate, uint32_t fn_core, uint16_t flow_group, uint32_t *pf_id)
 {
   struct flextcp_pl_flowst *fs;
   beui32_t lip = t_beui32(ip_local), rip = t_beui32(ip_remote);
@@ -251,6 +251,26 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   fs->cq_tail = 0;
   fs->rq_head = 0;
   fs->rq_tail = 0;
+  fs->rqe_tx_seq = 0;
+  fs->pending_rq_state = 0;
+  fs->rcv_tail = 0;
+  fs->rdma_failed = 0;
+  fs->rdma_credits = rdma_credits;
+  fs->rdma_credits_max = rdma_credits;
+  fs->rdma_peer = 0;
+  fs->rdma_copy_pending = 0;
+  fs->rdma_db_listed = 0;
+  fs->rdma_hdr_ver = RDMA_HDR_V1;
+  if ((flags & NICIF_CONN_RDMA_HDR_V2) == NICIF_CONN_RDMA_HDR_V2) {
+    fs->rdma_hdr_ver = RDMA_HDR_V2;
+  }
+
+  fs->txf_ack_seq = local_seq;
+  fs->txf_ack_len = 0;
+  fs->txf_ack_off = 0;
+  fs->txf_seq = local_seq;
+  fs->txf_len = 0;
+  fs->txf_off = 0;
 
   /* write to empty entry first */
   MEM_BARRIER();
@@ -263,13 +283,34 @@ int nicif_connection_add(uint32_t db, uint64_t mac_remote, uint32_t ip_local,
   return 0;
 }
 
+/* Wait until no loopback copy of the flow runs on a copy thread. Copies read
+ * and write the memory regions of the flow and its peer, and a completion
+ * would otherwise apply to the flow after its id is reused. */
+static void flow_copy_drain(struct flextcp_pl_flowst *fs)
+{
+  uint32_t pending;
+
+  for (;;) {
+    util_spin_lock(&fs->lock);
+    pending = fs->rdma_copy_pending;
+    util_spin_unlock(&fs->lock);
+
+    if (pending == 0)
+      return;
+    sched_yield();
+  }
+}
+
 int nicif_connection_disable(uint32_t f_id, uint32_t *tx_seq, uint32_t *rx_seq,
     int *tx_closed, int *rx_closed)
 {
   struct flextcp_pl_flowst *fs = &fp_state->flowst[f_id];
+  uint32_t peer;
 
   util_spin_lock(&fs->lock);
 
+  peer = fs->rdma_peer;
+  fs->rdma_peer = 0;
   *tx_seq = fs->tx_next_seq;
   *rx_seq = fs->rx_next_seq;
   fs->rx_base_sp |= FLEXNIC_PL_FLOWST_SLOWPATH;
@@ -280,6 +321,23 @@ int nicif_connection_disable(uint32_t f_id, uint32_t *tx_seq, uint32_t *rx_seq,
 
   util_spin_unlock(&fs->lock);
 
+  /* unpair loopback peer, the fast path never holds one lock while waiting
+   * for the other one here */
+  if (peer != 0) {
+    fs = &fp_state->flowst[peer - 1];
+    util_spin_lock(&fs->lock);
+    if (fs->rdma_peer == f_id + 1) {
+      fs->rdma_peer = 0;
+    }
+    util_spin_unlock(&fs->lock);
+
+    /* unpaired flows start no new copies, wait for the running ones before
+     * the regions can be freed */
+    flow_copy_drain(fs);
+    fs = &fp_state->flowst[f_id];
+    flow_copy_drain(fs);
+  }
+
   flow_slot_clear(f_id, fs->local_ip, fs->local_port, fs->remote_ip,
       fs->remote_port);
   return 0;
@@ -290,6 +348,105 @@ void nicif_connection_free(uint32_t f_id)
   flow_id_free(f_id);
 }
 
+int nicif_connection_rdma_peer(uint32_t f_a, uint32_t f_b)
+{
+  struct flextcp_pl_flowst *fa, *fb;
+
+  if (f_a >= FLEXNIC_PL_FLOWST_NUM || f_b >= FLEXNIC_PL_FLOWST_NUM ||
+      f_a == f_b)
+  {
+    fprintf(stderr, "nicif_connection_rdma_peer: bad flow id\n");
+    return -1;
+  }
+
+  fa = &fp_state->flowst[f_a];
+  fb = &fp_state->flowst[f_b];
+
+  /* each flow is only locked on its own, see nicif_connection_disable() */
+  util_spin_lock(&fa->lock);
+  fa->rdma_peer = f_b + 1;
+  util_spin_unlock(&fa->lock);
+
+  util_spin_lock(&fb->lock);
+  fb->rdma_peer = f_a + 1;
+  util_spin_unlock(&fb->lock);
+  return 0;
+}
+
+/* No operation of the flow or its loopback peer references the memory
+ * region, zero-copy tx frames re-read their payload from it until acked */
+static int flow_mr_idle(struct flextcp_pl_flowst *fs)
+{
+  struct flextcp_pl_flowst *peer = NULL;
+
+  if (fs->rdma_peer != 0) {
+    peer = &fp_state->flowst[fs->rdma_peer - 1];
+  }
+
+  return fs->tx_sent == 0 && fs->tx_avail == 0 &&
+    fs->cq_head == fs->wq_head && fs->rq_head == fs->rq_tail &&
+    fs->pending_rq_state == 0 && fs->rdma_copy_pending == 0 &&
+    (peer == NULL || peer->rdma_copy_pending == 0);
+}
+
+/** Switch flow to new memory region, fails unless the flow is idle */
+int nicif_connection_setmr(uint32_t f_id, uint64_t mr_base, uint64_t mr_len,
+    uint64_t copy_len)
+{
+  struct flextcp_pl_flowst *fs, *peer;
+  uint32_t rx_seq, wq_head, peer_id, peer_wq_tail = 0;
+  uint64_t old_base;
+
+  if (f_id >= FLEXNIC_PL_FLOWST_NUM) {
+    fprintf(stderr, "nicif_connection_setmr: bad flow id\n");
+    return -1;
+  }
+
+  fs = &fp_state->flowst[f_id];
+
+  util_spin_lock(&fs->lock);
+  if (!flow_mr_idle(fs)) {
+    util_spin_unlock(&fs->lock);
+    fprintf(stderr, "nicif_connection_setmr: flow has outstanding "
+        "operations\n");
+    return -1;
+  }
+  peer_id = fs->rdma_peer;
+  peer = (peer_id != 0 ? &fp_state->flowst[peer_id - 1] : NULL);
+  if (peer != NULL) {
+    peer_wq_tail = peer->wq_tail;
+  }
+  rx_seq = fs->rx_next_seq;
+  wq_head = fs->wq_head;
+  old_base = fs->mr_base;
+  util_spin_unlock(&fs->lock);
+
+  /* contents are moved without the lock, so fast path cores do not spin on
+   * the flow for the whole copy */
+  if (copy_len > 0) {
+    memcpy((uint8_t *) tas_shm + mr_base, (uint8_t *) tas_shm + old_base,
+        copy_len);
+  }
+
+  /* received data, new WQEs or loopback WQEs of the peer may have used the
+   * old region during the copy */
+  util_spin_lock(&fs->lock);
+  if (!flow_mr_idle(fs) || fs->rx_next_seq != rx_seq ||
+      fs->wq_head != wq_head || fs->mr_base != old_base ||
+      fs->rdma_peer != peer_id ||
+      (peer != NULL && peer->wq_tail != peer_wq_tail))
+  {
+    util_spin_unlock(&fs->lock);
+    fprintf(stderr, "nicif_connection_setmr: flow active during copy\n");
+    return -1;
+  }
+  fs->mr_base = mr_base;
+  fs->mr_len = mr_len;
+  util_spin_unlock(&fs->lock);
+
+  return 0;
+}
+
 /** Move flow to new db */
 int nicif_connection_move(uint32_t dst_db, uint32_t f_id)
 {
@@ -34,6 +34,7 @@
 
 #include <tas.h>
 #include <packet_defs.h>
+#include <tas_rdma.h>
 #include <utils.h>
 #include <utils_rng.h>
 #include "internal.h"
@@ -71,16 +72,19 @@ struct backlog_slot {
 struct tcp_opts {
   struct tcp_mss_opt *mss;
   struct tcp_timestamp_opt *ts;
+  struct tcp_rdma_opt *rdma;
 };
 
 static int conn_arp_done(struct connection *conn);
 static void conn_packet(struct connection *c, const struct pkt_tcp *p,
     const struct tcp_opts *opts, uint32_t fn_core, uint16_t flow_group);
-static inline struct connection *conn_alloc(void);
+static inline struct connection *conn_alloc(struct rdma_mr *mr,
+    uint64_t mr_len);
 static inline void conn_free(struct connection *conn);
 static void conn_register(struct connection *conn);
 static void conn_unregister(struct connection *conn);
 static struct connection *conn_lookup(const struct pkt_tcp *p);
+static void conn_loopback(struct connection *c);
 static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
     const struct tcp_opts *opts);
 static int conn_reg_synack(struct connection *c);
@@ -96,11 +100,15 @@ static void listener_accept(struct listener *l);
 
 static inline uint16_t port_alloc(void);
 static inline int send_control(const struct connection *conn, uint16_t flags,
-    int ts_opt, uint32_t ts_echo, uint16_t mss_opt);
+    int ts_opt, uint32_t ts_echo, uint16_t mss_opt, uint8_t rdma_opt);
 static inline int send_reset(const struct pkt_tcp *p,
     const struct tcp_opts *opts);
 static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
     struct tcp_opts *opts);
+static inline void rdma_hdr_negotiate(struct connection *c,
+    const struct tcp_opts *opts);
+static inline uint8_t rdma_hdr_ver(const struct connection *c);
+static inline uint16_t rdma_credits_local(void);
 
 static uintptr_t ports[PORT_MAX + 1];
 static uint16_t port_eph_hint = PORT_FIRST_EPH;
@@ -144,15 +152,17 @@ void tcp_poll(void)
 }
 
 int tcp_open(struct app_context *ctx, uint64_t opaque, uint32_t remote_ip,
-    uint16_t remote_port, uint32_t db_id, struct connection **pconn)
+    uint16_t remote_port, uint32_t db_id, struct rdma_mr *mr, uint64_t mr_len,
+    struct connection **pconn)
 {
   int ret;
   struct connection *conn;
   uint16_t local_port;
 
   /* allocate connection struct */
-  if ((conn = conn_alloc()) == NULL) {
+  if ((conn = conn_alloc(mr, mr_len)) == NULL) {
     fprintf(stderr, "tcp_open: malloc failed\n");
+    mr_detach(mr);
     return -1;
   }
 
@@ -319,13 +329,15 @@ int tcp_listen(struct app_context *ctx, uint64_t opaque, uint16_t local_port,
 }
 
 int tcp_accept(struct app_context *ctx, uint64_t opaque,
-    struct listener *listen, uint32_t db_id)
+    struct listener *listen, uint32_t db_id, struct rdma_mr *mr,
+    uint64_t mr_len)
 {
   struct connection *conn;
 
   /* allocate listener struct */
-  if ((conn = conn_alloc()) == NULL) {
+  if ((conn = conn_alloc(mr, mr_len)) == NULL) {
     fprintf(stderr, "tcp_accept: conn_alloc failed\n");
+    mr_detach(mr);
     return -1;
   }
 
@@ -346,6 +358,59 @@ int tcp_accept(struct app_context *ctx, uint64_t opaque,
   return 0;
 }
 
+int tcp_setmr(struct connection *conn, struct rdma_mr *mr, uint64_t mr_len)
+{
+  struct packetmem_handle *handle = NULL;
+  uintptr_t off;
+  uint64_t copy_len = 0;
+
+  if (conn->status != CONN_OPEN) {
+    fprintf(stderr, "tcp_setmr: connection not open\n");
+    mr_detach(mr);
+    return -1;
+  }
+
+  if (mr != NULL) {
+    off = mr->buf - (uint8_t *) tas_shm;
+    mr_len = mr->len;
+  } else {
+    if (mr_len == 0) {
+      mr_len = config.rdma_mr_len;
+    }
+    if (packetmem_alloc(mr_len, &off, &handle) != 0) {
+      fprintf(stderr, "tcp_setmr: packetmem_alloc failed\n");
+      return -1;
+    }
+
+    /* private regions keep their contents */
+    if (conn->mr == NULL) {
+      copy_len = MIN(mr_len, conn->mr_len);
+    }
+  }
+
+  if (nicif_connection_setmr(conn->flow_id, off, mr_len, copy_len) != 0) {
+    fprintf(stderr, "tcp_setmr: nicif_connection_setmr failed\n");
+    if (handle != NULL) {
+      packetmem_free(handle);
+    }
+    mr_detach(mr);
+    return -1;
+  }
+
+  /* no outstanding operation of the flow references the old region, see
+   * nicif_connection_setmr() */
+  if (conn->mr_handle != NULL) {
+    packetmem_free(conn->mr_handle);
+  }
+  mr_detach(conn->mr);
+
+  conn->mr = mr;
+  conn->mr_handle = handle;
+  conn->mr_buf = (uint8_t *) tas_shm + off;
+  conn->mr_len = mr_len;
+  return 0;
+}
+
 int tcp_packet(const void *pkt, uint16_t len, uint32_t fn_core,
     uint16_t flow_group)
 {
@@ -410,7 +475,7 @@ int tcp_close(struct connection *conn)
   conn->local_seq = tx_seq;
 
   if (!tx_c || !rx_c) {
-    send_control(conn, TCP_RST, 0, 0, 0);
+    send_control(conn, TCP_RST, 0, 0, 0, 0);
   }
 
   cc_conn_remove(conn);
@@ -463,7 +528,8 @@ void tcp_timeout(struct timeout *to, enum timeout_type type)
   conn_timeout_arm(c, TO_TCP_HANDSHAKE);
 
   /* re-send SYN packet */
-  send_control(c, TCP_SYN | TCP_ECE | TCP_CWR, 1, 0, TCP_MSS);
+  send_control(c, TCP_SYN | TCP_ECE | TCP_CWR, 1, 0, TCP_MSS,
+      config.rdma_hdr_ver);
 }
 
 static void conn_packet(struct connection *c, const struct pkt_tcp *p,
@@ -498,7 +564,7 @@ static void conn_packet(struct connection *c, const struct pkt_tcp *p,
     }
 
     send_control(c, TCP_SYN | TCP_ACK | ecn_flags, 1,
-        f_beui32(opts->ts->ts_val), TCP_MSS);
+        f_beui32(opts->ts->ts_val), TCP_MSS, rdma_hdr_ver(c));
   } else if (c->status == CONN_OPEN &&
       (TCPH_FLAGS(&p->tcp) & TCP_SYN) == TCP_SYN)
   {
@@ -508,7 +574,7 @@ static void conn_packet(struct connection *c, const struct pkt_tcp *p,
   {
    /* silently ignore a FIN for an already closed connection: TODO figure out
     * why necessary*/
-    send_control(c, TCP_ACK, 1, 0, 0);
+    send_control(c, TCP_ACK, 1, 0, 0, 0);
   } else {
     fprintf(stderr, "tcp_packet: unexpected connection state %u\n", c->status);
   }
@@ -526,7 +592,8 @@ static int conn_arp_done(struct connection *conn)
   conn_timeout_arm(conn, TO_TCP_HANDSHAKE);
 
   /* send SYN */
-  send_control(conn, TCP_SYN | TCP_ECE | TCP_CWR, 1, 0, TCP_MSS);
+  send_control(conn, TCP_SYN | TCP_ECE | TCP_CWR, 1, 0, TCP_MSS,
+      config.rdma_hdr_ver);
 
   CONN_DEBUG0(conn, "SYN SENT\n");
   return 0;
@@ -561,6 +628,8 @@ static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
     c->flags |= NICIF_CONN_ECN;
   }
 
+  rdma_hdr_negotiate(c, opts);
+
   cc_conn_init(c);
 
   c->comp.q = &conn_async_q;
@@ -573,8 +642,8 @@ static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
         c->wq_buf - (uint8_t*) tas_shm, c->wq_len,
         c->mr_buf - (uint8_t*) tas_shm, c->mr_len,
         c->rq_buf - (uint8_t*) tas_shm,
-        c->remote_seq, c->local_seq, c->opaque, c->flags, c->cc_rate,
-        c->fn_core, c->flow_group, &c->flow_id)
+        c->remote_seq, c->local_seq, c->opaque, c->flags, c->rdma_credits,
+        c->cc_rate, c->fn_core, c->flow_group, &c->flow_id)
       != 0)
   {
     fprintf(stderr, "conn_syn_sent_packet: nicif_connection_add failed\n");
@@ -585,8 +654,11 @@ static int conn_syn_sent_packet(struct connection *c, const struct pkt_tcp *p,
 
   c->status = CONN_OPEN;
 
+  /* the accepting end registered its flow when the SYN arrived */
+  conn_loopback(c);
+
   /* send ACK */
-  send_control(c, TCP_ACK, 1, c->syn_ts, 0);
+  send_control(c, TCP_ACK, 1, c->syn_ts, 0, 0);
 
   CONN_DEBUG0(c, "conn_syn_sent_packet: ACK sent\n");
 
@@ -606,7 +678,8 @@ static int conn_reg_synack(struct connection *c)
   }
 
   /* send ACK */
-  send_control(c, TCP_SYN | TCP_ACK | ecn_flags, 1, c->syn_ts, TCP_MSS);
+  send_control(c, TCP_SYN | TCP_ACK | ecn_flags, 1, c->syn_ts, TCP_MSS,
+      rdma_hdr_ver(c));
 
   appif_accept_conn(c, 0);
 
@@ -633,7 +706,8 @@ static inline uint16_t port_alloc(void)
   return 0;
 }
 
-static inline struct connection *conn_alloc(void)
+static inline struct connection *conn_alloc(struct rdma_mr *mr,
+    uint64_t mr_len)
 {
   struct connection *conn;
   uintptr_t off_rx, off_tx, off_mr, off_wq, off_rq;
@@ -653,12 +727,29 @@ static inline struct connection *conn_alloc(void)
     goto TXBUF_ALLOC_ERROR;
   }
 
-  if (packetmem_alloc(config.rdma_mr_len, &off_mr, &conn->mr_handle) != 0) {
+  /* shared regions are allocated on registration */
+  conn->mr = mr;
+  conn->mr_handle = NULL;
+  if (mr != NULL) {
+    off_mr = mr->buf - (uint8_t *) tas_shm;
+    mr_len = mr->len;
+  } else if (mr_len == 0) {
+    mr_len = config.rdma_mr_len;
+  }
+  if (mr == NULL &&
+      packetmem_alloc(mr_len, &off_mr, &conn->mr_handle) != 0)
+  {
     fprintf(stderr, "conn_alloc: packetmem_alloc mr failed\n");
     goto MRBUF_ALLOC_ERROR;
   }
 
-  if (packetmem_alloc(config.rdma_wq_len, &off_wq, &conn->wq_handle) != 0) {
+  /* work queue is followed by its doorbell, the receive queue and the
+   * inline payload slots */
+  if (packetmem_alloc(2 * config.rdma_wq_len +
+        sizeof(struct flextcp_pl_rdma_db) + config.rdma_wq_len /
+        sizeof(struct rdma_wqe) * RDMA_INLINE_MAX, &off_wq,
+        &conn->wq_handle) != 0)
+  {
     fprintf(stderr, "conn_alloc: packetmem_alloc wq failed\n");
     goto WQBUF_ALLOC_ERROR;
   }
@@ -673,18 +764,21 @@ static inline struct connection *conn_alloc(void)
   conn->tx_buf = (uint8_t *) tas_shm + off_tx;
   conn->tx_len = config.tcp_txbuf_len;
   conn->mr_buf = (uint8_t *) tas_shm + off_mr;
-  conn->mr_len = config.rdma_mr_len;
+  conn->mr_len = mr_len;
   conn->wq_buf = (uint8_t *) tas_shm + off_wq;
   conn->wq_len = config.rdma_wq_len;
   conn->rq_buf = (uint8_t *) tas_shm + off_rq;
   conn->to_armed = 0;
+  memset(conn->wq_buf + conn->wq_len, 0, sizeof(struct flextcp_pl_rdma_db));
 
   return conn;
 
 RQBUF_ALLOC_ERROR:
   packetmem_free(conn->wq_handle);
 WQBUF_ALLOC_ERROR:
-  packetmem_free(conn->mr_handle);
+  if (conn->mr_handle != NULL) {
+    packetmem_free(conn->mr_handle);
+  }
 MRBUF_ALLOC_ERROR:
   packetmem_free(conn->tx_handle);
 TXBUF_ALLOC_ERROR:
@@ -698,7 +792,10 @@ static inline void conn_free(struct connection *conn)
 {
   packetmem_free(conn->tx_handle);
   packetmem_free(conn->rx_handle);
-  packetmem_free(conn->mr_handle);
+  if (conn->mr_handle != NULL) {
+    packetmem_free(conn->mr_handle);
+  }
+  mr_detach(conn->mr);
   packetmem_free(conn->wq_handle);
   packetmem_free(conn->rq_handle);
   free(conn);
@@ -762,6 +859,32 @@ static struct connection *conn_lookup(const struct pkt_tcp *p)
   return NULL;
 }
 
+/** Pair the flow with the other end of the connection if that is local */
+static void conn_loopback(struct connection *c)
+{
+  uint32_t h;
+  struct connection *p;
+
+  if (c->remote_ip != config.ip) {
+    return;
+  }
+
+  h = conn_hash(c->remote_ip, c->local_ip, c->remote_port, c->local_port) %
+      TCP_HTSIZE;
+
+  for (p = tcp_hashtable[h]; p != NULL; p = p->ht_next) {
+    if (p != c && p->remote_ip == c->local_ip &&
+        p->local_port == c->remote_port && p->remote_port == c->local_port &&
+        (p->status == CONN_REG_SYNACK || p->status == CONN_OPEN))
+    {
+      if (nicif_connection_rdma_peer(c->flow_id, p->flow_id) != 0) {
+        fprintf(stderr, "conn_loopback: nicif_connection_rdma_peer failed\n");
+      }
+      return;
+    }
+  }
+}
+
 static void conn_failed(struct connection *c, int status)
 {
   conn_unregister(c);
@@ -967,6 +1090,8 @@ static void listener_accept(struct listener *l)
     c->flags |= NICIF_CONN_ECN;
   }
 
+  rdma_hdr_negotiate(c, &opts);
+
   cc_conn_init(c);
 
   c->status = CONN_REG_SYNACK;
@@ -981,8 +1106,8 @@ static void listener_accept(struct listener *l)
         c->wq_buf - (uint8_t*) tas_shm, c->wq_len,
         c->mr_buf - (uint8_t*) tas_shm, c->mr_len,
         c->rq_buf - (uint8_t*) tas_shm,
-        c->remote_seq, c->local_seq + 1, c->opaque, c->flags, c->cc_rate,
-        c->fn_core, c->flow_group, &c->flow_id)
+        c->remote_seq, c->local_seq + 1, c->opaque, c->flags,
+        c->rdma_credits, c->cc_rate, c->fn_core, c->flow_group, &c->flow_id)
       != 0)
   {
     fprintf(stderr, "listener_packet: nicif_connection_add failed\n");
@@ -1004,14 +1129,15 @@ out:
 static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
     uint16_t remote_port, uint16_t local_port, uint32_t local_seq,
     uint32_t remote_seq, uint16_t flags, int ts_opt, uint32_t ts_echo,
-    uint16_t mss_opt)
+    uint16_t mss_opt, uint8_t rdma_opt)
 {
   uint32_t new_tail;
   struct pkt_tcp *p;
   struct tcp_mss_opt *opt_mss;
   struct tcp_timestamp_opt *opt_ts;
+  struct tcp_rdma_opt *opt_rdma;
   uint8_t optlen;
-  uint16_t len, off_ts, off_mss;
+  uint16_t len, off_ts, off_mss, off_rdma;
 
   /* calculate header length depending on options */
   optlen = 0;
@@ -1019,6 +1145,8 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
   optlen += (mss_opt ? sizeof(*opt_mss) : 0);
   off_ts = optlen;
   optlen += (ts_opt ? sizeof(*opt_ts) : 0);
+  off_rdma = optlen;
+  optlen += (rdma_opt ? sizeof(*opt_rdma) : 0);
   optlen = (optlen + 3) & ~3;
   len = sizeof(*p) + optlen;
 
@@ -1066,13 +1194,24 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
   /* if requested: add timestamp option */
   if (ts_opt) {
     opt_ts = (struct tcp_timestamp_opt *) ((uint8_t *) (p + 1) + off_ts);
-    memset(opt_ts, 0, optlen);
+    memset(opt_ts, 0, optlen - off_ts);
     opt_ts->kind = TCP_OPT_TIMESTAMP;
     opt_ts->length = sizeof(*opt_ts);
     opt_ts->ts_val = t_beui32(0);
     opt_ts->ts_ecr = t_beui32(ts_echo);
   }
 
+  /* if requested: add rdma header version option */
+  if (rdma_opt) {
+    opt_rdma = (struct tcp_rdma_opt *) ((uint8_t *) (p + 1) + off_rdma);
+    memset(opt_rdma, 0, optlen - off_rdma);
+    opt_rdma->kind = TCP_OPT_EXP;
+    opt_rdma->length = sizeof(*opt_rdma);
+    opt_rdma->exid = t_beui16(TCP_OPT_RDMA_EXID);
+    opt_rdma->version = rdma_opt;
+    opt_rdma->credits = t_beui16(rdma_credits_local());
+  }
+
   /* calculate header checksums */
   p->ip.chksum = rte_ipv4_cksum((void *) &p->ip);
   p->tcp.chksum = rte_ipv4_udptcp_cksum((void *) &p->ip, (void *) &p->tcp);
@@ -1083,11 +1222,11 @@ static inline int send_control_raw(uint64_t remote_mac, uint32_t remote_ip,
 }
 
 static inline int send_control(const struct connection *conn, uint16_t flags,
-    int ts_opt, uint32_t ts_echo, uint16_t mss_opt)
+    int ts_opt, uint32_t ts_echo, uint16_t mss_opt, uint8_t rdma_opt)
 {
   return send_control_raw(conn->remote_mac, conn->remote_ip, conn->remote_port,
       conn->local_port, conn->local_seq, conn->remote_seq, flags, ts_opt,
-      ts_echo, mss_opt);
+      ts_echo, mss_opt, rdma_opt);
 }
 
 static inline int send_reset(const struct pkt_tcp *p,
@@ -1105,7 +1244,7 @@ static inline int send_reset(const struct pkt_tcp *p,
   memcpy(&remote_mac, &p->eth.src, ETH_ADDR_LEN);
   return send_control_raw(remote_mac, f_beui32(p->ip.src), f_beui16(p->tcp.src),
       f_beui16(p->tcp.dest), f_beui32(p->tcp.ackno), f_beui32(p->tcp.seqno) + 1,
-      TCP_RST | TCP_ACK, ts_opt, ts_val, 0);
+      TCP_RST | TCP_ACK, ts_opt, ts_val, 0, 0);
 }
 
 static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
@@ -1118,6 +1257,7 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
 
   opts->ts = NULL;
   opts->mss = NULL;
+  opts->rdma = NULL;
 
   /* whole header not in buf */
   if (TCPH_HDRLEN(&p->tcp) < 5 || opts_len > (len - sizeof(*p))) {
@@ -1154,6 +1294,13 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
         }
 
         opts->ts = (struct tcp_timestamp_opt *) (opt + off);
+      } else if (opt_kind == TCP_OPT_EXP &&
+          (opt_len == sizeof(struct tcp_rdma_opt) ||
+           opt_len == offsetof(struct tcp_rdma_opt, credits)) &&
+          f_beui16(((struct tcp_rdma_opt *) (opt + off))->exid) ==
+            TCP_OPT_RDMA_EXID)
+      {
+        opts->rdma = (struct tcp_rdma_opt *) (opt + off);
       }
     }
     off += opt_len;
@@ -1161,3 +1308,33 @@ static inline int parse_options(const struct pkt_tcp *p, uint16_t len,
 
   return 0;
 }
+
+/* Use the highest RDMA header version supported by both ends */
+static inline void rdma_hdr_negotiate(struct connection *c,
+    const struct tcp_opts *opts)
+{
+  c->flags &= ~NICIF_CONN_RDMA_HDR_V2;
+  if (opts->rdma != NULL && opts->rdma->version >= RDMA_HDR_V2 &&
+      config.rdma_hdr_ver >= RDMA_HDR_V2)
+  {
+    c->flags |= NICIF_CONN_RDMA_HDR_V2;
+  }
+
+  /* Peers without the credits field do not bound their requests */
+  c->rdma_credits = 0;
+  if (opts->rdma != NULL && opts->rdma->length == sizeof(*opts->rdma))
+    c->rdma_credits = f_beui16(opts->rdma->credits);
+}
+
+/* Requests a peer may have outstanding: one RQ slot stays empty and one
+ * holds the response being sent */
+static inline uint16_t rdma_credits_local(void)
+{
+  return MIN(config.rdma_wq_len / sizeof(struct rdma_wqe) - 2, UINT16_MAX);
+}
+
+static inline uint8_t rdma_hdr_ver(const struct connection *c)
+{
+  return ((c->flags & NICIF_CONN_RDMA_HDR_V2) == NICIF_CONN_RDMA_HDR_V2 ?
+      RDMA_HDR_V2 : RDMA_HDR_V1);
+}
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../tas/fast/dma.h"
+
+/* Microbenchmark for the fast path copy routine. Copies of growing size run
+ * with rte_memcpy() and with dma_copy(), which streams large copies past the
+ * cache. After every copy a flow state sized array is read, its read time
+ * shows how much of it the copy evicted from the cache.
+ *
+ * Usage: bench_dma_copy [MAX_SIZE] [ITERATIONS]
+ */
+
+#define BUF_SIZE    (256 * 1024 * 1024)
+#define STATE_SIZE  (1024 * 1024)
+
+typedef void (*copy_fn)(void *dst, const void *src, size_t len);
+
+static uint8_t *src;
+static uint8_t *dst;
+static uint8_t *state;
+static volatile uint64_t state_sum;
+
+static inline uint64_t get_nanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+/* Read one word of every cache line of the flow state */
+static void state_read(void)
+{
+    uint64_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < STATE_SIZE; i += 64)
+        sum += *(uint64_t *) (state + i);
+    state_sum += sum;
+}
+
+static void copy_rte(void *d, const void *s, size_t len)
+{
+    rte_memcpy(d, s, len);
+}
+
+static void copy_dma(void *d, const void *s, size_t len)
+{
+    dma_copy(d, s, len);
+}
+
+static void run(const char *name, copy_fn fn, size_t len, unsigned iters)
+{
+    uint64_t t, t_copy = 0, t_state = 0;
+    size_t off = 0;
+    unsigned i;
+
+    state_read();
+    for (i = 0; i < iters; i++)
+    {
+        // Walk through the buffers so the source is not cached either
+        if (off + len > BUF_SIZE)
+            off = 0;
+
+        t = get_nanos();
+        fn(dst + off, src + off, len);
+        t_copy += get_nanos() - t;
+
+        t = get_nanos();
+        state_read();
+        t_state += get_nanos() - t;
+
+        off += len;
+    }
+
+    printf("%-12s %10zu %10.2f GB/s %12.1f ns\n", name, len,
+            (double) len * iters / t_copy, (double) t_state / iters);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t i, len, max_len = 1024 * 1024;
+    unsigned iters = 1000;
+
+    if (argc > 1)
+        max_len = strtoul(argv[1], NULL, 10);
+    if (argc > 2)
+        iters = strtoul(argv[2], NULL, 10);
+    // The final check copies max_len bytes at offsets of up to 3 bytes
+    if (max_len == 0 || max_len > BUF_SIZE - 3 || iters == 0)
+    {
+        fprintf(stderr, "Usage: %s [MAX_SIZE] [ITERATIONS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (posix_memalign((void **) &src, 64, BUF_SIZE) != 0 ||
+            posix_memalign((void **) &dst, 64, BUF_SIZE) != 0 ||
+            posix_memalign((void **) &state, 64, STATE_SIZE) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u failed\n", __func__, __LINE__);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < BUF_SIZE; i++)
+        src[i] = i * 7;
+    memset(dst, 0, BUF_SIZE);
+    memset(state, 2, STATE_SIZE);
+
+    dma_init();
+    printf("streaming copies from %u bytes: %s\n", DMA_STREAM_MIN,
+            dma_copy_stream != NULL ? "enabled" : "not supported");
+    printf("%-12s %10s %15s %15s\n", "copy", "bytes", "throughput",
+            "state read");
+
+    for (len = 64; len <= max_len; len *= 2)
+    {
+        run("rte_memcpy", copy_rte, len, iters);
+        run("dma_copy", copy_dma, len, iters);
+    }
+
+    // Check the streamed copies
+    dma_copy(dst + 1, src + 3, max_len);
+    if (memcmp(dst + 1, src + 3, max_len) != 0)
+    {
+        fprintf(stderr, "[ERROR] %s():%u copy mismatch\n", __func__,
+                __LINE__);
+        return EXIT_FAILURE;
+    }
+
+    free(src);
+    free(dst);
+    free(state);
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 
 #include "harness.h"
 #include "../testutils.h"
@@ -35,12 +36,15 @@ struct harness {
   size_t num_fpcores;
   size_t next_ctx;
   uint64_t num_kicks;
+  void (*kick)(void);
   struct harness_ctx *ctxs;
 };
 
 struct harness_params harness_param;
 struct harness harness;
 
+extern int flexnic_evfd[FLEXTCP_MAX_FTCPCORES];
+
 
 void harness_prepare(struct harness_params *hp)
 {
@@ -52,6 +56,7 @@ void harness_prepare(struct harness_params *hp)
   harness.num_fpcores = hp->fp_cores;
   harness.next_ctx = 0;
   harness.num_kicks = 0;
+  harness.kick = NULL;
 
   /* allocate contexts */
   harness.ctxs = test_zalloc(harness.num_ctxs * sizeof(*hc));
@@ -79,6 +84,13 @@ void harness_prepare(struct harness_params *hp)
   }
 }
 
+/* kick is called whenever the library notifies the kernel, e.g. to answer
+ * requests on aout right away */
+void harness_set_kick(void (*kick)(void))
+{
+  harness.kick = kick;
+}
+
 int harness_aout_peek(struct kernel_appout **p_ao, size_t ctxid)
 {
   struct harness_ctx *hc = &harness.ctxs[ctxid];
@@ -222,6 +234,71 @@ int harness_ain_push_connopen_failed(size_t ctxid, uint64_t opaque,
   return harness_ain_push(ctxid, &ai);
 }
 
+static int harness_ain_push_rdma(size_t ctxid, uint8_t type, uint64_t opaque,
+    uint32_t wq_len, void *wq_buf, uint64_t mr_len, void *mr_buf,
+    uint32_t flow_id, uint32_t remote_ip, uint16_t port, uint32_t core)
+{
+  struct kernel_appin ai;
+  struct kernel_appin_conn_opened *aico;
+  struct kernel_appin_accept_conn *aiac;
+
+  memset(&ai, 0, sizeof(ai));
+  ai.type = type;
+  if (type == KERNEL_APPIN_CONN_OPENED) {
+    aico = &ai.data.conn_opened;
+    aico->opaque = opaque;
+    aico->wq_len = wq_len;
+    aico->wq_off = (uintptr_t) wq_buf;
+    aico->mr_len = mr_len;
+    aico->mr_off = (uintptr_t) mr_buf;
+    aico->flow_id = flow_id;
+    aico->local_port = port;
+    aico->fn_core = core;
+  } else {
+    aiac = &ai.data.accept_connection;
+    aiac->opaque = opaque;
+    aiac->wq_len = wq_len;
+    aiac->wq_off = (uintptr_t) wq_buf;
+    aiac->mr_len = mr_len;
+    aiac->mr_off = (uintptr_t) mr_buf;
+    aiac->flow_id = flow_id;
+    aiac->remote_ip = remote_ip;
+    aiac->remote_port = port;
+    aiac->fn_core = core;
+  }
+
+  return harness_ain_push(ctxid, &ai);
+}
+
+int harness_ain_push_rdmaopened(size_t ctxid, uint64_t opaque, uint32_t wq_len,
+    void *wq_buf, uint64_t mr_len, void *mr_buf, uint32_t flow_id,
+    uint16_t local_port, uint32_t core)
+{
+  return harness_ain_push_rdma(ctxid, KERNEL_APPIN_CONN_OPENED, opaque, wq_len,
+      wq_buf, mr_len, mr_buf, flow_id, 0, local_port, core);
+}
+
+int harness_ain_push_rdmaaccepted(size_t ctxid, uint64_t opaque,
+    uint32_t wq_len, void *wq_buf, uint64_t mr_len, void *mr_buf,
+    uint32_t flow_id, uint32_t remote_ip, uint16_t remote_port, uint32_t core)
+{
+  return harness_ain_push_rdma(ctxid, KERNEL_APPIN_ACCEPTED_CONN, opaque,
+      wq_len, wq_buf, mr_len, mr_buf, flow_id, remote_ip, remote_port, core);
+}
+
+int harness_ain_push_status(size_t ctxid, uint8_t type, uint64_t opaque,
+    int32_t status)
+{
+  struct kernel_appin ai;
+
+  memset(&ai, 0, sizeof(ai));
+  ai.type = type;
+  ai.data.status.opaque = opaque;
+  ai.data.status.status = status;
+
+  return harness_ain_push(ctxid, &ai);
+}
+
 int harness_atx_pull(size_t ctxid, size_t qid, uint32_t rx_bump,
     uint32_t tx_bump, uint32_t flow_id, uint16_t bump_seq, uint8_t flags)
 {
@@ -277,14 +354,90 @@ int harness_arx_push(size_t ctxid, size_t qid, uint64_t opaque,
 
 }
 
+int harness_atx_pull_rdma(size_t ctxid, size_t qid, uint32_t flow_id,
+    uint32_t wq_head, uint32_t cq_tail)
+{
+  struct harness_ctx *hc = &harness.ctxs[ctxid];
+  struct harness_fpc_ctx *fpc = &hc->fpcs[qid];
+  struct flextcp_pl_atx *atx = &fpc->atx_base[fpc->atx_pos];
+
+  if (atx->type == 0)
+    return -1;
+
+  if (atx->type == FLEXTCP_PL_ATX_RDMAUPDATE &&
+      atx->msg.rdmaupdate.flow_id == flow_id &&
+      atx->msg.rdmaupdate.wq_head == wq_head &&
+      atx->msg.rdmaupdate.cq_tail == cq_tail)
+  {
+    atx->type = 0;
+
+    fpc->atx_pos++;
+    if (fpc->atx_pos >= hc->atx_len)
+      fpc->atx_pos -= hc->atx_len;
+
+    return 0;
+  } else {
+    return 1;
+  }
+}
+
+int harness_atx_pop(size_t ctxid, size_t qid, struct flextcp_pl_atx *p_atx)
+{
+  struct harness_ctx *hc = &harness.ctxs[ctxid];
+  struct harness_fpc_ctx *fpc = &hc->fpcs[qid];
+  struct flextcp_pl_atx *atx = &fpc->atx_base[fpc->atx_pos];
+
+  if (atx->type == 0)
+    return -1;
+
+  *p_atx = *atx;
+  atx->type = 0;
+
+  fpc->atx_pos++;
+  if (fpc->atx_pos >= hc->atx_len)
+    fpc->atx_pos -= hc->atx_len;
+
+  return 0;
+}
+
+int harness_arx_push_rdma(size_t ctxid, size_t qid, uint64_t opaque,
+    uint32_t wq_tail, uint32_t cq_head, uint32_t rcv_tail)
+{
+  struct harness_ctx *hc = &harness.ctxs[ctxid];
+  struct harness_fpc_ctx *fpc = &hc->fpcs[qid];
+  struct flextcp_pl_arx *arx = &fpc->arx_base[fpc->arx_pos];
+
+  if (arx->type != FLEXTCP_PL_ARX_INVALID)
+    return -1;
+
+  arx->msg.rdmaupdate.opaque = opaque;
+  arx->msg.rdmaupdate.wq_tail = wq_tail;
+  arx->msg.rdmaupdate.cq_head = cq_head;
+  arx->msg.rdmaupdate.rcv_tail = rcv_tail;
+  arx->type = FLEXTCP_PL_ARX_RDMAUPDATE;
+
+  fpc->arx_pos++;
+  if (fpc->arx_pos >= hc->arx_len)
+    fpc->arx_pos -= hc->arx_len;
+
+  return 0;
+}
+
 int flextcp_kernel_connect(void)
 {
+  size_t i;
+
+  /* fast path kicks must not end up on stdin */
+  for (i = 0; i < harness.num_fpcores; i++)
+    flexnic_evfd[i] = eventfd(0, EFD_NONBLOCK);
   return 0;
 }
 
 void flextcp_kernel_kick(void)
 {
   harness.num_kicks++;
+  if (harness.kick != NULL)
+    harness.kick();
 }
 
 int flexnic_driver_internal(void **int_mem_start)
@@ -323,8 +476,9 @@ int flextcp_kernel_newctx(struct flextcp_context *ctx)
   ctx->num_queues = harness.num_fpcores;
   ctx->next_queue = 0;
 
-  ctx->rxq_len = hc->arx_len;
-  ctx->txq_len = hc->atx_len;
+  /* queue lengths are in bytes */
+  ctx->rxq_len = hc->arx_len * sizeof(struct flextcp_pl_arx);
+  ctx->txq_len = hc->atx_len * sizeof(struct flextcp_pl_atx);
 
   for (i = 0; i < ctx->num_queues; i++) {
     ctx->queues[i].rxq_base =
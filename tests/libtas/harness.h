@@ -17,6 +17,7 @@ struct harness_params {
 };
 
 void harness_prepare(struct harness_params *hp);
+void harness_set_kick(void (*kick)(void));
 
 int harness_aout_peek(struct kernel_appout **ao, size_t ctxid);
 int harness_aout_pop(size_t ctxid);
@@ -31,10 +32,24 @@ int harness_ain_push_connopened(size_t ctxid, uint64_t opaque, uint32_t rx_len,
     uint32_t local_ip, uint16_t local_port, uint32_t core);
 int harness_ain_push_connopen_failed(size_t ctxid, uint64_t opaque,
     int32_t status);
+int harness_ain_push_rdmaopened(size_t ctxid, uint64_t opaque, uint32_t wq_len,
+    void *wq_buf, uint64_t mr_len, void *mr_buf, uint32_t flow_id,
+    uint16_t local_port, uint32_t core);
+int harness_ain_push_rdmaaccepted(size_t ctxid, uint64_t opaque,
+    uint32_t wq_len, void *wq_buf, uint64_t mr_len, void *mr_buf,
+    uint32_t flow_id, uint32_t remote_ip, uint16_t remote_port, uint32_t core);
+int harness_ain_push_status(size_t ctxid, uint8_t type, uint64_t opaque,
+    int32_t status);
 
 int harness_atx_pull(size_t ctxid, size_t qid, uint32_t rx_bump,
     uint32_t tx_bump, uint32_t flow_id, uint16_t bump_seq, uint8_t flags);
 int harness_arx_push(size_t ctxid, size_t qid, uint64_t opaque,
     uint32_t rx_bump, uint32_t rx_pos, uint32_t tx_bump, uint8_t flags);
 
+int harness_atx_pull_rdma(size_t ctxid, size_t qid, uint32_t flow_id,
+    uint32_t wq_head, uint32_t cq_tail);
+int harness_atx_pop(size_t ctxid, size_t qid, struct flextcp_pl_atx *atx);
+int harness_arx_push_rdma(size_t ctxid, size_t qid, uint64_t opaque,
+    uint32_t wq_tail, uint32_t cq_head, uint32_t rcv_tail);
+
 #endif // ndef HARNESS_H_
@@ -135,6 +135,117 @@ static void test_connect_fail(void *p)
   test_assert("ctxev_conn", evs[0].ev.conn_open.conn == &conn);
 }
 
+static void test_rdma_poll_tcp(void *p)
+{
+  struct flextcp_context ctx;
+  struct flextcp_connection conn;
+  struct flextcp_event evs[4];
+  int num;
+  int n;
+  void *rxbuf, *txbuf;
+
+  if (flextcp_init() != 0)
+    test_error("flextcp_init failed");
+
+  test_randinit(&ctx, sizeof(ctx));
+  if (flextcp_context_create(&ctx) != 0)
+    test_error("flextcp_context_create failed");
+
+  /* open connection */
+  test_randinit(&conn, sizeof(conn));
+  if (flextcp_connection_open(&ctx, &conn, TEST_IP, TEST_PORT) != 0)
+    test_error("flextcp_connection_open failed");
+
+  n = harness_aout_pull_connopen(0, (uintptr_t) &conn, TEST_IP, TEST_PORT, 0);
+  test_assert("pulling conn open request off aout", n == 0);
+
+  rxbuf = test_zalloc(1024);
+  txbuf = test_zalloc(1024);
+  n = harness_ain_push_connopened(0, (uintptr_t) &conn, 1024, rxbuf, 1024,
+      txbuf, 1, TEST_LIP, TEST_LPORT, 0);
+  test_assert("harness_ain_push_connopened success", n == 0);
+
+  num = flextcp_context_poll(&ctx, 4, evs);
+  test_assert("conn open event", num == 1);
+
+  /* tcp update consumed by rdma polling */
+  n = harness_arx_push(0, 1, (uintptr_t) &conn, 32, 0, 0, 0);
+  test_assert("harness_arx_push success", n == 0);
+
+  num = rdma_context_poll(&ctx, 4);
+  test_assert("rdma poll consumed entry", num == 1);
+
+  /* ... is still reported by the next context poll */
+  num = flextcp_context_poll(&ctx, 4, evs);
+  test_assert("one rx event poll", num == 1);
+  test_assert("rxev_type", evs[0].event_type == FLEXTCP_EV_CONN_RECEIVED);
+  test_assert("rxev_buf", evs[0].ev.conn_received.buf == rxbuf);
+  test_assert("rxev_len", evs[0].ev.conn_received.len == 32);
+  test_assert("rxev_conn", evs[0].ev.conn_received.conn == &conn);
+
+  num = flextcp_context_poll(&ctx, 4, evs);
+  test_assert("no more events", num == 0);
+}
+
+static void test_mr_register(void *p)
+{
+  struct flextcp_context ctx;
+  struct flextcp_connection conn;
+  struct flextcp_mr mr;
+  struct flextcp_event evs[4];
+  struct kernel_appout *ao;
+  struct kernel_appin ai;
+  int num;
+  int n;
+
+  if (flextcp_init() != 0)
+    test_error("flextcp_init failed");
+
+  test_randinit(&ctx, sizeof(ctx));
+  if (flextcp_context_create(&ctx) != 0)
+    test_error("flextcp_context_create failed");
+
+  /* register region */
+  test_randinit(&mr, sizeof(mr));
+  if (flextcp_mr_register(&ctx, &mr, 4096) != 0)
+    test_error("flextcp_mr_register failed");
+
+  n = harness_aout_peek(&ao, 0);
+  test_assert("mr reg request on aout", n == 0 &&
+      ao->type == KERNEL_APPOUT_MR_REG &&
+      ao->data.mr_reg.opaque == (uintptr_t) &mr &&
+      ao->data.mr_reg.len == 4096);
+  harness_aout_pop(0);
+
+  memset(&ai, 0, sizeof(ai));
+  ai.type = KERNEL_APPIN_STATUS_MR_REG;
+  ai.data.mr_reg.opaque = (uintptr_t) &mr;
+  ai.data.mr_reg.mr_off = 8192;
+  ai.data.mr_reg.mr_len = 4096;
+  ai.data.mr_reg.key = 7;
+  n = harness_ain_push(0, &ai);
+  test_assert("harness_ain_push success", n == 0);
+
+  num = flextcp_context_poll(&ctx, 4, evs);
+  test_assert("mr reg event", num == 1);
+  test_assert("mrev_type", evs[0].event_type == FLEXTCP_EV_MR_REG);
+  test_assert("mrev_status", evs[0].ev.mr.status == 0);
+  test_assert("mrev_mr", evs[0].ev.mr.mr == &mr);
+  test_assert("mr key", mr.key == 7 && mr.len == 4096);
+
+  /* connections attach by key */
+  test_randinit(&conn, sizeof(conn));
+  if (flextcp_connection_open_mr(&ctx, &conn, TEST_IP, TEST_PORT, mr.key,
+        0) != 0)
+    test_error("flextcp_connection_open_mr failed");
+
+  n = harness_aout_peek(&ao, 0);
+  test_assert("conn open with key", n == 0 &&
+      ao->type == KERNEL_APPOUT_CONN_OPEN &&
+      ao->data.conn_open.mr_key == 7);
+  harness_aout_pop(0);
+}
+
 static void test_full_rxbuf(void *p)
 {
   struct flextcp_context ctx;
@@ -365,6 +476,12 @@ int main(int argc, char *argv[])
   if (test_subcase("connect fail", test_connect_fail, NULL))
     ret = 1;
 
+  if (test_subcase("rdma poll tcp update", test_rdma_poll_tcp, NULL))
+    ret = 1;
+
+  if (test_subcase("mr register", test_mr_register, NULL))
+    ret = 1;
+
   if (test_subcase("full rxbuf", test_full_rxbuf, NULL))
     ret = 1;
 
@@ -0,0 +1,1194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+
+#include <tas_ll.h>
+#include <tas_rdma.h>
+#include <rdma_verbs.h>
+
+#include "../testutils.h"
+#include "harness.h"
+
+#define TEST_IP   0x0a010203
+#define TEST_PORT 12345
+
+#define TEST_RIP  0x0a010204
+
+#define TEST_CTXS     2
+#define TEST_FP_CORES 2
+
+#define FAKE_CONNS    32
+#define FAKE_MRS      4
+#define FAKE_INCOMING 8
+#define FAKE_ACCEPTS  32
+#define FAKE_WQ_LEN   (32 * sizeof(struct rdma_wqe))
+#define FAKE_MR_LEN   (64 * 1024)
+
+/* Connection opened by the fake slow path, its fast path state is kept
+ * here */
+struct fake_conn {
+  size_t ctx;
+  uint64_t opaque;
+  uint8_t *wq;
+  uint8_t *mr;
+  uint32_t flow_id;
+  uint16_t port;
+  uint32_t wq_pos;      /* entries completed */
+  uint32_t rcv_pos;     /* receive buffers filled */
+  uint32_t imm;         /* hello delivered to the next receive buffer */
+  int has_imm;
+  int closed;
+};
+
+/* Connection request of a remote peer, accepted by the next accept */
+struct fake_incoming {
+  uint16_t port;
+  uint32_t imm;
+  int has_imm;
+};
+
+struct fake_accept {
+  size_t ctx;
+  uint64_t opaque;
+  uint32_t mr_key;
+};
+
+struct fake_mr {
+  uint8_t *base;
+  uint64_t len;
+  uint32_t key;
+};
+
+static struct {
+  struct fake_conn conns[FAKE_CONNS];
+  unsigned num_conns;
+  struct fake_mr mrs[FAKE_MRS];
+  unsigned num_mrs;
+  struct fake_incoming incoming[FAKE_INCOMING];
+  unsigned num_incoming;
+  struct fake_accept accepts[FAKE_ACCEPTS];
+  unsigned num_accepts;
+  uint16_t next_port;
+  /* complete all posted operations in flextcp_block() */
+  int auto_complete;
+} fake;
+
+static struct flextcp_pl_rdma_db *fake_db(struct fake_conn *f)
+{
+  return (struct flextcp_pl_rdma_db *) (f->wq + FAKE_WQ_LEN);
+}
+
+static struct rdma_wqe *fake_wqe(struct fake_conn *f, uint32_t pos)
+{
+  return (struct rdma_wqe *) (f->wq + pos % FAKE_WQ_LEN);
+}
+
+static struct rdma_wqe *fake_rcv(struct fake_conn *f, uint32_t pos)
+{
+  return (struct rdma_wqe *) (f->wq + FAKE_WQ_LEN +
+      sizeof(struct flextcp_pl_rdma_db) + pos % FAKE_WQ_LEN);
+}
+
+static uint8_t *fake_mr_get(uint32_t key)
+{
+  unsigned i;
+
+  if (key == 0)
+    return test_zalloc(FAKE_MR_LEN);
+
+  for (i = 0; i < fake.num_mrs; i++)
+    if (fake.mrs[i].key == key)
+      return fake.mrs[i].base;
+  test_error("fake_mr_get: unknown key");
+}
+
+static struct fake_conn *fake_conn_new(size_t ctx, uint64_t opaque,
+    uint32_t mr_key, uint16_t port)
+{
+  struct fake_conn *f;
+
+  if (fake.num_conns >= FAKE_CONNS)
+    test_error("fake_conn_new: too many connections");
+
+  f = &fake.conns[fake.num_conns];
+  f->ctx = ctx;
+  f->opaque = opaque;
+  /* work queue, doorbell, receive queue and inline slots */
+  f->wq = test_zalloc(2 * FAKE_WQ_LEN + sizeof(struct flextcp_pl_rdma_db) +
+      FAKE_WQ_LEN / sizeof(struct rdma_wqe) * RDMA_INLINE_MAX);
+  f->mr = fake_mr_get(mr_key);
+  f->flow_id = fake.num_conns + 1;
+  f->port = port;
+  fake.num_conns++;
+  return f;
+}
+
+static void fake_accept_conn(struct fake_accept *a, struct fake_incoming *in)
+{
+  struct fake_conn *f = fake_conn_new(a->ctx, a->opaque, a->mr_key,
+      in->port);
+
+  f->imm = in->imm;
+  f->has_imm = in->has_imm;
+  if (harness_ain_push_rdmaaccepted(f->ctx, f->opaque, FAKE_WQ_LEN, f->wq,
+        FAKE_MR_LEN, f->mr, f->flow_id, TEST_RIP, in->port, 0) != 0)
+    test_error("fake_accept_conn: ain full");
+}
+
+/* A remote peer connects, with a hello for its first receive buffer if
+ * has_imm is set */
+static void fake_connect_in(uint16_t port, uint32_t imm, int has_imm)
+{
+  struct fake_incoming in;
+
+  in.port = port;
+  in.imm = imm;
+  in.has_imm = has_imm;
+  if (fake.num_accepts > 0) {
+    fake_accept_conn(&fake.accepts[0], &in);
+    fake.num_accepts--;
+    memmove(&fake.accepts[0], &fake.accepts[1],
+        fake.num_accepts * sizeof(fake.accepts[0]));
+    return;
+  }
+
+  if (fake.num_incoming >= FAKE_INCOMING)
+    test_error("fake_connect_in: too many connections");
+  fake.incoming[fake.num_incoming++] = in;
+}
+
+static struct fake_conn *fake_conn_lookup(uint64_t opaque)
+{
+  unsigned i;
+
+  for (i = 0; i < fake.num_conns; i++)
+    if (fake.conns[i].opaque == opaque && !fake.conns[i].closed)
+      return &fake.conns[i];
+  return NULL;
+}
+
+/* Slow path: answer the requests of context ctx */
+static void fake_kick_ctx(size_t ctx)
+{
+  struct kernel_appout *ao;
+  struct kernel_appin ai;
+  struct fake_conn *f;
+  struct fake_mr *m;
+
+  while (harness_aout_peek(&ao, ctx) == 0) {
+    switch (ao->type) {
+      case KERNEL_APPOUT_LISTEN_OPEN:
+        harness_ain_push_status(ctx, KERNEL_APPIN_STATUS_LISTEN_OPEN,
+            ao->data.listen_open.opaque, 0);
+        break;
+
+      case KERNEL_APPOUT_CONN_OPEN:
+        f = fake_conn_new(ctx, ao->data.conn_open.opaque,
+            ao->data.conn_open.mr_key, fake.next_port++);
+        harness_ain_push_rdmaopened(ctx, f->opaque, FAKE_WQ_LEN, f->wq,
+            FAKE_MR_LEN, f->mr, f->flow_id, f->port, 0);
+        break;
+
+      case KERNEL_APPOUT_ACCEPT_CONN:
+        if (fake.num_accepts >= FAKE_ACCEPTS)
+          test_error("fake_kick: too many accepts");
+        fake.accepts[fake.num_accepts].ctx = ctx;
+        fake.accepts[fake.num_accepts].opaque =
+          ao->data.accept_conn.conn_opaque;
+        fake.accepts[fake.num_accepts].mr_key = ao->data.accept_conn.mr_key;
+        fake.num_accepts++;
+        break;
+
+      case KERNEL_APPOUT_CONN_CLOSE:
+        if ((f = fake_conn_lookup(ao->data.conn_close.opaque)) != NULL)
+          f->closed = 1;
+        harness_ain_push_status(ctx, KERNEL_APPIN_STATUS_CONN_CLOSE,
+            ao->data.conn_close.opaque, 0);
+        break;
+
+      case KERNEL_APPOUT_MR_REG:
+        if (fake.num_mrs >= FAKE_MRS)
+          test_error("fake_kick: too many memory regions");
+        m = &fake.mrs[fake.num_mrs++];
+        m->len = ao->data.mr_reg.len;
+        m->base = test_zalloc(m->len);
+        m->key = fake.num_mrs;
+
+        memset(&ai, 0, sizeof(ai));
+        ai.type = KERNEL_APPIN_STATUS_MR_REG;
+        ai.data.mr_reg.opaque = ao->data.mr_reg.opaque;
+        ai.data.mr_reg.mr_off = (uintptr_t) m->base;
+        ai.data.mr_reg.mr_len = m->len;
+        ai.data.mr_reg.key = m->key;
+        harness_ain_push(ctx, &ai);
+        break;
+
+      default:
+        test_error("fake_kick: unexpected aout entry");
+    }
+    harness_aout_pop(ctx);
+  }
+}
+
+/* Slow path: answer requests on aout right away */
+static void fake_kick(void)
+{
+  size_t i;
+
+  for (i = 0; i < TEST_CTXS; i++)
+    fake_kick_ctx(i);
+
+  /* connections that arrived before the accept */
+  while (fake.num_accepts > 0 && fake.num_incoming > 0) {
+    fake_accept_conn(&fake.accepts[0], &fake.incoming[0]);
+    fake.num_accepts--;
+    memmove(&fake.accepts[0], &fake.accepts[1],
+        fake.num_accepts * sizeof(fake.accepts[0]));
+    fake.num_incoming--;
+    memmove(&fake.incoming[0], &fake.incoming[1],
+        fake.num_incoming * sizeof(fake.incoming[0]));
+  }
+}
+
+static void fake_update(struct fake_conn *f)
+{
+  if (harness_arx_push_rdma(f->ctx, 0, f->opaque, f->wq_pos, f->wq_pos,
+        f->rcv_pos) != 0)
+    test_error("fake_update: arx full");
+}
+
+/* Fast path: complete the next num posted operations of f with status */
+static void fake_complete(struct fake_conn *f, uint32_t num, uint8_t status)
+{
+  struct flextcp_pl_rdma_db *db = fake_db(f);
+  uint32_t i;
+
+  for (i = 0; i < num; i++) {
+    if (f->wq_pos == db->wq_head)
+      test_error("fake_complete: no operation posted");
+    fake_wqe(f, f->wq_pos)->status = status;
+    f->wq_pos += sizeof(struct rdma_wqe);
+  }
+  fake_update(f);
+}
+
+/* Operations posted on f and not completed */
+static uint32_t fake_posted(struct fake_conn *f)
+{
+  return (fake_db(f)->wq_head - f->wq_pos) / sizeof(struct rdma_wqe);
+}
+
+static void fake_poll(void)
+{
+  struct flextcp_pl_atx atx;
+  struct fake_conn *f;
+  struct rdma_wqe *wqe;
+  unsigned i, j;
+
+  /* doorbells are read from the work queues directly */
+  for (i = 0; i < TEST_CTXS; i++)
+    for (j = 0; j < TEST_FP_CORES; j++)
+      while (harness_atx_pop(i, j, &atx) == 0);
+
+  for (i = 0; i < fake.num_conns; i++) {
+    f = &fake.conns[i];
+    if (f->closed)
+      continue;
+
+    if (f->has_imm && fake_db(f)->rcv_head != f->rcv_pos) {
+      wqe = fake_rcv(f, f->rcv_pos);
+      wqe->type = RDMA_OP_WRITE_IMM;
+      wqe->status = RDMA_SUCCESS;
+      wqe->imm = f->imm;
+      wqe->len = 0;
+      f->rcv_pos += sizeof(struct rdma_wqe);
+      f->has_imm = 0;
+      fake_update(f);
+    }
+
+    if (fake.auto_complete && fake_posted(f) > 0)
+      fake_complete(f, fake_posted(f), RDMA_SUCCESS);
+  }
+}
+
+/* The library waits for the fast path here */
+void flextcp_block(struct flextcp_context *ctx, int timeout_ms)
+{
+  fake_poll();
+}
+
+static void fake_init(void)
+{
+  memset(&fake, 0, sizeof(fake));
+  fake.next_port = 1000;
+  harness_set_kick(fake_kick);
+}
+
+static void test_init(void)
+{
+  fake_init();
+  if (rdma_tas_init() != 0)
+    test_error("rdma_tas_init failed");
+}
+
+static void test_addr(struct sockaddr_in *sa)
+{
+  memset(sa, 0, sizeof(*sa));
+  sa->sin_family = AF_INET;
+  sa->sin_addr.s_addr = htonl(TEST_IP);
+  sa->sin_port = htons(TEST_PORT);
+}
+
+static uint32_t test_hello(uint16_t port, uint32_t num, uint32_t idx)
+{
+  return ((uint32_t) port << 16) | (num << 8) | idx;
+}
+
+static void test_stripe_order(void *p)
+{
+  struct sockaddr_in sa;
+  struct rdma_wqe evs[4], *pev;
+  struct fake_conn *f0, *f1, *f2;
+  void *mr_base;
+  uint64_t mr_len;
+  uint32_t key;
+  int fd, n;
+
+  test_init();
+  test_addr(&sa);
+  if (rdma_tas_reg_mr(1024 * 1024, &mr_base, &key) != 0)
+    test_error("rdma_tas_reg_mr failed");
+
+  /* hellos complete right away */
+  fake.auto_complete = 1;
+  fd = rdma_tas_connect_stripe(&sa, key, 3, &mr_base, &mr_len);
+  test_assert("connect stripe", fd > 0 && fake.num_conns == 3);
+  f0 = &fake.conns[0];
+  f1 = &fake.conns[1];
+  f2 = &fake.conns[2];
+  test_assert("hellos sent", f0->wq_pos == sizeof(struct rdma_wqe) &&
+      fake_wqe(f1, 0)->imm == test_hello(f0->port, 3, 1) &&
+      fake_wqe(f2, 0)->imm == test_hello(f0->port, 3, 2));
+  fake.auto_complete = 0;
+
+  /* small write on the first sub-flow, bulk write over the others, and a
+   * send held behind the bulk write */
+  test_assert("post small", rdma_tas_write(fd, 4096, 0, 0) == 0);
+  test_assert("post bulk", rdma_tas_write(fd, 64 * 1024, 0, 0) == 1);
+  test_assert("post send", rdma_tas_send(fd, 64, 0) == 2);
+  test_assert("parts posted", fake_posted(f0) == 1 &&
+      fake_posted(f1) == 1 && fake_posted(f2) == 1);
+  test_assert("part lengths", fake_wqe(f1, f1->wq_pos)->len == 32 * 1024 &&
+      fake_wqe(f2, f2->wq_pos)->roff == 32 * 1024);
+
+  /* last bulk part and the small write complete */
+  fake_complete(f2, 1, RDMA_SUCCESS);
+  fake_complete(f0, 1, RDMA_SUCCESS);
+  n = rdma_tas_cq_poll(fd, evs, 4);
+  test_assert("small write completes", n == 1 && evs[0].id == 0 &&
+      evs[0].status == RDMA_SUCCESS);
+  test_assert("send still held", fake_posted(f0) == 0);
+
+  /* a failed part fails the bulk write and releases the send */
+  fake_complete(f1, 1, RDMA_OUT_OF_BOUNDS);
+  n = rdma_tas_cq_poll(fd, evs, 4);
+  test_assert("bulk write fails", n == 1 && evs[0].id == 1 &&
+      evs[0].status == RDMA_OUT_OF_BOUNDS && evs[0].len == 64 * 1024);
+  test_assert("send submitted", fake_posted(f0) == 1 &&
+      fake_wqe(f0, f0->wq_pos)->type == RDMA_OP_SEND);
+
+  fake_complete(f0, 1, RDMA_SUCCESS);
+  n = rdma_tas_cq_poll(fd, evs, 4);
+  test_assert("send completes", n == 1 && evs[0].id == 2 &&
+      evs[0].type == RDMA_OP_SEND);
+
+  /* a small write completing first waits for the earlier bulk write */
+  test_assert("post bulk 2", rdma_tas_read(fd, 64 * 1024, 0, 0) == 3);
+  test_assert("post small 2", rdma_tas_write(fd, 64, 0, 0) == 4);
+  fake_complete(f0, 1, RDMA_SUCCESS);
+  n = rdma_tas_cq_poll(fd, evs, 4);
+  test_assert("small write waits", n == 0);
+  fake_complete(f1, 1, RDMA_SUCCESS);
+  fake_complete(f2, 1, RDMA_SUCCESS);
+  n = rdma_tas_cq_poll(fd, evs, 4);
+  test_assert("posting order", n == 2 && evs[0].id == 3 &&
+      evs[0].type == RDMA_OP_READ && evs[1].id == 4);
+
+  /* waiting works on the striped connection */
+  fake.auto_complete = 1;
+  test_assert("post bulk 3", rdma_tas_write(fd, 64 * 1024, 0, 0) == 5);
+  n = rdma_tas_cq_wait(fd, evs, 4, 1000);
+  test_assert("wait", n == 1 && evs[0].id == 5);
+  test_assert("cq fd", rdma_tas_cq_fd(fd) >= 0);
+
+  /* single connection calls reject the fd */
+  test_assert("cq peek", rdma_tas_cq_peek(fd, &pev) == -1);
+  test_assert("post burst", rdma_tas_post_burst(fd, evs, 1) == -1);
+}
+
+static void test_stripe_accept(void *p)
+{
+  struct sockaddr_in sa;
+  struct fake_conn *a0, *b0;
+  void *mr_base;
+  uint64_t mr_len;
+  uint32_t key;
+  int lfd, fda, fdb;
+
+  test_init();
+  test_addr(&sa);
+  if (rdma_tas_reg_mr(1024 * 1024, &mr_base, &key) != 0)
+    test_error("rdma_tas_reg_mr failed");
+  lfd = rdma_tas_listen(&sa, 8);
+  test_assert("listen", lfd > 0);
+
+  /* sub-flows of two clients interleaved, and a peer with a bad hello */
+  fake_connect_in(100, test_hello(100, 2, 0), 1);
+  fake_connect_in(300, test_hello(300, 3, 0), 1);
+  fake_connect_in(200, test_hello(200, 2, 1), 1);
+  fake_connect_in(200, test_hello(200, 2, 0), 1);
+  fake_connect_in(100, test_hello(100, 2, 1), 1);
+
+  fdb = rdma_tas_accept_stripe(lfd, &sa, key, 2, &mr_base, &mr_len);
+  test_assert("accept first complete", fdb > 0 && fake.num_conns == 4);
+  test_assert("bad hello closed", fake.conns[1].closed &&
+      !fake.conns[0].closed);
+  fda = rdma_tas_accept_stripe(lfd, &sa, key, 2, &mr_base, &mr_len);
+  test_assert("accept held", fda > 0 && fake.num_conns == 5);
+
+  /* small operations use sub-flow 0 of each client */
+  a0 = &fake.conns[0];
+  b0 = &fake.conns[3];
+  test_assert("write b", rdma_tas_write(fdb, 64, 0, 0) == 0 &&
+      fake_posted(b0) == 1);
+  test_assert("write a", rdma_tas_write(fda, 64, 0, 0) == 0 &&
+      fake_posted(a0) == 1);
+}
+
+static void test_stripe_close(void *p)
+{
+  struct sockaddr_in sa;
+  struct rdma_wqe ev;
+  void *mr_base;
+  uint64_t mr_len;
+  uint32_t key;
+  int fd, fd2;
+
+  test_init();
+  test_addr(&sa);
+  if (rdma_tas_reg_mr(1024 * 1024, &mr_base, &key) != 0)
+    test_error("rdma_tas_reg_mr failed");
+
+  fake.auto_complete = 1;
+  fd = rdma_tas_connect_stripe(&sa, key, 2, &mr_base, &mr_len);
+  test_assert("connect stripe", fd > 0);
+  test_assert("write", rdma_tas_write(fd, 64, 0, 0) == 0);
+
+  test_assert("close", rdma_tas_close(fd) == 0);
+  test_assert("sub-flows closed", fake.conns[0].closed &&
+      fake.conns[1].closed);
+  test_assert("fd released", rdma_tas_cq_poll(fd, &ev, 1) == -1);
+
+  /* single connections close the same way */
+  fd2 = rdma_tas_connect_mr(&sa, key, 0, &mr_base, &mr_len);
+  test_assert("connect", fd2 > 0);
+  test_assert("close conn", rdma_tas_close(fd2) == 0 && fake.conns[2].closed);
+  test_assert("double close", rdma_tas_close(fd2) == -1);
+}
+
+static void test_scq(void *p)
+{
+  struct sockaddr_in sa;
+  struct rdma_cq_event evs[8];
+  struct rdma_wqe ev;
+  struct rdma_tas_cq *cq;
+  struct fake_conn *f1, *f2;
+  void *mr_base;
+  uint64_t mr_len;
+  int fd1, fd2, n;
+
+  test_init();
+  test_addr(&sa);
+  fd1 = rdma_tas_connect(&sa, &mr_base, &mr_len);
+  fd2 = rdma_tas_connect(&sa, &mr_base, &mr_len);
+  test_assert("connect", fd1 > 0 && fd2 > 0);
+  f1 = &fake.conns[0];
+  f2 = &fake.conns[1];
+
+  cq = rdma_tas_scq_create();
+  test_assert("scq create", cq != NULL);
+  test_assert("attach", rdma_tas_scq_attach(cq, fd1) == 0 &&
+      rdma_tas_scq_attach(cq, fd2) == 0);
+  test_assert("attach twice", rdma_tas_scq_attach(cq, fd1) == -1);
+
+  /* one poll returns the completions of both connections */
+  test_assert("post", rdma_tas_write(fd1, 64, 0, 0) == 0 &&
+      rdma_tas_write(fd2, 64, 0, 0) == 0);
+  fake_complete(f2, 1, RDMA_SUCCESS);
+  fake_complete(f1, 1, RDMA_OUT_OF_BOUNDS);
+  n = rdma_tas_scq_poll(cq, evs, 8);
+  test_assert("scq poll", n == 2);
+  test_assert("event fd2", evs[0].fd == fd2 && evs[0].wqe.id == 0 &&
+      evs[0].wqe.status == RDMA_SUCCESS);
+  test_assert("event fd1", evs[1].fd == fd1 && evs[1].wqe.id == 0 &&
+      evs[1].wqe.status == RDMA_OUT_OF_BOUNDS);
+  test_assert("scq empty", rdma_tas_scq_poll(cq, evs, 8) == 0);
+
+  /* detaching a connection with unread completions */
+  test_assert("post 2", rdma_tas_write(fd1, 64, 0, 0) == 32 &&
+      rdma_tas_write(fd2, 64, 0, 0) == 32);
+  fake_complete(f1, 1, RDMA_SUCCESS);
+  fake_complete(f2, 1, RDMA_SUCCESS);
+  test_assert("fetch updates", rdma_tas_scq_poll(cq, evs, 0) == 0);
+  test_assert("detach", rdma_tas_scq_detach(cq, fd1) == 0);
+  test_assert("detach twice", rdma_tas_scq_detach(cq, fd1) == -1);
+  n = rdma_tas_scq_poll(cq, evs, 8);
+  test_assert("scq poll without fd1", n == 1 && evs[0].fd == fd2);
+  n = rdma_tas_cq_poll(fd1, &ev, 1);
+  test_assert("completion stays on fd1", n == 1 && ev.id == 32);
+
+  /* closing detaches */
+  test_assert("destroy attached", rdma_tas_scq_destroy(cq) == -1);
+  test_assert("close", rdma_tas_close(fd2) == 0);
+  test_assert("destroy", rdma_tas_scq_destroy(cq) == 0);
+}
+
+/* Connect on a new thread, with its own context */
+static void *test_connect_thread(void *p)
+{
+  struct sockaddr_in sa;
+  void *mr_base;
+  uint64_t mr_len;
+  int *fd = p;
+
+  test_addr(&sa);
+  *fd = rdma_tas_connect_mr(&sa, fake.mrs[0].key, 0, &mr_base, &mr_len);
+  return NULL;
+}
+
+/* Connect num members to the shared region, with fake connections
+ * fake.conns[0..num - 1] */
+static uint32_t test_group_init(int *fds, uint32_t num)
+{
+  struct sockaddr_in sa;
+  void *mr_base;
+  uint64_t mr_len;
+  uint32_t i, key;
+
+  test_init();
+  test_addr(&sa);
+  if (rdma_tas_reg_mr(1024 * 1024, &mr_base, &key) != 0)
+    test_error("rdma_tas_reg_mr failed");
+
+  for (i = 0; i < num; i++) {
+    fds[i] = rdma_tas_connect_mr(&sa, key, 0, &mr_base, &mr_len);
+    if (fds[i] <= 0)
+      test_error("rdma_tas_connect_mr failed");
+  }
+  return key;
+}
+
+static void test_group_create(void *p)
+{
+  struct sockaddr_in sa;
+  struct rdma_tas_group *g;
+  int fds[RDMA_GROUP_MAX + 1], bad[2];
+  void *mr_base;
+  uint64_t mr_len;
+  pthread_t t;
+  uint32_t i;
+
+  test_group_init(fds, 2);
+  test_addr(&sa);
+  for (i = 2; i <= RDMA_GROUP_MAX; i++)
+    fds[i] = fds[i % 2];
+
+  test_assert("no fds", rdma_tas_group_create(NULL, 2, 2) == NULL);
+  test_assert("no members", rdma_tas_group_create(fds, 0, 1) == NULL);
+  test_assert("too many members",
+      rdma_tas_group_create(fds, RDMA_GROUP_MAX + 1, 1) == NULL);
+  test_assert("quorum 0", rdma_tas_group_create(fds, 2, 0) == NULL);
+  test_assert("quorum above members",
+      rdma_tas_group_create(fds, 2, 3) == NULL);
+
+  /* members must be connections */
+  bad[0] = fds[0];
+  bad[1] = rdma_tas_listen(&sa, 8);
+  test_assert("listener member", bad[1] > 0 &&
+      rdma_tas_group_create(bad, 2, 1) == NULL);
+  bad[1] = 0;
+  test_assert("invalid fd member", rdma_tas_group_create(bad, 2, 1) == NULL);
+
+  /* of one memory region */
+  bad[1] = rdma_tas_connect(&sa, &mr_base, &mr_len);
+  test_assert("private region member", bad[1] > 0 &&
+      rdma_tas_group_create(bad, 2, 1) == NULL);
+
+  /* and of one context */
+  if (pthread_create(&t, NULL, test_connect_thread, &bad[1]) != 0 ||
+      pthread_join(t, NULL) != 0)
+    test_error("connect thread failed");
+  test_assert("other context member", bad[1] > 0 &&
+      fake.conns[fake.num_conns - 1].ctx == 1 &&
+      rdma_tas_group_create(bad, 2, 1) == NULL);
+
+  g = rdma_tas_group_create(fds, RDMA_GROUP_MAX, RDMA_GROUP_MAX);
+  test_assert("create", g != NULL);
+  test_assert("destroy", rdma_tas_group_destroy(g) == 0);
+}
+
+static void test_group_quorum(void *p)
+{
+  struct rdma_tas_group *g;
+  struct rdma_wqe evs[4];
+  int fds[3];
+
+  test_group_init(fds, 3);
+  g = rdma_tas_group_create(fds, 3, 2);
+  test_assert("create", g != NULL);
+
+  /* the quorum completes a write before the last member */
+  test_assert("write", rdma_tas_write_group(g, 4096, 0, 128) == 0);
+  test_assert("all members posted", fake_posted(&fake.conns[0]) == 1 &&
+      fake_posted(&fake.conns[1]) == 1 && fake_posted(&fake.conns[2]) == 1);
+  test_assert("same range", fake_wqe(&fake.conns[2], 0)->len == 4096 &&
+      fake_wqe(&fake.conns[2], 0)->roff == 128);
+  fake_complete(&fake.conns[0], 1, RDMA_SUCCESS);
+  fake_complete(&fake.conns[1], 1, RDMA_OUT_OF_BOUNDS);
+  test_assert("one ack", rdma_tas_group_poll(g, evs, 4) == 0);
+  fake_complete(&fake.conns[2], 1, RDMA_SUCCESS);
+  test_assert("quorum", rdma_tas_group_poll(g, evs, 4) == 1 &&
+      evs[0].id == 0 && evs[0].status == RDMA_SUCCESS);
+
+  /* failures beyond num - quorum fail the write with the first status */
+  test_assert("write 2", rdma_tas_write_group(g, 64, 0, 0) == 1);
+  fake_complete(&fake.conns[1], 1, RDMA_OUT_OF_BOUNDS);
+  test_assert("one failure", rdma_tas_group_poll(g, evs, 4) == 0);
+  fake_complete(&fake.conns[2], 1, RDMA_UNALIGNED);
+  test_assert("quorum missed", rdma_tas_group_poll(g, evs, 4) == 1 &&
+      evs[0].id == 1 && evs[0].status == RDMA_OUT_OF_BOUNDS);
+
+  /* the slot is held until every member completed */
+  test_assert("destroy pending", rdma_tas_group_destroy(g) == -1);
+  fake_complete(&fake.conns[0], 1, RDMA_SUCCESS);
+  test_assert("no more events", rdma_tas_group_poll(g, evs, 4) == 0);
+  test_assert("destroy", rdma_tas_group_destroy(g) == 0);
+}
+
+static void test_group_order(void *p)
+{
+  struct rdma_tas_group *g;
+  struct rdma_wqe evs[4];
+  int fds[2];
+
+  test_group_init(fds, 2);
+  g = rdma_tas_group_create(fds, 2, 1);
+  test_assert("create", g != NULL);
+
+  /* the second write reaches its quorum first */
+  test_assert("write", rdma_tas_write_group(g, 64, 0, 0) == 0 &&
+      rdma_tas_write_group(g, 64, 0, 64) == 1);
+  fake_complete(&fake.conns[0], 1, RDMA_OUT_OF_BOUNDS);
+  fake_complete(&fake.conns[0], 1, RDMA_SUCCESS);
+  test_assert("held behind first", rdma_tas_group_poll(g, evs, 4) == 0);
+
+  /* member completions are consumed by the group */
+  test_assert("member cq consumed", rdma_tas_cq_poll(fds[0], evs, 4) == 0);
+
+  fake_complete(&fake.conns[1], 2, RDMA_SUCCESS);
+  test_assert("posting order", rdma_tas_group_poll(g, evs, 4) == 2 &&
+      evs[0].id == 0 && evs[0].status == RDMA_SUCCESS &&
+      evs[1].id == 1 && evs[1].roff == 64);
+  test_assert("member cq consumed 2", rdma_tas_cq_poll(fds[1], evs, 4) == 0);
+  test_assert("destroy", rdma_tas_group_destroy(g) == 0);
+}
+
+/* Connected queue pair reporting to send_cq and recv_cq, the verbs layer
+ * initializes the library itself */
+static struct rdma_cm_id *test_verbs_qp(struct ibv_cq *send_cq,
+    struct ibv_cq *recv_cq)
+{
+  struct ibv_qp_init_attr attr;
+  struct rdma_cm_id *id;
+
+  if (rdma_create_id(NULL, &id, NULL, RDMA_PS_TCP) != 0)
+    test_error("rdma_create_id failed");
+  test_addr(&id->route.addr.dst_sin);
+
+  memset(&attr, 0, sizeof(attr));
+  attr.send_cq = send_cq;
+  attr.recv_cq = recv_cq;
+  attr.qp_type = IBV_QPT_RC;
+  if (rdma_create_qp(id, NULL, &attr) != 0 || rdma_connect(id, NULL) != 0)
+    test_error("connecting the queue pair failed");
+  return id;
+}
+
+static int test_verbs_write(struct rdma_cm_id *id, uint64_t wr_id,
+    int flags)
+{
+  struct ibv_send_wr wr, *bad;
+  struct ibv_sge sge;
+
+  sge.addr = (uintptr_t) id->mr->addr;
+  sge.length = 64;
+  sge.lkey = 0;
+  memset(&wr, 0, sizeof(wr));
+  wr.wr_id = wr_id;
+  wr.opcode = IBV_WR_RDMA_WRITE;
+  wr.sg_list = &sge;
+  wr.num_sge = 1;
+  wr.send_flags = flags;
+  return ibv_post_send(id->qp, &wr, &bad);
+}
+
+struct test_destroy_cq {
+  struct ibv_cq *cq;
+  int ret;
+};
+
+static void *test_destroy_cq_thread(void *p)
+{
+  struct test_destroy_cq *d = p;
+
+  d->ret = ibv_destroy_cq(d->cq);
+  return NULL;
+}
+
+static void test_verbs_route(void *p)
+{
+  struct ibv_recv_wr rwr, *rbad;
+  struct ibv_sge sge;
+  struct ibv_wc wc[8];
+  struct ibv_cq *cq1, *cq2;
+  struct rdma_cm_id *id1, *id2;
+  struct fake_conn *f1, *f2;
+  struct test_destroy_cq d;
+  pthread_t t;
+  int n;
+
+  fake_init();
+  cq1 = ibv_create_cq(NULL, 1, NULL, NULL, 0);
+  cq2 = ibv_create_cq(NULL, 1, NULL, NULL, 0);
+  test_assert("create cq", cq1 != NULL && cq2 != NULL);
+  id1 = test_verbs_qp(cq1, cq1);
+  id2 = test_verbs_qp(cq2, cq2);
+  f1 = &fake.conns[0];
+  f2 = &fake.conns[1];
+
+  /* unsignaled operations only report failures */
+  test_assert("post qp1", test_verbs_write(id1, 1, IBV_SEND_SIGNALED) == 0 &&
+      test_verbs_write(id1, 2, 0) == 0 && test_verbs_write(id1, 3, 0) == 0);
+  test_assert("post qp2", test_verbs_write(id2, 4, IBV_SEND_SIGNALED) == 0);
+  fake_complete(f2, 1, RDMA_SUCCESS);
+  fake_complete(f1, 2, RDMA_SUCCESS);
+  fake_complete(f1, 1, RDMA_OUT_OF_BOUNDS);
+
+  /* polling one cq sorts the completions of the other */
+  n = ibv_poll_cq(cq2, 8, wc);
+  test_assert("poll cq2", n == 1 && wc[0].wr_id == 4 &&
+      wc[0].status == IBV_WC_SUCCESS && wc[0].opcode == IBV_WC_RDMA_WRITE &&
+      wc[0].qp_num == id2->qp->qp_num);
+  n = ibv_poll_cq(cq1, 8, wc);
+  test_assert("poll cq1", n == 2 && wc[0].wr_id == 1 &&
+      wc[0].status == IBV_WC_SUCCESS && wc[0].qp_num == id1->qp->qp_num);
+  test_assert("unsignaled failure", wc[1].wr_id == 3 &&
+      wc[1].status == IBV_WC_REM_ACCESS_ERR &&
+      wc[1].vendor_err == RDMA_OUT_OF_BOUNDS);
+  test_assert("cq1 empty", ibv_poll_cq(cq1, 8, wc) == 0);
+
+  /* receive buffer filled by a write with immediate */
+  sge.addr = (uintptr_t) id1->mr->addr;
+  sge.length = 64;
+  memset(&rwr, 0, sizeof(rwr));
+  rwr.wr_id = 5;
+  rwr.sg_list = &sge;
+  rwr.num_sge = 1;
+  test_assert("post recv", ibv_post_recv(id1->qp, &rwr, &rbad) == 0);
+  f1->imm = 0x12345678;
+  f1->has_imm = 1;
+  fake_poll();
+  n = ibv_poll_cq(cq1, 8, wc);
+  test_assert("recv imm", n == 1 && wc[0].wr_id == 5 &&
+      wc[0].opcode == IBV_WC_RECV_RDMA_WITH_IMM &&
+      (wc[0].wc_flags & IBV_WC_WITH_IMM) != 0 &&
+      wc[0].imm_data == htonl(0x12345678));
+
+  /* receive buffers must end in the memory region */
+  sge.addr = (uintptr_t) id1->mr->addr + id1->mr->length - 32;
+  test_assert("recv out of bounds", ibv_post_recv(id1->qp, &rwr, &rbad) ==
+      EINVAL && rbad == &rwr);
+  sge.addr = (uintptr_t) id1->mr->addr + id1->mr->length - 64;
+  test_assert("recv at the end", ibv_post_recv(id1->qp, &rwr, &rbad) == 0);
+
+  /* queue pairs hold their cqs, on any thread */
+  test_assert("destroy busy", ibv_destroy_cq(cq1) == EBUSY);
+  d.cq = cq2;
+  if (pthread_create(&t, NULL, test_destroy_cq_thread, &d) != 0 ||
+      pthread_join(t, NULL) != 0)
+    test_error("destroy thread failed");
+  test_assert("destroy busy on other thread", d.ret == EBUSY);
+  rdma_destroy_qp(id2);
+  test_assert("destroy", ibv_destroy_cq(cq2) == 0);
+}
+
+static void test_verbs_cq_grow(void *p)
+{
+  struct ibv_wc wc[128];
+  struct ibv_cq *cq, *other;
+  struct rdma_cm_id *id;
+  uint64_t wr_id = 0;
+  int i, j, n;
+
+  fake_init();
+  cq = ibv_create_cq(NULL, 1, NULL, NULL, 0);
+  other = ibv_create_cq(NULL, 1, NULL, NULL, 0);
+  test_assert("create cq", cq != NULL && other != NULL && cq->cqe == 64);
+  id = test_verbs_qp(cq, cq);
+
+  /* completions are sorted into cq while polling other */
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 32; j++)
+      if (test_verbs_write(id, wr_id++, IBV_SEND_SIGNALED) != 0)
+        test_error("ibv_post_send failed");
+    fake_complete(&fake.conns[0], 32, RDMA_SUCCESS);
+    test_assert("poll other", ibv_poll_cq(other, 128, wc) == 0);
+  }
+  test_assert("cq grew", cq->cqe == 128);
+
+  n = ibv_poll_cq(cq, 128, wc);
+  test_assert("poll all", n == 96);
+  for (i = 0; i < n; i++)
+    test_assert("order kept", wc[i].wr_id == (uint64_t) i);
+}
+
+static void test_verbs_chain(void *p)
+{
+  struct ibv_send_wr wr[3], *bad;
+  struct flextcp_pl_atx atx;
+  struct ibv_sge sge;
+  struct ibv_wc wc[4];
+  struct ibv_cq *cq;
+  struct rdma_cm_id *id;
+  struct fake_conn *f;
+  int i, ret;
+
+  fake_init();
+  cq = ibv_create_cq(NULL, 1, NULL, NULL, 0);
+  id = test_verbs_qp(cq, cq);
+  f = &fake.conns[0];
+  fake_poll();
+
+  sge.addr = (uintptr_t) id->mr->addr;
+  sge.length = 64;
+  sge.lkey = 0;
+  memset(wr, 0, sizeof(wr));
+  for (i = 0; i < 3; i++) {
+    wr[i].wr_id = i;
+    wr[i].opcode = IBV_WR_RDMA_WRITE;
+    wr[i].sg_list = &sge;
+    wr[i].num_sge = 1;
+    wr[i].send_flags = IBV_SEND_SIGNALED;
+    wr[i].next = (i < 2 ? &wr[i + 1] : NULL);
+  }
+
+  /* entries before an invalid request stay posted, with one update */
+  wr[1].opcode = (enum ibv_wr_opcode) 99;
+  test_assert("post chain", ibv_post_send(id->qp, wr, &bad) == EINVAL &&
+      bad == &wr[1]);
+  test_assert("first posted", fake_posted(f) == 1);
+  test_assert("one update", harness_atx_pull_rdma(0, 0, f->flow_id,
+        sizeof(struct rdma_wqe), 0) == 0 && harness_atx_pop(0, 0, &atx) != 0);
+  fake_complete(f, 1, RDMA_SUCCESS);
+  test_assert("first completed", ibv_poll_cq(cq, 4, wc) == 1 &&
+      wc[0].wr_id == 0);
+
+  /* fill the update queue, so that notifying the fast path fails */
+  wr[1].opcode = IBV_WR_RDMA_WRITE;
+  wr[0].next = NULL;
+  while ((ret = ibv_post_send(id->qp, wr, &bad)) == 0) {
+    fake_complete(f, 1, RDMA_SUCCESS);
+    if (ibv_poll_cq(cq, 4, wc) != 1)
+      test_error("ibv_poll_cq failed");
+  }
+  test_assert("bump fails", ret == ENOMEM && bad == wr);
+  test_assert("chain rolled back", ibv_post_send(id->qp, &wr[1], &bad) ==
+      ENOMEM && bad == &wr[1] && fake_posted(f) == 0);
+
+  /* the same entries are used once the fast path caught up */
+  fake_poll();
+  test_assert("post after drain", ibv_post_send(id->qp, &wr[1], &bad) == 0 &&
+      fake_posted(f) == 2);
+  fake_complete(f, 2, RDMA_SUCCESS);
+  test_assert("completed after drain", ibv_poll_cq(cq, 4, wc) == 2 &&
+      wc[0].wr_id == 1 && wc[1].wr_id == 2);
+}
+
+static void test_thread_fini(void *p)
+{
+  struct sockaddr_in sa;
+  void *mr_base;
+  uint64_t mr_len;
+  int fd;
+
+  test_init();
+  test_addr(&sa);
+  fd = rdma_tas_connect(&sa, &mr_base, &mr_len);
+  test_assert("connect", fd > 0);
+
+  /* open connections hold the context */
+  test_assert("fini busy", rdma_tas_thread_fini() == -1);
+  test_assert("close", rdma_tas_close(fd) == 0);
+  test_assert("fini", rdma_tas_thread_fini() == 0);
+  test_assert("fini twice", rdma_tas_thread_fini() == 0);
+
+  /* the next request creates a new context */
+  fd = rdma_tas_connect(&sa, &mr_base, &mr_len);
+  test_assert("connect on new context", fd > 0 && fake.conns[1].ctx == 1);
+}
+
+static void *test_exit_thread(void *p)
+{
+  *(int *) p = rdma_tas_ctrl_fd();
+  return NULL;
+}
+
+static void test_thread_exit(void *p)
+{
+  pthread_t t;
+  int epfd = -1;
+
+  test_init();
+  if (pthread_create(&t, NULL, test_exit_thread, &epfd) != 0 ||
+      pthread_join(t, NULL) != 0)
+    test_error("thread failed");
+
+  /* the context of the thread was released when it exited */
+  test_assert("context created", epfd >= 0);
+  test_assert("context released", fcntl(epfd, F_GETFD) == -1);
+}
+
+static void test_burst(void *p)
+{
+  struct flextcp_pl_atx atx;
+  struct sockaddr_in sa;
+  struct rdma_wqe ops[32], *evs;
+  struct fake_conn *f;
+  void *mr_base;
+  uint64_t mr_len;
+  int fd, i, n;
+
+  test_init();
+  test_addr(&sa);
+  fd = rdma_tas_connect(&sa, &mr_base, &mr_len);
+  test_assert("connect", fd > 0);
+  f = &fake.conns[0];
+  fake_poll();
+
+  memset(ops, 0, sizeof(ops));
+  for (i = 0; i < 32; i++) {
+    ops[i].type = RDMA_OP_WRITE;
+    ops[i].len = 64;
+    ops[i].loff = 64 * i;
+    ops[i].roff = 64 * i;
+  }
+
+  /* posting stops at the first invalid entry, one update for the rest */
+  ops[4].type = RDMA_OP_FETCH_ADD;
+  n = rdma_tas_post_burst(fd, ops, 8);
+  test_assert("burst", n == 4);
+  test_assert("doorbell", fake_db(f)->wq_head == 4 * sizeof(struct rdma_wqe));
+  test_assert("one update", harness_atx_pull_rdma(0, 0, f->flow_id,
+        4 * sizeof(struct rdma_wqe), 0) == 0 &&
+      harness_atx_pop(0, 0, &atx) != 0);
+  test_assert("atomic rejected", rdma_tas_post_burst(fd, &ops[4], 1) == 0 &&
+      fake_posted(f) == 4 && harness_atx_pop(0, 0, &atx) != 0);
+  for (i = 0; i < 4; i++)
+    test_assert("entry", fake_wqe(f, i * sizeof(struct rdma_wqe))->loff ==
+        ops[i].loff);
+
+  /* completions are read in place */
+  fake_complete(f, 4, RDMA_SUCCESS);
+  n = rdma_tas_cq_peek(fd, &evs);
+  test_assert("peek", n == 4 && evs[0].id == 0 &&
+      evs[3].id == 3 * sizeof(struct rdma_wqe));
+  test_assert("advance", rdma_tas_cq_advance(fd, 2) == 0);
+  n = rdma_tas_cq_peek(fd, &evs);
+  test_assert("peek after advance", n == 2 &&
+      evs[0].id == 2 * sizeof(struct rdma_wqe));
+  test_assert("advance too far", rdma_tas_cq_advance(fd, 3) == -1);
+  test_assert("advance rest", rdma_tas_cq_advance(fd, 2) == 0);
+  test_assert("peek empty", rdma_tas_cq_peek(fd, &evs) == 0);
+
+  /* only entries up to the end of the queue are contiguous */
+  ops[4].type = RDMA_OP_WRITE;
+  n = rdma_tas_post_burst(fd, ops, 30);
+  test_assert("burst wrapping", n == 30);
+  fake_complete(f, 30, RDMA_SUCCESS);
+  n = rdma_tas_cq_peek(fd, &evs);
+  test_assert("peek to the end", n == 28 &&
+      evs[0].id == 4 * sizeof(struct rdma_wqe));
+  test_assert("advance to the end", rdma_tas_cq_advance(fd, 28) == 0);
+  n = rdma_tas_cq_peek(fd, &evs);
+  test_assert("peek wrapped", n == 2 && evs[0].id == 0);
+}
+
+/* Listener with accepts posted ahead of time, reporting on ch */
+static struct rdma_cm_id *test_cm_listen(struct rdma_event_channel *ch)
+{
+  struct rdma_cm_id *listen;
+
+  if (rdma_create_id(ch, &listen, NULL, RDMA_PS_TCP) != 0)
+    test_error("rdma_create_id failed");
+  test_addr(&listen->route.addr.src_sin);
+  if (rdma_listen(listen, 8) != 0)
+    test_error("rdma_listen failed");
+  return listen;
+}
+
+static struct rdma_cm_event *test_cm_event(struct rdma_event_channel *ch,
+    enum rdma_cm_event_type type)
+{
+  struct rdma_cm_event *ev;
+
+  if (rdma_get_cm_event(ch, &ev) != 0)
+    test_error("rdma_get_cm_event failed");
+  test_assert("event type", ev->event == type && ev->status == 0);
+  return ev;
+}
+
+static void test_cm_channel(void *p)
+{
+  struct rdma_event_channel *ch;
+  struct rdma_cm_id *listen, *req, *id;
+  struct rdma_cm_event *ev;
+
+  fake_init();
+  ch = rdma_create_event_channel();
+  test_assert("create channel", ch != NULL);
+  listen = test_cm_listen(ch);
+  test_assert("accepts posted", fake.num_accepts == 16);
+
+  /* a connecting peer is reported on a new id, the accept posted again */
+  fake_connect_in(2000, 0, 0);
+  ev = test_cm_event(ch, RDMA_CM_EVENT_CONNECT_REQUEST);
+  req = ev->id;
+  test_assert("request listener", ev->listen_id == listen);
+  rdma_ack_cm_event(ev);
+  test_assert("request fd", req->send_cq_channel->fd > 0 &&
+      req->mr->length == FAKE_MR_LEN);
+  test_assert("accept posted again", fake.num_accepts == 16);
+
+  test_assert("accept", rdma_accept(req, NULL) == 0);
+  ev = test_cm_event(ch, RDMA_CM_EVENT_ESTABLISHED);
+  test_assert("accepted id", ev->id == req);
+  rdma_ack_cm_event(ev);
+
+  /* connects complete asynchronously */
+  test_assert("create id", rdma_create_id(ch, &id, NULL, RDMA_PS_TCP) == 0);
+  test_addr(&id->route.addr.dst_sin);
+  test_assert("connect", rdma_connect(id, NULL) == 0);
+  ev = test_cm_event(ch, RDMA_CM_EVENT_ESTABLISHED);
+  test_assert("connected id", ev->id == id);
+  rdma_ack_cm_event(ev);
+  test_assert("connect fd", id->send_cq_channel->fd > 0 &&
+      id->send_cq_channel->fd != req->send_cq_channel->fd &&
+      id->mr->length == FAKE_MR_LEN);
+}
+
+static void test_cm_no_fds(void *p)
+{
+  struct rdma_event_channel *ch;
+  struct rdma_cm_id *listen, *req, *id = NULL;
+  struct rdma_cm_event *ev;
+  struct sockaddr_in sa;
+
+  fake_init();
+  ch = rdma_create_event_channel();
+  listen = test_cm_listen(ch);
+
+  /* use up all fds */
+  test_addr(&sa);
+  sa.sin_port = htons(TEST_PORT + 1);
+  while (rdma_tas_listen(&sa, 8) > 0);
+
+  /* requests are still reported, with one accept less */
+  fake_connect_in(2000, 0, 0);
+  ev = test_cm_event(ch, RDMA_CM_EVENT_CONNECT_REQUEST);
+  req = ev->id;
+  rdma_ack_cm_event(ev);
+  test_assert("accept missing", fake.num_accepts == 15);
+
+  /* the accept is posted again once an fd is free */
+  fake_connect_in(2001, 0, 0);
+  test_assert("accept used", fake.num_accepts == 14);
+  test_assert("close", rdma_tas_close(req->send_cq_channel->fd) == 0);
+  test_assert("get request", rdma_get_request(listen, &id) == 0 &&
+      id != NULL && id->send_cq_channel->fd > 0);
+  test_assert("accept posted again", fake.num_accepts == 15);
+}
+
+int main(int argc, char *argv[])
+{
+  int ret = 0;
+
+  struct harness_params params;
+  params.num_ctxs = TEST_CTXS;
+  params.fp_cores = TEST_FP_CORES;
+  params.arx_len = 1024;
+  params.atx_len = 1024;
+  params.ain_len = 1024;
+  params.aout_len = 1024;
+
+  harness_prepare(&params);
+
+  if (test_subcase("stripe completion order", test_stripe_order, NULL))
+    ret = 1;
+
+  if (test_subcase("stripe accept grouping", test_stripe_accept, NULL))
+    ret = 1;
+
+  if (test_subcase("stripe close", test_stripe_close, NULL))
+    ret = 1;
+
+  if (test_subcase("shared cq", test_scq, NULL))
+    ret = 1;
+
+  if (test_subcase("group create", test_group_create, NULL))
+    ret = 1;
+
+  if (test_subcase("group quorum", test_group_quorum, NULL))
+    ret = 1;
+
+  if (test_subcase("group order", test_group_order, NULL))
+    ret = 1;
+
+  if (test_subcase("post burst", test_burst, NULL))
+    ret = 1;
+
+  if (test_subcase("thread context release", test_thread_fini, NULL))
+    ret = 1;
+
+  if (test_subcase("thread exit", test_thread_exit, NULL))
+    ret = 1;
+
+  if (test_subcase("event channel", test_cm_channel, NULL))
+    ret = 1;
+
+  if (test_subcase("event channel without fds", test_cm_no_fds, NULL))
+    ret = 1;
+
+  if (test_subcase("verbs completion routing", test_verbs_route, NULL))
+    ret = 1;
+
+  if (test_subcase("verbs cq growth", test_verbs_cq_grow, NULL))
+    ret = 1;
+
+  if (test_subcase("verbs post chain", test_verbs_chain, NULL))
+    ret = 1;
+
+  return ret;
+}
@@ -16,7 +16,7 @@ int main()
   remoteaddr.sin_port = htons(5005);
 
   void *mr_base;
-  uint32_t mr_len;
+  uint64_t mr_len;
 
   int fd = rdma_tas_connect(&remoteaddr, &mr_base, &mr_len);
 
@@ -57,9 +57,9 @@ int main(int argc, char* argv[])
     remoteaddr.sin_port = htons(rport);
     
     id = calloc(NUM_CONNECTIONS, sizeof(struct rdma_cm_id*));
+    struct rdma_event_channel *ec = rdma_create_event_channel();
     for (int i = 0; i < num_conns; i++)
     {
-        struct rdma_event_channel *ec = rdma_create_event_channel();
         int ret = rdma_create_id(ec, &id[i], NULL, RDMA_PS_TCP);
         if (ret < 0)
         {
@@ -79,6 +79,19 @@ int main(int argc, char* argv[])
         }
     }
 
+    // Connects proceed in parallel, wait until all are established
+    for (int i = 0; i < num_conns; i++)
+    {
+        struct rdma_cm_event *cm_ev;
+        if (rdma_get_cm_event(ec, &cm_ev) < 0 ||
+                cm_ev->event != RDMA_CM_EVENT_ESTABLISHED)
+        {
+            fprintf(stderr, "Connection failed\n");
+            return -1;
+        }
+        rdma_ack_cm_event(cm_ev);
+    }
+
     fprintf(stderr, "Connections established: %d\n", num_conns);
     fprintf(stderr, "Type Enter to start PingPong.\n");
     getchar();
@@ -168,7 +181,8 @@ int main(int argc, char* argv[])
                     rdma_reg_write();
                 */
                 uint32_t loff =  msg_len*j;
-                int ret = rdma_post_write(id[i], NULL, &loff, msg_len, NULL, 0, msg_len*j, 0);
+                int ret = rdma_post_write(id[i], NULL, (char*)id[i]->mr->addr + loff,
+                                        msg_len, NULL, 0, msg_len*j, 0);
                 if (ret < 0)
                 {
                     fprintf(stderr, "%s():%d\n", __func__, __LINE__);
@@ -195,7 +209,7 @@ int main(int argc, char* argv[])
                     rdma_reg_read();
                 */
                 uint32_t loff = read_base+msg_len*k;
-                int ret = rdma_post_read(id[i], NULL, &loff, 
+                int ret = rdma_post_read(id[i], NULL, (char*)id[i]->mr->addr + loff,
                                         msg_len, NULL, 0, msg_len *k, 0);
                 if (ret < 0)
                 {
@@ -16,7 +16,7 @@
 
 int fd[NUM_CONNECTIONS];
 void* mr_base[NUM_CONNECTIONS];
-uint32_t mr_len[NUM_CONNECTIONS];
+uint64_t mr_len[NUM_CONNECTIONS];
 int count[NUM_CONNECTIONS];
 struct rdma_wqe ev[WQSIZE];
 uint64_t latency[8 * WQSIZE * 30];
@@ -13,7 +13,7 @@
 
 int fd[NUM_CONNECTIONS];
 void* mr_base[NUM_CONNECTIONS];
-uint32_t mr_len[NUM_CONNECTIONS];
+uint64_t mr_len[NUM_CONNECTIONS];
 
 int main(int argc, char* argv[])
 {
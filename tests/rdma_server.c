@@ -16,7 +16,7 @@ int main()
     localaddr.sin_port = htons(5005);
 
     void *mr_base;
-    uint32_t mr_len;
+    uint64_t mr_len;
 
     int lfd = rdma_tas_listen(&localaddr, 8);
     int fd = rdma_tas_accept(lfd, &remoteaddr, &mr_base, &mr_len);
@@ -11,6 +11,7 @@
 
 #include <tas.h>
 #include <tas_memif.h>
+#include <tas_rdma.h>
 #include "../../tas/include/config.h"
 #include "../../tas/fast/internal.h"
 #include "../../tas/fast/fastemu.h"
@@ -64,6 +65,22 @@ void util_flexnic_kick(struct flextcp_pl_appctx *ctx, uint32_t ts_us)
   printf("util_flexnic_kick\n");
 }
 
+struct fast_copy_req copy_req;
+int copy_submitted = 0;
+
+int fast_copy_submit(struct dataplane_context *ctx, void *dst,
+    const void *src, uint32_t len, uint32_t flow_id, uint32_t id)
+{
+  copy_submitted++;
+  copy_req.dst = dst;
+  copy_req.src = src;
+  copy_req.len = len;
+  copy_req.flow_id = flow_id;
+  copy_req.id = id;
+
+  return 0;
+}
+
 /* initialize basic flow state */
 static void flow_init(uint32_t fid, uint32_t rxlen, uint32_t txlen, uint64_t opaque)
 {
@@ -287,6 +304,1015 @@ void test_retransmit(void *arg)
       (QMAN_SET_RATE | QMAN_SET_MAXCHUNK | QMAN_ADD_AVAIL));
 }
 
+/* Test that rdma write payload is taken from the memory region when the
+ * segment is built, and that only the rdma header goes to the tx buffer.
+ */
+void test_rdma_tx_zerocopy(void *arg)
+{
+  int ret, i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *wq = (struct rdma_wqe *) (shm + 2048);
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      8 * sizeof(struct rdma_wqe));
+  uint8_t *mr = shm + 3072;
+  struct rdma_hdr hdr;
+  uint8_t *payload;
+  memset(&ctx, 0, sizeof(ctx));
+
+  /* buffers are addressed as offsets into the shared memory region */
+  tas_shm = shm;
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 512;
+  fs->wq_len = 8 * sizeof(struct rdma_wqe);
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  memset(shm + 1024, 0xff, 1024);
+  for (i = 0; i < 1024; i++)
+    mr[i] = i;
+
+  wq[0].id = 0;
+  wq[0].type = RDMA_OP_WRITE;
+  wq[0].status = RDMA_PENDING;
+  wq[0].loff = 16;
+  wq[0].roff = 32;
+  wq[0].len = 100;
+
+  config.fp_rdma_db_poll = 1;
+  db->wq_head = sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, sizeof(struct rdma_wqe), 0);
+  test_assert("doorbell polled while tx pending", db->fp_active &&
+      fs->rdma_db_listed && ctx.rdma_db_num == 1 && ctx.rdma_db_flows[0] == 0);
+  test_assert("tx avail covers header and payload",
+      fs->tx_avail == sizeof(struct rdma_hdr) + 100);
+  test_assert("wqe waits for response", wq[0].status == RDMA_RESP_PENDING);
+
+  memcpy(&hdr, shm + 1024, sizeof(hdr));
+  test_assert("header in tx buffer", f_beui32(hdr.length) == 100 &&
+      f_beui32(hdr.loffset) == 16 && f_beui32(hdr.offset) == 32);
+  test_assert("payload not copied to tx buffer",
+      shm[1024 + sizeof(hdr)] == 0xff);
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("segment sent", ret == 0 && ctx.tx_num == 1);
+
+  payload = (uint8_t *) network_buf_buf((struct network_buf_handle *) tmb) +
+      sizeof(struct pkt_tcp) + ((sizeof(struct tcp_timestamp_opt) + 3) & ~3);
+  test_assert("segment header from tx buffer",
+      memcmp(payload, &hdr, sizeof(hdr)) == 0);
+  test_assert("segment payload from memory region",
+      memcmp(payload + sizeof(hdr), mr + 16, 100) == 0);
+
+  /* retransmitted segment has to carry the same bytes */
+  fast_flows_retransmit(&ctx, 0);
+  tmb = mbuf_alloc();
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("segment resent", ret == 0 && ctx.tx_num == 2);
+
+  payload = (uint8_t *) network_buf_buf((struct network_buf_handle *) tmb) +
+      sizeof(struct pkt_tcp) + ((sizeof(struct tcp_timestamp_opt) + 3) & ~3);
+  test_assert("resent header from tx buffer",
+      memcmp(payload, &hdr, sizeof(hdr)) == 0);
+  test_assert("resent payload from memory region",
+      memcmp(payload + sizeof(hdr), mr + 16, 100) == 0);
+
+  /* a post to the active flow is picked up without a bump */
+  wq[1] = wq[0];
+  wq[1].id = sizeof(struct rdma_wqe);
+  wq[1].status = RDMA_PENDING;
+  db->wq_head = 2 * sizeof(struct rdma_wqe);
+  ret = fast_rdma_db_poll_active(&ctx, BATCH_SIZE);
+  test_assert("polled doorbell", ret == 1 && fs->wq_head == db->wq_head &&
+      wq[1].status == RDMA_RESP_PENDING && ctx.rdma_db_num == 1);
+
+  config.fp_rdma_db_poll = 0;
+}
+
+/* Test that in-order rdma payload is placed directly in the memory region
+ * without going through the receive buffer.
+ */
+void test_rdma_rx_placement(void *arg)
+{
+  int i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *rq = (struct rdma_wqe *) (shm + 2048 + 512);
+  uint8_t *mr = shm + 3072;
+  struct tcp_timestamp_opt *opt_ts;
+  struct tcp_opts opts;
+  struct rdma_hdr *hdr;
+  struct pkt_tcp *p;
+  uint8_t *payload;
+  uint16_t optlen = (sizeof(*opt_ts) + 3) & ~3;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 512;
+  fs->wq_len = 8 * sizeof(struct rdma_wqe);
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  memset(shm, 0xff, 1024);
+
+  /* write request with 50 bytes payload */
+  struct rte_mbuf *tmb = mbuf_alloc();
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  memset(p, 0, sizeof(*p) + optlen);
+  IPH_VHL_SET(&p->ip, 4, 5);
+  p->ip.len = t_beui16(sizeof(p->ip) + sizeof(p->tcp) + optlen +
+      sizeof(*hdr) + 50);
+  p->tcp.seqno = t_beui32(fs->rx_next_seq);
+  p->tcp.ackno = t_beui32(fs->tx_next_seq);
+  p->tcp.wnd = t_beui16(1024);
+  TCPH_HDRLEN_FLAGS_SET(&p->tcp, 5 + optlen / 4, TCP_ACK | TCP_PSH);
+  opt_ts = (struct tcp_timestamp_opt *) (p + 1);
+  opt_ts->kind = TCP_OPT_TIMESTAMP;
+  opt_ts->length = sizeof(*opt_ts);
+  opts.ts = opt_ts;
+
+  hdr = (struct rdma_hdr *) ((uint8_t *) (p + 1) + optlen);
+  hdr->type = RDMA_REQUEST | RDMA_WRITE;
+  hdr->id = t_beui32(7);
+  hdr->offset = t_beui32(8);
+  hdr->length = t_beui32(50);
+  payload = (uint8_t *) (hdr + 1);
+  for (i = 0; i < 50; i++)
+    payload[i] = i + 1;
+
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("payload placed in memory region",
+      memcmp(mr + 8, payload, 50) == 0);
+  test_assert("receive buffer untouched", shm[0] == 0xff &&
+      shm[sizeof(*hdr) + 49] == 0xff);
+  test_assert("receive window restored", fs->rx_avail == 1024);
+  test_assert("rx position advanced",
+      fs->rx_next_pos == sizeof(*hdr) + 50);
+  test_assert("request recorded", rq[0].id == 7 &&
+      rq[0].status == RDMA_SUCCESS);
+}
+
+/* Test that flows with version 2 headers carry 64-bit offsets, and that
+ * version 1 flows reject offsets that do not fit the header.
+ */
+void test_rdma_hdr_v2(void *arg)
+{
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *wq = (struct rdma_wqe *) (shm + 2048);
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      8 * sizeof(struct rdma_wqe));
+  struct rdma_hdr_v2 hdr;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 512;
+  fs->wq_len = 8 * sizeof(struct rdma_wqe);
+  fs->wq_head = fs->wq_tail = fs->cq_head = fs->cq_tail = 0;
+  fs->txb_head = 0;
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  fs->rdma_hdr_ver = RDMA_HDR_V2;
+
+  memset(wq, 0, 2 * sizeof(*wq));
+  wq[0].type = RDMA_OP_WRITE;
+  wq[0].status = RDMA_PENDING;
+  wq[0].loff = 16;
+  wq[0].roff = 1ull << 33;
+  wq[0].len = 100;
+
+  db->wq_head = sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, sizeof(struct rdma_wqe), 0);
+  test_assert("tx avail covers v2 header and payload",
+      fs->tx_avail == sizeof(struct rdma_hdr_v2) + 100);
+
+  memcpy(&hdr, shm + 1024, sizeof(hdr));
+  test_assert("v2 header in tx buffer", f_beui32(hdr.length) == 100 &&
+      f_beui64(hdr.loffset) == 16 && f_beui64(hdr.offset) == (1ull << 33));
+
+  /* same operation on a version 1 flow does not fit the header */
+  fs->rdma_hdr_ver = RDMA_HDR_V1;
+  wq[1] = wq[0];
+  wq[1].id = sizeof(struct rdma_wqe);
+  db->wq_head = 2 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, 2 * sizeof(struct rdma_wqe), 0);
+  test_assert("v1 rejects 64-bit offset",
+      wq[1].status == RDMA_OUT_OF_BOUNDS &&
+      fs->tx_avail == sizeof(struct rdma_hdr_v2) + 100);
+
+  fs->rdma_hdr_ver = 0;
+}
+
+/* Test that an atomic request is executed on the memory region on receive
+ * and that the response returns the old value.
+ */
+void test_rdma_atomic(void *arg)
+{
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *rq = (struct rdma_wqe *) (shm + 2048 + 512);
+  uint64_t *word = (uint64_t *) (shm + 3072 + 16);
+  struct tcp_timestamp_opt *opt_ts;
+  struct tcp_opts opts;
+  struct rdma_hdr *hdr;
+  struct rdma_atomic_req *req;
+  struct rdma_atomic_resp resp;
+  struct pkt_tcp *p;
+  uint16_t optlen = (sizeof(*opt_ts) + 3) & ~3;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 512;
+  fs->wq_len = 8 * sizeof(struct rdma_wqe);
+  fs->wq_head = fs->wq_tail = fs->cq_head = fs->cq_tail = 0;
+  fs->rq_head = fs->rq_tail = 0;
+  fs->txb_head = 0;
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  *word = 100;
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  memset(p, 0, sizeof(*p) + optlen);
+  IPH_VHL_SET(&p->ip, 4, 5);
+  p->ip.len = t_beui16(sizeof(p->ip) + sizeof(p->tcp) + optlen +
+      sizeof(*hdr) + sizeof(*req));
+  p->tcp.seqno = t_beui32(fs->rx_next_seq);
+  p->tcp.ackno = t_beui32(fs->tx_next_seq);
+  p->tcp.wnd = t_beui16(1024);
+  TCPH_HDRLEN_FLAGS_SET(&p->tcp, 5 + optlen / 4, TCP_ACK | TCP_PSH);
+  opt_ts = (struct tcp_timestamp_opt *) (p + 1);
+  opt_ts->kind = TCP_OPT_TIMESTAMP;
+  opt_ts->length = sizeof(*opt_ts);
+  opts.ts = opt_ts;
+
+  hdr = (struct rdma_hdr *) ((uint8_t *) (p + 1) + optlen);
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->type = RDMA_REQUEST | RDMA_FETCH_ADD;
+  hdr->id = t_beui32(9);
+  hdr->offset = t_beui32(16);
+  hdr->length = t_beui32(sizeof(*req));
+  hdr->loffset = t_beui32(40);
+  req = (struct rdma_atomic_req *) (hdr + 1);
+  req->compare_add = t_beui64(5);
+  req->swap = t_beui64(0);
+
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("word updated", *word == 105);
+  test_assert("old value recorded", rq[0].status == RDMA_SUCCESS &&
+      rq[0].type == RDMA_OP_FETCH_ADD && rq[0].loff == 100);
+  test_assert("response queued", fs->rq_head == sizeof(struct rdma_wqe));
+
+  fast_rdmawq_bump(&ctx, 0, 0, 0);
+  test_assert("response in tx buffer",
+      fs->tx_avail == sizeof(*hdr) + sizeof(resp));
+  hdr = (struct rdma_hdr *) (shm + 1024);
+  memcpy(&resp, hdr + 1, sizeof(resp));
+  test_assert("response header", hdr->type == (RDMA_RESPONSE | RDMA_FETCH_ADD)
+      && f_beui32(hdr->id) == 9 && f_beui32(hdr->offset) == 40 &&
+      f_beui32(hdr->length) == sizeof(resp));
+  test_assert("response carries old value", f_beui64(resp.old) == 100);
+}
+
+/* build a packet with an rdma frame carrying len bytes of payload, with the
+ * header version of the flow */
+static struct rte_mbuf *rdma_pkt(struct flextcp_pl_flowst *fs,
+    struct tcp_opts *opts, uint8_t type, uint32_t id, uint32_t len,
+    uint32_t offset, uint32_t imm)
+{
+  uint32_t i, hdr_len;
+  struct tcp_timestamp_opt *opt_ts;
+  struct rdma_hdr *hdr;
+  struct rdma_hdr_v2 *hdr_v2;
+  struct pkt_tcp *p;
+  uint8_t *payload;
+  uint16_t optlen = (sizeof(*opt_ts) + 3) & ~3;
+
+  hdr_len = (fs->rdma_hdr_ver == RDMA_HDR_V2 ? sizeof(*hdr_v2) : sizeof(*hdr));
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+  p = network_buf_bufoff((struct network_buf_handle *) tmb);
+  memset(p, 0, sizeof(*p) + optlen);
+  IPH_VHL_SET(&p->ip, 4, 5);
+  p->ip.len = t_beui16(sizeof(p->ip) + sizeof(p->tcp) + optlen +
+      hdr_len + len);
+  p->tcp.seqno = t_beui32(fs->rx_next_seq);
+  p->tcp.ackno = t_beui32(fs->tx_next_seq);
+  p->tcp.wnd = t_beui16(1024);
+  TCPH_HDRLEN_FLAGS_SET(&p->tcp, 5 + optlen / 4, TCP_ACK | TCP_PSH);
+  opt_ts = (struct tcp_timestamp_opt *) (p + 1);
+  opt_ts->kind = TCP_OPT_TIMESTAMP;
+  opt_ts->length = sizeof(*opt_ts);
+  opts->ts = opt_ts;
+
+  hdr = (struct rdma_hdr *) ((uint8_t *) (p + 1) + optlen);
+  hdr_v2 = (struct rdma_hdr_v2 *) hdr;
+  memset(hdr, 0, hdr_len);
+  if (fs->rdma_hdr_ver == RDMA_HDR_V2) {
+    hdr_v2->type = type;
+    hdr_v2->id = t_beui32(id);
+    hdr_v2->length = t_beui32(len);
+    hdr_v2->offset = t_beui64(offset);
+    hdr_v2->imm = t_beui32(imm);
+  } else {
+    hdr->type = type;
+    hdr->id = t_beui32(id);
+    hdr->length = t_beui32(len);
+    hdr->offset = t_beui32(offset);
+  }
+  payload = (uint8_t *) hdr + hdr_len;
+  for (i = 0; i < len; i++)
+    payload[i] = i + 1;
+
+  return tmb;
+}
+
+/* Test that a SEND is placed in the next posted receive buffer and that a
+ * receive completion is reported to the application.
+ */
+void test_rdma_send_recv(void *arg)
+{
+  int i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      8 * sizeof(struct rdma_wqe));
+  struct rdma_wqe *rcv = (struct rdma_wqe *) (db + 1);
+  struct rdma_wqe *rq = (struct rdma_wqe *) (shm + 2048 + 768);
+  uint8_t *mr = shm + 3072;
+  struct tcp_opts opts;
+  struct rdma_hdr *hdr;
+  struct rte_mbuf *tmb;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 768;
+  fs->wq_len = 8 * sizeof(struct rdma_wqe);
+  fs->wq_head = fs->wq_tail = fs->cq_head = fs->cq_tail = 0;
+  fs->rq_head = fs->rq_tail = 0;
+  fs->rcv_tail = 0;
+  fs->txb_head = 0;
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+
+  /* one receive buffer posted */
+  memset(db, 0, sizeof(*db));
+  memset(rcv, 0, sizeof(*rcv));
+  rcv[0].type = RDMA_OP_RECV;
+  rcv[0].status = RDMA_PENDING;
+  rcv[0].loff = 64;
+  rcv[0].len = 100;
+  db->rcv_head = sizeof(struct rdma_wqe);
+
+  tmb = rdma_pkt(fs, &opts, RDMA_REQUEST | RDMA_SEND, 11, 50, 0, 0);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  for (i = 0; i < 50 && mr[64 + i] == i + 1; i++);
+  test_assert("payload placed in receive buffer", i == 50);
+  test_assert("receive completed", rcv[0].status == RDMA_SUCCESS &&
+      rcv[0].len == 50 && fs->rcv_tail == sizeof(struct rdma_wqe));
+  test_assert("receive completion reported", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].msg.rdmaupdate.rcv_tail == sizeof(struct rdma_wqe));
+  test_assert("response queued", rq[0].type == RDMA_OP_SEND &&
+      fs->rq_head == sizeof(struct rdma_wqe));
+
+  /* no buffer left, the next SEND fails */
+  tmb = rdma_pkt(fs, &opts, RDMA_REQUEST | RDMA_SEND, 12, 50, 0, 0);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("no receive buffer", rq[1].status == RDMA_NO_RECV &&
+      fs->rcv_tail == sizeof(struct rdma_wqe) && ctx.arx_num == 1);
+
+  fast_rdmawq_bump(&ctx, 0, 0, 0);
+  hdr = (struct rdma_hdr *) (shm + 1024);
+  test_assert("response header", hdr->type == (RDMA_RESPONSE | RDMA_SEND)
+      && f_beui32(hdr->id) == 11 && hdr->status == RDMA_SUCCESS);
+}
+
+/* Test that a write with immediate places its payload at the given offset
+ * and completes a posted receive buffer with the immediate value, also
+ * without payload.
+ */
+void test_rdma_write_imm(void *arg)
+{
+  int i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      8 * sizeof(struct rdma_wqe));
+  struct rdma_wqe *rcv = (struct rdma_wqe *) (db + 1);
+  uint8_t *mr = shm + 3072;
+  struct tcp_opts opts;
+  struct rte_mbuf *tmb;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 768;
+  fs->wq_len = 8 * sizeof(struct rdma_wqe);
+  fs->wq_head = fs->wq_tail = fs->cq_head = fs->cq_tail = 0;
+  fs->rq_head = fs->rq_tail = 0;
+  fs->rcv_tail = 0;
+  fs->txb_head = 0;
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  fs->rdma_hdr_ver = RDMA_HDR_V2;
+
+  /* two receive buffers posted, their memory is not used */
+  memset(db, 0, sizeof(*db));
+  memset(rcv, 0, 2 * sizeof(*rcv));
+  rcv[0].type = rcv[1].type = RDMA_OP_RECV;
+  rcv[0].status = rcv[1].status = RDMA_PENDING;
+  db->rcv_head = 2 * sizeof(struct rdma_wqe);
+
+  tmb = rdma_pkt(fs, &opts, RDMA_REQUEST | RDMA_WRITE | RDMA_IMM, 13, 50,
+      128, 0xabcd);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  for (i = 0; i < 50 && mr[128 + i] == i + 1; i++);
+  test_assert("payload placed at offset", i == 50);
+  test_assert("write completion", rcv[0].status == RDMA_SUCCESS &&
+      rcv[0].type == RDMA_OP_WRITE_IMM && rcv[0].imm == 0xabcd &&
+      rcv[0].len == 50 && ctx.arx_num == 1);
+
+  tmb = rdma_pkt(fs, &opts, RDMA_REQUEST | RDMA_WRITE | RDMA_IMM, 14, 0,
+      0, 7);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("write completion without payload",
+      rcv[1].status == RDMA_SUCCESS && rcv[1].imm == 7 &&
+      fs->rcv_tail == 2 * sizeof(struct rdma_wqe) &&
+      fs->rq_head == 2 * sizeof(struct rdma_wqe));
+
+  fs->rdma_hdr_ver = 0;
+}
+
+/* Test that inline payload is taken from the work queue, not the memory
+ * region, when the segment is built.
+ */
+void test_rdma_inline(void *arg)
+{
+  int ret, i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *wq = (struct rdma_wqe *) (shm + 2048);
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      4 * sizeof(struct rdma_wqe));
+  uint8_t *inl = shm + 2048 + 8 * sizeof(struct rdma_wqe) + sizeof(*db);
+  struct rdma_hdr hdr;
+  uint8_t *payload;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  memset(fs, 0, sizeof(*fs));
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 768;
+  fs->wq_len = 4 * sizeof(struct rdma_wqe);
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  memset(shm + 3072, 0xff, 1024);
+
+  /* second entry, payload in its inline slot */
+  memset(db, 0, sizeof(*db));
+  wq[1].id = sizeof(struct rdma_wqe);
+  wq[1].type = RDMA_OP_WRITE;
+  wq[1].status = RDMA_PENDING;
+  wq[1].flags = RDMA_WQE_INLINE;
+  wq[1].loff = 0;
+  wq[1].roff = 8;
+  wq[1].len = 20;
+  for (i = 0; i < 20; i++)
+    inl[RDMA_INLINE_MAX + i] = i;
+  fs->wq_head = fs->wq_tail = fs->cq_head = fs->cq_tail =
+      sizeof(struct rdma_wqe);
+
+  db->wq_head = db->cq_tail = fs->wq_head;
+  db->wq_head += sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("tx avail covers header and payload",
+      fs->tx_avail == sizeof(struct rdma_hdr) + 20);
+  test_assert("wqe waits for response", wq[1].status == RDMA_RESP_PENDING);
+
+  memcpy(&hdr, shm + 1024, sizeof(hdr));
+  test_assert("header marks inline payload",
+      f_beui16(hdr.flags) == RDMA_FLAG_INLINE && f_beui32(hdr.length) == 20);
+
+  struct rte_mbuf *tmb = mbuf_alloc();
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("segment sent", ret == 0 && ctx.tx_num == 1);
+
+  payload = (uint8_t *) network_buf_buf((struct network_buf_handle *) tmb) +
+      sizeof(struct pkt_tcp) + ((sizeof(struct tcp_timestamp_opt) + 3) & ~3);
+  test_assert("segment payload from inline slot",
+      memcmp(payload + sizeof(hdr), inl + RDMA_INLINE_MAX, 20) == 0);
+}
+
+/* Test that responses complete their WQE by id in any order, and that an
+ * unexpected response fails the outstanding WQEs of the flow.
+ */
+void test_rdma_cq_match(void *arg)
+{
+  int i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *wq = (struct rdma_wqe *) (shm + 2048);
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      4 * sizeof(struct rdma_wqe));
+  struct tcp_opts opts;
+  struct rte_mbuf *tmb;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  memset(fs, 0, sizeof(*fs));
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 768;
+  fs->wq_len = 4 * sizeof(struct rdma_wqe);
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+
+  /* three writes sent, waiting for responses */
+  for (i = 0; i < 3; i++) {
+    wq[i].id = i * sizeof(struct rdma_wqe);
+    wq[i].type = RDMA_OP_WRITE;
+    wq[i].status = RDMA_RESP_PENDING;
+  }
+  fs->wq_head = fs->wq_tail = 3 * sizeof(struct rdma_wqe);
+  memset(db, 0, sizeof(*db));
+  db->wq_head = fs->wq_head;
+
+  tmb = rdma_pkt(fs, &opts, RDMA_RESPONSE | RDMA_WRITE, wq[1].id, 0, 0, 0);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("completed out of order", wq[1].status == RDMA_SUCCESS &&
+      wq[0].status == RDMA_RESP_PENDING && fs->cq_head == 0);
+
+  tmb = rdma_pkt(fs, &opts, RDMA_RESPONSE | RDMA_WRITE, wq[0].id, 0, 0, 0);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("cq head over completed entries", wq[0].status == RDMA_SUCCESS
+      && fs->cq_head == 2 * sizeof(struct rdma_wqe));
+
+  tmb = rdma_pkt(fs, &opts, RDMA_RESPONSE | RDMA_WRITE, wq[1].id, 0, 0, 0);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("duplicate response fails flow", fs->rdma_failed &&
+      wq[2].status == RDMA_CONN_FAILURE && fs->cq_head == fs->wq_tail);
+}
+
+/* Test that requests wait for credits of the peer, and that credits returned
+ * with a response release them.
+ */
+void test_rdma_credits(void *arg)
+{
+  int i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *wq = (struct rdma_wqe *) (shm + 2048);
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      4 * sizeof(struct rdma_wqe));
+  struct tcp_opts opts;
+  struct rdma_hdr *hdr;
+  struct rte_mbuf *tmb;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  memset(fs, 0, sizeof(*fs));
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 768;
+  fs->wq_len = 4 * sizeof(struct rdma_wqe);
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  fs->rdma_credits = fs->rdma_credits_max = 1;
+
+  memset(db, 0, sizeof(*db));
+  for (i = 0; i < 2; i++) {
+    wq[i].id = i * sizeof(struct rdma_wqe);
+    wq[i].type = RDMA_OP_WRITE;
+    wq[i].status = RDMA_PENDING;
+    wq[i].flags = 0;
+    wq[i].loff = 0;
+    wq[i].roff = 0;
+    wq[i].len = 8;
+  }
+  db->wq_head = 2 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("second request waits for credit",
+      wq[0].status == RDMA_RESP_PENDING && wq[1].status == RDMA_PENDING &&
+      fs->wq_tail == sizeof(struct rdma_wqe) && fs->rdma_credits == 0);
+
+  tmb = rdma_pkt(fs, &opts, RDMA_RESPONSE | RDMA_WRITE, wq[0].id, 0, 0, 0);
+  hdr = (struct rdma_hdr *) ((uint8_t *) opts.ts +
+      ((sizeof(struct tcp_timestamp_opt) + 3) & ~3));
+  hdr->flags = t_beui16(RDMA_FLAG_CREDITS(1));
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("returned credit sends second request",
+      wq[0].status == RDMA_SUCCESS && wq[1].status == RDMA_RESP_PENDING &&
+      fs->wq_tail == 2 * sizeof(struct rdma_wqe) && fs->rdma_credits == 0);
+}
+
+/* Test that queue positions keep working when they wrap around 2^32, and
+ * that the application cannot post more WQEs than the queue holds.
+ */
+void test_rdma_ring_wrap(void *arg)
+{
+  int i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *wq = (struct rdma_wqe *) (shm + 2048);
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      4 * sizeof(struct rdma_wqe));
+  uint32_t pos = UINT32_MAX - sizeof(struct rdma_wqe) + 1;
+  struct tcp_opts opts;
+  struct rte_mbuf *tmb;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  memset(fs, 0, sizeof(*fs));
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 768;
+  fs->wq_len = 4 * sizeof(struct rdma_wqe);
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  fs->wq_head = fs->wq_tail = fs->cq_head = fs->cq_tail = pos;
+
+  /* last entry of the queue, then the first one */
+  memset(db, 0, sizeof(*db));
+  for (i = 0; i < 2; i++) {
+    struct rdma_wqe *wqe = &wq[(3 + i) % 4];
+    wqe->id = (3 + i) % 4 * sizeof(struct rdma_wqe);
+    wqe->type = RDMA_OP_WRITE;
+    wqe->status = RDMA_PENDING;
+    wqe->flags = 0;
+    wqe->loff = 0;
+    wqe->roff = 0;
+    wqe->len = 8;
+  }
+
+  db->cq_tail = pos;
+  db->wq_head = pos + 5 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("overfull queue rejected", fs->wq_head == pos &&
+      fs->wq_tail == pos);
+
+  db->wq_head = pos + 2 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("both entries sent", fs->wq_tail == sizeof(struct rdma_wqe) &&
+      wq[3].status == RDMA_RESP_PENDING && wq[0].status == RDMA_RESP_PENDING);
+
+  tmb = rdma_pkt(fs, &opts, RDMA_RESPONSE | RDMA_WRITE, wq[3].id, 0, 0, 0);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  tmb = rdma_pkt(fs, &opts, RDMA_RESPONSE | RDMA_WRITE, wq[0].id, 0, 0, 0);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  test_assert("cq head wraps", wq[3].status == RDMA_SUCCESS &&
+      wq[0].status == RDMA_SUCCESS &&
+      fs->cq_head == sizeof(struct rdma_wqe) && !fs->rdma_failed);
+}
+
+/* Test that a write gathers its payload from a scatter/gather list and that
+ * a read response is scattered into the list of the read.
+ */
+void test_rdma_sgl(void *arg)
+{
+  int ret, i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct dataplane_context ctx;
+  static uint8_t shm[4096];
+  struct rdma_wqe *wq = (struct rdma_wqe *) (shm + 2048);
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm + 2048 +
+      4 * sizeof(struct rdma_wqe));
+  struct rdma_sge *sgl = (struct rdma_sge *) (shm + 2048 +
+      8 * sizeof(struct rdma_wqe) + sizeof(*db));
+  uint8_t *mr = shm + 3072;
+  struct tcp_opts opts;
+  struct rdma_hdr hdr;
+  uint8_t *payload;
+  struct rte_mbuf *tmb;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  memset(fs, 0, sizeof(*fs));
+  flow_init(0, 1024, 1024, 123456);
+  fs->rx_base_sp = 0;
+  fs->tx_base = 1024;
+  fs->wq_base = 2048;
+  fs->rq_base = 2048 + 768;
+  fs->wq_len = 4 * sizeof(struct rdma_wqe);
+  fs->mr_base = 3072;
+  fs->mr_len = 1024;
+  for (i = 0; i < 1024; i++)
+    mr[i] = i;
+
+  /* write of 10 + 20 bytes from two places, read into two places */
+  memset(db, 0, sizeof(*db));
+  memset(sgl, 0, 2 * RDMA_INLINE_MAX);
+  wq[0].id = 0;
+  wq[0].type = RDMA_OP_WRITE;
+  wq[0].status = RDMA_PENDING;
+  wq[0].flags = RDMA_WQE_SGL;
+  wq[0].loff = 0;
+  wq[0].roff = 8;
+  wq[0].len = 30;
+  sgl[0].loff = 100;
+  sgl[0].len = 10;
+  sgl[1].loff = 500;
+  sgl[1].len = 20;
+
+  wq[1].id = sizeof(struct rdma_wqe);
+  wq[1].type = RDMA_OP_READ;
+  wq[1].status = RDMA_PENDING;
+  wq[1].flags = RDMA_WQE_SGL;
+  wq[1].loff = 0;
+  wq[1].roff = 64;
+  wq[1].len = 20;
+  sgl[RDMA_SGE_MAX].loff = 200;
+  sgl[RDMA_SGE_MAX].len = 5;
+  sgl[RDMA_SGE_MAX + 1].loff = 600;
+  sgl[RDMA_SGE_MAX + 1].len = 15;
+
+  db->wq_head = 2 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("one frame per list",
+      fs->tx_avail == 2 * sizeof(struct rdma_hdr) + 30 &&
+      wq[0].status == RDMA_RESP_PENDING && wq[1].status == RDMA_RESP_PENDING);
+
+  memcpy(&hdr, shm + 1024, sizeof(hdr));
+  test_assert("header marks list", f_beui16(hdr.flags) == RDMA_FLAG_SGL &&
+      f_beui32(hdr.length) == 30);
+
+  tmb = mbuf_alloc();
+  ret = fast_flows_qman(&ctx, 0, (struct network_buf_handle *) tmb, 0);
+  test_assert("segment sent", ret == 0 && ctx.tx_num == 1);
+
+  payload = (uint8_t *) network_buf_buf((struct network_buf_handle *) tmb) +
+      sizeof(struct pkt_tcp) + ((sizeof(struct tcp_timestamp_opt) + 3) & ~3);
+  test_assert("payload gathered from list",
+      memcmp(payload + sizeof(hdr), mr + 100, 10) == 0 &&
+      memcmp(payload + sizeof(hdr) + 10, mr + 500, 20) == 0);
+
+  tmb = rdma_pkt(fs, &opts, RDMA_RESPONSE | RDMA_READ, wq[1].id, 20, 0, 0);
+  fast_flows_packet(&ctx, (struct network_buf_handle *) tmb, fs, &opts, 0);
+  for (i = 0; i < 5 && mr[200 + i] == i + 1; i++);
+  test_assert("response scattered to first entry", i == 5);
+  for (i = 0; i < 15 && mr[600 + i] == i + 6; i++);
+  test_assert("response scattered to second entry", i == 15);
+  test_assert("read completed", wq[1].status == RDMA_SUCCESS &&
+      mr[205] == 205 && mr[0] == 0);
+}
+
+/* Test that WQEs of a flow paired with a flow of the same instance are
+ * executed directly on the peer's memory region and complete without any
+ * data in the tx buffer.
+ */
+void test_rdma_loopback(void *arg)
+{
+  int i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *peer = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  static uint8_t shm[8192];
+  struct rdma_wqe *wq = (struct rdma_wqe *) shm;
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm +
+      4 * sizeof(struct rdma_wqe));
+  struct flextcp_pl_rdma_db *peer_db = (struct flextcp_pl_rdma_db *) (shm +
+      1024 + 4 * sizeof(struct rdma_wqe));
+  struct rdma_wqe *peer_rcv = (struct rdma_wqe *) (peer_db + 1);
+  uint8_t *mr = shm + 2048, *peer_mr = shm + 3072;
+  uint64_t *ops = (uint64_t *) (mr + 400), *word = (uint64_t *) (peer_mr + 800);
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  memset(fs, 0, 2 * sizeof(*fs));
+  flow_init(0, 1024, 1024, 123456);
+  flow_init(1, 1024, 1024, 654321);
+  fs->tx_base = peer->tx_base = 4096;
+  fs->wq_base = 0;
+  fs->mr_base = 2048;
+  peer->wq_base = 1024;
+  peer->mr_base = 3072;
+  fs->wq_len = peer->wq_len = 4 * sizeof(struct rdma_wqe);
+  fs->mr_len = peer->mr_len = 1024;
+  fs->rdma_peer = 2;
+  peer->rdma_peer = 1;
+  for (i = 0; i < 1024; i++) {
+    mr[i] = i;
+    peer_mr[i] = 255 - i;
+  }
+
+  /* one receive buffer posted on the peer */
+  memset(db, 0, sizeof(*db));
+  memset(peer_db, 0, sizeof(*peer_db));
+  peer_rcv[0].type = RDMA_OP_RECV;
+  peer_rcv[0].status = RDMA_PENDING;
+  peer_rcv[0].loff = 500;
+  peer_rcv[0].len = 64;
+  peer_db->rcv_head = sizeof(struct rdma_wqe);
+
+  /* write, read, send and fetch-and-add */
+  memset(wq, 0, 4 * sizeof(*wq));
+  for (i = 0; i < 4; i++) {
+    wq[i].id = i * sizeof(struct rdma_wqe);
+    wq[i].status = RDMA_PENDING;
+  }
+  wq[0].type = RDMA_OP_WRITE;
+  wq[0].loff = 0;
+  wq[0].roff = 100;
+  wq[0].len = 16;
+  wq[1].type = RDMA_OP_READ;
+  wq[1].loff = 300;
+  wq[1].roff = 200;
+  wq[1].len = 8;
+  wq[2].type = RDMA_OP_SEND;
+  wq[2].loff = 32;
+  wq[2].len = 10;
+  wq[3].type = RDMA_OP_FETCH_ADD;
+  wq[3].loff = 400;
+  wq[3].roff = 800;
+  ops[0] = 5;
+  ops[1] = 0;
+  *word = 100;
+
+  db->wq_head = 4 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("nothing sent", fs->tx_avail == 0 && fs->wq_tail == db->wq_head);
+  test_assert("all completed", wq[0].status == RDMA_SUCCESS &&
+      wq[1].status == RDMA_SUCCESS && wq[2].status == RDMA_SUCCESS &&
+      wq[3].status == RDMA_SUCCESS && fs->cq_head == db->wq_head);
+  test_assert("write copied", memcmp(peer_mr + 100, mr, 16) == 0);
+  for (i = 0; i < 8 && mr[300 + i] == 255 - (200 + i); i++);
+  test_assert("read copied", i == 8);
+  test_assert("send received", memcmp(peer_mr + 500, mr + 32, 10) == 0 &&
+      peer_rcv[0].status == RDMA_SUCCESS && peer_rcv[0].len == 10 &&
+      peer->rcv_tail == sizeof(struct rdma_wqe));
+  test_assert("atomic executed", *word == 105 && ops[0] == 100);
+  test_assert("both flows notified", ctx.arx_num == 2 &&
+      ctx.arx_cache[0].msg.rdmaupdate.opaque == 654321 &&
+      ctx.arx_cache[1].msg.rdmaupdate.opaque == 123456 &&
+      ctx.arx_cache[1].msg.rdmaupdate.cq_head == db->wq_head);
+
+  memset(fs, 0, 2 * sizeof(*fs));
+}
+
+/* Test that a bulk loopback write is handed to a copy thread and the WQEs
+ * behind it only execute once the copy completed.
+ */
+void test_rdma_copy_offload(void *arg)
+{
+  int i;
+  struct flextcp_pl_flowst *fs = &state_base.flowst[0];
+  struct flextcp_pl_flowst *peer = &state_base.flowst[1];
+  struct dataplane_context ctx;
+  static uint8_t shm[8192];
+  struct rdma_wqe *wq = (struct rdma_wqe *) shm;
+  struct flextcp_pl_rdma_db *db = (struct flextcp_pl_rdma_db *) (shm +
+      4 * sizeof(struct rdma_wqe));
+  uint8_t *mr = shm + 2048, *peer_mr = shm + 3072;
+  memset(&ctx, 0, sizeof(ctx));
+
+  tas_shm = shm;
+  memset(fs, 0, 2 * sizeof(*fs));
+  flow_init(0, 1024, 1024, 123456);
+  flow_init(1, 1024, 1024, 654321);
+  fs->wq_base = 0;
+  fs->mr_base = 2048;
+  peer->wq_base = 1024;
+  peer->mr_base = 3072;
+  fs->wq_len = peer->wq_len = 4 * sizeof(struct rdma_wqe);
+  fs->mr_len = peer->mr_len = 1024;
+  fs->rdma_peer = 2;
+  peer->rdma_peer = 1;
+  for (i = 0; i < 1024; i++) {
+    mr[i] = i;
+    peer_mr[i] = 0;
+  }
+  config.fp_copy_threads = 1;
+  config.fp_copy_min = 256;
+  copy_submitted = 0;
+
+  /* bulk write followed by a small write */
+  memset(db, 0, sizeof(*db));
+  memset(wq, 0, 4 * sizeof(*wq));
+  for (i = 0; i < 2; i++) {
+    wq[i].id = i * sizeof(struct rdma_wqe);
+    wq[i].status = RDMA_PENDING;
+    wq[i].type = RDMA_OP_WRITE;
+  }
+  wq[0].loff = 0;
+  wq[0].roff = 100;
+  wq[0].len = 512;
+  wq[1].loff = 600;
+  wq[1].roff = 700;
+  wq[1].len = 8;
+
+  db->wq_head = 2 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("bulk write offloaded", copy_submitted == 1 &&
+      copy_req.dst == peer_mr + 100 && copy_req.src == mr &&
+      copy_req.len == 512 && copy_req.flow_id == 0 && copy_req.id == 0);
+  test_assert("nothing copied inline", peer_mr[101] == 0 &&
+      peer_mr[700] == 0 && fs->tx_avail == 0);
+  test_assert("later write waits", wq[0].status == RDMA_RESP_PENDING &&
+      wq[1].status == RDMA_PENDING && fs->cq_head == 0 &&
+      fs->wq_tail == sizeof(struct rdma_wqe) && ctx.arx_num == 0);
+
+  /* copy thread done */
+  memcpy(copy_req.dst, copy_req.src, copy_req.len);
+  fast_rdma_copy_done(&ctx, copy_req.flow_id, copy_req.id);
+  test_assert("all completed", wq[0].status == RDMA_SUCCESS &&
+      wq[1].status == RDMA_SUCCESS && fs->cq_head == db->wq_head &&
+      fs->rdma_copy_pending == 0 && copy_submitted == 1);
+  test_assert("writes copied", memcmp(peer_mr + 100, mr, 512) == 0 &&
+      memcmp(peer_mr + 700, mr + 600, 8) == 0);
+  test_assert("flow notified", ctx.arx_num == 1 &&
+      ctx.arx_cache[0].msg.rdmaupdate.opaque == 123456 &&
+      ctx.arx_cache[0].msg.rdmaupdate.cq_head == db->wq_head);
+
+  /* bulk write on a flow whose doorbell is polled */
+  config.fp_rdma_db_poll = 1;
+  ctx.arx_num = 0;
+  for (i = 2; i < 4; i++) {
+    wq[i].id = i * sizeof(struct rdma_wqe);
+    wq[i].status = RDMA_PENDING;
+    wq[i].type = RDMA_OP_WRITE;
+  }
+  wq[2].loff = 0;
+  wq[2].roff = 200;
+  wq[2].len = 256;
+  wq[3].loff = 610;
+  wq[3].roff = 800;
+  wq[3].len = 8;
+
+  db->cq_tail = 2 * sizeof(struct rdma_wqe);
+  db->wq_head = 3 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("active flow offloaded", copy_submitted == 2 &&
+      copy_req.id == 2 * sizeof(struct rdma_wqe) && db->fp_active &&
+      wq[2].status == RDMA_RESP_PENDING);
+
+  /* posted without a bump while the flow is active */
+  db->wq_head = 4 * sizeof(struct rdma_wqe);
+  memcpy(copy_req.dst, copy_req.src, copy_req.len);
+  fast_rdma_copy_done(&ctx, copy_req.flow_id, copy_req.id);
+  test_assert("unbumped write completed", wq[2].status == RDMA_SUCCESS &&
+      wq[3].status == RDMA_SUCCESS && fs->cq_head == db->wq_head &&
+      memcmp(peer_mr + 200, mr, 256) == 0 &&
+      memcmp(peer_mr + 800, mr + 610, 8) == 0);
+  test_assert("idle flow inactive", !db->fp_active &&
+      fs->rdma_copy_pending == 0);
+
+  /* the application bumps the idle flow again */
+  wq[0].id = 0;
+  wq[0].status = RDMA_PENDING;
+  wq[0].loff = 620;
+  wq[0].roff = 900;
+  wq[0].len = 8;
+  db->cq_tail = 4 * sizeof(struct rdma_wqe);
+  db->wq_head = 5 * sizeof(struct rdma_wqe);
+  fast_rdmawq_bump(&ctx, 0, db->wq_head, db->cq_tail);
+  test_assert("last write completed", wq[0].status == RDMA_SUCCESS &&
+      fs->cq_head == db->wq_head && !db->fp_active &&
+      memcmp(peer_mr + 900, mr + 620, 8) == 0 && copy_submitted == 2);
+
+  config.fp_rdma_db_poll = 0;
+  config.fp_copy_threads = 0;
+  memset(fs, 0, 2 * sizeof(*fs));
+}
+
 int main(int argc, char *argv[])
 {
   int ret = 0;
@@ -318,5 +1344,44 @@ int main(int argc, char *argv[])
   if (test_subcase("retransmit", test_retransmit, NULL))
     ret = 1;
 
+  if (test_subcase("rdma tx zero copy", test_rdma_tx_zerocopy, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma rx placement", test_rdma_rx_placement, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma v2 header", test_rdma_hdr_v2, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma atomic", test_rdma_atomic, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma send recv", test_rdma_send_recv, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma write imm", test_rdma_write_imm, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma inline", test_rdma_inline, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma cq match", test_rdma_cq_match, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma credits", test_rdma_credits, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma ring wrap", test_rdma_ring_wrap, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma sgl", test_rdma_sgl, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma loopback", test_rdma_loopback, NULL))
+    ret = 1;
+
+  if (test_subcase("rdma copy offload", test_rdma_copy_offload, NULL))
+    ret = 1;
+
   return ret;
 }